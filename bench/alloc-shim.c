@@ -0,0 +1,212 @@
+/* alloc-shim - count heap allocations per menu construction phase
+ *
+ * Built as a shared library and loaded with LD_PRELOAD in front of a program
+ * that runs the plugin's menu code (bench/run-menu-soak.sh --alloc does
+ * this). It wraps malloc, calloc, realloc and the aligned allocators, and
+ * defines focus_menu_alloc_phase(), which focus-menu.c calls through a weak
+ * reference as it moves between the phases of building a menu: scan, sort,
+ * group, items and show. Allocations and requested bytes are added to the
+ * phase running on the calling thread.
+ *
+ * At exit the totals are written one JSON object per phase, to the file
+ * named by FOCUS_MENU_ALLOC_REPORT or else to stderr:
+ *
+ *   {"phase":"items","entries":1000,"allocs":812000,"bytes":41250000,"allocs_per_entry":812.0,"bytes_per_entry":41250.0}
+ *
+ * entries is the number of times the phase was entered, so the per-entry
+ * figures are per menu build. GLib's slice allocator hides allocations from
+ * the shim unless G_SLICE=always-malloc is set.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHIM_MAX_PHASES 32
+#define SHIM_BOOTSTRAP_BYTES 8192     /* Serves dlsym()'s own allocations while the real functions are looked up */
+
+typedef struct
+{
+    const char *name;
+    unsigned long long entries;
+    unsigned long long allocs;
+    unsigned long long bytes;
+} ShimPhase;
+
+static ShimPhase shim_phases[SHIM_MAX_PHASES];
+static int shim_n_phases;
+/* Initial-exec TLS, so reading it never allocates */
+static __thread int shim_current __attribute__((tls_model("initial-exec"))) = -1;   /* Index into shim_phases, -1 outside any phase */
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static char shim_bootstrap[SHIM_BOOTSTRAP_BYTES];
+static size_t shim_bootstrap_used;
+static int shim_resolving;
+
+/* ===== SETUP ===== */
+
+static void shim_resolve(void) 
+{
+    if (real_malloc || shim_resolving) return;
+
+    shim_resolving = 1;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    shim_resolving = 0;
+}
+
+/* Hands out zeroed memory from a static buffer until the real allocator is known */
+static void *shim_bootstrap_alloc(size_t size) 
+{
+    size = (size + 15) & ~(size_t)15;
+    if (shim_bootstrap_used + size > sizeof(shim_bootstrap)) return NULL;
+
+    void *ptr = shim_bootstrap + shim_bootstrap_used;
+    shim_bootstrap_used += size;
+    return ptr;
+}
+
+static int shim_is_bootstrap(const void *ptr) 
+{
+    return (const char *)ptr >= shim_bootstrap && (const char *)ptr < shim_bootstrap + sizeof(shim_bootstrap);
+}
+
+static void shim_count(size_t size) 
+{
+    int current = shim_current;
+    if (current < 0) return;
+
+    shim_phases[current].allocs++;
+    shim_phases[current].bytes += size;
+}
+
+/* ===== PHASES ===== */
+
+/* Called by focus-menu.c; phase is a string literal or NULL for none */
+const char *focus_menu_alloc_phase(const char *phase) 
+{
+    const char *previous = shim_current >= 0 ? shim_phases[shim_current].name : NULL;
+
+    if (!phase)
+    {
+        shim_current = -1;
+        return previous;
+    }
+
+    int index;
+    for (index = 0; index < shim_n_phases; index++)
+    {
+        if (shim_phases[index].name == phase || strcmp(shim_phases[index].name, phase) == 0) break;
+    }
+    if (index == shim_n_phases)
+    {
+        if (shim_n_phases == SHIM_MAX_PHASES)
+        {
+            shim_current = -1;
+            return previous;
+        }
+        shim_phases[shim_n_phases++].name = phase;
+    }
+
+    if (shim_current != index) shim_phases[index].entries++;
+    shim_current = index;
+    return previous;
+}
+
+__attribute__((destructor)) static void shim_report(void) 
+{
+    shim_current = -1;
+
+    const char *path = getenv("FOCUS_MENU_ALLOC_REPORT");
+    FILE *file = path && *path ? fopen(path, "w") : stderr;
+    if (!file) file = stderr;
+
+    for (int i = 0; i < shim_n_phases; i++)
+    {
+        const ShimPhase *phase = &shim_phases[i];
+        double entries = phase->entries ? (double)phase->entries : 1.0;
+        fprintf(file, "{\"phase\":\"%s\",\"entries\":%llu,\"allocs\":%llu,\"bytes\":%llu,\"allocs_per_entry\":%.1f,\"bytes_per_entry\":%.1f}\n",
+                phase->name, phase->entries, phase->allocs, phase->bytes, phase->allocs / entries, phase->bytes / entries);
+    }
+
+    if (file != stderr) fclose(file);
+}
+
+/* ===== ALLOCATOR ===== */
+
+void *malloc(size_t size) 
+{
+    shim_resolve();
+    if (!real_malloc) return shim_bootstrap_alloc(size);
+
+    shim_count(size);
+    return real_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) 
+{
+    shim_resolve();
+    if (!real_calloc) return shim_bootstrap_alloc(n * size);
+
+    shim_count(n * size);
+    return real_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) 
+{
+    shim_resolve();
+    if (shim_is_bootstrap(ptr))
+    {
+        /* Rare: something grows a block handed out during bootstrap */
+        size_t available = (size_t)(shim_bootstrap + sizeof(shim_bootstrap) - (char *)ptr);
+        void *moved = malloc(size);
+        if (moved) memcpy(moved, ptr, size < available ? size : available);
+        return moved;
+    }
+
+    shim_count(size);
+    return real_realloc(ptr, size);
+}
+
+void free(void *ptr) 
+{
+    if (!ptr || shim_is_bootstrap(ptr)) return;
+
+    shim_resolve();
+    real_free(ptr);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) 
+{
+    shim_resolve();
+    shim_count(size);
+    return real_posix_memalign(ptr, alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) 
+{
+    shim_resolve();
+    shim_count(size);
+    return real_aligned_alloc(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) 
+{
+    shim_resolve();
+    shim_count(size);
+    return real_memalign(alignment, size);
+}
@@ -0,0 +1,577 @@
+/* classlib-bench - micro-benchmarks for the toolkit-free classlib helpers
+ *
+ * Runs each workload several times over synthetic data and prints one JSON
+ * object per line:
+ *
+ *   {"bench":"resolve_display_name","n":10000,"runs":7,"median_ms":1.234,"ns_per_op":123.4}
+ *
+ * Field names and order are stable so results can be diffed between builds.
+ *
+ * Usage: classlib-bench [--runs N] [FILTER]
+ * Only benchmarks whose name contains FILTER are run.
+ *
+ *        classlib-bench --make-proc-fixture DIR N [COMM=ARGS...]
+ * Writes a synthetic /proc with N processes to DIR and exits. The listed
+ * processes (default: the desktop managers) are mixed in; the plugin reads it
+ * when started with FOCUS_MENU_PROC_ROOT=DIR.
+ */
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../classlib.h"
+#include "proc-fixture.h"
+
+#define BENCH_APP_NAMES 10000
+#define BENCH_WINDOW_TITLES 100000
+#define BENCH_DESKTOP_FILES 5000
+#define BENCH_DEFAULT_RUNS 7
+#define BENCH_EXPECTED_DESKTOP_MANAGERS 3  /* The ordinary caja fixture doesn't count */
+#define BENCH_FIRST_FIXTURE_PID 300        /* Where proc-fixture starts numbering */
+#define BENCH_DEFAULT_HANDLER_CALLS 1000
+#define BENCH_MIMEAPPS_FILLER_TYPES 200    /* Unrelated associations, as a long-lived profile has */
+
+typedef void (*BenchFunc)(gpointer data);
+
+typedef struct
+{
+    const gchar *name;
+    BenchFunc func;
+    gpointer data;
+    guint n;                     /* Operations performed by one call of func */
+    BenchFunc setup;             /* Optional, run before timing */
+    BenchFunc teardown;          /* Optional, run after timing */
+} Bench;
+
+typedef struct
+{
+    gchar **strings;
+    guint n;
+    ClassicSortStyle sort_style;
+} StringSet;
+
+typedef struct
+{
+    gchar *dir_path;
+    const gchar *app_name;
+} DesktopLookup;
+
+typedef struct
+{
+    guint n_processes;
+    gchar *root;                 /* Fixture directory while the bench runs */
+} ProcScan;
+
+typedef struct
+{
+    gchar *root;                 /* Fake XDG config and data directories */
+    const gchar *expected;       /* What the resolver should answer */
+} MimeappsFixture;
+
+static volatile gsize bench_sink; /* Keeps results observable to the compiler */
+
+/* ===== SYNTHETIC WORKLOADS ===== */
+
+/* Application names covering every resolution tier */
+static StringSet *make_app_names(guint n) 
+{
+    static const gchar *patterns[] =
+    {
+        "firefox-%u",                  /* Tier 5: dashes */
+        "Org.example.tool-%u",         /* Tier 3: reverse domain */
+        "Xfce4-panel-%u-settings",     /* Tier 2: settings pattern */
+        "editor%u",                    /* Tier 4: simple capitalization */
+        "Report %u.odt - LibreOffice", /* Tier 0: window title as name */
+        "MixedCase%u",                 /* Tier 6: unchanged */
+        "vlc",                         /* Tier 1: manual mapping */
+        ".hidden%u",                   /* Special-character sorting */
+    };
+    StringSet *set = g_new0(StringSet, 1);
+
+    set->n = n;
+    set->strings = g_new0(gchar *, n + 1);
+    for (guint i = 0; i < n; i++)
+    {
+        /* Scramble the index so sorting sees unordered input */
+        guint id = (i * 2654435761u) % (n * 10);
+        set->strings[i] = g_strdup_printf(patterns[i % G_N_ELEMENTS(patterns)], id);
+    }
+    return set;
+}
+
+/* Window titles in the shapes real applications produce */
+static StringSet *make_window_titles(guint n) 
+{
+    static const gchar *patterns[] =
+    {
+        "~/Documents/notes-%u.txt - Mousepad",
+        "Chapter %u — Mozilla Firefox",
+        "/home/user/src/project/file%u.c – Visual Studio Code",
+        "Terminal %u",
+        "Untitled %u - LibreOffice Writer",
+    };
+    StringSet *set = g_new0(StringSet, 1);
+
+    set->n = n;
+    set->strings = g_new0(gchar *, n + 1);
+    for (guint i = 0; i < n; i++)
+    {
+        set->strings[i] = g_strdup_printf(patterns[i % G_N_ELEMENTS(patterns)], i);
+    }
+    return set;
+}
+
+static void string_set_free(StringSet *set) 
+{
+    g_strfreev(set->strings);
+    g_free(set);
+}
+
+/* Fill a temporary directory with n minimal desktop files */
+static gchar *make_desktop_directory(guint n) 
+{
+    gchar *dir_path = g_dir_make_tmp("classlib-bench-XXXXXX", NULL);
+    if (!dir_path)
+    {
+        return NULL;
+    }
+
+    for (guint i = 0; i < n; i++)
+    {
+        gchar *file_name = g_strdup_printf("app-%05u.desktop", i);
+        gchar *file_path = g_build_filename(dir_path, file_name, NULL);
+        gchar *contents = g_strdup_printf("[Desktop Entry]\n"
+                                          "Type=Application\n"
+                                          "Name=Application %u\n"
+                                          "Exec=app-%u %%U\n"
+                                          "Icon=app-%u\n", i, i, i);
+        g_file_set_contents(file_path, contents, -1, NULL);
+        g_free(contents);
+        g_free(file_path);
+        g_free(file_name);
+    }
+    return dir_path;
+}
+
+/* Delete a directory and everything below it */
+static void remove_directory_tree(const gchar *dir_path) 
+{
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    if (dir)
+    {
+        const gchar *entry;
+        while ((entry = g_dir_read_name(dir)) != NULL)
+        {
+            gchar *file_path = g_build_filename(dir_path, entry, NULL);
+            if (g_file_test(file_path, G_FILE_TEST_IS_DIR))
+            {
+                remove_directory_tree(file_path);
+            }
+            else
+            {
+                g_remove(file_path);
+            }
+            g_free(file_path);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(dir_path);
+}
+
+static void write_fixture_file(const gchar *root, const gchar *relative_path, const gchar *contents) 
+{
+    gchar *path = g_build_filename(root, relative_path, NULL);
+    gchar *dir_path = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir_path, 0755);
+    g_file_set_contents(path, contents, -1, NULL);
+    g_free(dir_path);
+    g_free(path);
+}
+
+/* A profile where each precedence rule matters: the user's mimeapps.list
+ * names a file manager that isn't installed, the desktop-specific system
+ * list names thunar, and the generic system list (which would say caja)
+ * is never reached. Points the XDG variables at it, so it has to run before
+ * anything asks GLib for those directories. */
+static gchar *make_mimeapps_fixture(void) 
+{
+    gchar *root = g_dir_make_tmp("classlib-bench-xdg-XXXXXX", NULL);
+    if (!root)
+    {
+        return NULL;
+    }
+
+    GString *user_list = g_string_new("[Default Applications]\n");
+    for (guint i = 0; i < BENCH_MIMEAPPS_FILLER_TYPES; i++)
+    {
+        g_string_append_printf(user_list, "application/x-bench-%u=app-%u.desktop;\n", i, i);
+    }
+    g_string_append(user_list, "inode/directory=nemo.desktop;\n");
+    write_fixture_file(root, "config/mimeapps.list", user_list->str);
+    g_string_free(user_list, TRUE);
+
+    write_fixture_file(root, "etc/xdg/xfce-mimeapps.list",
+                       "[Default Applications]\ninode/directory=thunar.desktop;\n");
+    write_fixture_file(root, "share/applications/mimeapps.list",
+                       "[Default Applications]\ninode/directory=caja.desktop;\n");
+    write_fixture_file(root, "share/applications/thunar.desktop",
+                       "[Desktop Entry]\nType=Application\nName=Thunar\nExec=thunar %F\n");
+    write_fixture_file(root, "share/applications/caja.desktop",
+                       "[Desktop Entry]\nType=Application\nName=Caja\nExec=caja %U\n");
+
+    gchar *path = g_build_filename(root, "config", NULL);
+    g_setenv("XDG_CONFIG_HOME", path, TRUE);
+    g_free(path);
+    path = g_build_filename(root, "etc", "xdg", NULL);
+    g_setenv("XDG_CONFIG_DIRS", path, TRUE);
+    g_free(path);
+    path = g_build_filename(root, "data", NULL);
+    g_setenv("XDG_DATA_HOME", path, TRUE);
+    g_free(path);
+    path = g_build_filename(root, "share", NULL);
+    g_setenv("XDG_DATA_DIRS", path, TRUE);
+    g_free(path);
+    g_setenv("XDG_CURRENT_DESKTOP", "XFCE", TRUE);
+    return root;
+}
+
+/* ===== BENCHMARK BODIES ===== */
+
+static void bench_resolve_display_name(gpointer data) 
+{
+    StringSet *set = data;
+    for (guint i = 0; i < set->n; i++)
+    {
+        bench_sink += (gsize)classlib_resolve_display_name(set->strings[i], 0);
+    }
+}
+
+static gint compare_with_style(gconstpointer a, gconstpointer b, gpointer user_data) 
+{
+    StringSet *set = user_data;
+    return classlib_file_manager_aware_compare(*(gchar * const *)a, *(gchar * const *)b,
+                                               set->sort_style, CLASSLIB_LOCALE_TYPE_UTF8);
+}
+
+/* Sort a copy of the names with the comparator, as the menu used to */
+static void bench_sort_compare(gpointer data) 
+{
+    StringSet *set = data;
+    gchar **copy = g_new(gchar *, set->n);
+    memcpy(copy, set->strings, set->n * sizeof(gchar *));
+    g_qsort_with_data(copy, set->n, sizeof(gchar *), compare_with_style, set);
+    bench_sink += (gsize)copy[0];
+    g_free(copy);
+}
+
+static gint compare_keys(gconstpointer a, gconstpointer b) 
+{
+    return strcmp(*(gchar * const *)a, *(gchar * const *)b);
+}
+
+/* Build one key per name and sort the keys, as the model does */
+static void bench_sort_keys(gpointer data) 
+{
+    StringSet *set = data;
+    gchar **keys = g_new(gchar *, set->n);
+    for (guint i = 0; i < set->n; i++)
+    {
+        keys[i] = classlib_file_manager_aware_sort_key(set->strings[i], set->sort_style,
+                                                       CLASSLIB_LOCALE_TYPE_UTF8);
+    }
+    qsort(keys, set->n, sizeof(gchar *), compare_keys);
+    for (guint i = 0; i < set->n; i++)
+    {
+        g_free(keys[i]);
+    }
+    g_free(keys);
+}
+
+static void bench_extract_document_name(gpointer data) 
+{
+    StringSet *set = data;
+    for (guint i = 0; i < set->n; i++)
+    {
+        gchar *document = classlib_extract_document_name_for_sorting(set->strings[i]);
+        bench_sink += strlen(document);
+        g_free(document);
+    }
+}
+
+static void bench_remove_app_name_suffix(gpointer data) 
+{
+    StringSet *set = data;
+    for (guint i = 0; i < set->n; i++)
+    {
+        gchar *title = classlib_remove_app_name_suffix(set->strings[i], "Mozilla Firefox");
+        bench_sink += strlen(title);
+        g_free(title);
+    }
+}
+
+static void bench_search_desktop_directory(gpointer data) 
+{
+    DesktopLookup *lookup = data;
+    gchar *result = classlib_search_desktop_directory(lookup->dir_path, lookup->app_name);
+    bench_sink += result ? strlen(result) : 0;
+    g_free(result);
+}
+
+/* Build a fake process table and point classlib at it */
+static void proc_scan_setup(gpointer data) 
+{
+    ProcScan *scan = data;
+    scan->root = proc_fixture_create(NULL, scan->n_processes, proc_fixture_desktop_processes,
+                                     proc_fixture_n_desktop_processes);
+    if (!scan->root) 
+    {
+        /* Carrying on would time the real /proc instead */
+        g_printerr("classlib-bench: could not create a %u process fixture\n", scan->n_processes);
+        exit(1);
+    }
+    classlib_set_proc_root(scan->root);
+
+    GList *found = classlib_scan_desktop_managers(NULL);
+    if (g_list_length(found) != BENCH_EXPECTED_DESKTOP_MANAGERS) 
+    {
+        g_printerr("classlib-bench: expected %d desktop managers in the fixture, found %u\n",
+                   BENCH_EXPECTED_DESKTOP_MANAGERS, g_list_length(found));
+    }
+    g_list_free_full(found, (GDestroyNotify)classlib_desktop_process_free);
+}
+
+static void proc_scan_teardown(gpointer data) 
+{
+    ProcScan *scan = data;
+    classlib_set_proc_root(NULL);
+    proc_fixture_remove(scan->root);
+    g_free(scan->root);
+    scan->root = NULL;
+}
+
+static void bench_scan_desktop_managers(gpointer data) 
+{
+    guint scanned = 0;
+    GList *found = classlib_scan_desktop_managers(&scanned);
+    bench_sink += scanned + g_list_length(found);
+    g_list_free_full(found, (GDestroyNotify)classlib_desktop_process_free);
+}
+
+/* Check the fixture resolves as designed, so the timings measure the full walk */
+static void default_file_manager_setup(gpointer data) 
+{
+    MimeappsFixture *fixture = data;
+    classlib_invalidate_default_file_manager();
+    gchar *name = classlib_get_default_file_manager();
+    if (g_strcmp0(name, fixture->expected) != 0) 
+    {
+        g_printerr("classlib-bench: expected %s as the default file manager, got %s\n",
+                   fixture->expected, name ? name : "nothing");
+    }
+    g_free(name);
+}
+
+static void bench_default_file_manager_cached(gpointer data G_GNUC_UNUSED) 
+{
+    for (guint i = 0; i < BENCH_DEFAULT_HANDLER_CALLS; i++)
+    {
+        gchar *name = classlib_get_default_file_manager();
+        bench_sink += name ? strlen(name) : 0;
+        g_free(name);
+    }
+}
+
+/* Every call misses the cache, as the first call after a mimeapps.list edit does */
+static void bench_default_file_manager_resolve(gpointer data G_GNUC_UNUSED) 
+{
+    classlib_invalidate_default_file_manager();
+    gchar *name = classlib_get_default_file_manager();
+    bench_sink += name ? strlen(name) : 0;
+    g_free(name);
+}
+
+/* Verdicts the scan cached, looked up for every pid in the fixture as the menu would */
+static void bench_lookup_process_class(gpointer data) 
+{
+    ProcScan *scan = data;
+    ClassicProcessClass process_class;
+    for (guint i = 0; i < scan->n_processes; i++)
+    {
+        if (classlib_lookup_process_class((pid_t)(BENCH_FIRST_FIXTURE_PID + i), &process_class))
+        {
+            bench_sink += process_class.role;
+        }
+    }
+}
+
+/* ===== DRIVER ===== */
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) 
+{
+    gdouble x = *(const gdouble *)a;
+    gdouble y = *(const gdouble *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_bench(const Bench *bench, guint runs) 
+{
+    if (bench->setup) 
+    {
+        bench->setup(bench->data);
+    }
+
+    gdouble *samples = g_new(gdouble, runs);
+
+    /* One untimed pass to warm caches and the string intern table */
+    bench->func(bench->data);
+
+    for (guint i = 0; i < runs; i++)
+    {
+        gint64 start = g_get_monotonic_time();
+        bench->func(bench->data);
+        samples[i] = (gdouble)(g_get_monotonic_time() - start);
+    }
+    qsort(samples, runs, sizeof(gdouble), compare_doubles);
+
+    gdouble median_us = samples[runs / 2];
+    printf("{\"bench\":\"%s\",\"n\":%u,\"runs\":%u,\"median_ms\":%.3f,\"ns_per_op\":%.1f}\n",
+           bench->name, bench->n, runs, median_us / 1000.0, median_us * 1000.0 / bench->n);
+    fflush(stdout);
+    g_free(samples);
+
+    if (bench->teardown) 
+    {
+        bench->teardown(bench->data);
+    }
+}
+
+/* --make-proc-fixture DIR N [COMM=ARGS...] */
+static int make_proc_fixture(int argc, char **argv) 
+{
+    if (argc < 2) 
+    {
+        g_printerr("usage: classlib-bench --make-proc-fixture DIR N [COMM=ARGS...]\n");
+        return 2;
+    }
+
+    const gchar *dir_path = argv[0];
+    guint n_processes = (guint)MAX(1, atoi(argv[1]));
+    const ProcFixtureProcess *processes = proc_fixture_desktop_processes;
+    guint n_listed = proc_fixture_n_desktop_processes;
+    ProcFixtureProcess *custom = NULL;
+    gchar **pairs = NULL;
+
+    if (argc > 2) 
+    {
+        custom = g_new0(ProcFixtureProcess, argc - 2);
+        pairs = g_new0(gchar *, argc - 2 + 1);
+        for (int i = 2; i < argc; i++) 
+        {
+            gchar *pair = g_strdup(argv[i]);
+            gchar *separator = strchr(pair, '=');
+            if (separator) *separator = '\0';
+            custom[i - 2].comm = pair;
+            custom[i - 2].cmdline = separator ? separator + 1 : pair;
+            pairs[i - 2] = pair;
+        }
+        processes = custom;
+        n_listed = argc - 2;
+    }
+
+    gchar *root = proc_fixture_create(dir_path, n_processes, processes, n_listed);
+    g_strfreev(pairs);
+    g_free(custom);
+    if (!root) 
+    {
+        return 1;
+    }
+
+    printf("{\"fixture\":\"%s\",\"processes\":%u,\"listed\":%u}\n", root, n_processes, n_listed);
+    g_free(root);
+    return 0;
+}
+
+int main(int argc, char **argv) 
+{
+    guint runs = BENCH_DEFAULT_RUNS;
+    const gchar *filter = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (g_strcmp0(argv[i], "--runs") == 0 && i + 1 < argc)
+        {
+            runs = MAX(1, atoi(argv[++i]));
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    gchar *mimeapps_root = make_mimeapps_fixture();
+    if (!mimeapps_root)
+    {
+        g_printerr("classlib-bench: could not create a temporary directory\n");
+        return 1;
+    }
+    MimeappsFixture mimeapps = { mimeapps_root, "thunar" };
+
+    StringSet *app_names = make_app_names(BENCH_APP_NAMES);
+    StringSet *app_names_thunar = make_app_names(BENCH_APP_NAMES);
+    app_names->sort_style = CLASSLIB_SORT_STYLE_CAJA;
+    app_names_thunar->sort_style = CLASSLIB_SORT_STYLE_THUNAR;
+    StringSet *window_titles = make_window_titles(BENCH_WINDOW_TITLES);
+
+    gchar *desktop_dir = make_desktop_directory(BENCH_DESKTOP_FILES);
+    if (!desktop_dir)
+    {
+        g_printerr("classlib-bench: could not create a temporary directory\n");
+        return 1;
+    }
+    /* Directory order is filesystem-defined, so the miss is the reliable worst case */
+    DesktopLookup desktop_hit = { desktop_dir, "Application 2500" };
+    DesktopLookup desktop_miss = { desktop_dir, "No Such Application" };
+    ProcScan proc_1k = { 1000, NULL };
+    ProcScan proc_10k = { 10000, NULL };
+    ProcScan proc_50k = { 50000, NULL };
+
+    const Bench benches[] =
+    {
+        { "resolve_display_name", bench_resolve_display_name, app_names, BENCH_APP_NAMES, NULL, NULL },
+        { "sort_compare_caja", bench_sort_compare, app_names, BENCH_APP_NAMES, NULL, NULL },
+        { "sort_compare_thunar", bench_sort_compare, app_names_thunar, BENCH_APP_NAMES, NULL, NULL },
+        { "sort_keys_caja", bench_sort_keys, app_names, BENCH_APP_NAMES, NULL, NULL },
+        { "sort_keys_thunar", bench_sort_keys, app_names_thunar, BENCH_APP_NAMES, NULL, NULL },
+        { "extract_document_name", bench_extract_document_name, window_titles, BENCH_WINDOW_TITLES, NULL, NULL },
+        { "remove_app_name_suffix", bench_remove_app_name_suffix, window_titles, BENCH_WINDOW_TITLES, NULL, NULL },
+        { "search_desktop_directory_hit", bench_search_desktop_directory, &desktop_hit, 1, NULL, NULL },
+        { "search_desktop_directory_miss", bench_search_desktop_directory, &desktop_miss, 1, NULL, NULL },
+        { "scan_desktop_managers_1k", bench_scan_desktop_managers, &proc_1k, 1000, proc_scan_setup, proc_scan_teardown },
+        { "scan_desktop_managers_10k", bench_scan_desktop_managers, &proc_10k, 10000, proc_scan_setup, proc_scan_teardown },
+        { "scan_desktop_managers_50k", bench_scan_desktop_managers, &proc_50k, 50000, proc_scan_setup, proc_scan_teardown },
+        { "lookup_process_class_10k", bench_lookup_process_class, &proc_10k, 10000, proc_scan_setup, proc_scan_teardown },
+        { "default_file_manager_cached", bench_default_file_manager_cached, &mimeapps, BENCH_DEFAULT_HANDLER_CALLS,
+          default_file_manager_setup, NULL },
+        { "default_file_manager_resolve", bench_default_file_manager_resolve, &mimeapps, 1,
+          default_file_manager_setup, NULL },
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(benches); i++)
+    {
+        if (filter && !strstr(benches[i].name, filter))
+        {
+            continue;
+        }
+        run_bench(&benches[i], runs);
+    }
+
+    remove_directory_tree(desktop_dir);
+    g_free(desktop_dir);
+    remove_directory_tree(mimeapps_root);
+    g_free(mimeapps_root);
+    string_set_free(window_titles);
+    string_set_free(app_names_thunar);
+    string_set_free(app_names);
+    return 0;
+}
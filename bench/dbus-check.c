@@ -0,0 +1,381 @@
+/* dbus-check - the org.xfce.FocusMenu bus interface against an in-memory session
+ *
+ * Includes focus-menu.c and serves the plugin's D-Bus interface from a
+ * backend built on the in-memory window source, on a private bus started by
+ * GTestDBus (which needs dbus-daemon). A second connection calls the methods
+ * the way a script would and checks the replies, the state they leave
+ * behind, and the signals with their order.
+ *
+ * Usage: dbus-check [GTest options, such as --tap or -p /dbus/hide]
+ */
+#include "../focus-menu.c"
+
+#define DBUS_CHECK_FIRST_PID 200000  /* Above real pids, so no application is a desktop manager */
+#define DBUS_CHECK_TIMEOUT_MS 5000
+
+typedef struct
+{
+    FocusMenuWindowSource *source;
+    FocusMenuBackend *backend;
+    FocusMenuPlugin *plugin;
+    GDBusConnection *client;
+    guint subscription_id;
+    GPtrArray *signals;          /* "Name id" per signal received, in order */
+    FocusMenuSourceApp *editor;
+    FocusMenuSourceApp *browser;
+    FocusMenuSourceWindow *editor_windows[2];
+    FocusMenuSourceWindow *browser_window;
+} Fixture;
+
+typedef struct
+{
+    GVariant *reply;
+    GError *error;
+    gboolean done;
+} CallResult;
+
+static GTestDBus *test_bus;
+
+/* ===== BUS CLIENT ===== */
+
+static void on_signal(GDBusConnection *connection G_GNUC_UNUSED, const gchar *sender G_GNUC_UNUSED,
+                      const gchar *object_path G_GNUC_UNUSED, const gchar *interface_name G_GNUC_UNUSED,
+                      const gchar *signal_name, GVariant *parameters, gpointer user_data)
+{
+    Fixture *fixture = user_data;
+    guint64 id = 0;
+
+    if (g_variant_is_of_type(parameters, G_VARIANT_TYPE("(t)")))
+    {
+        g_variant_get(parameters, "(t)", &id);
+    }
+    g_ptr_array_add(fixture->signals, g_strdup_printf("%s %" G_GUINT64_FORMAT, signal_name, id));
+}
+
+static void on_call_done(GObject *object, GAsyncResult *result, gpointer user_data)
+{
+    CallResult *call = user_data;
+    call->reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &call->error);
+    call->done = TRUE;
+}
+
+/* Call a method and run the main loop until it answers, so the service,
+ * which lives on this thread too, can serve it. Signals the call caused
+ * were sent before the reply, so they have been recorded by the time it returns */
+static GVariant *call_method(Fixture *fixture, const gchar *method, GVariant *parameters, GError **error)
+{
+    CallResult call = { NULL, NULL, FALSE };
+
+    g_dbus_connection_call(fixture->client, FOCUS_MENU_DBUS_NAME, FOCUS_MENU_DBUS_PATH, FOCUS_MENU_DBUS_INTERFACE,
+                           method, parameters, NULL, G_DBUS_CALL_FLAGS_NONE, DBUS_CHECK_TIMEOUT_MS, NULL, on_call_done, &call);
+    while (!call.done)
+    {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    if (call.error)
+    {
+        g_propagate_error(error, call.error);
+    }
+    return call.reply;
+}
+
+/* Index of the first signal with this name and id, or -1 */
+static gint signal_index(Fixture *fixture, const gchar *name, gulong id)
+{
+    gchar *wanted = g_strdup_printf("%s %" G_GUINT64_FORMAT, name, (guint64)id);
+    gint found = -1;
+
+    for (guint i = 0; i < fixture->signals->len && found < 0; i++)
+    {
+        if (g_strcmp0(g_ptr_array_index(fixture->signals, i), wanted) == 0) found = (gint)i;
+    }
+    g_free(wanted);
+    return found;
+}
+
+/* Index of the first signal of any name that carries this id, or -1 */
+static gint first_signal_for(Fixture *fixture, gulong id)
+{
+    gchar *suffix = g_strdup_printf(" %" G_GUINT64_FORMAT, (guint64)id);
+    gint found = -1;
+
+    for (guint i = 0; i < fixture->signals->len && found < 0; i++)
+    {
+        if (g_str_has_suffix(g_ptr_array_index(fixture->signals, i), suffix)) found = (gint)i;
+    }
+    g_free(suffix);
+    return found;
+}
+
+static void on_name_appeared(GDBusConnection *connection G_GNUC_UNUSED, const gchar *name G_GNUC_UNUSED,
+                             const gchar *name_owner G_GNUC_UNUSED, gpointer user_data)
+{
+    *(gboolean *)user_data = TRUE;
+}
+
+static gulong app_id(Fixture *fixture, FocusMenuSourceApp *app)
+{
+    return focus_menu_source_app_get_id(fixture->source, app);
+}
+
+static gulong window_id(Fixture *fixture, FocusMenuSourceWindow *window)
+{
+    return focus_menu_source_window_get_id(fixture->source, window);
+}
+
+/* ListApplications' entry for an application: fills hidden and n_windows, FALSE if missing */
+static gboolean list_application(Fixture *fixture, gulong id, gboolean *hidden, guint *n_windows)
+{
+    GVariant *reply = call_method(fixture, "ListApplications", NULL, NULL);
+    GVariantIter *iter;
+    guint64 entry_id;
+    const gchar *name;
+    gint32 pid;
+    guint32 windows, menu_windows;
+    gboolean active, entry_hidden, desktop_manager;
+    gboolean found = FALSE;
+
+    g_assert_nonnull(reply);
+    g_variant_get(reply, "(a(tsiuubbb))", &iter);
+    while (g_variant_iter_next(iter, "(t&siuubbb)", &entry_id, &name, &pid, &windows, &menu_windows, &active, &entry_hidden, &desktop_manager))
+    {
+        g_assert_cmpstr(name, !=, "");
+        g_assert_false(desktop_manager);
+        if (entry_id == id)
+        {
+            found = TRUE;
+            if (hidden) *hidden = entry_hidden;
+            if (n_windows) *n_windows = windows;
+        }
+    }
+    g_variant_iter_free(iter);
+    g_variant_unref(reply);
+    return found;
+}
+
+/* ListWindows' minimized and active flags for a window, FALSE if missing */
+static gboolean list_window(Fixture *fixture, gulong id, gboolean *minimized, gboolean *active)
+{
+    GVariant *reply = call_method(fixture, "ListWindows", NULL, NULL);
+    GVariantIter *iter;
+    guint64 entry_id, entry_app;
+    const gchar *title;
+    gboolean entry_minimized, in_menu, entry_active;
+    gboolean found = FALSE;
+
+    g_assert_nonnull(reply);
+    g_variant_get(reply, "(a(ttsbbb))", &iter);
+    while (g_variant_iter_next(iter, "(tt&sbbb)", &entry_id, &entry_app, &title, &entry_minimized, &in_menu, &entry_active))
+    {
+        if (entry_id == id)
+        {
+            found = TRUE;
+            *minimized = entry_minimized;
+            *active = entry_active;
+        }
+    }
+    g_variant_iter_free(iter);
+    g_variant_unref(reply);
+    return found;
+}
+
+/* ===== FIXTURE ===== */
+
+/* An editor with two windows and a focused browser, served on the test bus */
+static void fixture_set_up(Fixture *fixture, gconstpointer data G_GNUC_UNUSED)
+{
+    GError *error = NULL;
+
+    fixture->source = focus_menu_mock_source_new(1);
+    fixture->editor = focus_menu_mock_source_add_app(fixture->source, "mousepad", DBUS_CHECK_FIRST_PID);
+    fixture->browser = focus_menu_mock_source_add_app(fixture->source, "firefox", DBUS_CHECK_FIRST_PID + 1);
+    fixture->editor_windows[0] = focus_menu_mock_source_add_window(fixture->source, fixture->editor, "notes.txt - Mousepad",
+                                                                   FOCUS_MENU_SOURCE_WINDOW_NORMAL, 0, 0);
+    fixture->editor_windows[1] = focus_menu_mock_source_add_window(fixture->source, fixture->editor, "todo.txt - Mousepad",
+                                                                   FOCUS_MENU_SOURCE_WINDOW_NORMAL, 0, 0);
+    fixture->browser_window = focus_menu_mock_source_add_window(fixture->source, fixture->browser, "Start Page — Mozilla Firefox",
+                                                                FOCUS_MENU_SOURCE_WINDOW_NORMAL, 0, 0);
+    focus_menu_mock_source_set_active_window(fixture->source, fixture->browser_window);
+
+    /* The parts of focus_menu_backend_new() and focus_menu_construct() the service needs */
+    FocusMenuBackend *backend = g_new0(FocusMenuBackend, 1);
+    backend->ref_count = 1;
+    backend->source = fixture->source;
+    backend->model = focus_menu_model_new(fixture->source, CLASSLIB_SORT_STYLE_CAJA, classlib_detect_locale_type());
+    focus_menu_model_set_notify(backend->model, focus_menu_backend_on_model_changed, backend);
+
+    FocusMenuPlugin *plugin = g_new0(FocusMenuPlugin, 1);
+    plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    plugin->journal_op = BULK_OP_NONE;
+    plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
+    plugin->locale_type = classlib_detect_locale_type();
+    plugin->use_submenus = TRUE;
+    plugin->backend = backend;
+    plugin->source = backend->source;
+    plugin->model = backend->model;
+    backend->instances = g_list_append(NULL, plugin);
+
+    fixture->backend = backend;
+    fixture->plugin = plugin;
+    fixture->signals = g_ptr_array_new_with_free_func(g_free);
+
+    dbus_service_start(backend);
+
+    fixture->client = g_dbus_connection_new_for_address_sync(g_test_dbus_get_bus_address(test_bus),
+                                                             G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                             G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                             NULL, NULL, &error);
+    g_assert_no_error(error);
+    fixture->subscription_id = g_dbus_connection_signal_subscribe(fixture->client, NULL, FOCUS_MENU_DBUS_INTERFACE, NULL,
+                                                                  FOCUS_MENU_DBUS_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                  on_signal, fixture, NULL);
+
+    /* The name is owned, and the object exported, before any test calls */
+    gboolean appeared = FALSE;
+    guint watch_id = g_bus_watch_name_on_connection(fixture->client, FOCUS_MENU_DBUS_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                    on_name_appeared, NULL, &appeared, NULL);
+    while (!appeared || !backend->dbus_registration_id)
+    {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    g_bus_unwatch_name(watch_id);
+}
+
+static void fixture_tear_down(Fixture *fixture, gconstpointer data G_GNUC_UNUSED)
+{
+    g_dbus_connection_signal_unsubscribe(fixture->client, fixture->subscription_id);
+    g_object_unref(fixture->client);
+    dbus_service_stop(fixture->backend);
+
+    g_hash_table_destroy(fixture->plugin->hidden_apps);
+    g_array_free(fixture->plugin->journal, TRUE);
+    focus_menu_build_arena_free(fixture->plugin->build_arena);
+    g_free(fixture->plugin);
+
+    focus_menu_model_free(fixture->backend->model);
+    g_list_free(fixture->backend->instances);
+    g_free(fixture->backend);
+    focus_menu_source_free(fixture->source);
+    g_ptr_array_free(fixture->signals, TRUE);
+
+    /* Let the bus forget this client before the next test connects */
+    while (g_main_context_iteration(NULL, FALSE));
+}
+
+/* ===== TESTS ===== */
+
+static void test_list_applications(Fixture *fixture, gconstpointer data G_GNUC_UNUSED)
+{
+    gboolean hidden = TRUE;
+    guint n_windows = 0;
+
+    g_assert_true(list_application(fixture, app_id(fixture, fixture->editor), &hidden, &n_windows));
+    g_assert_false(hidden);
+    g_assert_cmpuint(n_windows, ==, 2);
+    g_assert_true(list_application(fixture, app_id(fixture, fixture->browser), &hidden, &n_windows));
+    g_assert_cmpuint(n_windows, ==, 1);
+
+    /* Listing changes nothing, so it sends nothing */
+    g_assert_cmpuint(fixture->signals->len, ==, 0);
+}
+
+static void test_hide(Fixture *fixture, gconstpointer data G_GNUC_UNUSED)
+{
+    GError *error = NULL;
+    GVariant *reply = call_method(fixture, "Hide", g_variant_new("(t)", (guint64)app_id(fixture, fixture->editor)), &error);
+    g_assert_no_error(error);
+    g_variant_unref(reply);
+
+    /* Both editor windows went down, and nothing else changed */
+    gint first = signal_index(fixture, "WindowChanged", window_id(fixture, fixture->editor_windows[0]));
+    gint second = signal_index(fixture, "WindowChanged", window_id(fixture, fixture->editor_windows[1]));
+    g_assert_cmpint(first, >=, 0);
+    g_assert_cmpint(second, >, first);
+    g_assert_cmpint(first_signal_for(fixture, window_id(fixture, fixture->browser_window)), ==, -1);
+
+    gboolean hidden = FALSE;
+    g_assert_true(list_application(fixture, app_id(fixture, fixture->editor), &hidden, NULL));
+    g_assert_true(hidden);
+
+    gboolean minimized = FALSE, active = TRUE;
+    g_assert_true(list_window(fixture, window_id(fixture, fixture->editor_windows[1]), &minimized, &active));
+    g_assert_true(minimized);
+    g_assert_false(active);
+
+    /* An unknown id is the caller's mistake, not a crash */
+    reply = call_method(fixture, "Hide", g_variant_new("(t)", (guint64)0xdead), &error);
+    g_assert_null(reply);
+    g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+    g_clear_error(&error);
+}
+
+static void test_activate_window(Fixture *fixture, gconstpointer data G_GNUC_UNUSED)
+{
+    GError *error = NULL;
+    gulong target = window_id(fixture, fixture->editor_windows[0]);
+
+    focus_menu_mock_source_set_window_state(fixture->source, fixture->editor_windows[0], FOCUS_MENU_SOURCE_STATE_MINIMIZED);
+    g_variant_unref(call_method(fixture, "ListWindows", NULL, NULL));
+    g_ptr_array_set_size(fixture->signals, 0);
+
+    GVariant *reply = call_method(fixture, "ActivateWindow", g_variant_new("(t)", (guint64)target), &error);
+    g_assert_no_error(error);
+    g_variant_unref(reply);
+
+    /* Unminimized first, then focused, and the focus change names the window */
+    gint changed = signal_index(fixture, "WindowChanged", target);
+    gint focused = signal_index(fixture, "ActiveWindowChanged", target);
+    g_assert_cmpint(changed, >=, 0);
+    g_assert_cmpint(focused, >, changed);
+    g_assert_cmpstr(g_ptr_array_index(fixture->signals, fixture->signals->len - 1), ==,
+                    g_ptr_array_index(fixture->signals, focused));
+
+    gboolean minimized = TRUE, active = FALSE;
+    g_assert_true(list_window(fixture, target, &minimized, &active));
+    g_assert_false(minimized);
+    g_assert_true(active);
+
+    reply = call_method(fixture, "ActivateWindow", g_variant_new("(t)", (guint64)0xdead), &error);
+    g_assert_null(reply);
+    g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+    g_clear_error(&error);
+}
+
+/* A client must hear about an application before any change to it */
+static void test_application_added_first(Fixture *fixture, gconstpointer data G_GNUC_UNUSED)
+{
+    FocusMenuSourceApp *viewer = focus_menu_mock_source_add_app(fixture->source, "ristretto", DBUS_CHECK_FIRST_PID + 2);
+    FocusMenuSourceWindow *window = focus_menu_mock_source_add_window(fixture->source, viewer, "photo.jpg - Image Viewer",
+                                                                      FOCUS_MENU_SOURCE_WINDOW_NORMAL, 0, 0);
+    focus_menu_mock_source_set_app_name(fixture->source, viewer, "Image Viewer");
+
+    /* A round trip delivers everything sent before it */
+    g_variant_unref(call_method(fixture, "ListWindows", NULL, NULL));
+
+    gint added = signal_index(fixture, "ApplicationAdded", app_id(fixture, viewer));
+    g_assert_cmpint(added, >=, 0);
+    g_assert_cmpint(first_signal_for(fixture, app_id(fixture, viewer)), ==, added);
+    g_assert_cmpint(signal_index(fixture, "ApplicationChanged", app_id(fixture, viewer)), >, added);
+    g_assert_cmpint(signal_index(fixture, "WindowAdded", window_id(fixture, window)), >, added);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    /* A private bus, so the check never meets a running panel's service */
+    test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_bus);
+
+    g_test_add("/dbus/list-applications", Fixture, NULL, fixture_set_up, test_list_applications, fixture_tear_down);
+    g_test_add("/dbus/hide", Fixture, NULL, fixture_set_up, test_hide, fixture_tear_down);
+    g_test_add("/dbus/activate-window", Fixture, NULL, fixture_set_up, test_activate_window, fixture_tear_down);
+    g_test_add("/dbus/application-added-first", Fixture, NULL, fixture_set_up, test_application_added_first, fixture_tear_down);
+
+    int result = g_test_run();
+
+    g_test_dbus_down(test_bus);
+    g_object_unref(test_bus);
+    return result;
+}
@@ -0,0 +1,581 @@
+/* event-replay - play a recorded window event stream through the model
+ *
+ * Reads a recording made with FOCUS_MENU_RECORD=FILE (one JSON object per
+ * line, see the EVENT RECORDER section of focus-menu.c) and re-creates the
+ * session on the in-memory window source, event by event. The model hears
+ * every change through the same listener the plugin uses, and passes it on
+ * to the plugin's own handler (focus_menu_on_model_changed()), so the
+ * hidden-state registry and the coalesced button updates run as they would
+ * in the panel. Each menu opening in the recording builds the menu layout
+ * again. The result is one line of JSON per pass:
+ *
+ *   {"recording":"session.jsonl","pass":1,"events":5120,"menus":14,"button_updates":96,
+ *    "wall_ms":3.210,"handler_cpu_ms":2.104,"menu_cpu_ms":0.912,"windows":48,"apps":17}
+ *
+ * handler_cpu_ms is the thread CPU time spent applying events, model work,
+ * plugin handlers and button updates included; menu_cpu_ms is the time
+ * spent building menu layouts. Pending button updates run whenever the
+ * recording goes quiet for a frame, before each menu and at the end, so
+ * bursts coalesce as they did live. With a display, the button's label
+ * and icon are real widgets; without one only the model side of the
+ * update runs. Runs of two builds on the same recording can be compared
+ * directly.
+ *
+ * Usage: event-replay [--fast] [--repeat N] RECORDING
+ * Events are paced as they were recorded unless --fast is given. The
+ * desktop manager scan reads /proc, or FOCUS_MENU_PROC_ROOT if it is set,
+ * which gives identical results from one machine to the next.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../focus-menu.c"
+
+#define REPLAY_MIN_WORKSPACES 1
+#define REPLAY_FRAME_US 16667   /* A quiet gap this long lets pending button updates run */
+
+typedef enum
+{
+    REPLAY_WINDOW_OPENED,
+    REPLAY_WINDOW_CLOSED,
+    REPLAY_WINDOW_CHANGED,
+    REPLAY_APP_OPENED,
+    REPLAY_APP_CLOSED,
+    REPLAY_APP_CHANGED,
+    REPLAY_ACTIVE_WINDOW,
+    REPLAY_ACTIVE_WORKSPACE,
+    REPLAY_MENU,
+    REPLAY_UNKNOWN
+} ReplayEventKind;
+
+/* One recorded line; fields the event doesn't carry are left at zero */
+typedef struct
+{
+    gint64 time_us;
+    ReplayEventKind kind;
+    FocusMenuSourceChange what;
+    gulong window_id;
+    gulong app_id;
+    pid_t pid;
+    gchar *name;
+    gchar *app_name;
+    gint type;
+    gint state;
+    gint workspace;
+} ReplayEvent;
+
+/* One pass over the recording */
+typedef struct
+{
+    FocusMenuWindowSource *source;
+    FocusMenuPlugin *plugin;
+    GHashTable *windows;      /* Recorded window id -> FocusMenuSourceWindow* */
+    GHashTable *apps;         /* Recorded application id -> FocusMenuSourceApp* */
+    guint menus;
+    guint button_updates;
+    gint64 handler_cpu_ns;
+    gint64 menu_cpu_ns;
+} ReplaySession;
+
+static volatile gsize replay_sink; /* Keeps results observable to the compiler */
+static gboolean replay_have_display; /* The button gets real widgets */
+
+/* ===== READING RECORDINGS ===== */
+
+static void skip_spaces(const gchar **p) 
+{
+    while (**p == ' ' || **p == '\t') (*p)++;
+}
+
+/* Parse a JSON string at *p into a new UTF-8 string; NULL on malformed input */
+static gchar *parse_string(const gchar **p) 
+{
+    if (**p != '"') return NULL;
+    (*p)++;
+
+    GString *out = g_string_new(NULL);
+    while (**p && **p != '"')
+    {
+        if (**p != '\\')
+        {
+            g_string_append_c(out, *(*p)++);
+            continue;
+        }
+
+        (*p)++;
+        switch (**p)
+        {
+            case 'n': g_string_append_c(out, '\n'); break;
+            case 't': g_string_append_c(out, '\t'); break;
+            case 'r': g_string_append_c(out, '\r'); break;
+            case 'b': g_string_append_c(out, '\b'); break;
+            case 'f': g_string_append_c(out, '\f'); break;
+            case 'u':
+            {
+                gchar hex[5] = { 0 };
+                if (strlen(*p + 1) < 4) goto malformed;
+                memcpy(hex, *p + 1, 4);
+                g_string_append_unichar(out, (gunichar)strtoul(hex, NULL, 16));
+                *p += 4;
+                break;
+            }
+            case '\0':
+                goto malformed;
+            default:
+                g_string_append_c(out, **p);
+                break;
+        }
+        (*p)++;
+    }
+    if (**p != '"') goto malformed;
+    (*p)++;
+    return g_string_free(out, FALSE);
+
+malformed:
+    g_string_free(out, TRUE);
+    return NULL;
+}
+
+static ReplayEventKind parse_event_kind(const gchar *name) 
+{
+    static const struct { const gchar *name; ReplayEventKind kind; } kinds[] =
+    {
+        { "window-opened", REPLAY_WINDOW_OPENED },
+        { "window-closed", REPLAY_WINDOW_CLOSED },
+        { "window-changed", REPLAY_WINDOW_CHANGED },
+        { "app-opened", REPLAY_APP_OPENED },
+        { "app-closed", REPLAY_APP_CLOSED },
+        { "app-changed", REPLAY_APP_CHANGED },
+        { "active-window", REPLAY_ACTIVE_WINDOW },
+        { "active-workspace", REPLAY_ACTIVE_WORKSPACE },
+        { "menu", REPLAY_MENU },
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(kinds); i++)
+    {
+        if (g_strcmp0(name, kinds[i].name) == 0) return kinds[i].kind;
+    }
+    return REPLAY_UNKNOWN;
+}
+
+static FocusMenuSourceChange parse_change(const gchar *name) 
+{
+    if (g_strcmp0(name, "state") == 0) return FOCUS_MENU_SOURCE_CHANGE_STATE;
+    if (g_strcmp0(name, "workspace") == 0) return FOCUS_MENU_SOURCE_CHANGE_WORKSPACE;
+    if (g_strcmp0(name, "icon") == 0) return FOCUS_MENU_SOURCE_CHANGE_ICON;
+    return FOCUS_MENU_SOURCE_CHANGE_NAME;
+}
+
+/* Parse one line; returns FALSE for the header and anything unreadable */
+static gboolean parse_event(const gchar *line, ReplayEvent *event) 
+{
+    const gchar *p = line;
+    gboolean is_event = FALSE;
+
+    memset(event, 0, sizeof(*event));
+    event->workspace = -1;
+
+    skip_spaces(&p);
+    if (*p++ != '{') return FALSE;
+
+    while (*p)
+    {
+        skip_spaces(&p);
+        gchar *key = parse_string(&p);
+        if (!key) break;
+        skip_spaces(&p);
+        if (*p++ != ':')
+        {
+            g_free(key);
+            break;
+        }
+        skip_spaces(&p);
+
+        if (*p == '"')
+        {
+            gchar *value = parse_string(&p);
+            if (!value)
+            {
+                g_free(key);
+                break;
+            }
+
+            if (g_strcmp0(key, "ev") == 0)
+            {
+                event->kind = parse_event_kind(value);
+                is_event = TRUE;
+            }
+            else if (g_strcmp0(key, "what") == 0)
+            {
+                event->what = parse_change(value);
+            }
+            else if (g_strcmp0(key, "name") == 0 && !event->name)
+            {
+                event->name = g_steal_pointer(&value);
+            }
+            else if (g_strcmp0(key, "app_name") == 0 && !event->app_name)
+            {
+                event->app_name = g_steal_pointer(&value);
+            }
+            g_free(value);
+        }
+        else
+        {
+            gchar *end;
+            gint64 value = g_ascii_strtoll(p, &end, 10);
+            if (end == p)
+            {
+                g_free(key);
+                break;
+            }
+            p = end;
+
+            if (g_strcmp0(key, "t") == 0) event->time_us = value;
+            else if (g_strcmp0(key, "win") == 0) event->window_id = (gulong)value;
+            else if (g_strcmp0(key, "app") == 0) event->app_id = (gulong)value;
+            else if (g_strcmp0(key, "pid") == 0) event->pid = (pid_t)value;
+            else if (g_strcmp0(key, "type") == 0) event->type = (gint)value;
+            else if (g_strcmp0(key, "state") == 0) event->state = (gint)value;
+            else if (g_strcmp0(key, "ws") == 0) event->workspace = (gint)value;
+        }
+        g_free(key);
+
+        skip_spaces(&p);
+        if (*p == ',') p++;
+        else break;
+    }
+
+    if (!is_event || event->kind == REPLAY_UNKNOWN)
+    {
+        g_free(event->name);
+        g_free(event->app_name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Read every event; the parse happens before timing starts */
+static GArray *load_recording(const gchar *path, GError **error) 
+{
+    gchar *contents;
+    if (!g_file_get_contents(path, &contents, NULL, error)) return NULL;
+
+    GArray *events = g_array_new(FALSE, FALSE, sizeof(ReplayEvent));
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    gboolean saw_header = FALSE;
+
+    for (guint i = 0; lines[i]; i++)
+    {
+        ReplayEvent event;
+        if (!saw_header && strstr(lines[i], "\"focus_menu_recording\":1"))
+        {
+            saw_header = TRUE;
+            continue;
+        }
+        if (parse_event(lines[i], &event)) g_array_append_val(events, event);
+    }
+
+    g_strfreev(lines);
+    g_free(contents);
+
+    if (!saw_header)
+    {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a Focus Menu recording", path);
+        g_array_free(events, TRUE);
+        return NULL;
+    }
+    return events;
+}
+
+static void free_recording(GArray *events) 
+{
+    for (guint i = 0; i < events->len; i++)
+    {
+        ReplayEvent *event = &g_array_index(events, ReplayEvent, i);
+        g_free(event->name);
+        g_free(event->app_name);
+    }
+    g_array_free(events, TRUE);
+}
+
+/* ===== REPLAYING ===== */
+
+static gint64 thread_cpu_ns(void) 
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/* Enough workspaces for every number the recording mentions */
+static guint count_workspaces(GArray *events) 
+{
+    gint highest = REPLAY_MIN_WORKSPACES - 1;
+    for (guint i = 0; i < events->len; i++)
+    {
+        highest = MAX(highest, g_array_index(events, ReplayEvent, i).workspace);
+    }
+    return (guint)highest + 1;
+}
+
+/* The parts of focus_menu_construct() the model and menu layout need */
+static ReplaySession *replay_session_new(guint n_workspaces) 
+{
+    ReplaySession *session = g_new0(ReplaySession, 1);
+    session->source = focus_menu_mock_source_new(n_workspaces);
+    session->windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+    session->apps = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    FocusMenuPlugin *plugin = g_new0(FocusMenuPlugin, 1);
+    plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    plugin->journal_op = BULK_OP_NONE;
+    plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
+    plugin->locale_type = classlib_detect_locale_type();
+    plugin->use_submenus = TRUE;
+    plugin->source = session->source;
+    plugin->model = focus_menu_model_new(session->source, determine_sort_style(session->source), plugin->locale_type);
+    if (replay_have_display)
+    {
+        plugin->label = g_object_ref_sink(gtk_label_new("Desktop"));
+        plugin->icon = g_object_ref_sink(gtk_image_new());
+    }
+    session->plugin = plugin;
+
+    /* The plugin hears the model the way the backend passes changes on */
+    focus_menu_model_set_notify(plugin->model, focus_menu_on_model_changed, plugin);
+    hidden_registry_seed(plugin);
+
+    return session;
+}
+
+static void replay_session_free(ReplaySession *session) 
+{
+    FocusMenuPlugin *plugin = session->plugin;
+
+    if (plugin->update_idle_id) g_source_remove(plugin->update_idle_id);
+    if (plugin->label) g_object_unref(plugin->label);
+    if (plugin->icon) g_object_unref(plugin->icon);
+    if (plugin->displayed_icon) g_object_unref(plugin->displayed_icon);
+    g_free(plugin->displayed_label);
+
+    focus_menu_model_free(plugin->model);
+    g_hash_table_destroy(plugin->hidden_apps);
+    g_array_free(plugin->journal, TRUE);
+    focus_menu_build_arena_free(plugin->build_arena);
+    g_free(plugin);
+    focus_menu_source_free(session->source);
+    g_hash_table_destroy(session->windows);
+    g_hash_table_destroy(session->apps);
+    g_free(session);
+}
+
+static FocusMenuSourceApp *replay_app(ReplaySession *session, const ReplayEvent *event) 
+{
+    FocusMenuSourceApp *app = g_hash_table_lookup(session->apps, GSIZE_TO_POINTER(event->app_id));
+    if (!app)
+    {
+        app = focus_menu_mock_source_add_app(session->source, event->app_name ? event->app_name : "", event->pid);
+        g_hash_table_insert(session->apps, GSIZE_TO_POINTER(event->app_id), app);
+    }
+    return app;
+}
+
+/* Bring a window to its recorded state; the change is reported even when
+ * nothing differs, as the window manager reported it */
+static void replay_window_changed(ReplaySession *session, FocusMenuSourceWindow *window, const ReplayEvent *event) 
+{
+    FocusMenuWindowSource *source = session->source;
+    guint workspace = event->workspace < 0 ? 0 : (guint)event->workspace;
+
+    switch (event->what)
+    {
+        case FOCUS_MENU_SOURCE_CHANGE_NAME:
+            focus_menu_mock_source_set_window_name(source, window, event->name);
+            return;
+        case FOCUS_MENU_SOURCE_CHANGE_STATE:
+            if (focus_menu_source_window_get_state(source, window) != (FocusMenuSourceWindowState)event->state)
+            {
+                focus_menu_mock_source_set_window_state(source, window, event->state);
+                return;
+            }
+            break;
+        case FOCUS_MENU_SOURCE_CHANGE_WORKSPACE:
+        {
+            FocusMenuSourceWorkspace *current = focus_menu_source_window_get_workspace(source, window);
+            gboolean moved = event->workspace >= 0 && focus_menu_source_workspace_get_number(source, current) != event->workspace;
+            gboolean retyped = focus_menu_source_window_get_type(source, window) != (FocusMenuSourceWindowType)event->type;
+
+            focus_menu_mock_source_set_window_type(source, window, event->type);
+            if (event->workspace >= 0) focus_menu_mock_source_set_window_workspace(source, window, workspace);
+            if (moved || retyped) return;
+            break;
+        }
+        case FOCUS_MENU_SOURCE_CHANGE_ICON:
+            break;
+    }
+    focus_menu_source_emit_window_changed(source, window, event->what);
+}
+
+static void replay_event(ReplaySession *session, const ReplayEvent *event) 
+{
+    FocusMenuWindowSource *source = session->source;
+    gpointer window_key = GSIZE_TO_POINTER(event->window_id);
+    FocusMenuSourceWindow *window = g_hash_table_lookup(session->windows, window_key);
+
+    switch (event->kind)
+    {
+        case REPLAY_WINDOW_OPENED:
+            if (window) break;
+            window = focus_menu_mock_source_add_window(source, replay_app(session, event), event->name, event->type, event->state,
+                                                       event->workspace < 0 ? 0 : (guint)event->workspace);
+            g_hash_table_insert(session->windows, window_key, window);
+            break;
+        case REPLAY_WINDOW_CLOSED:
+            if (!window) break;
+            g_hash_table_remove(session->windows, window_key);
+            focus_menu_mock_source_remove_window(source, window);
+            break;
+        case REPLAY_WINDOW_CHANGED:
+            if (window) replay_window_changed(session, window, event);
+            break;
+        case REPLAY_APP_OPENED:
+            /* The in-memory source announces an application with its first window */
+            replay_app(session, event);
+            break;
+        case REPLAY_APP_CLOSED:
+            /* Likewise, it reports the close when the last window goes */
+            break;
+        case REPLAY_APP_CHANGED:
+        {
+            FocusMenuSourceApp *app = replay_app(session, event);
+            if (event->what == FOCUS_MENU_SOURCE_CHANGE_NAME)
+            {
+                focus_menu_mock_source_set_app_name(source, app, event->app_name ? event->app_name : "");
+            }
+            else
+            {
+                focus_menu_source_emit_app_changed(source, app, event->what);
+            }
+            break;
+        }
+        case REPLAY_ACTIVE_WINDOW:
+            focus_menu_mock_source_set_active_window(source, window);
+            break;
+        case REPLAY_ACTIVE_WORKSPACE:
+            if (event->workspace >= 0) focus_menu_mock_source_set_active_workspace(source, (guint)event->workspace);
+            break;
+        case REPLAY_MENU:
+        case REPLAY_UNKNOWN:
+            break;
+    }
+}
+
+/* Run whatever the plugin left for the main loop, as the panel would at the next frame */
+static void replay_dispatch(ReplaySession *session) 
+{
+    if (session->plugin->update_idle_id) session->button_updates++;
+    while (g_main_context_iteration(NULL, FALSE));
+}
+
+static void replay_menu(ReplaySession *session) 
+{
+    FocusMenuLayout *layout = focus_menu_layout_build(session->plugin);
+    replay_sink += layout->app_rows->len + layout->desktop_rows->len;
+    focus_menu_layout_free(layout);
+    session->menus++;
+}
+
+static void replay_pass(const gchar *path, GArray *events, guint pass, gboolean fast) 
+{
+    ReplaySession *session = replay_session_new(count_workspaces(events));
+    gint64 start_us = g_get_monotonic_time();
+
+    for (guint i = 0; i < events->len; i++)
+    {
+        const ReplayEvent *event = &g_array_index(events, ReplayEvent, i);
+
+        if (!fast)
+        {
+            gint64 wait_us = start_us + event->time_us - g_get_monotonic_time();
+            if (wait_us > 0) g_usleep((gulong)wait_us);
+        }
+
+        gint64 cpu_start = thread_cpu_ns();
+        if (event->kind == REPLAY_MENU)
+        {
+            replay_menu(session);
+            session->menu_cpu_ns += thread_cpu_ns() - cpu_start;
+            continue;
+        }
+
+        replay_event(session, event);
+
+        /* Coalesced updates wait for a quiet frame, a menu or the end */
+        const ReplayEvent *next = i + 1 < events->len ? &g_array_index(events, ReplayEvent, i + 1) : NULL;
+        if (!next || next->kind == REPLAY_MENU || next->time_us - event->time_us >= REPLAY_FRAME_US)
+        {
+            replay_dispatch(session);
+        }
+        session->handler_cpu_ns += thread_cpu_ns() - cpu_start;
+    }
+
+    gint64 wall_us = g_get_monotonic_time() - start_us;
+    printf("{\"recording\":\"%s\",\"pass\":%u,\"events\":%u,\"menus\":%u,\"button_updates\":%u,\"wall_ms\":%.3f,\"handler_cpu_ms\":%.3f,\"menu_cpu_ms\":%.3f,\"windows\":%u,\"apps\":%u}\n",
+           path, pass, events->len, session->menus, session->button_updates, wall_us / 1000.0, session->handler_cpu_ns / 1e6, session->menu_cpu_ns / 1e6,
+           g_hash_table_size(session->windows), g_hash_table_size(session->plugin->model->apps));
+    fflush(stdout);
+    replay_session_free(session);
+}
+
+int main(int argc, char **argv) 
+{
+    gboolean fast = FALSE;
+    guint repeat = 1;
+    const gchar *path = NULL;
+
+    replay_have_display = gtk_init_check(&argc, &argv);
+    for (int i = 1; i < argc; i++)
+    {
+        if (g_strcmp0(argv[i], "--fast") == 0)
+        {
+            fast = TRUE;
+        }
+        else if (g_strcmp0(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = MAX(1, atoi(argv[++i]));
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (!path)
+    {
+        g_printerr("Usage: event-replay [--fast] [--repeat N] RECORDING\n");
+        return 2;
+    }
+
+    GError *error = NULL;
+    GArray *events = load_recording(path, &error);
+    if (!events)
+    {
+        g_printerr("event-replay: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    const gchar *proc_root = g_getenv("FOCUS_MENU_PROC_ROOT");
+    if (proc_root && *proc_root) classlib_set_proc_root(proc_root);
+
+    for (guint pass = 1; pass <= repeat; pass++)
+    {
+        replay_pass(path, events, pass, fast);
+    }
+
+    classlib_set_proc_root(NULL);
+    free_recording(events);
+    return 0;
+}
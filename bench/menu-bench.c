@@ -0,0 +1,376 @@
+/* menu-bench - end-to-end menu timings against a live X session
+ *
+ * Hosts the plugin's menu logic outside the panel (this file includes
+ * focus-menu.c, so the real static functions run) and times create_menu(),
+ * Hide Others and Show All while bench/xclients fills the session with
+ * synthetic application windows. Meant to run under Xvfb with an EWMH
+ * window manager; see bench/run-menu-bench.sh.
+ *
+ * Usage: menu-bench [--runs N] [--windows-per-app M] [--minimized P]
+ *                   [--other-workspace Q] [--xclients PATH] [WINDOWS...]
+ *
+ * Each WINDOWS value is one point on the scaling curve. Results are printed
+ * one JSON object per line, in the same style as classlib-bench:
+ *
+ *   {"bench":"create_menu","windows":500,"apps":100,"runs":7,"median_ms":4.210,"max_ms":5.020,"settle_ms":0.000}
+ *
+ * For Hide Others and Show All, median_ms is the time spent in the plugin's
+ * handler and settle_ms is how long the window manager and libwnck took
+ * until the model stopped changing.
+ *
+ * Built with DEBUG=1, it also reports the most X requests each action sent
+ * at each point and exits with status 1 if any run went over the action's
+ * cap (see X REQUEST ACCOUNTING in focus-menu.c):
+ *
+ *   {"bench":"x_requests","windows":500,"apps":100,"action":"hide_others","requests":212,"cap":1208}
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "../focus-menu.c"
+
+#define MENU_BENCH_DEFAULT_RUNS 7
+#define MENU_BENCH_WAIT_US (60 * G_USEC_PER_SEC)   /* Give up waiting for windows after this */
+#define MENU_BENCH_QUIET_US (150 * 1000)           /* The model counts as settled after this long unchanged */
+
+static const guint default_curve[] = { 10, 50, 100, 250, 500, 1000, 2000 };
+
+typedef struct
+{
+    guint runs;
+    guint windows_per_app;
+    gint minimized_percent;
+    gint other_workspace_percent;
+    const gchar *xclients;
+} MenuBenchOptions;
+
+typedef struct
+{
+    gdouble *samples;
+    gdouble *settle;
+    guint count;
+} MenuBenchResult;
+
+#ifdef DEBUG
+/* Most X requests one run of an action sent, and the cap for that run */
+typedef struct
+{
+    gulong requests;
+    gulong cap;
+} XRequestWorst;
+
+static gboolean x_caps_exceeded;
+#endif
+
+/* ===== PLUGIN HOST ===== */
+
+/* The parts of focus_menu_construct() the menu needs, without a panel */
+static FocusMenuPlugin *menu_bench_plugin_new(void) 
+{
+    FocusMenuPlugin *plugin = g_new0(FocusMenuPlugin, 1);
+    plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    plugin->journal_op = BULK_OP_NONE;
+    plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
+    plugin->locale_type = classlib_detect_locale_type();
+
+    /* A realized button lets focus_menu_get_timestamp() ask the server for the time */
+    GtkWidget *host = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    plugin->button = gtk_button_new();
+    plugin->label = gtk_label_new("Desktop");
+    plugin->icon = gtk_image_new();
+    gtk_container_add(GTK_CONTAINER(host), plugin->button);
+    gtk_widget_realize(plugin->button);
+
+    WnckScreen *screen = wnck_handle_get_default_screen(wnck_handle_new(WNCK_CLIENT_TYPE_PAGER));
+    wnck_screen_force_update(screen);
+    plugin->source = focus_menu_wnck_source_new(screen);
+    plugin->model = focus_menu_model_new(plugin->source, determine_sort_style(plugin->source), plugin->locale_type);
+
+    focus_menu_model_set_notify(plugin->model, focus_menu_on_model_changed, plugin);
+    hidden_registry_seed(plugin);
+    return plugin;
+}
+
+/* ===== SESSION CONTROL ===== */
+
+/* Windows currently known to the plugin that belong to the given client */
+static guint count_client_windows(FocusMenuPlugin *plugin, GPid client) 
+{
+    guint count = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, plugin->model->windows);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) 
+    {
+        if (((FocusMenuWindowRecord *)value)->app_record->pid == (pid_t)client) count++;
+    }
+    return count;
+}
+
+/* Run the main loop until the client's window count reaches target */
+static gboolean wait_for_client_windows(FocusMenuPlugin *plugin, GPid client, guint target) 
+{
+    gint64 deadline = g_get_monotonic_time() + MENU_BENCH_WAIT_US;
+    while (count_client_windows(plugin, client) != target) 
+    {
+        if (g_get_monotonic_time() > deadline) return FALSE;
+        g_main_context_iteration(NULL, FALSE);
+        g_usleep(1000);
+    }
+    return TRUE;
+}
+
+/* Dispatch events until the model's counters stop moving; returns the time it took */
+static gdouble wait_for_model_to_settle(FocusMenuPlugin *plugin) 
+{
+    gint64 start = g_get_monotonic_time();
+    gint64 last_change = start;
+    gint minimized = plugin->model->n_minimized;
+    gint hideable = plugin->model->n_hideable_visible;
+
+    while (g_get_monotonic_time() - last_change < MENU_BENCH_QUIET_US && 
+           g_get_monotonic_time() - start < MENU_BENCH_WAIT_US) 
+    {
+        while (g_main_context_iteration(NULL, FALSE));
+        if (plugin->model->n_minimized != minimized || plugin->model->n_hideable_visible != hideable) 
+        {
+            minimized = plugin->model->n_minimized;
+            hideable = plugin->model->n_hideable_visible;
+            last_change = g_get_monotonic_time();
+        }
+        g_usleep(1000);
+    }
+    return (gdouble)(last_change - start);
+}
+
+/* Start xclients and read its "ready" line */
+static GPid spawn_clients(const MenuBenchOptions *options, guint n_apps) 
+{
+    gchar *apps = g_strdup_printf("%u", n_apps);
+    gchar *windows = g_strdup_printf("%u", options->windows_per_app);
+    gchar *minimized = g_strdup_printf("%d", options->minimized_percent);
+    gchar *other = g_strdup_printf("%d", options->other_workspace_percent);
+    gchar *argv[] = { (gchar *)options->xclients, apps, windows, minimized, other, NULL };
+    GPid pid = 0;
+    gint out_fd = -1;
+    GError *error = NULL;
+
+    if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &out_fd, NULL, &error)) 
+    {
+        g_printerr("menu-bench: could not start %s: %s\n", options->xclients, error->message);
+        g_error_free(error);
+        pid = 0;
+    } 
+    else 
+    {
+        GIOChannel *channel = g_io_channel_unix_new(out_fd);
+        gchar *line = NULL;
+        g_io_channel_read_line(channel, &line, NULL, NULL, NULL);
+        if (!line || !g_str_has_prefix(line, "ready")) 
+        {
+            g_printerr("menu-bench: %s did not start\n", options->xclients);
+        }
+        g_free(line);
+        g_io_channel_shutdown(channel, FALSE, NULL);
+        g_io_channel_unref(channel);
+    }
+
+    g_free(other);
+    g_free(minimized);
+    g_free(windows);
+    g_free(apps);
+    return pid;
+}
+
+static void stop_clients(FocusMenuPlugin *plugin, GPid client) 
+{
+    kill(client, SIGTERM);
+    waitpid(client, NULL, 0);
+    g_spawn_close_pid(client);
+    wait_for_client_windows(plugin, client, 0);
+}
+
+/* ===== MEASUREMENTS ===== */
+
+#ifdef DEBUG
+/* Keep the run of action that sent the most requests; n_windows is how many it changed */
+static void note_x_requests(FocusMenuPlugin *plugin, XAction action, guint n_windows, XRequestWorst *worst) 
+{
+    gulong requests = plugin->x_requests[action];
+    if (requests >= worst[action].requests) 
+    {
+        worst[action].requests = requests;
+        worst[action].cap = x_action_cap(action, n_windows);
+    }
+}
+
+static void print_x_requests(guint windows, guint apps, const XRequestWorst *worst) 
+{
+    static const XAction measured[] = { X_ACTION_MENU_OPEN, X_ACTION_HIDE_OTHERS, X_ACTION_SHOW_ALL, X_ACTION_ACTIVATE_WINDOW };
+
+    for (guint i = 0; i < G_N_ELEMENTS(measured); i++) 
+    {
+        XAction action = measured[i];
+        printf("{\"bench\":\"x_requests\",\"windows\":%u,\"apps\":%u,\"action\":\"%s\",\"requests\":%lu,\"cap\":%lu}\n",
+               windows, apps, x_action_caps[action].name, worst[action].requests, worst[action].cap);
+    }
+    fflush(stdout);
+}
+#endif
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) 
+{
+    gdouble x = *(const gdouble *)a;
+    gdouble y = *(const gdouble *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_result(const gchar *name, guint windows, guint apps, MenuBenchResult *result) 
+{
+    qsort(result->samples, result->count, sizeof(gdouble), compare_doubles);
+    qsort(result->settle, result->count, sizeof(gdouble), compare_doubles);
+    printf("{\"bench\":\"%s\",\"windows\":%u,\"apps\":%u,\"runs\":%u,\"median_ms\":%.3f,\"max_ms\":%.3f,\"settle_ms\":%.3f}\n",
+           name, windows, apps, result->count,
+           result->samples[result->count / 2] / 1000.0,
+           result->samples[result->count - 1] / 1000.0,
+           result->settle[result->count / 2] / 1000.0);
+    fflush(stdout);
+}
+
+static void measure_point(FocusMenuPlugin *plugin, const MenuBenchOptions *options, guint n_windows) 
+{
+    guint n_apps = MAX(1, n_windows / options->windows_per_app);
+    guint total = n_apps * options->windows_per_app;
+
+    GPid client = spawn_clients(options, n_apps);
+    if (!client) return;
+    if (!wait_for_client_windows(plugin, client, total)) 
+    {
+        g_printerr("menu-bench: only %u of %u windows appeared\n", count_client_windows(plugin, client), total);
+        stop_clients(plugin, client);
+        return;
+    }
+    wait_for_model_to_settle(plugin);
+
+    MenuBenchResult results[3];
+    for (guint r = 0; r < G_N_ELEMENTS(results); r++) 
+    {
+        results[r].samples = g_new0(gdouble, options->runs);
+        results[r].settle = g_new0(gdouble, options->runs);
+        results[r].count = options->runs;
+    }
+    MenuBenchResult *build = &results[0];
+    MenuBenchResult *hide = &results[1];
+    MenuBenchResult *show = &results[2];
+
+    /* One untimed build warms the icon and name caches */
+    create_menu(plugin);
+
+    #ifdef DEBUG
+    XRequestWorst x_worst[X_ACTION_COUNT] = { { 0, 0 } };
+    guint x_overruns = plugin->x_request_overruns;
+    #endif
+
+    for (guint i = 0; i < options->runs; i++) 
+    {
+        gint64 start = g_get_monotonic_time();
+        create_menu(plugin);
+        build->samples[i] = (gdouble)(g_get_monotonic_time() - start);
+
+        start = g_get_monotonic_time();
+        hide_all_applications(NULL, plugin);
+        hide->samples[i] = (gdouble)(g_get_monotonic_time() - start);
+        #ifdef DEBUG
+        guint hide_changed = plugin->journal->len;
+        #endif
+        hide->settle[i] = wait_for_model_to_settle(plugin);
+
+        start = g_get_monotonic_time();
+        show_all_applications(NULL, plugin);
+        show->samples[i] = (gdouble)(g_get_monotonic_time() - start);
+        show->settle[i] = wait_for_model_to_settle(plugin);
+
+        #ifdef DEBUG
+        note_x_requests(plugin, X_ACTION_MENU_OPEN, 0, x_worst);
+        note_x_requests(plugin, X_ACTION_HIDE_OTHERS, hide_changed, x_worst);
+        note_x_requests(plugin, X_ACTION_SHOW_ALL, plugin->journal->len, x_worst);
+
+        /* Bring the bottom window forward, as picking it from the menu would */
+        GList *stacking = focus_menu_source_list_windows(plugin->source);
+        if (stacking) 
+        {
+            activate_window(plugin, stacking->data, focus_menu_get_timestamp(plugin));
+            note_x_requests(plugin, X_ACTION_ACTIVATE_WINDOW, 0, x_worst);
+            wait_for_model_to_settle(plugin);
+        }
+        #endif
+    }
+
+    print_result("create_menu", total, n_apps, build);
+    print_result("hide_others", total, n_apps, hide);
+    print_result("show_all", total, n_apps, show);
+
+    #ifdef DEBUG
+    print_x_requests(total, n_apps, x_worst);
+    if (plugin->x_request_overruns != x_overruns) 
+    {
+        g_printerr("menu-bench: %u actions at %u windows sent more X requests than allowed\n",
+                   plugin->x_request_overruns - x_overruns, total);
+        x_caps_exceeded = TRUE;
+    }
+    #endif
+
+    for (guint r = 0; r < G_N_ELEMENTS(results); r++) 
+    {
+        g_free(results[r].samples);
+        g_free(results[r].settle);
+    }
+
+    if (plugin->menu) 
+    {
+        gtk_widget_destroy(plugin->menu);
+        plugin->menu = NULL;
+    }
+    stop_clients(plugin, client);
+}
+
+int main(int argc, char **argv) 
+{
+    MenuBenchOptions options = { MENU_BENCH_DEFAULT_RUNS, 5, 20, 25, "bench/xclients" };
+    GArray *curve = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    gtk_init(&argc, &argv);
+
+    for (int i = 1; i < argc; i++) 
+    {
+        gboolean has_value = i + 1 < argc;
+        if (g_strcmp0(argv[i], "--runs") == 0 && has_value) options.runs = MAX(1, atoi(argv[++i]));
+        else if (g_strcmp0(argv[i], "--windows-per-app") == 0 && has_value) options.windows_per_app = MAX(1, atoi(argv[++i]));
+        else if (g_strcmp0(argv[i], "--minimized") == 0 && has_value) options.minimized_percent = atoi(argv[++i]);
+        else if (g_strcmp0(argv[i], "--other-workspace") == 0 && has_value) options.other_workspace_percent = atoi(argv[++i]);
+        else if (g_strcmp0(argv[i], "--xclients") == 0 && has_value) options.xclients = argv[++i];
+        else 
+        {
+            guint n = (guint)atoi(argv[i]);
+            if (n > 0) g_array_append_val(curve, n);
+        }
+    }
+    if (curve->len == 0) 
+    {
+        g_array_append_vals(curve, default_curve, G_N_ELEMENTS(default_curve));
+    }
+
+    FocusMenuPlugin *plugin = menu_bench_plugin_new();
+    for (guint i = 0; i < curve->len; i++) 
+    {
+        measure_point(plugin, &options, g_array_index(curve, guint, i));
+    }
+
+    g_array_free(curve, TRUE);
+    #ifdef DEBUG
+    return x_caps_exceeded ? 1 : 0;
+    #else
+    return 0;
+    #endif
+}
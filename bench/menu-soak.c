@@ -0,0 +1,355 @@
+/* menu-soak - long-run memory check for repeated menu builds
+ *
+ * The applet lives as long as the panel, so anything create_menu() leaves
+ * behind adds up over weeks. This program includes focus-menu.c, runs the
+ * real create_menu() against a scripted session on the in-memory window
+ * source, and builds and destroys the menu many times while the session
+ * keeps changing: windows retitle, minimize, move between workspaces, and
+ * open and close, with application names drawn from a fixed pool so the
+ * working set itself stays the same size.
+ *
+ * Resident memory and heap in use (mallinfo2) are sampled at intervals
+ * and printed one JSON object per line:
+ *
+ *   {"soak":"sample","builds":5000,"rss_kb":23140,"heap_kb":4120}
+ *   {"soak":"result","builds":100000,"rss_growth_kb":12,"heap_growth_kb":0,"limit_kb":1024,"steady":true}
+ *
+ * Growth is measured from the sample a quarter of the way in, once caches
+ * have filled, to the last one. The exit status is 1 if the heap (or, where
+ * mallinfo2 is unavailable, resident memory) grew by more than the limit.
+ *
+ * With --release-every N, the plugin's idle memory release runs after every
+ * Nth build, and one more line compares the builds that followed a release
+ * with the rest, which is the latency the release trades for memory:
+ *
+ *   {"soak":"release","releases":100,"rss_released_kb":310,"build_us":412.5,"build_after_release_us":1630.2}
+ *
+ * Usage: menu-soak [--builds N] [--interval N] [--windows N] [--limit-kb N]
+ *                  [--release-every N]
+ * GTK needs a display; bench/run-menu-soak.sh provides one with Xvfb.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "../focus-menu.c"
+#include "proc-fixture.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define MENU_SOAK_HAVE_MALLINFO2 1
+#endif
+
+#define MENU_SOAK_DEFAULT_BUILDS 100000
+#define MENU_SOAK_DEFAULT_INTERVAL 5000
+#define MENU_SOAK_DEFAULT_WINDOWS 60
+#define MENU_SOAK_DEFAULT_LIMIT_KB 1024
+#define MENU_SOAK_WINDOWS_PER_APP 3
+#define MENU_SOAK_APP_NAMES 32        /* Pool the churning applications draw their names from */
+#define MENU_SOAK_CHURN_EVERY 50      /* Builds between closing one window and opening another */
+#define MENU_SOAK_PROCESSES 300
+#define MENU_SOAK_FIRST_PID 100000
+
+typedef struct
+{
+    guint builds;
+    guint interval;
+    guint n_windows;
+    guint limit_kb;
+    guint release_every;          /* 0: never run the idle memory release */
+} MenuSoakOptions;
+
+/* Builds right after an idle memory release, against all the others */
+typedef struct
+{
+    guint releases;
+    gint64 rss_released_kb;
+    guint builds;
+    gint64 build_us;
+    guint builds_after_release;
+    gint64 build_after_release_us;
+} ReleaseStats;
+
+/* The scripted session: a ring of windows, oldest first */
+typedef struct
+{
+    FocusMenuWindowSource *source;
+    FocusMenuPlugin *plugin;
+    FocusMenuSourceApp **apps;
+    guint n_apps;
+    GQueue windows;
+    guint opened;                 /* Windows opened so far, for titles */
+} SoakSession;
+
+typedef struct
+{
+    guint builds;
+    gint64 rss_kb;
+    gint64 heap_kb;               /* -1 without mallinfo2 */
+} SoakSample;
+
+/* ===== SCRIPTED SESSION ===== */
+
+static void soak_open_window(SoakSession *session) 
+{
+    guint index = session->opened++;
+    FocusMenuSourceApp *app = session->apps[(index / MENU_SOAK_WINDOWS_PER_APP) % session->n_apps];
+    gchar *title = g_strdup_printf("Document %u - Soak", index % 997);
+    FocusMenuSourceWindowState state = (index % 4 == 1) ? FOCUS_MENU_SOURCE_STATE_MINIMIZED : 0;
+
+    FocusMenuSourceWindow *window = focus_menu_mock_source_add_window(session->source, app, title, FOCUS_MENU_SOURCE_WINDOW_NORMAL,
+                                                                      state, index % 3 == 2 ? 1 : 0);
+    g_queue_push_tail(&session->windows, window);
+    g_free(title);
+}
+
+/* One step of the script, between two menu builds */
+static void soak_step(SoakSession *session, guint build) 
+{
+    FocusMenuWindowSource *source = session->source;
+    guint n = g_queue_get_length(&session->windows);
+    FocusMenuSourceWindow *window = g_queue_peek_nth(&session->windows, build % n);
+
+    /* Titles come from a bounded set, as a busy terminal's would */
+    gchar *title = g_strdup_printf("Document %u - Soak", (build * 7) % 997);
+    focus_menu_mock_source_set_window_name(source, window, title);
+    g_free(title);
+
+    focus_menu_mock_source_set_window_state(source, window,
+                                            focus_menu_source_window_get_state(source, window) ^ FOCUS_MENU_SOURCE_STATE_MINIMIZED);
+    focus_menu_mock_source_set_active_window(source, g_queue_peek_nth(&session->windows, (build * 13) % n));
+
+    if (build % 17 == 0)
+    {
+        focus_menu_mock_source_set_window_workspace(source, window, build % 2);
+    }
+    if (build % 101 == 0)
+    {
+        focus_menu_mock_source_set_active_workspace(source, (build / 101) % 2);
+    }
+
+    /* Replace the oldest window; its application may close and reopen */
+    if (build % MENU_SOAK_CHURN_EVERY == 0)
+    {
+        FocusMenuSourceWindow *oldest = g_queue_pop_head(&session->windows);
+        focus_menu_mock_source_remove_window(source, oldest);
+        soak_open_window(session);
+    }
+
+    /* Renames cycle through the same pool, so the set of names stays fixed */
+    if (build % 211 == 0)
+    {
+        guint app_index = build % session->n_apps;
+        gchar *name = g_strdup_printf("soak-app-%u", (app_index + build / 211) % MENU_SOAK_APP_NAMES);
+        focus_menu_mock_source_set_app_name(source, session->apps[app_index], name);
+        g_free(name);
+    }
+}
+
+/* The parts of focus_menu_construct() create_menu() needs */
+static SoakSession *soak_session_new(guint n_windows) 
+{
+    SoakSession *session = g_new0(SoakSession, 1);
+    session->source = focus_menu_mock_source_new(2);
+    session->n_apps = MAX(1, n_windows / MENU_SOAK_WINDOWS_PER_APP);
+    session->apps = g_new(FocusMenuSourceApp *, session->n_apps);
+    g_queue_init(&session->windows);
+
+    for (guint i = 0; i < session->n_apps; i++)
+    {
+        gchar *name = g_strdup_printf("soak-app-%u", i % MENU_SOAK_APP_NAMES);
+        session->apps[i] = focus_menu_mock_source_add_app(session->source, name, MENU_SOAK_FIRST_PID + i);
+        g_free(name);
+    }
+    for (guint i = 0; i < MAX(1, n_windows); i++)
+    {
+        soak_open_window(session);
+    }
+
+    FocusMenuPlugin *plugin = g_new0(FocusMenuPlugin, 1);
+    plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    plugin->journal_op = BULK_OP_NONE;
+    plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
+    plugin->locale_type = classlib_detect_locale_type();
+    plugin->use_submenus = TRUE;
+    plugin->source = session->source;
+    plugin->model = focus_menu_model_new(session->source, determine_sort_style(session->source), plugin->locale_type);
+    session->plugin = plugin;
+
+    return session;
+}
+
+static void soak_session_free(SoakSession *session) 
+{
+    FocusMenuPlugin *plugin = session->plugin;
+
+    if (plugin->menu) gtk_widget_destroy(plugin->menu);
+    focus_menu_model_free(plugin->model);
+    g_hash_table_destroy(plugin->hidden_apps);
+    g_array_free(plugin->journal, TRUE);
+    focus_menu_build_arena_free(plugin->build_arena);
+    g_free(plugin);
+    g_queue_clear(&session->windows);
+    focus_menu_source_free(session->source);
+    g_free(session->apps);
+    g_free(session);
+}
+
+/* ===== MEASUREMENT ===== */
+
+static gint64 read_heap_kb(void) 
+{
+#ifdef MENU_SOAK_HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return (gint64)(info.uordblks / 1024);
+#else
+    return -1;
+#endif
+}
+
+/* Let GTK finish destroying the last menu before measuring */
+static void drain_main_context(void) 
+{
+    while (g_main_context_iteration(NULL, FALSE));
+}
+
+static SoakSample take_sample(guint builds) 
+{
+    SoakSample sample = { builds, memory_read_rss_kb(), read_heap_kb() };
+
+    printf("{\"soak\":\"sample\",\"builds\":%u,\"rss_kb\":%" G_GINT64_FORMAT ",\"heap_kb\":%" G_GINT64_FORMAT "}\n",
+           sample.builds, sample.rss_kb, sample.heap_kb);
+    fflush(stdout);
+    return sample;
+}
+
+/* Compare the end of the run with the first sample after warm-up */
+static gboolean report_result(GArray *samples, const MenuSoakOptions *options) 
+{
+    const SoakSample *baseline = &g_array_index(samples, SoakSample, samples->len / 4);
+    const SoakSample *last = &g_array_index(samples, SoakSample, samples->len - 1);
+    gint64 rss_growth = last->rss_kb - baseline->rss_kb;
+    gint64 heap_growth = last->heap_kb >= 0 ? last->heap_kb - baseline->heap_kb : -1;
+    gint64 judged = heap_growth >= 0 ? heap_growth : rss_growth;
+    gboolean steady = judged <= (gint64)options->limit_kb;
+
+    printf("{\"soak\":\"result\",\"builds\":%u,\"rss_growth_kb\":%" G_GINT64_FORMAT ",\"heap_growth_kb\":%" G_GINT64_FORMAT ",\"limit_kb\":%u,\"steady\":%s}\n",
+           last->builds, rss_growth, heap_growth, options->limit_kb, steady ? "true" : "false");
+    fflush(stdout);
+    return steady;
+}
+
+static void report_release(const ReleaseStats *stats) 
+{
+    printf("{\"soak\":\"release\",\"releases\":%u,\"rss_released_kb\":%" G_GINT64_FORMAT ",\"build_us\":%.1f,\"build_after_release_us\":%.1f}\n",
+           stats->releases, stats->releases ? stats->rss_released_kb / stats->releases : 0,
+           stats->builds ? (gdouble)stats->build_us / stats->builds : 0.0,
+           stats->builds_after_release ? (gdouble)stats->build_after_release_us / stats->builds_after_release : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) 
+{
+    MenuSoakOptions options =
+    {
+        .builds = MENU_SOAK_DEFAULT_BUILDS,
+        .interval = MENU_SOAK_DEFAULT_INTERVAL,
+        .n_windows = MENU_SOAK_DEFAULT_WINDOWS,
+        .limit_kb = MENU_SOAK_DEFAULT_LIMIT_KB,
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (g_strcmp0(argv[i], "--builds") == 0 && i + 1 < argc)
+        {
+            options.builds = MAX(1, atoi(argv[++i]));
+        }
+        else if (g_strcmp0(argv[i], "--interval") == 0 && i + 1 < argc)
+        {
+            options.interval = MAX(1, atoi(argv[++i]));
+        }
+        else if (g_strcmp0(argv[i], "--windows") == 0 && i + 1 < argc)
+        {
+            options.n_windows = MAX(2, atoi(argv[++i]));
+        }
+        else if (g_strcmp0(argv[i], "--limit-kb") == 0 && i + 1 < argc)
+        {
+            options.limit_kb = MAX(0, atoi(argv[++i]));
+        }
+        else if (g_strcmp0(argv[i], "--release-every") == 0 && i + 1 < argc)
+        {
+            options.release_every = MAX(0, atoi(argv[++i]));
+        }
+        else
+        {
+            g_printerr("Usage: menu-soak [--builds N] [--interval N] [--windows N] [--limit-kb N] [--release-every N]\n");
+            return 2;
+        }
+    }
+
+    if (!gtk_init_check(&argc, &argv))
+    {
+        g_printerr("menu-soak: cannot open a display; use bench/run-menu-soak.sh\n");
+        return 1;
+    }
+
+    gchar *proc_root = proc_fixture_create(NULL, MENU_SOAK_PROCESSES, proc_fixture_desktop_processes,
+                                           proc_fixture_n_desktop_processes);
+    if (!proc_root)
+    {
+        g_printerr("menu-soak: could not create a process fixture\n");
+        return 1;
+    }
+    classlib_set_proc_root(proc_root);
+
+    SoakSession *session = soak_session_new(options.n_windows);
+    GArray *samples = g_array_new(FALSE, FALSE, sizeof(SoakSample));
+    ReleaseStats release_stats = { 0 };
+
+    for (guint build = 1; build <= options.builds; build++)
+    {
+        soak_step(session, build);
+        gint64 start = g_get_monotonic_time();
+        create_menu(session->plugin);
+        gint64 build_us = g_get_monotonic_time() - start;
+        drain_main_context();
+
+        if (session->plugin->popup_after_release)
+        {
+            session->plugin->popup_after_release = FALSE;
+            release_stats.builds_after_release++;
+            release_stats.build_after_release_us += build_us;
+        }
+        else
+        {
+            release_stats.builds++;
+            release_stats.build_us += build_us;
+        }
+
+        if (options.release_every && build % options.release_every == 0)
+        {
+            memory_release(session->plugin);
+            release_stats.releases++;
+            release_stats.rss_released_kb += session->plugin->memory_rss_before_kb - session->plugin->memory_rss_after_kb;
+        }
+
+        if (build % options.interval == 0 || build == options.builds)
+        {
+            SoakSample sample = take_sample(build);
+            g_array_append_val(samples, sample);
+        }
+    }
+
+    gboolean steady = report_result(samples, &options);
+    if (options.release_every)
+    {
+        report_release(&release_stats);
+    }
+
+    g_array_free(samples, TRUE);
+    soak_session_free(session);
+    classlib_set_proc_root(NULL);
+    proc_fixture_remove(proc_root);
+    g_free(proc_root);
+    return steady ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+/* model-bench - window model and menu layout timings without a display
+ *
+ * Includes focus-menu.c, so the real model, menu layout and bulk commands
+ * run, but feeds them from the in-memory window source instead of wnck.
+ * Sessions of 100 to 10,000 windows are generated in-process, which makes
+ * the model's CPU cost measurable (and profilable under perf or callgrind)
+ * with no X server involved. Results use the classlib-bench format:
+ *
+ *   {"bench":"menu_layout_warm","n":10000,"runs":7,"median_ms":1.234,"ns_per_op":123.4}
+ *
+ * n is the number of windows in the session.
+ *
+ * Usage: model-bench [--runs N] [--windows N] [FILTER]
+ * --windows replaces the default sizes with a single one; only benchmarks
+ * whose name contains FILTER are run.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "../focus-menu.c"
+#include "proc-fixture.h"
+
+#define MODEL_BENCH_DEFAULT_RUNS 7
+#define MODEL_BENCH_WINDOWS_PER_APP 5
+#define MODEL_BENCH_WORKSPACES 2
+#define MODEL_BENCH_PROCESSES 500     /* Size of the fake /proc the desktop manager scan reads */
+#define MODEL_BENCH_FIRST_PID 100000  /* Above the fixture's pids, so no application is a desktop manager */
+
+static const guint default_sizes[] = { 100, 1000, 10000 };
+
+/* One synthetic session and the plugin state that runs against it */
+typedef struct
+{
+    guint n_windows;
+    FocusMenuWindowSource *source;
+    FocusMenuPlugin *plugin;
+    ClassicSortStyle sort_style;
+    FocusMenuSourceWindow **windows;
+    FocusMenuSourceWindowState *initial_states;
+    FocusMenuSourceWindow *initial_active;
+    guint storm_round;
+} ModelSession;
+
+typedef void (*ModelBenchFunc)(ModelSession *session);
+
+typedef struct
+{
+    const gchar *name;
+    ModelBenchFunc prepare;      /* Optional, untimed, run before every timed call */
+    ModelBenchFunc func;
+} ModelBench;
+
+static volatile gsize bench_sink; /* Keeps results observable to the compiler */
+
+/* ===== SYNTHETIC SESSIONS ===== */
+
+/* Application names in the shapes the display name tiers handle */
+static gchar *make_app_name(guint index) 
+{
+    static const gchar *patterns[] =
+    {
+        "firefox-%u",
+        "Org.example.tool-%u",
+        "editor%u",
+        "Report %u.odt - LibreOffice",
+        "MixedCase%u",
+        "thunar",
+        "",                         /* Nameless; borrows its first window's title */
+        "Xfce4-panel-%u-settings",
+    };
+
+    guint id = (index * 2654435761u) % 100000;
+    return g_strdup_printf(patterns[index % G_N_ELEMENTS(patterns)], id);
+}
+
+static gchar *make_window_title(guint index, guint round) 
+{
+    static const gchar *patterns[] =
+    {
+        "~/Documents/notes-%u.txt - Mousepad",
+        "Chapter %u — Mozilla Firefox",
+        "/home/user/src/project/file%u.c – Visual Studio Code",
+        "Terminal %u",
+        "Untitled %u - LibreOffice Writer",
+    };
+
+    return g_strdup_printf(patterns[(index + round) % G_N_ELEMENTS(patterns)], index + round * 7);
+}
+
+/* Fill the source: one window in five minimized, one in five on the second workspace */
+static void session_populate(ModelSession *session) 
+{
+    guint n_apps = MAX(1, session->n_windows / MODEL_BENCH_WINDOWS_PER_APP);
+    FocusMenuSourceApp **apps = g_new(FocusMenuSourceApp *, n_apps);
+
+    for (guint i = 0; i < n_apps; i++)
+    {
+        gchar *name = make_app_name(i);
+        apps[i] = focus_menu_mock_source_add_app(session->source, name, MODEL_BENCH_FIRST_PID + i);
+        g_free(name);
+    }
+
+    session->windows = g_new(FocusMenuSourceWindow *, session->n_windows);
+    session->initial_states = g_new(FocusMenuSourceWindowState, session->n_windows);
+    for (guint i = 0; i < session->n_windows; i++)
+    {
+        gchar *title = make_window_title(i, 0);
+        FocusMenuSourceWindowState state = (i % 5 == 1) ? FOCUS_MENU_SOURCE_STATE_MINIMIZED : 0;
+        guint workspace = (i % 5 == 2) ? 1 : 0;
+
+        session->windows[i] = focus_menu_mock_source_add_window(session->source, apps[i % n_apps], title,
+                                                                FOCUS_MENU_SOURCE_WINDOW_NORMAL, state, workspace);
+        session->initial_states[i] = state;
+        g_free(title);
+    }
+
+    /* The most recently opened window that is on screen has focus */
+    guint active = session->n_windows - 1;
+    while (active > 0 && (active % 5 == 1 || active % 5 == 2)) active--;
+    session->initial_active = session->windows[active];
+    focus_menu_mock_source_set_active_window(session->source, session->initial_active);
+    g_free(apps);
+}
+
+/* The parts of focus_menu_construct() the model and menu commands need */
+static FocusMenuPlugin *model_bench_plugin_new(FocusMenuWindowSource *source) 
+{
+    FocusMenuPlugin *plugin = g_new0(FocusMenuPlugin, 1);
+    plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    plugin->journal_op = BULK_OP_NONE;
+    plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
+    plugin->locale_type = classlib_detect_locale_type();
+    plugin->use_submenus = TRUE;
+    plugin->source = source;
+    return plugin;
+}
+
+static ModelSession *session_new(guint n_windows) 
+{
+    ModelSession *session = g_new0(ModelSession, 1);
+    session->n_windows = MAX(1, n_windows);
+    session->source = focus_menu_mock_source_new(MODEL_BENCH_WORKSPACES);
+    session_populate(session);
+    session->plugin = model_bench_plugin_new(session->source);
+    session->sort_style = determine_sort_style(session->source);
+    return session;
+}
+
+static void session_free(ModelSession *session) 
+{
+    focus_menu_model_free(session->plugin->model);
+    g_hash_table_destroy(session->plugin->hidden_apps);
+    g_array_free(session->plugin->journal, TRUE);
+    focus_menu_build_arena_free(session->plugin->build_arena);
+    g_free(session->plugin);
+    focus_menu_source_free(session->source);
+    g_free(session->initial_states);
+    g_free(session->windows);
+    g_free(session);
+}
+
+/* ===== BENCHMARK BODIES ===== */
+
+static void ensure_model(ModelSession *session) 
+{
+    FocusMenuPlugin *plugin = session->plugin;
+    if (!plugin->model)
+    {
+        plugin->model = focus_menu_model_new(session->source, session->sort_style, plugin->locale_type);
+    }
+}
+
+static void drop_model(ModelSession *session) 
+{
+    focus_menu_model_free(session->plugin->model);
+    session->plugin->model = NULL;
+}
+
+/* Put every window back in its generated state, as if nothing had run */
+static void reset_session(ModelSession *session) 
+{
+    ensure_model(session);
+    for (guint i = 0; i < session->n_windows; i++)
+    {
+        focus_menu_mock_source_set_window_state(session->source, session->windows[i], session->initial_states[i]);
+    }
+    focus_menu_mock_source_set_active_workspace(session->source, 0);
+    focus_menu_mock_source_set_active_window(session->source, session->initial_active);
+    g_hash_table_remove_all(session->plugin->hidden_apps);
+}
+
+static void bench_model_construct(ModelSession *session) 
+{
+    ensure_model(session);
+}
+
+static void bench_model_free(ModelSession *session) 
+{
+    drop_model(session);
+}
+
+/* Application order has to be recomputed, as after any name change */
+static void prepare_layout_cold(ModelSession *session) 
+{
+    ensure_model(session);
+    session->plugin->model->sorted_apps_dirty = TRUE;
+}
+
+static void bench_menu_layout(ModelSession *session) 
+{
+    FocusMenuLayout *layout = focus_menu_layout_build(session->plugin);
+    bench_sink += layout->app_rows->len + layout->desktop_rows->len;
+    focus_menu_layout_free(layout);
+}
+
+/* Every window retitles once, as a build or a busy terminal session would */
+static void bench_title_storm(ModelSession *session) 
+{
+    session->storm_round++;
+    for (guint i = 0; i < session->n_windows; i++)
+    {
+        gchar *title = make_window_title(i, session->storm_round);
+        focus_menu_mock_source_set_window_name(session->source, session->windows[i], title);
+        g_free(title);
+    }
+}
+
+static void bench_hide_others(ModelSession *session) 
+{
+    hide_all_applications(NULL, session->plugin);
+    bench_sink += session->plugin->journal->len;
+}
+
+static void bench_show_all(ModelSession *session) 
+{
+    show_all_applications(NULL, session->plugin);
+    bench_sink += session->plugin->journal->len;
+}
+
+static const ModelBench benches[] =
+{
+    { "model_construct", drop_model, bench_model_construct },
+    { "menu_layout_cold", prepare_layout_cold, bench_menu_layout },
+    { "menu_layout_warm", ensure_model, bench_menu_layout },
+    { "title_storm", ensure_model, bench_title_storm },
+    { "hide_others", reset_session, bench_hide_others },
+    { "show_all", reset_session, bench_show_all },
+    { "model_free", ensure_model, bench_model_free },
+};
+
+/* ===== DRIVER ===== */
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) 
+{
+    gdouble x = *(const gdouble *)a;
+    gdouble y = *(const gdouble *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_bench(const ModelBench *bench, ModelSession *session, guint runs) 
+{
+    gdouble *samples = g_new(gdouble, runs);
+
+    /* One untimed pass to warm caches, icons and sort keys */
+    if (bench->prepare) bench->prepare(session);
+    bench->func(session);
+
+    for (guint i = 0; i < runs; i++)
+    {
+        if (bench->prepare) bench->prepare(session);
+        gint64 start = g_get_monotonic_time();
+        bench->func(session);
+        samples[i] = (gdouble)(g_get_monotonic_time() - start);
+    }
+    qsort(samples, runs, sizeof(gdouble), compare_doubles);
+
+    gdouble median_us = samples[runs / 2];
+    printf("{\"bench\":\"%s\",\"n\":%u,\"runs\":%u,\"median_ms\":%.3f,\"ns_per_op\":%.1f}\n",
+           bench->name, session->n_windows, runs, median_us / 1000.0, median_us * 1000.0 / session->n_windows);
+    fflush(stdout);
+    g_free(samples);
+}
+
+int main(int argc, char **argv) 
+{
+    guint runs = MODEL_BENCH_DEFAULT_RUNS;
+    guint single_size = 0;
+    const gchar *filter = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (g_strcmp0(argv[i], "--runs") == 0 && i + 1 < argc)
+        {
+            runs = MAX(1, atoi(argv[++i]));
+        }
+        else if (g_strcmp0(argv[i], "--windows") == 0 && i + 1 < argc)
+        {
+            single_size = MAX(1, atoi(argv[++i]));
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    /* A small fake /proc keeps the desktop manager scan in the layout deterministic */
+    gchar *proc_root = proc_fixture_create(NULL, MODEL_BENCH_PROCESSES, proc_fixture_desktop_processes,
+                                           proc_fixture_n_desktop_processes);
+    if (!proc_root)
+    {
+        g_printerr("model-bench: could not create a process fixture\n");
+        return 1;
+    }
+    classlib_set_proc_root(proc_root);
+
+    const guint *sizes = single_size ? &single_size : default_sizes;
+    guint n_sizes = single_size ? 1 : G_N_ELEMENTS(default_sizes);
+
+    for (guint s = 0; s < n_sizes; s++)
+    {
+        ModelSession *session = session_new(sizes[s]);
+        for (guint b = 0; b < G_N_ELEMENTS(benches); b++)
+        {
+            if (filter && !strstr(benches[b].name, filter)) continue;
+            run_bench(&benches[b], session, runs);
+        }
+        session_free(session);
+    }
+
+    classlib_set_proc_root(NULL);
+    proc_fixture_remove(proc_root);
+    g_free(proc_root);
+    return 0;
+}
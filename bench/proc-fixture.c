@@ -0,0 +1,144 @@
+/* proc-fixture - synthetic /proc trees for benchmarking process scans
+ * See proc-fixture.h for the layout.
+ */
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include "proc-fixture.h"
+
+#define PROC_FIXTURE_FIRST_PID 300  /* Low pids belong to the kernel on real systems */
+
+const ProcFixtureProcess proc_fixture_desktop_processes[] =
+{
+    { "xfdesktop", "xfdesktop --sm-client-id 2a1b3c" },
+    { "nemo-desktop", "/usr/bin/nemo-desktop" },
+    { "caja", "caja -n --force-desktop" },
+    { "caja", "/usr/bin/caja /home/user/Documents" },  /* A window, not the desktop */
+};
+const guint proc_fixture_n_desktop_processes = G_N_ELEMENTS(proc_fixture_desktop_processes);
+
+/* Ordinary processes used to fill the rest of the table */
+static const ProcFixtureProcess filler_processes[] =
+{
+    { "bash", "-bash" },
+    { "sshd", "sshd: user@pts/0" },
+    { "xrdp", "/usr/sbin/xrdp --nodaemon" },
+    { "Xorg", "/usr/lib/xorg/Xorg :10 -auth .Xauthority -config xrdp/xorg.conf -noreset -nolisten tcp" },
+    { "xfce4-panel", "xfce4-panel --display :10.0 --sm-client-id 2f4c1e" },
+    { "thunar", "Thunar --daemon" },
+    { "firefox", "/usr/lib/firefox/firefox -contentproc -childID 3 -isForBrowser -prefsLen 31337 tab" },
+    { "kworker/0:1", "" },      /* Kernel threads have an empty cmdline */
+};
+
+static gboolean write_process(const gchar *root, guint pid, const ProcFixtureProcess *process) 
+{
+    gchar *pid_str = g_strdup_printf("%u", pid);
+    gchar *pid_dir = g_build_filename(root, pid_str, NULL);
+    gboolean ok = g_mkdir(pid_dir, 0755) == 0;
+
+    if (ok) 
+    {
+        /* /proc separates arguments with NUL and ends the last one with NUL too */
+        gsize cmdline_length = strlen(process->cmdline);
+        gchar *cmdline = g_strdup(process->cmdline);
+        g_strdelimit(cmdline, " ", '\0');
+
+        gchar *cmdline_path = g_build_filename(pid_dir, "cmdline", NULL);
+        ok = g_file_set_contents(cmdline_path, cmdline, cmdline_length ? (gssize)cmdline_length + 1 : 0, NULL);
+        g_free(cmdline_path);
+        g_free(cmdline);
+
+        gchar *comm = g_strdup_printf("%s\n", process->comm);
+        gchar *comm_path = g_build_filename(pid_dir, "comm", NULL);
+        ok = ok && g_file_set_contents(comm_path, comm, -1, NULL);
+        g_free(comm_path);
+        g_free(comm);
+    }
+
+    g_free(pid_dir);
+    g_free(pid_str);
+    return ok;
+}
+
+gchar *proc_fixture_create(const gchar *dir_path, guint n_processes,
+                           const ProcFixtureProcess *processes, guint n_listed) 
+{
+    gchar *root;
+
+    if (dir_path) 
+    {
+        if (g_mkdir_with_parents(dir_path, 0755) != 0) return NULL;
+        root = g_strdup(dir_path);
+    } 
+    else 
+    {
+        root = g_dir_make_tmp("proc-fixture-XXXXXX", NULL);
+        if (!root) return NULL;
+    }
+
+    /* Non-process entries a scanner must skip */
+    gchar *self_path = g_build_filename(root, "self", NULL);
+    gchar *sys_path = g_build_filename(root, "sys", NULL);
+    gchar *meminfo_path = g_build_filename(root, "meminfo", NULL);
+    g_mkdir(self_path, 0755);
+    g_mkdir(sys_path, 0755);
+    g_file_set_contents(meminfo_path, "MemTotal:       16318412 kB\n", -1, NULL);
+    g_free(meminfo_path);
+    g_free(sys_path);
+    g_free(self_path);
+
+    n_listed = MIN(n_listed, n_processes);
+    guint stride = n_listed ? n_processes / n_listed : 0;
+
+    for (guint i = 0; i < n_processes; i++) 
+    {
+        const ProcFixtureProcess *process = &filler_processes[i % G_N_ELEMENTS(filler_processes)];
+
+        if (stride && i % stride == stride / 2 && i / stride < n_listed) 
+        {
+            process = &processes[i / stride];
+        }
+
+        if (!write_process(root, PROC_FIXTURE_FIRST_PID + i, process)) 
+        {
+            g_printerr("proc-fixture: could not write process %u under %s\n", PROC_FIXTURE_FIRST_PID + i, root);
+            proc_fixture_remove(root);
+            g_free(root);
+            return NULL;
+        }
+    }
+    return root;
+}
+
+/* Remove a directory tree; fixtures are at most two levels deep */
+static void remove_tree(const gchar *path) 
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) 
+    {
+        const gchar *entry;
+        while ((entry = g_dir_read_name(dir)) != NULL) 
+        {
+            gchar *child = g_build_filename(path, entry, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) 
+            {
+                remove_tree(child);
+            } 
+            else 
+            {
+                g_remove(child);
+            }
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+void proc_fixture_remove(const gchar *root) 
+{
+    if (root && *root) 
+    {
+        remove_tree(root);
+    }
+}
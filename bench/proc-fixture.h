@@ -0,0 +1,35 @@
+/* proc-fixture - synthetic /proc trees for benchmarking process scans
+ *
+ * A fixture is a directory laid out like /proc: one numeric directory per
+ * process holding "cmdline" (NUL-separated arguments) and "comm", plus a few
+ * non-process entries such as "self" and "meminfo" so scanners have to skip
+ * them. Point classlib_set_proc_root() at it to use it in place of /proc.
+ */
+#ifndef PROC_FIXTURE_H
+#define PROC_FIXTURE_H
+
+#include <glib.h>
+
+typedef struct
+{
+    const gchar *comm;           /* Contents of comm, without the newline */
+    const gchar *cmdline;        /* Arguments separated by single spaces */
+} ProcFixtureProcess;
+
+/* xfdesktop, nemo-desktop, a desktop caja and an ordinary caja window */
+extern const ProcFixtureProcess proc_fixture_desktop_processes[];
+extern const guint proc_fixture_n_desktop_processes;
+
+/**
+ * Create a fixture with n_processes pids under dir_path, or under a new
+ * temporary directory when dir_path is NULL. The listed processes are spread
+ * evenly across the pid range and the rest are filled with ordinary session
+ * processes. Returns the fixture root, or NULL on failure.
+ */
+gchar *proc_fixture_create(const gchar *dir_path, guint n_processes,
+                           const ProcFixtureProcess *processes, guint n_listed);
+
+/* Delete a fixture created by proc_fixture_create() */
+void proc_fixture_remove(const gchar *root);
+
+#endif /* PROC_FIXTURE_H */
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Run bench/menu-bench inside a private Xvfb session with an EWMH window manager.
+#
+# Usage: bench/run-menu-bench.sh [menu-bench options] [WINDOWS...]
+#        bench/run-menu-bench.sh --sources [source-compare options] [WINDOWS]
+#
+# --sources runs bench/source-compare instead, comparing the XCB window
+# source with the wnck one.
+#
+# MENU_BENCH_WM picks the window manager (default: the first of xfwm4,
+# openbox, fluxbox and icewm that is installed); it must support at least two
+# workspaces. MENU_BENCH_DISPLAY picks the display number (default :87).
+
+set -eu
+
+here=$(cd "$(dirname "$0")" && pwd)
+program=menu-bench
+if [ "${1:-}" = "--sources" ]; then
+    program=source-compare
+    shift
+fi
+display=${MENU_BENCH_DISPLAY:-:87}
+
+if ! command -v Xvfb >/dev/null 2>&1; then
+    echo "run-menu-bench: Xvfb is not installed" >&2
+    exit 1
+fi
+
+wm=${MENU_BENCH_WM:-}
+if [ -z "$wm" ]; then
+    for candidate in xfwm4 openbox fluxbox icewm; do
+        if command -v "$candidate" >/dev/null 2>&1; then
+            wm=$candidate
+            break
+        fi
+    done
+fi
+if [ -z "$wm" ]; then
+    echo "run-menu-bench: no EWMH window manager found; set MENU_BENCH_WM" >&2
+    exit 1
+fi
+
+Xvfb "$display" -screen 0 1600x1200x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb_pid=$!
+wm_pid=
+cleanup() {
+    [ -n "$wm_pid" ] && kill "$wm_pid" 2>/dev/null || true
+    kill "$xvfb_pid" 2>/dev/null || true
+}
+trap cleanup EXIT INT TERM
+
+export DISPLAY="$display"
+# Wait for the server to accept connections
+tries=0
+until xdpyinfo >/dev/null 2>&1 || [ $tries -ge 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+
+# Some window managers (xfwm4) want a session bus for their settings
+if command -v dbus-run-session >/dev/null 2>&1 && [ -z "${DBUS_SESSION_BUS_ADDRESS:-}" ]; then
+    exec_wrapper="dbus-run-session --"
+else
+    exec_wrapper=
+fi
+
+$exec_wrapper "$wm" >/dev/null 2>&1 &
+wm_pid=$!
+
+# Wait for the window manager to claim the screen
+tries=0
+until xprop -root _NET_SUPPORTING_WM_CHECK 2>/dev/null | grep -q "window id" || [ $tries -ge 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+
+"$here/$program" --xclients "$here/xclients" "$@"
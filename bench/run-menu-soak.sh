@@ -0,0 +1,100 @@
+#!/bin/sh
+# Run bench/menu-soak, on a private Xvfb display when there is no DISPLAY.
+#
+# Usage: bench/run-menu-soak.sh [--massif | --alloc | --alloc-baseline] [menu-soak options]
+#
+# --massif runs the soak under valgrind's massif heap profiler instead, with
+# a shorter run (MENU_SOAK_MASSIF_BUILDS, default 2000). The profile is
+# written to bench/massif.out.PID; read it with ms_print.
+#
+# --alloc preloads bench/libfocus-alloc-shim.so for a short run
+# (MENU_SOAK_ALLOC_BUILDS, default 1000), writes the allocations made in each
+# phase of a menu build to bench/alloc-report.jsonl, and fails if any phase
+# is over its budget in bench/alloc-budget.txt, or if that file is missing.
+# --alloc-baseline does the same run and writes the budget file from it,
+# with 10% headroom.
+#
+# MENU_SOAK_DISPLAY picks the display number (default :88).
+
+set -eu
+
+here=$(cd "$(dirname "$0")" && pwd)
+
+mode=soak
+case "${1:-}" in
+    --massif|--alloc|--alloc-baseline)
+        mode=${1#--}
+        shift
+        ;;
+esac
+
+xvfb_pid=
+cleanup() {
+    [ -n "$xvfb_pid" ] && kill "$xvfb_pid" 2>/dev/null || true
+}
+trap cleanup EXIT INT TERM
+
+if [ -z "${DISPLAY:-}" ]; then
+    if ! command -v Xvfb >/dev/null 2>&1; then
+        echo "run-menu-soak: no DISPLAY and Xvfb is not installed" >&2
+        exit 1
+    fi
+    display=${MENU_SOAK_DISPLAY:-:88}
+    Xvfb "$display" -screen 0 1280x1024x24 -nolisten tcp >/dev/null 2>&1 &
+    xvfb_pid=$!
+    export DISPLAY="$display"
+
+    # Wait for the server to accept connections
+    tries=0
+    until xdpyinfo >/dev/null 2>&1 || [ $tries -ge 50 ]; do
+        sleep 0.1
+        tries=$((tries + 1))
+    done
+fi
+
+if [ "$mode" = massif ]; then
+    if ! command -v valgrind >/dev/null 2>&1; then
+        echo "run-menu-soak: valgrind is not installed" >&2
+        exit 1
+    fi
+    # Plain malloc for every GLib allocation, so massif sees each one
+    G_SLICE=always-malloc G_DEBUG=gc-friendly \
+        valgrind --tool=massif --massif-out-file="$here/massif.out.%p" \
+        "$here/menu-soak" --builds "${MENU_SOAK_MASSIF_BUILDS:-2000}" --interval 500 "$@"
+    echo "run-menu-soak: profile written to $here/massif.out.*; view it with ms_print" >&2
+elif [ "$mode" = alloc ] || [ "$mode" = alloc-baseline ]; then
+    report="$here/alloc-report.jsonl"
+    budget="$here/alloc-budget.txt"
+    # The memory limit is lifted; this run is about allocation counts only
+    FOCUS_MENU_ALLOC_REPORT="$report" G_SLICE=always-malloc LD_PRELOAD="$here/libfocus-alloc-shim.so" \
+        "$here/menu-soak" --builds "${MENU_SOAK_ALLOC_BUILDS:-1000}" --interval "${MENU_SOAK_ALLOC_BUILDS:-1000}" \
+        --limit-kb 1000000 "$@" >/dev/null
+    cat "$report"
+
+    # Per-build figures: "phase":"items" ... "allocs_per_entry":812.0,"bytes_per_entry":41250.0
+    extract='{ phase = $0; sub(/.*"phase":"/, "", phase); sub(/".*/, "", phase);
+               allocs = $0; sub(/.*"allocs_per_entry":/, "", allocs); sub(/,.*/, "", allocs);
+               bytes = $0; sub(/.*"bytes_per_entry":/, "", bytes); sub(/}.*/, "", bytes); }'
+
+    if [ "$mode" = alloc-baseline ]; then
+        {
+            echo "# Allocation budget per menu build, from bench/run-menu-soak.sh --alloc-baseline"
+            echo "# phase  allocations  bytes"
+            awk "$extract"' { printf "%-6s %d %d\n", phase, allocs * 1.1 + 1, bytes * 1.1 + 1 }' "$report"
+        } > "$budget"
+        echo "run-menu-soak: wrote $budget" >&2
+    elif [ -f "$budget" ]; then
+        awk "FNR == NR { if (\$0 !~ /^#/ && NF >= 3) { max_allocs[\$1] = \$2; max_bytes[\$1] = \$3 } next }
+             $extract"' phase in max_allocs {
+                 ok = allocs + 0 <= max_allocs[phase] && bytes + 0 <= max_bytes[phase]
+                 printf "%s %-6s %10.1f of %d allocations %12.1f of %d bytes\n", ok ? "ok  " : "OVER", phase, allocs, max_allocs[phase], bytes, max_bytes[phase]
+                 if (!ok) failed = 1
+             }
+             END { exit failed }' "$budget" "$report"
+    else
+        echo "run-menu-soak: no $budget to check against; run bench/run-menu-soak.sh --alloc-baseline and commit the file it writes" >&2
+        exit 1
+    fi
+else
+    "$here/menu-soak" "$@"
+fi
@@ -0,0 +1,311 @@
+/* source-compare - the XCB window source side by side with the wnck one
+ *
+ * Includes focus-menu.c, so the plugin's own wnck source, model and menu
+ * layout run, and links window-source-xcb.c. Against the same X session it
+ * opens each source in turn, builds the model and a menu layout on it, and
+ * prints what that cost, one JSON object per source:
+ *
+ *   {"source":"xcb","windows":500,"apps":100,"startup_ms":3.1,"model_ms":1.2,"layout_ms":0.4,"rss_kb":310,"heap_kb":220}
+ *
+ * startup_ms covers connecting and reading the whole session; rss_kb and
+ * heap_kb are what the source and model added to the process. A last line
+ * compares what the two sources report for every window:
+ *
+ *   {"compare":"fields","windows":500,"missing":0,"name":0,"type":0,"state":0,"workspace":0,"pid":0,"app":0}
+ *
+ * Usage: source-compare [--xclients PATH] [--wnck-first] [WINDOWS]
+ * With WINDOWS (default 500) the session is filled by bench/xclients first;
+ * 0 uses the session as it is. bench/run-menu-bench.sh --sources runs this
+ * under Xvfb with a window manager.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <sys/wait.h>
+
+#include "../focus-menu.c"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define SOURCE_COMPARE_HAVE_MALLINFO2 1
+#endif
+
+#define SOURCE_COMPARE_DEFAULT_WINDOWS 500
+#define SOURCE_COMPARE_WINDOWS_PER_APP 5
+#define SOURCE_COMPARE_WAIT_US (60 * G_USEC_PER_SEC)
+#define SOURCE_COMPARE_MAX_REPORTED 10    /* Mismatches described on stderr */
+
+/* One source, opened and measured */
+typedef struct
+{
+    const gchar *name;
+    FocusMenuWindowSource *source;
+    WnckHandle *handle;           /* wnck only */
+    FocusMenuPlugin *plugin;
+} SourceRun;
+
+/* ===== MEASUREMENT ===== */
+
+static gint64 read_rss_kb(void) 
+{
+    gchar *contents = NULL;
+    gint64 rss_kb = -1;
+
+    if (g_file_get_contents("/proc/self/statm", &contents, NULL, NULL))
+    {
+        unsigned long size_pages, resident_pages;
+        if (sscanf(contents, "%lu %lu", &size_pages, &resident_pages) == 2)
+            rss_kb = (gint64)resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+    g_free(contents);
+    return rss_kb;
+}
+
+static gint64 read_heap_kb(void) 
+{
+#ifdef SOURCE_COMPARE_HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return (gint64)(info.uordblks / 1024);
+#else
+    return -1;
+#endif
+}
+
+/* ===== SESSION ===== */
+
+/* Start xclients and read its "ready" line */
+static GPid spawn_clients(const gchar *xclients, guint n_windows) 
+{
+    gchar *apps = g_strdup_printf("%u", MAX(1, n_windows / SOURCE_COMPARE_WINDOWS_PER_APP));
+    gchar *windows = g_strdup_printf("%u", SOURCE_COMPARE_WINDOWS_PER_APP);
+    gchar *argv[] = { (gchar *)xclients, apps, windows, "20", "25", NULL };
+    GPid pid = 0;
+    gint out_fd = -1;
+    GError *error = NULL;
+
+    if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &out_fd, NULL, &error))
+    {
+        g_printerr("source-compare: could not start %s: %s\n", xclients, error->message);
+        g_error_free(error);
+        pid = 0;
+    }
+    else
+    {
+        GIOChannel *channel = g_io_channel_unix_new(out_fd);
+        gchar *line = NULL;
+        g_io_channel_read_line(channel, &line, NULL, NULL, NULL);
+        if (!line || !g_str_has_prefix(line, "ready"))
+        {
+            g_printerr("source-compare: %s did not start\n", xclients);
+        }
+        g_free(line);
+        g_io_channel_shutdown(channel, FALSE, NULL);
+        g_io_channel_unref(channel);
+    }
+
+    g_free(windows);
+    g_free(apps);
+    return pid;
+}
+
+/* Wait until the window manager lists the clients' windows */
+static void wait_for_windows(guint target) 
+{
+    FocusMenuWindowSource *source = focus_menu_xcb_source_new(NULL);
+    gint64 deadline = g_get_monotonic_time() + SOURCE_COMPARE_WAIT_US;
+
+    while (source && g_list_length(focus_menu_source_list_windows(source)) < target && g_get_monotonic_time() < deadline)
+    {
+        g_usleep(20 * 1000);
+        focus_menu_source_update(source);
+    }
+    focus_menu_source_free(source);
+}
+
+/* ===== SOURCES ===== */
+
+static FocusMenuPlugin *source_compare_plugin_new(FocusMenuWindowSource *source) 
+{
+    FocusMenuPlugin *plugin = g_new0(FocusMenuPlugin, 1);
+    plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    plugin->journal_op = BULK_OP_NONE;
+    plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
+    plugin->locale_type = classlib_detect_locale_type();
+    plugin->use_submenus = TRUE;
+    plugin->source = source;
+    return plugin;
+}
+
+static gboolean source_run_open(SourceRun *run) 
+{
+    gint64 rss_before = read_rss_kb();
+    gint64 heap_before = read_heap_kb();
+    gint64 start = g_get_monotonic_time();
+
+    if (g_strcmp0(run->name, "xcb") == 0)
+    {
+        run->source = focus_menu_xcb_source_new(NULL);
+    }
+    else
+    {
+        run->handle = wnck_handle_new(WNCK_CLIENT_TYPE_PAGER);
+        WnckScreen *screen = wnck_handle_get_default_screen(run->handle);
+        wnck_screen_force_update(screen);
+        run->source = focus_menu_wnck_source_new(screen);
+    }
+    if (!run->source)
+    {
+        g_printerr("source-compare: could not open the %s source\n", run->name);
+        return FALSE;
+    }
+    gint64 opened = g_get_monotonic_time();
+
+    run->plugin = source_compare_plugin_new(run->source);
+    run->plugin->model = focus_menu_model_new(run->source, CLASSLIB_SORT_STYLE_CAJA, run->plugin->locale_type);
+    gint64 modelled = g_get_monotonic_time();
+
+    FocusMenuLayout *layout = focus_menu_layout_build(run->plugin);
+    gint64 laid_out = g_get_monotonic_time();
+    guint n_rows = layout->app_rows->len;
+    focus_menu_layout_free(layout);
+
+    printf("{\"source\":\"%s\",\"windows\":%u,\"apps\":%u,\"startup_ms\":%.3f,\"model_ms\":%.3f,\"layout_ms\":%.3f,"
+           "\"rss_kb\":%" G_GINT64_FORMAT ",\"heap_kb\":%" G_GINT64_FORMAT "}\n",
+           run->name, g_list_length(focus_menu_source_list_windows(run->source)), n_rows,
+           (opened - start) / 1000.0, (modelled - opened) / 1000.0, (laid_out - modelled) / 1000.0,
+           read_rss_kb() - rss_before, heap_before >= 0 ? read_heap_kb() - heap_before : -1);
+    fflush(stdout);
+    return TRUE;
+}
+
+static void source_run_close(SourceRun *run) 
+{
+    if (run->plugin)
+    {
+        focus_menu_model_free(run->plugin->model);
+        g_hash_table_destroy(run->plugin->hidden_apps);
+        g_array_free(run->plugin->journal, TRUE);
+        focus_menu_build_arena_free(run->plugin->build_arena);
+        g_free(run->plugin);
+    }
+    focus_menu_source_free(run->source);
+    if (run->handle) g_object_unref(run->handle);
+}
+
+/* ===== COMPARISON ===== */
+
+static void report_mismatch(guint *reported, const gchar *field, gulong xid, const gchar *xcb_value, const gchar *wnck_value) 
+{
+    if ((*reported)++ >= SOURCE_COMPARE_MAX_REPORTED) return;
+    g_printerr("source-compare: window 0x%lx %s: xcb \"%s\", wnck \"%s\"\n", xid, field, xcb_value ? xcb_value : "", wnck_value ? wnck_value : "");
+}
+
+/* Every window the XCB source lists, checked against the wnck source's view of it */
+static void compare_sources(SourceRun *xcb, SourceRun *wnck) 
+{
+    GHashTable *wnck_windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+    guint n = 0, missing = 0, name = 0, type = 0, state = 0, workspace = 0, pid = 0, app = 0, reported = 0;
+
+    for (GList *l = focus_menu_source_list_windows(wnck->source); l; l = l->next)
+    {
+        g_hash_table_insert(wnck_windows, GSIZE_TO_POINTER(focus_menu_source_window_get_id(wnck->source, l->data)), l->data);
+    }
+
+    for (GList *l = focus_menu_source_list_windows(xcb->source); l; l = l->next, n++)
+    {
+        FocusMenuSourceWindow *x = l->data;
+        gulong xid = focus_menu_source_window_get_id(xcb->source, x);
+        FocusMenuSourceWindow *w = g_hash_table_lookup(wnck_windows, GSIZE_TO_POINTER(xid));
+        if (!w)
+        {
+            missing++;
+            report_mismatch(&reported, "missing", xid, "listed", "absent");
+            continue;
+        }
+
+        const gchar *x_name = focus_menu_source_window_get_name(xcb->source, x);
+        const gchar *w_name = focus_menu_source_window_get_name(wnck->source, w);
+        if (g_strcmp0(x_name, w_name) != 0)
+        {
+            name++;
+            report_mismatch(&reported, "name", xid, x_name, w_name);
+        }
+        if (focus_menu_source_window_get_type(xcb->source, x) != focus_menu_source_window_get_type(wnck->source, w)) type++;
+        if (focus_menu_source_window_get_state(xcb->source, x) != focus_menu_source_window_get_state(wnck->source, w)) state++;
+
+        FocusMenuSourceWorkspace *x_workspace = focus_menu_source_window_get_workspace(xcb->source, x);
+        FocusMenuSourceWorkspace *w_workspace = focus_menu_source_window_get_workspace(wnck->source, w);
+        if (focus_menu_source_workspace_get_number(xcb->source, x_workspace) != focus_menu_source_workspace_get_number(wnck->source, w_workspace)) workspace++;
+
+        FocusMenuSourceApp *x_app = focus_menu_source_window_get_app(xcb->source, x);
+        FocusMenuSourceApp *w_app = focus_menu_source_window_get_app(wnck->source, w);
+        if (focus_menu_source_app_get_pid(xcb->source, x_app) != focus_menu_source_app_get_pid(wnck->source, w_app)) pid++;
+
+        /* Applications match if their display names do; wnck and XCB name them from the same properties */
+        const gchar *x_app_name = source_app_get_display_name(xcb->source, x_app, x);
+        gchar *x_app_copy = g_strdup(x_app_name);
+        const gchar *w_app_name = source_app_get_display_name(wnck->source, w_app, w);
+        if (g_strcmp0(x_app_copy, w_app_name) != 0)
+        {
+            app++;
+            report_mismatch(&reported, "application", xid, x_app_copy, w_app_name);
+        }
+        g_free(x_app_copy);
+    }
+
+    printf("{\"compare\":\"fields\",\"windows\":%u,\"missing\":%u,\"name\":%u,\"type\":%u,\"state\":%u,\"workspace\":%u,\"pid\":%u,\"app\":%u}\n",
+           n, missing, name, type, state, workspace, pid, app);
+    fflush(stdout);
+    g_hash_table_destroy(wnck_windows);
+}
+
+int main(int argc, char **argv) 
+{
+    const gchar *xclients = "bench/xclients";
+    gboolean wnck_first = FALSE;
+    guint n_windows = SOURCE_COMPARE_DEFAULT_WINDOWS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (g_strcmp0(argv[i], "--xclients") == 0 && i + 1 < argc) xclients = argv[++i];
+        else if (g_strcmp0(argv[i], "--wnck-first") == 0) wnck_first = TRUE;
+        else n_windows = (guint)atoi(argv[i]);
+    }
+
+    if (!gtk_init_check(&argc, &argv))
+    {
+        g_printerr("source-compare: cannot open the display\n");
+        return 1;
+    }
+
+    GPid client = 0;
+    if (n_windows > 0)
+    {
+        client = spawn_clients(xclients, n_windows);
+        if (!client) return 1;
+        wait_for_windows(n_windows);
+    }
+
+    /* Whichever goes second finds shared libraries and GDK state already warm */
+    SourceRun runs[2] = { { .name = "xcb" }, { .name = "wnck" } };
+    SourceRun *order[2] = { &runs[0], &runs[1] };
+    if (wnck_first)
+    {
+        order[0] = &runs[1];
+        order[1] = &runs[0];
+    }
+
+    gboolean ok = source_run_open(order[0]) && source_run_open(order[1]);
+    if (ok) compare_sources(&runs[0], &runs[1]);
+
+    source_run_close(&runs[0]);
+    source_run_close(&runs[1]);
+
+    if (client)
+    {
+        kill(client, SIGTERM);
+        waitpid(client, NULL, 0);
+        g_spawn_close_pid(client);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/* xclients - populate an X session with synthetic application windows
+ *
+ * Usage: xclients APPS WINDOWS_PER_APP [MINIMIZED_PERCENT [OTHER_WORKSPACE_PERCENT]]
+ *
+ * Every application gets its own unmapped group leader, so libwnck sees
+ * APPS separate applications even though one process owns all the windows.
+ * Windows carry the properties an EWMH window manager and libwnck look at:
+ * WM_CLASS, WM_NAME/_NET_WM_NAME, _NET_WM_PID, WM_CLIENT_LEADER, the window
+ * type, an iconic initial state for minimized windows and _NET_WM_DESKTOP
+ * for windows placed on the second workspace.
+ *
+ * Prints "ready N" once all N windows are mapped, then idles until killed.
+ */
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Spread a percentage evenly over window indexes instead of clumping it at the start */
+static int pick(unsigned int index, int percent) 
+{
+    return (int)((index * 37u) % 100u) < percent;
+}
+
+static void set_cardinal(Display *display, Window window, Atom property, unsigned long value) 
+{
+    XChangeProperty(display, window, property, XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&value, 1);
+}
+
+static void set_title(Display *display, Window window, Atom net_wm_name, Atom utf8_string, const char *title) 
+{
+    XStoreName(display, window, title);
+    XChangeProperty(display, window, net_wm_name, utf8_string, 8, PropModeReplace, (const unsigned char *)title, (int)strlen(title));
+}
+
+int main(int argc, char **argv) 
+{
+    if (argc < 3) 
+    {
+        fprintf(stderr, "usage: %s APPS WINDOWS_PER_APP [MINIMIZED_PERCENT [OTHER_WORKSPACE_PERCENT]]\n", argv[0]);
+        return 2;
+    }
+
+    unsigned int n_apps = (unsigned int)atoi(argv[1]);
+    unsigned int n_windows = (unsigned int)atoi(argv[2]);
+    int minimized_percent = argc > 3 ? atoi(argv[3]) : 0;
+    int other_workspace_percent = argc > 4 ? atoi(argv[4]) : 0;
+
+    Display *display = XOpenDisplay(NULL);
+    if (!display) 
+    {
+        fprintf(stderr, "xclients: cannot open display\n");
+        return 1;
+    }
+
+    Window root = DefaultRootWindow(display);
+    unsigned long white = WhitePixel(display, DefaultScreen(display));
+    Atom utf8_string = XInternAtom(display, "UTF8_STRING", False);
+    Atom net_wm_name = XInternAtom(display, "_NET_WM_NAME", False);
+    Atom net_wm_pid = XInternAtom(display, "_NET_WM_PID", False);
+    Atom net_wm_desktop = XInternAtom(display, "_NET_WM_DESKTOP", False);
+    Atom net_wm_window_type = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
+    Atom window_type_normal = XInternAtom(display, "_NET_WM_WINDOW_TYPE_NORMAL", False);
+    Atom wm_client_leader = XInternAtom(display, "WM_CLIENT_LEADER", False);
+    unsigned long pid = (unsigned long)getpid();
+    unsigned int index = 0;
+
+    for (unsigned int a = 0; a < n_apps; a++) 
+    {
+        char res_name[64];
+        char res_class[64];
+        snprintf(res_name, sizeof(res_name), "bench-app-%u", a);
+        snprintf(res_class, sizeof(res_class), "Bench-app-%u", a);
+        XClassHint class_hint = { res_name, res_class };
+
+        /* The group leader is never mapped; it names the application */
+        Window leader = XCreateSimpleWindow(display, root, 0, 0, 1, 1, 0, 0, 0);
+        XSetClassHint(display, leader, &class_hint);
+        set_title(display, leader, net_wm_name, utf8_string, res_name);
+        set_cardinal(display, leader, net_wm_pid, pid);
+
+        for (unsigned int w = 0; w < n_windows; w++, index++) 
+        {
+            Window window = XCreateSimpleWindow(display, root, (int)(index % 40) * 20, (int)(index % 30) * 20, 320, 200, 0, 0, white);
+            char title[128];
+            snprintf(title, sizeof(title), "~/Documents/report-%u.txt - bench-app-%u", w, a);
+
+            set_title(display, window, net_wm_name, utf8_string, title);
+            XSetClassHint(display, window, &class_hint);
+            set_cardinal(display, window, net_wm_pid, pid);
+            XChangeProperty(display, window, wm_client_leader, XA_WINDOW, 32, PropModeReplace, (unsigned char *)&leader, 1);
+            XChangeProperty(display, window, net_wm_window_type, XA_ATOM, 32, PropModeReplace, (unsigned char *)&window_type_normal, 1);
+
+            XWMHints hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.flags = WindowGroupHint | StateHint | InputHint;
+            hints.window_group = leader;
+            hints.input = True;
+            hints.initial_state = pick(index, minimized_percent) ? IconicState : NormalState;
+            XSetWMHints(display, window, &hints);
+
+            if (pick(index * 7u + 3u, other_workspace_percent)) 
+            {
+                set_cardinal(display, window, net_wm_desktop, 1);
+            }
+
+            XMapWindow(display, window);
+        }
+    }
+
+    XSync(display, False);
+    printf("ready %u\n", index);
+    fflush(stdout);
+
+    /* Keep the windows alive until the driver kills us */
+    for (;;) 
+    {
+        XEvent event;
+        XNextEvent(display, &event);
+    }
+    return 0;
+}
@@ -0,0 +1,1642 @@
+/* classlib - toolkit-free helpers shared by the Focus Menu plugin
+ * See classlib.h for the overview.
+ */
+#include <glib.h>
+#include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <libxml/tree.h>
+#include "classlib.h"
+
+/* =============================================================================
+ * PROCESS TABLE
+ * Everything that reads /proc goes through the root set here, so a synthetic
+ * process table can stand in for the real one
+ * ============================================================================= */
+
+static gchar *proc_root = NULL;  /* NULL means "/proc" */
+
+static void process_class_cache_clear(void);
+
+/**
+ * Point process lookups at a different process table root.
+ * Pass NULL to go back to /proc.
+ */
+void classlib_set_proc_root(const gchar *root) 
+{
+    g_free(proc_root);
+    proc_root = (root && *root) ? g_strdup(root) : NULL;
+    process_class_cache_clear();
+}
+
+const gchar *classlib_get_proc_root(void) 
+{
+    return proc_root ? proc_root : "/proc";
+}
+
+/**
+ * Read the raw, NUL-separated command line of a process.
+ * Returns NULL if the process has gone away or has no command line.
+ */
+gchar *classlib_read_process_cmdline(pid_t pid, gsize *length) 
+{
+    gchar *pid_str = g_strdup_printf("%d", (int)pid);
+    gchar *cmdline_path = g_build_filename(classlib_get_proc_root(), pid_str, "cmdline", NULL);
+    gchar *cmdline = NULL;
+    gsize cmdline_length = 0;
+
+    if (!g_file_get_contents(cmdline_path, &cmdline, &cmdline_length, NULL) || cmdline_length == 0) 
+    {
+        g_free(cmdline);
+        cmdline = NULL;
+        cmdline_length = 0;
+    }
+
+    g_free(cmdline_path);
+    g_free(pid_str);
+    if (length) *length = cmdline_length;
+    return cmdline;
+}
+
+/**
+ * Check the raw command line for a whole argument, e.g. "--force-desktop".
+ * Arguments are NUL-separated, but processes that rewrite their title join
+ * them with spaces, so a space ends an argument too.
+ */
+gboolean classlib_cmdline_has_argument(const gchar *cmdline, gsize cmdline_length, const gchar *argument) 
+{
+    gsize argument_length = strlen(argument);
+    gsize start = 0;
+
+    if (!cmdline) 
+    {
+        return FALSE;
+    }
+
+    for (gsize i = 0; i <= cmdline_length; i++) 
+    {
+        if (i == cmdline_length || cmdline[i] == '\0' || cmdline[i] == ' ') 
+        {
+            if (i - start == argument_length && memcmp(&cmdline[start], argument, argument_length) == 0) 
+            {
+                return TRUE;
+            }
+            start = i + 1;
+        }
+    }
+    return FALSE;
+}
+
+/* Application display finder tools for PIDs */
+gchar *classlib_get_process_name_from_pid(pid_t pid) 
+{
+    gchar *cmdline = classlib_read_process_cmdline(pid, NULL);
+    gchar *result = NULL;
+
+    if (cmdline) 
+    {
+        /* Extract program name (first null-terminated string) */
+        result = g_path_get_basename(cmdline);
+        g_free(cmdline);
+    }
+
+    return result ? result : g_strdup("unknown");
+}
+
+/* =============================================================================
+ * PROCESS CLASSIFIER
+ * Which processes are desktop managers and which are file managers, decided
+ * in one place from one rule table. Verdicts are cached per pid, so the
+ * process scan, the menu and the sorting code all see the same answer
+ * ============================================================================= */
+
+/* One way a program can run. Rules for the same executable must be adjacent
+ * and the first rule whose arguments fit wins */
+typedef struct 
+{
+    const gchar *executable;     /* Basename of argv[0], lowercase */
+    const gchar *required[3];    /* Arguments that must all be present */
+    const gchar *forbidden[3];   /* Arguments that must all be absent */
+    ClassicProcessRole role;
+    ClassicSortStyle sort_style;
+    const gchar *display_name;
+} ProcessRule;
+
+static const ProcessRule process_rules[] = 
+{
+    { "xfdesktop", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER, CLASSLIB_SORT_STYLE_THUNAR, "Xfdesktop" },
+    { "nemo-desktop", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "Nemo" },
+    { "nautilus-desktop", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "Nautilus" },
+    /* caja -n --force-desktop draws the desktop; any other caja is a file manager window */
+    { "caja", { "--force-desktop", NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER, CLASSLIB_SORT_STYLE_CAJA, "Caja" },
+    { "caja", { "--desktop", NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER, CLASSLIB_SORT_STYLE_CAJA, "Caja" },
+    { "caja", { NULL }, { "--force-desktop", "--desktop", NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_CAJA, "Caja" },
+    { "pcmanfm", { "--desktop", NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "PCManFM" },
+    { "pcmanfm", { NULL }, { "--desktop", NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "PCManFM" },
+    { "thunar", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_THUNAR, "Thunar" },
+    { "nemo", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "Nemo" },
+    { "nautilus", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "Nautilus" },
+    { "dolphin", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "Dolphin" },
+    { "konqueror", { NULL }, { NULL }, CLASSLIB_PROCESS_ROLE_FILE_MANAGER, CLASSLIB_SORT_STYLE_UNKNOWN, "Konqueror" },
+};
+
+/* The rules for one executable */
+typedef struct 
+{
+    guint first_rule;
+    guint n_rules;
+    ClassicProcessRole roles;    /* Every role a process of this name can have */
+} ExecutableRules;
+
+static GHashTable *process_rule_index = NULL;  /* executable -> ExecutableRules*, built once */
+
+G_LOCK_DEFINE_STATIC(process_classes);
+static GHashTable *process_class_cache = NULL; /* pid -> GUINT_TO_POINTER(rule + 1), processes a rule matched */
+
+static GHashTable *get_process_rule_index(void) 
+{
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) 
+    {
+        GHashTable *index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+        for (guint i = 0; i < G_N_ELEMENTS(process_rules); i++) 
+        {
+            ExecutableRules *rules = g_hash_table_lookup(index, process_rules[i].executable);
+            if (!rules) 
+            {
+                rules = g_new0(ExecutableRules, 1);
+                rules->first_rule = i;
+                g_hash_table_insert(index, (gpointer)process_rules[i].executable, rules);
+            }
+            g_warn_if_fail(rules->first_rule + rules->n_rules == i);
+            rules->n_rules++;
+            rules->roles |= process_rules[i].role;
+        }
+        process_rule_index = index;
+        g_once_init_leave(&initialized, 1);
+    }
+    return process_rule_index;
+}
+
+/* Rules for a program name, ignoring case; NULL if there are none */
+static const ExecutableRules *lookup_executable_rules(const gchar *name) 
+{
+    gchar *lower = g_ascii_strdown(name, -1);
+    const ExecutableRules *rules = g_hash_table_lookup(get_process_rule_index(), lower);
+    g_free(lower);
+    return rules;
+}
+
+static void fill_process_class(guint rule_index, ClassicProcessClass *process_class) 
+{
+    const ProcessRule *rule = &process_rules[rule_index];
+    process_class->role = rule->role;
+    process_class->sort_style = rule->sort_style;
+    process_class->executable = rule->executable;
+    process_class->display_name = rule->display_name;
+}
+
+/* Index of the rule a command line matches, or -1 */
+static gint match_process_rule(const gchar *cmdline, gsize cmdline_length) 
+{
+    gchar *basename = g_path_get_basename(cmdline);
+    const ExecutableRules *rules = lookup_executable_rules(basename);
+
+    /* A rewritten title keeps its arguments in argv[0] */
+    gchar *space = strchr(basename, ' ');
+    if (!rules && space) 
+    {
+        *space = '\0';
+        rules = lookup_executable_rules(basename);
+    }
+    g_free(basename);
+
+    for (guint i = 0; rules && i < rules->n_rules; i++) 
+    {
+        const ProcessRule *rule = &process_rules[rules->first_rule + i];
+        gboolean fits = TRUE;
+
+        for (int r = 0; fits && rule->required[r]; r++) 
+        {
+            fits = classlib_cmdline_has_argument(cmdline, cmdline_length, rule->required[r]);
+        }
+        for (int f = 0; fits && rule->forbidden[f]; f++) 
+        {
+            fits = !classlib_cmdline_has_argument(cmdline, cmdline_length, rule->forbidden[f]);
+        }
+        if (fits) 
+        {
+            return (gint)(rules->first_rule + i);
+        }
+    }
+    return -1;
+}
+
+/* Drop every cached verdict, e.g. when the process table root changes */
+static void process_class_cache_clear(void) 
+{
+    G_LOCK(process_classes);
+    GHashTable *old_cache = process_class_cache;
+    process_class_cache = NULL;
+    G_UNLOCK(process_classes);
+
+    if (old_cache) g_hash_table_destroy(old_cache);
+}
+
+/**
+ * Classify a raw, NUL-separated command line against the rule table.
+ * Returns FALSE, with process_class set to CLASSLIB_PROCESS_ROLE_NONE,
+ * if no rule matches.
+ */
+gboolean classlib_classify_cmdline(const gchar *cmdline, gsize cmdline_length, ClassicProcessClass *process_class) 
+{
+    gint rule_index = cmdline ? match_process_rule(cmdline, cmdline_length) : -1;
+
+    if (rule_index < 0) 
+    {
+        process_class->role = CLASSLIB_PROCESS_ROLE_NONE;
+        process_class->sort_style = CLASSLIB_SORT_STYLE_UNKNOWN;
+        process_class->executable = NULL;
+        process_class->display_name = NULL;
+        return FALSE;
+    }
+
+    fill_process_class((guint)rule_index, process_class);
+    return TRUE;
+}
+
+/**
+ * Cached verdict for a process, without touching the process table.
+ * Returns FALSE if no scan or classification has matched the pid to a rule yet.
+ * Safe on any thread.
+ */
+gboolean classlib_lookup_process_class(pid_t pid, ClassicProcessClass *process_class) 
+{
+    G_LOCK(process_classes);
+    guint value = process_class_cache ? GPOINTER_TO_UINT(g_hash_table_lookup(process_class_cache, GINT_TO_POINTER(pid))) : 0;
+    G_UNLOCK(process_classes);
+
+    if (value == 0) 
+    {
+        return FALSE;
+    }
+
+    fill_process_class(value - 1, process_class);
+    return TRUE;
+}
+
+/**
+ * Classify a running process, reading its command line only if no verdict
+ * is cached. Returns FALSE if it matches no rule or has gone away.
+ */
+gboolean classlib_classify_process(pid_t pid, ClassicProcessClass *process_class) 
+{
+    if (classlib_lookup_process_class(pid, process_class)) 
+    {
+        return TRUE;
+    }
+
+    gsize cmdline_length = 0;
+    gchar *cmdline = classlib_read_process_cmdline(pid, &cmdline_length);
+    gint rule_index = cmdline ? match_process_rule(cmdline, cmdline_length) : -1;
+    g_free(cmdline);
+
+    if (rule_index < 0) 
+    {
+        return classlib_classify_cmdline(NULL, 0, process_class);
+    }
+
+    G_LOCK(process_classes);
+    if (!process_class_cache) 
+    {
+        process_class_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    g_hash_table_insert(process_class_cache, GINT_TO_POINTER(pid), GUINT_TO_POINTER((guint)rule_index + 1));
+    G_UNLOCK(process_classes);
+
+    fill_process_class((guint)rule_index, process_class);
+    return TRUE;
+}
+
+/**
+ * Every role a program of this name can have, without looking at a process.
+ * The name may be the executable, a window class such as "Caja", or a
+ * title such as "Caja - Home".
+ */
+ClassicProcessRole classlib_get_name_roles(const gchar *name) 
+{
+    if (!name || !*name) 
+    {
+        return CLASSLIB_PROCESS_ROLE_NONE;
+    }
+
+    const ExecutableRules *rules = lookup_executable_rules(name);
+    const gchar *space = strchr(name, ' ');
+    if (!rules && space) 
+    {
+        gchar *first_word = g_strndup(name, space - name);
+        rules = lookup_executable_rules(first_word);
+        g_free(first_word);
+    }
+    return rules ? rules->roles : CLASSLIB_PROCESS_ROLE_NONE;
+}
+
+/**
+ * Scan the process table for running desktop managers: every process the
+ * rule table classifies as one, such as xfdesktop, nemo-desktop, and caja
+ * started with --force-desktop.
+ * Returns a list of ClassicDesktopProcess; entries_scanned, if given,
+ * receives the number of pid entries examined. The verdicts for every
+ * process the rules matched are merged into the cache, and only processes
+ * whose /proc entry has gone lose theirs.
+ */
+GList *classlib_scan_desktop_managers(guint *entries_scanned) 
+{
+    GList *desktop_managers = NULL;
+    const gchar *proc_entry;
+    guint scanned = 0;
+
+    GDir *proc_dir = g_dir_open(classlib_get_proc_root(), 0, NULL);
+    if (!proc_dir) 
+    {
+        g_warning("Could not open %s directory", classlib_get_proc_root());
+        if (entries_scanned) *entries_scanned = 0;
+        return NULL;
+    }
+
+    GHashTable *verdicts = g_hash_table_new(g_direct_hash, g_direct_equal);
+    while ((proc_entry = g_dir_read_name(proc_dir)) != NULL) 
+    {
+        /* Skip non-numeric entries (not PIDs) */
+        if (!g_ascii_isdigit(proc_entry[0])) 
+        {
+            continue;
+        }
+        scanned++;
+
+        pid_t pid = (pid_t)atoi(proc_entry);
+        gsize cmdline_length = 0;
+        gchar *cmdline = classlib_read_process_cmdline(pid, &cmdline_length);
+        if (!cmdline) 
+        {
+            continue;
+        }
+
+        gint rule_index = match_process_rule(cmdline, cmdline_length);
+        g_free(cmdline);
+        if (rule_index < 0) 
+        {
+            continue;
+        }
+        g_hash_table_insert(verdicts, GINT_TO_POINTER(pid), GUINT_TO_POINTER((guint)rule_index + 1));
+
+        const ProcessRule *rule = &process_rules[rule_index];
+        if (rule->role & CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER) 
+        {
+            ClassicDesktopProcess *process = g_new0(ClassicDesktopProcess, 1);
+            process->pid = pid;
+            process->name = g_strdup(rule->executable);
+            process->display_name = g_strdup(rule->display_name);
+            process->sort_style = rule->sort_style;
+            desktop_managers = g_list_append(desktop_managers, process);
+        }
+    }
+    g_dir_close(proc_dir);
+
+    /* Merge rather than replace: classlib_classify_process() may have cached a
+     * process that started after the scan went past it */
+    GHashTableIter iter;
+    gpointer key, value;
+    GList *unseen = NULL;
+
+    G_LOCK(process_classes);
+    if (!process_class_cache) 
+    {
+        process_class_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    g_hash_table_iter_init(&iter, verdicts);
+    while (g_hash_table_iter_next(&iter, &key, &value)) 
+    {
+        g_hash_table_insert(process_class_cache, key, value);
+    }
+    g_hash_table_iter_init(&iter, process_class_cache);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) 
+    {
+        if (!g_hash_table_contains(verdicts, key)) unseen = g_list_prepend(unseen, key);
+    }
+    G_UNLOCK(process_classes);
+    g_hash_table_destroy(verdicts);
+
+    /* Pids the scan did not match keep their verdict while the process lives;
+     * the /proc checks happen outside the lock */
+    for (GList *l = unseen; l; l = l->next) 
+    {
+        gchar *pid_str = g_strdup_printf("%d", GPOINTER_TO_INT(l->data));
+        gchar *pid_path = g_build_filename(classlib_get_proc_root(), pid_str, NULL);
+        if (!g_file_test(pid_path, G_FILE_TEST_EXISTS)) 
+        {
+            G_LOCK(process_classes);
+            if (process_class_cache) g_hash_table_remove(process_class_cache, l->data);
+            G_UNLOCK(process_classes);
+        }
+        g_free(pid_path);
+        g_free(pid_str);
+    }
+    g_list_free(unseen);
+
+    if (entries_scanned) *entries_scanned = scanned;
+    return desktop_managers;
+}
+
+void classlib_desktop_process_free(ClassicDesktopProcess *process) 
+{
+    if (process) 
+    {
+        g_free(process->name);
+        g_free(process->display_name);
+        g_free(process);
+    }
+}
+
+gboolean classlib_looks_like_window_title(const gchar *name)
+{
+    return (strlen(name) > 20 ||           // Too long for app name
+    strstr(name, " — ") ||         // Contains document separator
+    strstr(name, " - ") ||         // Alternate separator
+    strchr(name, ':') ||           // Contains colons
+    strchr(name, '/'));            // Contains paths
+}
+
+/* =============================================================================
+ * APPLICATION NAME RESOLUTION SYSTEM
+ * 6-tier resolution system extracted from both working projects
+ * ============================================================================= */
+
+/**
+ * Validate that a string contains valid UTF-8 encoding.
+ * Returns a safe fallback if the input is invalid.
+ */
+const gchar *classlib_ensure_valid_utf8(const gchar *input) 
+{
+    if (!input) 
+    {
+        return "Invalid App Name";
+    }
+
+    if (g_utf8_validate(input, -1, NULL)) 
+    {
+        return input; /* Input is valid UTF-8 */
+    } 
+    else 
+    {
+        return "Invalid App Name"; /* Safe fallback for invalid UTF-8 */
+    }
+}
+
+/**
+ * Resolve the display name for an application name using 6-tier resolution.
+ *
+ * This is the core function that both projects rely on for consistent
+ * application naming. Extracted from macos9-menu.c get_app_display_name().
+ * The pid is only used by tier 0; pass 0 when it is not known.
+ */
+const gchar *classlib_resolve_display_name(const gchar *name, pid_t pid) 
+{
+    /* Handle applications with no name (like Python apps) */
+    if (!name || strlen(name) == 0) 
+    {
+        return "Untitled Program";
+    }
+
+    /* Validate the application name before processing */
+    name = classlib_ensure_valid_utf8(name);
+    if (g_strcmp0(name, "Invalid App Name") == 0) 
+    {
+        return name; /* Return the safe fallback */
+    }
+    /* =========================================================================
+     * TIER 0: Check if the name resembles a window title
+     * ========================================================================= */
+    /* TIER 0: PROCESS NAME FALLBACK - Handle window titles masquerading as app names */
+    if (classlib_looks_like_window_title(name)) 
+    {
+        if (pid > 0)
+        {
+            gchar *process_name = classlib_get_process_name_from_pid(pid);
+            if (process_name && strlen(process_name) > 0 && g_strcmp0(process_name, "unknown") != 0) 
+                {
+                /* Use process name instead and continue through existing tiers */
+                name = g_intern_string(process_name);
+            g_free(process_name);
+                } 
+                else 
+                {
+                    g_free(process_name);
+                }
+        }
+    }
+
+    /* =========================================================================
+     * TIER 1: MANUAL MAPPING (Highest Priority)
+     * Specific preferences and edge cases that need exact control
+     * ========================================================================= */
+
+    /* Using case-insensitive comparison for reliability */
+    if (g_ascii_strcasecmp(name, "Org.mozilla.firefox") == 0) 
+    {
+        return "Firefox";
+    } 
+    else if (g_ascii_strcasecmp(name, "google-chrome") == 0) 
+    {
+        return "Google Chrome";
+    }
+     else if (g_ascii_strcasecmp(name, "code") == 0) {
+        return "Visual Studio Code";
+    }
+    else if (g_ascii_strcasecmp(name, "gimp") == 0) {
+    return "GIMP";
+    }
+     else if (g_ascii_strcasecmp(name, "vlc") == 0 || g_ascii_strcasecmp(name, "VLC media player") == 0) 
+    {
+        return "VLC Media Player";
+    }
+    else if (g_ascii_strcasecmp(name, "xfce4-about") == 0) 
+    {
+        return "About Xfce";
+    } 
+    else if (g_ascii_strcasecmp(name, "xfce4-appfinder") == 0) 
+    {
+        return "App Finder";
+    } 
+    else if (g_str_has_prefix(name, "Soffice") || g_str_has_prefix(name, "soffice"))
+    {
+        return "LibreOffice";
+    } 
+    else if (g_str_has_suffix(name, "- Audacious")) 
+    {
+        return "Audacious";
+    }
+    else if (g_ascii_strcasecmp(name, "cherrytree") == 0) 
+    {
+        return "CherryTree";
+    }
+    /* =========================================================================
+        * TIER 2: XFCE SETTINGS PATTERN
+        * Handle Xfce4-*-settings applications with proper capitalization
+        * ========================================================================= */
+
+    if (g_str_has_prefix(name, "Xfce4-") && g_str_has_suffix(name, "-settings")) 
+    {
+        /* Extract the middle part and capitalize it */
+        const gchar *start = name + 6; /* Skip "Xfce4-" */
+        const gchar *end = g_strrstr(name, "-settings");
+        if (end && end > start) 
+        {
+            gsize len = end - start;
+            gchar *middle = g_strndup(start, len);
+            if (middle) 
+            {
+                /* Capitalize first letter */
+                if (middle[0] >= 'a' && middle[0] <= 'z') 
+                {
+                    middle[0] = middle[0] - 'a' + 'A';
+                }
+
+                /* Apply Tier 5 logic to handle dashes in the middle part */
+                if (strchr(middle, '-') != NULL) 
+                {
+                    /* Replace dashes with spaces and capitalize each word */
+                    for (int i = 0; middle[i]; i++) 
+                    {
+                        if (middle[i] == '-') 
+                        {
+                            middle[i] = ' ';
+                            /* Capitalize letter after space (if exists and is lowercase) */
+                            if (middle[i + 1] >= 'a' && middle[i + 1] <= 'z') 
+                            {
+                                middle[i + 1] = middle[i + 1] - 'a' + 'A';
+                            }
+                        }
+                    }
+                }
+                /* Use GLib intern string to avoid memory leaks */
+                const gchar *result = g_intern_string(middle);
+                g_free(middle);  /* Free our temporary string */
+                return result;   /* Return the interned version (managed by GLib) */
+            }
+        }
+    }
+
+    /* =========================================================================
+        * TIER 3: REVERSE DOMAIN PATTERN
+        * Handle org.*.* and Org.*.* applications
+        * ========================================================================= */
+
+    if (g_str_has_prefix(name, "org.") || g_str_has_prefix(name, "Org.")) 
+    {
+        /* Find the last dot to get the app name */
+        const gchar *last_dot = g_strrstr(name, ".");
+        if (last_dot) 
+        {
+            const gchar *app_name = last_dot + 1; /* Skip the dot */
+            if (strlen(app_name) > 0) 
+            {
+                /* Capitalize first letter only */
+                gchar *capitalized = g_strdup(app_name);
+                if (capitalized[0] >= 'a' && capitalized[0] <= 'z') 
+                {
+                    capitalized[0] = capitalized[0] - 'a' + 'A';
+                }
+
+                /* Apply Tier 5 logic if there are dashes */
+                if (strchr(capitalized, '-') != NULL) 
+                {
+                    for (int i = 0; capitalized[i]; i++) {
+                        if (capitalized[i] == '-') 
+                        {
+                            capitalized[i] = ' ';
+                            /* Capitalize letter after space */
+                            if (capitalized[i + 1] >= 'a' && capitalized[i + 1] <= 'z') 
+                            {
+                                capitalized[i + 1] = capitalized[i + 1] - 'a' + 'A';
+                            }
+                        }
+                    }
+                }
+                const gchar *result = g_intern_string(capitalized);
+                g_free(capitalized);
+                return result;
+            }
+        }
+    }
+
+    /* =========================================================================
+        * TIER 4: SIMPLE CAPITALIZATION
+        * Single lowercase words only - capitalize first letter
+        * ========================================================================= */
+
+    /* Check if it's a simple single word (no spaces, dots, dashes) */
+    if (!strchr(name, ' ') && !strchr(name, '.') && !strchr(name, '-')) 
+    {
+        /* Check if it's all lowercase */
+        gboolean is_lowercase = TRUE;
+        for (const gchar *p = name; *p; p++) 
+        {
+            if (*p >= 'A' && *p <= 'Z') 
+            {
+                is_lowercase = FALSE;
+                break;
+            }
+        }
+
+        if (is_lowercase && strlen(name) > 0) 
+        {
+            gchar *capitalized = g_strdup(name);
+            capitalized[0] = g_ascii_toupper(capitalized[0]);
+            const gchar *result = g_intern_string(capitalized);
+            g_free(capitalized);
+            return result;
+        }
+    }
+
+    /* =========================================================================
+        * TIER 5: DASH REPLACEMENT
+        * Any name with dashes - replace with spaces and capitalize each word
+        * ========================================================================= */
+
+    if (strchr(name, '-') != NULL) 
+    {
+        gchar *processed = g_strdup(name);
+
+        /* Replace dashes with spaces and capitalize each word */
+        for (int i = 0; processed[i]; i++) 
+        {
+            if (processed[i] == '-') 
+            {
+                processed[i] = ' ';
+                /* Capitalize letter after space (if exists and is lowercase) */
+                if (processed[i + 1] >= 'a' && processed[i + 1] <= 'z') 
+                {
+                    processed[i + 1] = processed[i + 1] - 'a' + 'A';
+                }
+            }
+        }
+
+        /* Also capitalize the first letter if it's lowercase */
+        if (processed[0] >= 'a' && processed[0] <= 'z') 
+        {
+            processed[0] = processed[0] - 'a' + 'A';
+        }
+
+        const gchar *result = g_intern_string(processed);
+        g_free(processed);
+        return result;
+    }
+
+    /* =========================================================================
+        * TIER 6: FALLBACK
+        * Return original name unchanged
+        * ========================================================================= */
+
+    return name;
+}
+
+/* =============================================================================
+ * FILE MANAGER DETECTION AND BLACKLISTING SYSTEM
+ * Extracted from switcher menu's file manager detection and spatial menu's blacklisting
+ * ============================================================================= */
+
+/**
+ * Check if a process name corresponds to a desktop manager.
+ * Without its arguments this can't tell a desktop caja from a window, so
+ * any program that can draw the desktop counts.
+ */
+gboolean classlib_is_desktop_manager(const gchar *process_name) 
+{
+    return (classlib_get_name_roles(process_name) & CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER) != 0;
+}
+
+/**
+ * Check if an application name belongs to a file manager.
+ * Desktop managers count too, as they are part of one.
+ */
+gboolean classlib_is_file_manager_name(const gchar *app_name) 
+{
+    return classlib_get_name_roles(app_name) != CLASSLIB_PROCESS_ROLE_NONE;
+}
+
+/**
+ * Check if an application should be blacklisted from recent document tracking.
+ * Extracted from spatial menu's is_blacklisted_application() function.
+ */
+/* Check if application should be blacklisted from recent documents */
+gboolean classlib_should_blacklist_application(xmlNode *bookmark_node) 
+{
+    /* Applications that primarily download/fetch files rather than edit documents */
+    const gchar *blacklisted_apps[] = 
+    {
+        "Firefox",
+        "firefox",
+        "Mozilla Firefox",
+        "Chrome",
+        "Chromium",
+        "Google Chrome",
+        "chromium",
+        "wget",
+        "curl",
+        "Thunderbird",
+        "thunderbird",
+        "Transmission",
+        "qBittorrent",
+        "aria2c",
+        "yt-dlp",
+        "youtube-dl",
+        NULL
+    };
+
+    /* Look for application metadata in the bookmark */
+    for (xmlNode *child = bookmark_node->children; child; child = child->next) 
+    {
+        if (child->type != XML_ELEMENT_NODE) 
+        {
+            continue;
+        }
+
+        /* Check for info/metadata structure */
+        if (xmlStrcmp(child->name, (const xmlChar *)"info") == 0) 
+        {
+            for (xmlNode *info_child = child->children; info_child; info_child = info_child->next) 
+            {
+                if (info_child->type != XML_ELEMENT_NODE) 
+                {
+                    continue;
+                }
+
+                /* Look for metadata with applications */
+                if (xmlStrcmp(info_child->name, (const xmlChar *)"metadata") == 0) 
+                {
+                    for (xmlNode *meta_child = info_child->children; meta_child; meta_child = meta_child->next) 
+                    {
+                        if (meta_child->type != XML_ELEMENT_NODE) 
+                        {
+                            continue;
+                        }
+
+                        /* Look for bookmark:applications */
+                        if (xmlStrcmp(meta_child->name, (const xmlChar *)"applications") == 0) 
+                        {
+                            for (xmlNode *app_child = meta_child->children; app_child; app_child = app_child->next) 
+                            {
+                                if (app_child->type != XML_ELEMENT_NODE) 
+                                {
+                                    continue;
+                                }
+
+                                /* Check bookmark:application elements */
+                                if (xmlStrcmp(app_child->name, (const xmlChar *)"application") == 0) 
+                                {
+                                    xmlChar *app_name = xmlGetProp(app_child, (const xmlChar *)"name");
+                                    if (app_name) 
+                                    {
+                                        /* Check against blacklist */
+                                        for (int i = 0; blacklisted_apps[i]; i++) 
+                                        {
+                                            if (g_ascii_strcasecmp((const gchar *)app_name, blacklisted_apps[i]) == 0) 
+                                            {
+                                                xmlFree(app_name);
+                                                return TRUE; /* Blacklisted */
+                                            }
+                                        }
+                                        xmlFree(app_name);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return FALSE; /* Not blacklisted */
+}
+
+/* Default directory handler, resolved from the mimeapps.list files the way
+ * xdg-mime does but without running it. The answer is cached until one of
+ * the watched directories changes. */
+G_LOCK_DEFINE_STATIC(default_file_manager_cache);
+static gboolean default_file_manager_valid = FALSE;
+static gchar *default_file_manager = NULL;     /* NULL if nothing was found */
+static GHashTable *default_file_manager_monitors = NULL;  /* Watched path -> GFileMonitor*, grown on each resolve */
+
+/* Lowercased XDG_CURRENT_DESKTOP entries, for $desktop-mimeapps.list */
+static gchar **current_desktop_names(void) 
+{
+    const gchar *current = g_getenv("XDG_CURRENT_DESKTOP");
+    gchar **names = g_strsplit(current ? current : "", ":", -1);
+    for (int i = 0; names[i]; i++) 
+    {
+        gchar *lower = g_ascii_strdown(names[i], -1);
+        g_free(names[i]);
+        names[i] = lower;
+    }
+    return names;
+}
+
+/* Directories holding mimeapps.list files, highest precedence first */
+static GPtrArray *mimeapps_directories(void) 
+{
+    GPtrArray *dirs = g_ptr_array_new_with_free_func(g_free);
+    const gchar * const *config_dirs = g_get_system_config_dirs();
+    const gchar * const *data_dirs = g_get_system_data_dirs();
+
+    g_ptr_array_add(dirs, g_strdup(g_get_user_config_dir()));
+    for (int i = 0; config_dirs[i]; i++) 
+    {
+        g_ptr_array_add(dirs, g_strdup(config_dirs[i]));
+    }
+    g_ptr_array_add(dirs, g_build_filename(g_get_user_data_dir(), "applications", NULL));
+    for (int i = 0; data_dirs[i]; i++) 
+    {
+        g_ptr_array_add(dirs, g_build_filename(data_dirs[i], "applications", NULL));
+    }
+    return dirs;
+}
+
+/* Whether a desktop file id names a file under dir. Files in subdirectories
+ * have the path's '/' turned into '-' in their id, so kde4-dolphin.desktop
+ * may be kde4/dolphin.desktop; each '-' with a matching directory is tried */
+static gboolean desktop_id_exists_in(const gchar *dir, const gchar *desktop_id) 
+{
+    gchar *path = g_build_filename(dir, desktop_id, NULL);
+    gboolean found = g_file_test(path, G_FILE_TEST_EXISTS);
+    g_free(path);
+
+    for (const gchar *dash = strchr(desktop_id, '-'); !found && dash; dash = strchr(dash + 1, '-')) 
+    {
+        if (dash == desktop_id) continue;
+
+        gchar *prefix = g_strndup(desktop_id, dash - desktop_id);
+        gchar *subdir = g_build_filename(dir, prefix, NULL);
+        if (g_file_test(subdir, G_FILE_TEST_IS_DIR)) 
+        {
+            found = desktop_id_exists_in(subdir, dash + 1);
+        }
+        g_free(subdir);
+        g_free(prefix);
+    }
+    return found;
+}
+
+/* Whether a desktop file id is installed in any applications directory */
+static gboolean desktop_id_is_installed(const gchar *desktop_id) 
+{
+    const gchar * const *data_dirs = g_get_system_data_dirs();
+    gchar *dir = g_build_filename(g_get_user_data_dir(), "applications", NULL);
+    gboolean found = desktop_id_exists_in(dir, desktop_id);
+    g_free(dir);
+
+    for (int i = 0; !found && data_dirs[i]; i++) 
+    {
+        dir = g_build_filename(data_dirs[i], "applications", NULL);
+        found = desktop_id_exists_in(dir, desktop_id);
+        g_free(dir);
+    }
+    return found;
+}
+
+/* First installed default for mime_type in one file, or NULL */
+static gchar *mimeapps_file_lookup(const gchar *path, const gchar *group, const gchar *mime_type) 
+{
+    GKeyFile *key_file = g_key_file_new();
+    gchar *result = NULL;
+
+    if (g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, NULL)) 
+    {
+        gchar **desktop_ids = g_key_file_get_string_list(key_file, group, mime_type, NULL, NULL);
+        for (int i = 0; desktop_ids && desktop_ids[i] && !result; i++) 
+        {
+            g_strstrip(desktop_ids[i]);
+            if (*desktop_ids[i] && desktop_id_is_installed(desktop_ids[i])) 
+            {
+                result = g_strdup(desktop_ids[i]);
+            }
+        }
+        g_strfreev(desktop_ids);
+    }
+    g_key_file_free(key_file);
+    return result;
+}
+
+/* Default application for mime_type as a desktop file id, following the
+ * XDG MIME Applications precedence: each directory in turn, desktop-specific
+ * lists before the generic one, then the legacy defaults.list */
+static gchar *resolve_default_application(const gchar *mime_type) 
+{
+    GPtrArray *dirs = mimeapps_directories();
+    gchar **desktops = current_desktop_names();
+    gchar *result = NULL;
+
+    for (guint d = 0; d < dirs->len && !result; d++) 
+    {
+        const gchar *dir = g_ptr_array_index(dirs, d);
+        for (int i = 0; desktops[i] && !result; i++) 
+        {
+            if (!*desktops[i]) continue;
+            gchar *file_name = g_strconcat(desktops[i], "-mimeapps.list", NULL);
+            gchar *path = g_build_filename(dir, file_name, NULL);
+            result = mimeapps_file_lookup(path, "Default Applications", mime_type);
+            g_free(path);
+            g_free(file_name);
+        }
+        if (!result) 
+        {
+            gchar *path = g_build_filename(dir, "mimeapps.list", NULL);
+            result = mimeapps_file_lookup(path, "Default Applications", mime_type);
+            g_free(path);
+        }
+    }
+
+    for (guint d = 0; d < dirs->len && !result; d++) 
+    {
+        gchar *path = g_build_filename(g_ptr_array_index(dirs, d), "defaults.list", NULL);
+        result = mimeapps_file_lookup(path, "Default Applications", mime_type);
+        g_free(path);
+    }
+
+    g_strfreev(desktops);
+    g_ptr_array_free(dirs, TRUE);
+    return result;
+}
+
+static void on_mimeapps_directory_changed(GFileMonitor *monitor G_GNUC_UNUSED, GFile *file G_GNUC_UNUSED,
+                                          GFile *other_file G_GNUC_UNUSED, GFileMonitorEvent event G_GNUC_UNUSED,
+                                          gpointer user_data G_GNUC_UNUSED) 
+{
+    classlib_invalidate_default_file_manager();
+}
+
+/* A missing directory's nearest existing ancestor only matters once
+ * something is created there; the next resolve then watches what appeared */
+static void on_mimeapps_ancestor_changed(GFileMonitor *monitor G_GNUC_UNUSED, GFile *file G_GNUC_UNUSED,
+                                         GFile *other_file G_GNUC_UNUSED, GFileMonitorEvent event,
+                                         gpointer user_data G_GNUC_UNUSED) 
+{
+    if (event == G_FILE_MONITOR_EVENT_CREATED) 
+    {
+        classlib_invalidate_default_file_manager();
+    }
+}
+
+static void watch_directory(const gchar *path, GCallback on_changed) 
+{
+    if (g_hash_table_contains(default_file_manager_monitors, path)) return;
+
+    GFile *dir = g_file_new_for_path(path);
+    GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE, NULL, NULL);
+    if (monitor) 
+    {
+        g_signal_connect(monitor, "changed", on_changed, NULL);
+        g_hash_table_insert(default_file_manager_monitors, g_strdup(path), monitor);
+    }
+    g_object_unref(dir);
+}
+
+/* Watch every directory a mimeapps.list or desktop file could appear in, and
+ * for those that do not exist yet, the nearest ancestor that does. Run on
+ * each resolve, so a directory created since the last one is picked up.
+ * Called with the lock held; events arrive in the calling thread's main context */
+static void watch_mimeapps_directories(void) 
+{
+    if (!default_file_manager_monitors) 
+    {
+        default_file_manager_monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    }
+
+    GPtrArray *dirs = mimeapps_directories();
+    GPtrArray *missing = g_ptr_array_new();
+    for (guint d = 0; d < dirs->len; d++) 
+    {
+        const gchar *path = g_ptr_array_index(dirs, d);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) 
+        {
+            watch_directory(path, G_CALLBACK(on_mimeapps_directory_changed));
+        }
+        else 
+        {
+            g_ptr_array_add(missing, (gpointer)path);
+        }
+    }
+
+    /* After the real directories, so one of them is never watched as a mere ancestor */
+    for (guint d = 0; d < missing->len; d++) 
+    {
+        gchar *ancestor = g_path_get_dirname(g_ptr_array_index(missing, d));
+        while (!g_file_test(ancestor, G_FILE_TEST_IS_DIR)) 
+        {
+            gchar *parent = g_path_get_dirname(ancestor);
+            gboolean at_root = strcmp(parent, ancestor) == 0;
+            g_free(ancestor);
+            ancestor = parent;
+            if (at_root) break;
+        }
+        watch_directory(ancestor, G_CALLBACK(on_mimeapps_ancestor_changed));
+        g_free(ancestor);
+    }
+    g_ptr_array_free(missing, TRUE);
+    g_ptr_array_free(dirs, TRUE);
+}
+
+/**
+ * Forget the cached default file manager; the next call resolves it again.
+ * The directory monitors call this whenever a mimeapps.list or desktop file changes.
+ */
+void classlib_invalidate_default_file_manager(void) 
+{
+    G_LOCK(default_file_manager_cache);
+    default_file_manager_valid = FALSE;
+    g_free(default_file_manager);
+    default_file_manager = NULL;
+    G_UNLOCK(default_file_manager_cache);
+}
+
+/**
+ * Get the default file manager for the system, e.g. "thunar".
+ * Reads the handler for inode/directory from the mimeapps.list files, as
+ * xdg-mime would, and falls back to the first known file manager on PATH.
+ */
+gchar *classlib_get_default_file_manager(void) 
+{
+    G_LOCK(default_file_manager_cache);
+    if (!default_file_manager_valid) 
+    {
+        watch_mimeapps_directories();
+
+        gchar *desktop_id = resolve_default_application("inode/directory");
+        if (desktop_id) 
+        {
+            /* Strip the .desktop extension */
+            if (g_str_has_suffix(desktop_id, ".desktop")) 
+            {
+                desktop_id[strlen(desktop_id) - 8] = '\0';
+            }
+            default_file_manager = desktop_id;
+        } 
+        else 
+        {
+            /* Fallback detection */
+            const gchar *fallback_managers[] = {"caja", "thunar", "nemo", "nautilus", NULL};
+            for (int i = 0; fallback_managers[i] && !default_file_manager; i++) 
+            {
+                gchar *path = g_find_program_in_path(fallback_managers[i]);
+                if (path) 
+                {
+                    g_free(path);
+                    default_file_manager = g_strdup(fallback_managers[i]);
+                }
+            }
+        }
+        default_file_manager_valid = TRUE;
+    }
+
+    gchar *result = g_strdup(default_file_manager);
+    G_UNLOCK(default_file_manager_cache);
+    return result;
+}
+
+/* =============================================================================
+ * NATURAL SORTING SYSTEM
+ * File manager aware string comparison extracted from switcher menu
+ * ============================================================================= */
+
+/**
+ * Detect the current system locale type for sorting purposes.
+ * Follows Linux locale hierarchy: LC_ALL -> LC_COLLATE -> LANG -> "C"
+ */
+ClassicLocaleType classlib_detect_locale_type(void) 
+{
+    const gchar *locale = NULL;
+
+    /* Follow the canonical hierarchy */
+    locale = getenv("LC_ALL");
+    if (!locale || !*locale) 
+    {
+        locale = getenv("LC_COLLATE");
+        if (!locale || !*locale) 
+        {
+            locale = getenv("LANG");
+            if (!locale || !*locale) 
+            {
+                locale = "C";  /* Final fallback */
+            }
+        }
+    }
+
+    /* Check if it's C locale */
+    if (g_strcmp0(locale, "C") == 0 || g_strcmp0(locale, "POSIX") == 0) 
+    {
+        return CLASSLIB_LOCALE_TYPE_C;
+    }
+
+    /* Everything else is treated as UTF-8 locale */
+    return CLASSLIB_LOCALE_TYPE_UTF8;
+}
+
+/**
+ * Get special character priority for different file managers.
+ * Extracted from switcher menu's get_special_char_priority().
+ */
+gint classlib_get_special_char_priority(const gchar *str, ClassicSortStyle sort_style) 
+{
+    if (!str || !*str) return 1;  /* Default priority for empty strings */
+    {
+        switch (sort_style) 
+        {
+            case CLASSLIB_SORT_STYLE_CAJA:
+            /* Caja: Both . and # files go to end */
+            if (str[0] == '.' || str[0] == '#') 
+            {
+                return 1;   /* Special files last */
+            } 
+            else 
+            {
+                return 0;   /* Normal files first */
+            }
+
+            case CLASSLIB_SORT_STYLE_THUNAR:
+            /* Thunar: Only . files get special treatment (go to beginning) */
+            if (str[0] == '.') 
+            {
+                return 0;   /* Hidden files first */
+            } 
+            else 
+            {
+                return 1;   /* Everything else (including #) second */
+            }
+
+            case CLASSLIB_SORT_STYLE_UNKNOWN:
+            default:
+            /* Default to Caja behavior */
+            if (str[0] == '.' || str[0] == '#') 
+            {
+                return 1;
+            } 
+            else 
+            {
+                return 0;
+            }
+        }
+    }
+}
+
+/**
+ * File manager aware string comparison.
+ * Extracted from switcher menu's file_manager_aware_compare().
+ */
+gint classlib_file_manager_aware_compare(const gchar *a, const gchar *b, ClassicSortStyle sort_style, ClassicLocaleType locale_type) 
+{
+    if (!a && !b) return 0;
+    if (!a) return -1;
+    if (!b) return 1;
+
+    /* Phase 1: Special character priority (different for each file manager) */
+    gint priority_a = classlib_get_special_char_priority(a, sort_style);
+    gint priority_b = classlib_get_special_char_priority(b, sort_style);
+
+    if (priority_a != priority_b) 
+    {
+        return priority_a - priority_b;
+    }
+
+    /* Phase 2: Locale-aware comparison */
+    if (sort_style == CLASSLIB_SORT_STYLE_CAJA && locale_type == CLASSLIB_LOCALE_TYPE_C) 
+    {
+        /* Only Caja falls back to C locale sorting */
+        return strcmp(a, b);
+    } 
+    else 
+    {
+        /* Thunar always uses UTF-8, Caja uses UTF-8 in UTF-8 locales */
+        gchar *key_a = g_utf8_collate_key_for_filename(a, -1);
+        gchar *key_b = g_utf8_collate_key_for_filename(b, -1);
+        gint result = strcmp(key_a, key_b);
+        g_free(key_a);
+        g_free(key_b);
+        return result;
+    }
+}
+
+/**
+ * Build a sort key that orders like classlib_file_manager_aware_compare().
+ * strcmp() on two keys agrees with comparing the strings, so a key can be
+ * computed once and reused for every sort.
+ */
+gchar *classlib_file_manager_aware_sort_key(const gchar *str, ClassicSortStyle sort_style, ClassicLocaleType locale_type) 
+{
+    if (!str) return g_strdup("");
+
+    /* Phase 1 becomes a leading priority digit */
+    gchar priority = classlib_get_special_char_priority(str, sort_style) ? '1' : '0';
+
+    /* Phase 2 matches the comparison: raw bytes for Caja in C locale, collation key otherwise */
+    if (sort_style == CLASSLIB_SORT_STYLE_CAJA && locale_type == CLASSLIB_LOCALE_TYPE_C) 
+    {
+        return g_strdup_printf("%c%s", priority, str);
+    }
+
+    gchar *collate_key = g_utf8_collate_key_for_filename(str, -1);
+    gchar *key = g_strdup_printf("%c%s", priority, collate_key);
+    g_free(collate_key);
+    return key;
+}
+/* =============================================================================
+ * DESKTOP FILE SEARCH SYSTEM
+ * Extracted from spatial menu's desktop file search logic
+ * ============================================================================= */
+
+/**
+ * Parse desktop file for display name and icon.
+ * Helper function for desktop file searching.
+ */
+static gboolean parse_desktop_file_for_search(const gchar *desktop_path, gchar **display_name, gchar **icon_name) 
+{
+    GKeyFile *key_file = g_key_file_new();
+    GError *error = NULL;
+
+    if (!g_key_file_load_from_file(key_file, desktop_path, G_KEY_FILE_NONE, &error)) 
+    {
+        g_key_file_free(key_file);
+        if (error) g_error_free(error);
+        return FALSE;
+    }
+
+    /* Get application name */
+    gchar *name = g_key_file_get_string(key_file, "Desktop Entry", "Name", NULL);
+    if (display_name) 
+    {
+        *display_name = name;
+    } 
+    else 
+    {
+        g_free(name);
+    }
+
+    /* Get icon name */
+    gchar *icon = g_key_file_get_string(key_file, "Desktop Entry", "Icon", NULL);
+    if (icon_name) 
+    {
+        *icon_name = icon;
+    } 
+    else 
+    {
+        g_free(icon);
+    }
+
+    g_key_file_free(key_file);
+    return TRUE;
+}
+
+/**
+ * Search a specific directory for desktop files matching an application name.
+ * Extracted from spatial menu's search_desktop_dir_for_app().
+ */
+gchar *classlib_search_desktop_directory(const gchar *dir_path, const gchar *app_name) 
+{
+    if (!dir_path || !app_name) 
+    {
+        return NULL;
+    }
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) 
+    {
+        return NULL;
+    }
+
+    struct dirent *entry;
+    gchar *result = NULL;
+
+    while ((entry = readdir(dir)) != NULL) 
+    {
+        if (!g_str_has_suffix(entry->d_name, ".desktop")) 
+        {
+            continue;
+        }
+
+        gchar *desktop_path = g_build_filename(dir_path, entry->d_name, NULL);
+        gchar *display_name = NULL;
+        gchar *icon_name = NULL;
+
+        if (parse_desktop_file_for_search(desktop_path, &display_name, &icon_name)) 
+        {
+            if (display_name && g_ascii_strcasecmp(display_name, app_name) == 0) 
+            {
+                result = g_strdup(desktop_path);
+                g_free(display_name);
+                g_free(icon_name);
+                g_free(desktop_path);
+                break;
+            }
+            g_free(display_name);
+            g_free(icon_name);
+        }
+        g_free(desktop_path);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+/*
+ * Helper function to assist classlib_find_desktop_file in retrieving executables' desktop files.
+ */
+static gchar *search_desktop_by_executable(const gchar *dir_path, const gchar *exe_name) 
+{
+    DIR *dir = opendir(dir_path);
+    if (!dir) return NULL;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) 
+    {
+        if (!g_str_has_suffix(entry->d_name, ".desktop")) continue;
+
+        gchar *desktop_path = g_build_filename(dir_path, entry->d_name, NULL);
+        GKeyFile *keyfile = g_key_file_new();
+
+        if (g_key_file_load_from_file(keyfile, desktop_path, G_KEY_FILE_NONE, NULL)) 
+        {
+            gchar *exec = g_key_file_get_string(keyfile, "Desktop Entry", "Exec", NULL);
+            if (exec && strstr(exec, exe_name)) 
+            {
+                g_free(exec);
+                g_key_file_free(keyfile);
+                closedir(dir);
+                return desktop_path;
+            }
+            g_free(exec);
+        }
+        g_key_file_free(keyfile);
+        g_free(desktop_path);
+    }
+    closedir(dir);
+    return NULL;
+}
+
+
+/**
+ * Find desktop file for an application by name.
+ * Extracted from spatial menu's find_desktop_file_for_application().
+ */
+gchar *classlib_find_desktop_file(const gchar *app_name, pid_t pid) 
+{
+    if (!app_name) return NULL;
+
+    const gchar *desktop_dirs[] = 
+    {
+        "/usr/share/applications",
+        "/usr/local/share/applications",
+        NULL
+    };
+
+    /* Try search variations */
+    gchar *search_names[4];
+    search_names[0] = g_strdup(app_name);
+    search_names[1] = g_ascii_strdown(app_name, -1);
+    search_names[2] = g_strdelimit(g_ascii_strdown(app_name, -1), " ", '-');
+    search_names[3] = NULL;
+
+    for (int i = 0; desktop_dirs[i]; i++) 
+    {
+        for (int j = 0; search_names[j]; j++) 
+        {
+            gchar *result = classlib_search_desktop_directory(desktop_dirs[i], search_names[j]);
+            if (result) 
+            {
+                for (int k = 0; k < 3; k++) g_free(search_names[k]);
+                return result;
+            }
+        }
+    }
+
+    for (int i = 0; i < 3; i++) g_free(search_names[i]);
+    /* Fallback: search by executable name */
+    if (pid > 0) 
+    {
+        gchar *exe_name = classlib_get_process_name_from_pid(pid);
+        if (exe_name && g_strcmp0(exe_name, "unknown") != 0) 
+        {
+            for (int i = 0; desktop_dirs[i]; i++) 
+            {
+                gchar *result = search_desktop_by_executable(desktop_dirs[i], exe_name);
+                if (result) 
+                {
+                    g_free(exe_name);
+                    return result;
+                }
+            }
+        }
+        g_free(exe_name);
+    }
+    return NULL;
+}
+/**
+* Natural string comparison with smart number handling.
+* Simplified version focusing on natural numeric ordering.
+*/
+gint classlib_natural_compare_strings(const gchar *a, const gchar *b) 
+{
+    if (!a && !b) return 0;
+    if (!a) return -1;
+    if (!b) return 1;
+
+    /* Use GLib's filename-aware collation which handles natural sorting */
+    gchar *key_a = g_utf8_collate_key_for_filename(a, -1);
+    gchar *key_b = g_utf8_collate_key_for_filename(b, -1);
+    gint result = strcmp(key_a, key_b);
+    g_free(key_a);
+    g_free(key_b);
+    return result;
+}
+
+/* =============================================================================
+ * WINDOW TITLE HELPERS
+ * Shared by menu labels and document-aware window sorting
+ * ============================================================================= */
+
+/* Helper function to remove application name suffixes from window titles */
+gchar *classlib_remove_app_name_suffix(const gchar *window_title, const gchar *app_name) 
+{
+    if (!window_title || !app_name) 
+    {
+        return g_strdup(window_title ? window_title : "");
+    }
+
+    gchar *title_copy = g_strdup(window_title);
+    gsize app_len = strlen(app_name);
+
+    /* Look for patterns like " — AppName" or " - AppName" at the end */
+    const gchar *patterns[] = 
+    {
+        " — ",  /* Em dash U+2014 (most common) */
+        " – ",  /* En dash U+2013 */
+        " - ",  /* Regular hyphen-minus U+002D */
+        " ― ",  /* Horizontal bar U+2015 */
+        " ‒ ",  /* Figure dash U+2012 */
+        " ⸺ ",  /* Two-em dash U+2E3A */
+        " ⸻ ",  /* Three-em dash U+2E3B */
+        "—",    /* Em dash without spaces */
+        "–",    /* En dash without spaces */
+        "-",    /* Hyphen without spaces */
+        NULL
+    };
+
+    for (int i = 0; patterns[i]; i++) 
+    {
+        gsize pattern_len = strlen(patterns[i]);
+
+        /* Find the pattern in the title */
+        gchar *pattern_pos = g_strrstr(title_copy, patterns[i]);
+        if (!pattern_pos) continue;
+
+        /* Check if this pattern is followed by something that ends with our app name */
+        gchar *after_pattern = pattern_pos + pattern_len;
+        gsize remaining_len = strlen(after_pattern);
+
+        /* Check for exact match with app name */
+        if (remaining_len == app_len && g_ascii_strcasecmp(after_pattern, app_name) == 0) 
+        {
+            *pattern_pos = '\0';  /* Remove from pattern onwards */
+            break;
+        }
+
+        /* Check if it ends with the app name (for cases like "Mozilla Firefox" when app_name is "Firefox") */
+        if (remaining_len >= app_len) 
+        {
+            gchar *potential_app = after_pattern + remaining_len - app_len;
+            if (g_ascii_strcasecmp(potential_app, app_name) == 0) 
+            {
+                /* Make sure there's a word boundary before the app name */
+                if (potential_app == after_pattern || *(potential_app - 1) == ' ') 
+                {
+                    *pattern_pos = '\0';  /* Remove from pattern onwards */
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Trim any trailing whitespace */
+    g_strstrip(title_copy);
+
+    /* If we ended up with an empty string, return a fallback */
+    if (strlen(title_copy) == 0) 
+    {
+        g_free(title_copy);
+        return g_strdup("Document");
+    }
+
+    return title_copy;
+}
+
+/* Return a newly allocated copy of input that is guaranteed to be valid UTF-8 */
+gchar *classlib_dup_valid_utf8(const gchar *input) 
+{
+    if (!input) 
+    {
+        return g_strdup("");
+    }
+
+    /* Check if string is already valid UTF-8 */
+    if (g_utf8_validate(input, -1, NULL)) 
+    {
+        return g_strdup(input);
+    }
+
+    /* If not valid, try to make it valid by escaping invalid sequences */
+    gchar *escaped = g_uri_escape_string(input, G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, TRUE);
+    if (escaped && g_utf8_validate(escaped, -1, NULL)) 
+    {
+        return escaped;
+    }
+
+    /* Last resort: return a safe fallback */
+    g_free(escaped);
+    return g_strdup("Invalid Window Name");
+}
+
+/* Extract document name for sorting from window titles */
+gchar *classlib_extract_document_name_for_sorting(const gchar *window_title) 
+{
+    if (!window_title) return g_strdup("");
+
+    /* First ensure the input is valid UTF-8 */
+    gchar *safe_title = classlib_dup_valid_utf8(window_title);
+
+    /* For windows like "~/path/filename - Application", extract just "filename" */
+    const gchar *last_slash = g_strrstr(safe_title, "/");
+    const gchar *app_separator = g_strrstr(safe_title, " - ");
+
+    gchar *filename_part;
+    if (last_slash) 
+    {
+        filename_part = g_strdup(last_slash + 1);  /* Skip the slash */
+    } 
+    else 
+    {
+        filename_part = g_strdup(safe_title);
+    }
+
+    /* Remove the application name suffix if present */
+    if (app_separator) 
+    {
+        gchar *separator_in_filename = g_strrstr(filename_part, " - ");
+        if (separator_in_filename) 
+        {
+            *separator_in_filename = '\0';  /* Truncate at the separator */
+        }
+    }
+
+    g_free(safe_title);
+    return filename_part;
+}
@@ -0,0 +1,97 @@
+/* classlib - toolkit-free helpers shared by the Focus Menu plugin
+ *
+ * Application naming, file manager detection, file-manager-aware sorting
+ * and desktop file lookup. Only GLib (with GIO, for file monitoring) and
+ * libxml2 are needed, so the same code is linked into the panel plugin and
+ * into the micro-benchmarks.
+ */
+#ifndef CLASSLIB_H
+#define CLASSLIB_H
+
+#include <glib.h>
+#include <sys/types.h>
+#include <libxml/tree.h>
+
+typedef enum 
+{
+    CLASSLIB_LOCALE_TYPE_C,      /* ASCII sorting */
+    CLASSLIB_LOCALE_TYPE_UTF8    /* Smart sorting that ignores special chars */
+} ClassicLocaleType;
+
+typedef enum 
+{
+    CLASSLIB_SORT_STYLE_CAJA,     /* Locale-aware, ignores special chars in UTF-8 */
+    CLASSLIB_SORT_STYLE_THUNAR,   /* Always uses natural sorting regardless of locale */
+    CLASSLIB_SORT_STYLE_UNKNOWN   /* Fallback to Caja behavior */
+} ClassicSortStyle;
+
+/* What a process is to the menu; a name can carry several */
+typedef enum 
+{
+    CLASSLIB_PROCESS_ROLE_NONE = 0,
+    CLASSLIB_PROCESS_ROLE_FILE_MANAGER = 1 << 0,
+    CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER = 1 << 1
+} ClassicProcessRole;
+
+/* The process classifier's verdict; the strings are static */
+typedef struct
+{
+    ClassicProcessRole role;
+    ClassicSortStyle sort_style;  /* Sorting that matches this program's own views */
+    const gchar *executable;      /* Rule's executable, e.g. "caja"; NULL if no rule matched */
+    const gchar *display_name;    /* Default display name, e.g. "Caja" */
+} ClassicProcessClass;
+
+/* A desktop manager process found in the process table */
+typedef struct
+{
+    pid_t pid;
+    gchar *name;                  /* Process basename, e.g. "caja" */
+    gchar *display_name;          /* Default display name, e.g. "Caja" */
+    ClassicSortStyle sort_style;
+} ClassicDesktopProcess;
+
+/* Process table - rooted at /proc unless classlib_set_proc_root() says otherwise */
+void classlib_set_proc_root(const gchar *root);
+const gchar *classlib_get_proc_root(void);
+gchar *classlib_read_process_cmdline(pid_t pid, gsize *length);
+gboolean classlib_cmdline_has_argument(const gchar *cmdline, gsize cmdline_length, const gchar *argument);
+gchar *classlib_get_process_name_from_pid(pid_t pid);
+
+/* Process classification - one rule table, verdicts cached per pid */
+gboolean classlib_classify_cmdline(const gchar *cmdline, gsize cmdline_length, ClassicProcessClass *process_class);
+gboolean classlib_lookup_process_class(pid_t pid, ClassicProcessClass *process_class);
+gboolean classlib_classify_process(pid_t pid, ClassicProcessClass *process_class);
+ClassicProcessRole classlib_get_name_roles(const gchar *name);
+GList *classlib_scan_desktop_managers(guint *entries_scanned);
+void classlib_desktop_process_free(ClassicDesktopProcess *process);
+
+/* Application naming */
+gboolean classlib_looks_like_window_title(const gchar *name);
+const gchar *classlib_ensure_valid_utf8(const gchar *input);
+const gchar *classlib_resolve_display_name(const gchar *name, pid_t pid);
+
+/* File manager detection and blacklisting */
+gboolean classlib_is_desktop_manager(const gchar *process_name);
+gboolean classlib_is_file_manager_name(const gchar *app_name);
+gboolean classlib_should_blacklist_application(xmlNode *bookmark_node);
+gchar *classlib_get_default_file_manager(void);
+void classlib_invalidate_default_file_manager(void);
+
+/* Sorting */
+ClassicLocaleType classlib_detect_locale_type(void);
+gint classlib_get_special_char_priority(const gchar *str, ClassicSortStyle sort_style);
+gint classlib_file_manager_aware_compare(const gchar *a, const gchar *b, ClassicSortStyle sort_style, ClassicLocaleType locale_type);
+gchar *classlib_file_manager_aware_sort_key(const gchar *str, ClassicSortStyle sort_style, ClassicLocaleType locale_type);
+gint classlib_natural_compare_strings(const gchar *a, const gchar *b);
+
+/* Desktop file lookup */
+gchar *classlib_search_desktop_directory(const gchar *dir_path, const gchar *app_name);
+gchar *classlib_find_desktop_file(const gchar *app_name, pid_t pid);
+
+/* Window title helpers - all return newly allocated strings */
+gchar *classlib_dup_valid_utf8(const gchar *input);
+gchar *classlib_remove_app_name_suffix(const gchar *window_title, const gchar *app_name);
+gchar *classlib_extract_document_name_for_sorting(const gchar *window_title);
+
+#endif /* CLASSLIB_H */
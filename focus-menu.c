@@ -1,10 +1,18 @@
 #include <gtk/gtk.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <libxfce4panel/libxfce4panel.h>
 #include <xfconf/xfconf.h>
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include "classlib.h"
+#include "window-source.h"
 /* Required to acknowledge libwnck API instability */
 // #define WNCK_I_KNOW_THIS_IS_UNSTABLE
 #include <libwnck/libwnck.h>
@@ -19,40 +27,192 @@
 #define PLUGIN_AUTHORS "James Gooch"
 #define CONFIG_CHANNEL "xfce4-panel"
 #define CONFIG_PROPERTY_BASE "/plugins/" PLUGIN_ID
+#define FOCUS_MENU_DBUS_NAME "org.xfce.FocusMenu"
+#define FOCUS_MENU_DBUS_PATH "/org/xfce/FocusMenu"
+#define FOCUS_MENU_DBUS_INTERFACE "org.xfce.FocusMenu"
+#define TRACE_BUFFER_EVENTS 4096  /* Spans held in memory between trace file writes */
+#define LATENCY_SUB_BUCKETS 4     /* Histogram buckets per doubling of latency */
+#define LATENCY_BUCKETS (32 * LATENCY_SUB_BUCKETS)
+#define FLIGHT_RECORDER_EVENTS 1024  /* Most recent events kept by the flight recorder */
+#define MEMORY_RELEASE_ICON_CAP 32   /* Scaled menu icons kept through an idle memory release */
+
+
+/* Bulk operations that can be undone */
+typedef enum
+{
+    BULK_OP_NONE,
+    BULK_OP_HIDE_OTHERS,
+    BULK_OP_SHOW_ALL
+} BulkOperation;
+
+/* One window changed by a bulk operation, with the state it had before */
+typedef struct
+{
+    gulong xid;
+    gint stack_position;     /* Index in the stacking order, bottom first */
+    gboolean was_minimized;
+} BulkJournalEntry;
+
+#ifdef DEBUG
+/* User actions whose X requests are counted in debug builds */
+typedef enum
+{
+    X_ACTION_MENU_OPEN,
+    X_ACTION_ACTIVATE_WINDOW,
+    X_ACTION_ACTIVATE_DESKTOP,
+    X_ACTION_HIDE_OTHERS,
+    X_ACTION_SHOW_ALL,
+    X_ACTION_COUNT
+} XAction;
+#endif
+
+/* What a flight recorder event's value means */
+typedef enum
+{
+    FLIGHT_WNCK_WINDOW,      /* Window signal; value is the XID */
+    FLIGHT_WNCK_APP,         /* Application signal; value is the PID */
+    FLIGHT_WNCK_SCREEN,      /* Screen signal; no value */
+    FLIGHT_MENU_BUILD,       /* Menu built; value is the duration in microseconds */
+    FLIGHT_PROC_SCAN,        /* /proc walked; value is the entries examined */
+    FLIGHT_WINDOW_OP,        /* Request sent to the window manager; value is the XID */
+    FLIGHT_MEMORY_RELEASE    /* Idle memory release; value is the resident kB it gave back */
+} FlightEventKind;
+
+/* One flight recorder entry */
+typedef struct
+{
+    gint64 time_us;          /* g_get_monotonic_time() */
+    FlightEventKind kind;
+    const char *what;        /* String literal, never freed */
+    gint64 value;
+} FlightEvent;
+
+/* Process-wide work counters shown in the Diagnostics section */
+typedef struct
+{
+    guint64 proc_entries_scanned;    /* /proc/<pid> entries examined by scans */
+    guint64 display_name_hits;       /* Name refreshes that left the cached display name as it was */
+    guint64 display_name_misses;     /* Name refreshes that changed it, re-keying the sort */
+    guint64 icon_scales;             /* Pixbufs scaled to menu or button size */
+} PerfCounters;
 
-/* CLASSIC LIBRARY DEFINES */
+static PerfCounters perf_counters;
 
-gchar *classlib_get_process_name_from_pid(pid_t pid);
-const gchar *classlib_get_application_display_name(WnckApplication *app);
-gboolean classlib_looks_like_window_title(const gchar *name);
-const gchar *classlib_get_application_display_name(WnckApplication *app);
-const gchar *classlib_ensure_valid_utf8(const gchar *input);
-gboolean classlib_is_file_manager(WnckApplication *app);
-gboolean classlib_should_blacklist_application(xmlNode *bookmark_node);
-gchar *classlib_get_default_file_manager(void);
-gboolean classlib_is_desktop_manager(const gchar *process_name);
+/* One completed trace span */
+typedef struct
+{
+    const char *name;        /* String literal, never freed */
+    gint64 start_us;         /* g_get_monotonic_time() at the start */
+    gint64 duration_us;
+} TraceEvent;
 
-typedef enum 
+/* Window source events being written to a file, for replaying later */
+typedef struct
+{
+    FILE *file;
+    gint64 start_us;                           /* g_get_monotonic_time() when recording began */
+    FocusMenuWindowSource *source;
+    const FocusMenuSourceListener *listener;   /* The listener events are passed on to */
+    gpointer listener_data;
+    guint64 events;
+} EventRecorder;
+
+/* Scratch memory for one menu build, emptied in one step when the build ends */
+typedef struct
 {
-    CLASSLIB_LOCALE_TYPE_C,      /* ASCII sorting */
-    CLASSLIB_LOCALE_TYPE_UTF8    /* Smart sorting that ignores special chars */
-} ClassicLocaleType;
+    GString *scratch;            /* Labels GTK copies as soon as it gets them */
+    GPtrArray *window_records;   /* Every submenu's FocusMenuWindowRecord*, back to back */
+    PangoAttrList *italic;       /* Shared by every minimized window's label; kept across builds */
+} FocusMenuBuildArena;
+
+/* Process table lookups run on a worker thread; see PROCESS WORKER */
+typedef struct _ProcessWorker ProcessWorker;
 
-typedef enum 
+/* Window tracking shared by every instance in one panel process; see SHARED BACKEND */
+typedef struct _FocusMenuBackend FocusMenuBackend;
+
+/* Click-to-paint latencies, with the session size seen in each bucket */
+typedef struct
 {
-    CLASSLIB_SORT_STYLE_CAJA,     /* Locale-aware, ignores special chars in UTF-8 */
-    CLASSLIB_SORT_STYLE_THUNAR,   /* Always uses natural sorting regardless of locale */
-    CLASSLIB_SORT_STYLE_UNKNOWN   /* Fallback to Caja behavior */
-} ClassicSortStyle;
+    guint32 counts[LATENCY_BUCKETS];
+    guint64 window_sums[LATENCY_BUCKETS];  /* Tracked windows, summed over the bucket's samples */
+    guint64 app_sums[LATENCY_BUCKETS];     /* Tracked applications, likewise */
+    guint32 total;
+} LatencyHistogram;
 
-gint classlib_file_manager_aware_compare(const gchar *a, const gchar *b, ClassicSortStyle sort_style, ClassicLocaleType locale_type);
-gint classlib_get_special_char_priority(const gchar *str, ClassicSortStyle sort_style);
-ClassicLocaleType classlib_detect_locale_type(void);
-gint classlib_natural_compare_strings(const gchar *a, const gchar *b);
-gchar *classlib_find_desktop_file(const gchar *app_name, WnckApplication *app);
-gchar *classlib_search_desktop_directory(const gchar *dir_path, const gchar *app_name);
+/* Model record for one application */
+typedef struct _FocusMenuAppRecord FocusMenuAppRecord;
 
-/* END CLASS LIBRARY DEFINES*/
+/* Model record for one window, with everything the menu needs precomputed */
+typedef struct
+{
+    FocusMenuSourceWindow *window;
+    FocusMenuAppRecord *app_record;
+    FocusMenuSourceWorkspace *workspace;
+    gchar *menu_label;           /* Submenu label: cleaned, truncated title */
+    gchar *sort_key;             /* Sort key for the document part of the title */
+    gboolean is_normal;          /* FOCUS_MENU_SOURCE_WINDOW_NORMAL */
+    gboolean is_desktop_type;    /* FOCUS_MENU_SOURCE_WINDOW_DESKTOP */
+    gboolean is_desktop_named;   /* Titled "Desktop" - protected from hiding */
+    gboolean is_minimized;
+    gboolean was_minimized;      /* is_minimized before the latest refresh, for listeners */
+    gboolean is_pinned;          /* On every workspace */
+    gboolean in_menu;            /* Listed in the menu for the active workspace */
+    gboolean hideable_visible;   /* On screen and could be hidden */
+} FocusMenuWindowRecord;
+
+struct _FocusMenuAppRecord
+{
+    FocusMenuSourceApp *app;
+    pid_t pid;
+    gchar *display_name;         /* source_app_get_display_name(), kept current */
+    gchar *sort_key;             /* Sort key for display_name */
+    GdkPixbuf *menu_icon;        /* Menu-sized icon, scaled on first use */
+    GList *windows;              /* FocusMenuWindowRecord*, in opening order */
+    gint n_menu_windows;         /* Windows with in_menu set */
+    gint n_hideable_visible;     /* Windows with hideable_visible set */
+};
+
+/* Changes the model reports to its listener */
+typedef enum
+{
+    MODEL_APPLICATION_ADDED,
+    MODEL_APPLICATION_REMOVED,
+    MODEL_APPLICATION_CHANGED,       /* Display name changed */
+    MODEL_WINDOW_ADDED,
+    MODEL_WINDOW_REMOVED,
+    MODEL_WINDOW_CHANGED,            /* Title, state, type or workspace changed */
+    MODEL_ACTIVE_WINDOW_CHANGED,
+    MODEL_ACTIVE_WORKSPACE_CHANGED
+} FocusMenuModelChange;
+
+typedef struct _FocusMenuModel FocusMenuModel;
+
+/* object is the FocusMenuSourceApp* or FocusMenuSourceWindow* the change is
+ * about (the new active window, possibly NULL; NULL for the workspace), and
+ * id its source id, or 0 (XIDs with wnck) */
+typedef void (*FocusMenuModelNotify)(FocusMenuModel *model, FocusMenuModelChange change, gpointer object, gulong id, gpointer user_data);
+
+/* Live window/application model, updated per event rather than per click */
+struct _FocusMenuModel
+{
+    FocusMenuWindowSource *source;   /* Not owned; the model is its listener */
+    GHashTable *apps;            /* FocusMenuSourceApp* -> FocusMenuAppRecord* */
+    GHashTable *windows;         /* FocusMenuSourceWindow* -> FocusMenuWindowRecord* */
+    GHashTable *windows_by_id;   /* Source window id -> FocusMenuWindowRecord*, for undo and the bus */
+    GHashTable *apps_by_pid;     /* pid -> GList* of FocusMenuAppRecord*, oldest first */
+    GHashTable *desktop_windows; /* pid -> FocusMenuWindowRecord* that stands for the desktop */
+    GList *sorted_apps;          /* FocusMenuAppRecord* in display order */
+    gboolean sorted_apps_dirty;
+    FocusMenuSourceWindow *active_window;
+    FocusMenuSourceWorkspace *active_workspace;
+    gint n_minimized;            /* Minimized windows listed in the menu */
+    gint n_hideable_visible;     /* Sum of every app's n_hideable_visible */
+    ClassicSortStyle sort_style;
+    ClassicLocaleType locale_type;
+    FocusMenuModelNotify notify;     /* Optional change listener */
+    gpointer notify_data;
+};
 
 typedef struct 
 {
@@ -61,11 +221,66 @@ typedef struct
     GtkWidget *label;
     GtkWidget *icon;
     GtkWidget *menu;
-    WnckHandle *handle;
-    WnckScreen *screen;
-    WnckWindow *active_window;
+    FocusMenuBackend *backend;        /* Shared with the other instances in this panel process */
+    FocusMenuWindowSource *source;    /* Windows as the model and menu commands see them; source, model, recorder and process_worker are the backend's */
+    FocusMenuModel *model;
     GSList *radio_group;  /* Radio group for native GTK radio menu items */
     gboolean menu_construction_mode;  /* Flag to ignore signals during menu creation */
+    GHashTable *hidden_apps;  /* FocusMenuSourceApp* -> HiddenAppRecord*, one entry per hidden application */
+
+    /* Undo journal for the last Hide Others / Show All */
+    BulkOperation journal_op;
+    GArray *journal;           /* BulkJournalEntry, one per window the operation changed */
+    gulong journal_active_xid; /* Window that had focus when the operation ran */
+
+    /* Coalesced button updates */
+    guint update_idle_id;             /* Pending update callback, 0 if none */
+    FocusMenuSourceApp *displayed_app;  /* Application the button currently shows */
+    GdkPixbuf *displayed_icon;        /* Model's scaled icon the button shows (referenced) */
+    gchar *displayed_label;
+#ifdef DEBUG
+    guint screen_events;              /* Screen events received */
+    guint button_updates;             /* Updates actually run */
+    gulong x_requests[X_ACTION_COUNT];  /* X requests the last run of each action sent */
+    guint x_request_overruns;         /* Actions that sent more than their cap */
+#endif
+
+    /* Trace-event spans; trace_events is NULL while tracing is off */
+    TraceEvent *trace_events;
+    guint trace_count;
+    gchar *trace_path;
+    gboolean trace_file_started;
+    guint trace_flush_idle_id;
+
+    /* Window source event recording; NULL unless FOCUS_MENU_RECORD is set */
+    EventRecorder *recorder;
+
+    /* Desktop manager scans off the main thread; NULL means scan synchronously */
+    ProcessWorker *process_worker;
+
+    /* Click-to-paint latency */
+    LatencyHistogram latency;
+    gint64 press_time_us;             /* When the last button press arrived */
+    GdkFrameClock *latency_clock;     /* Menu frame clock awaiting its first paint (referenced) */
+    gulong latency_handler_id;
+
+    /* Scratch memory for menu builds; created by the first one */
+    FocusMenuBuildArena *build_arena;
+
+    /* Idle memory release; memory_idle_seconds 0 keeps everything between clicks */
+    guint memory_idle_seconds;
+    guint memory_idle_id;             /* Pending release after the menu closed, 0 if none */
+    guint memory_releases;
+    gint64 memory_rss_before_kb;      /* Around the last release; -1 if unreadable */
+    gint64 memory_rss_after_kb;
+    gboolean popup_after_release;     /* The next popup is built from scratch */
+    guint released_popups;            /* Popups that followed a release, and their click-to-paint total */
+    gint64 released_latency_total_us;
+
+    /* Menu build statistics for the Diagnostics section */
+    guint menu_builds;
+    gint64 build_time_total_us;
+    gint64 build_time_worst_us;
 
     /* Configuration properties */
     XfconfChannel *channel;
@@ -76,7 +291,6 @@ typedef struct
 
     /* Sorting configuration */
     ClassicLocaleType locale_type;
-    ClassicSortStyle sort_style;
 } FocusMenuPlugin;
 
 /* Structure to hold desktop manager info when no windows are detected */
@@ -88,121 +302,182 @@ typedef struct
     gboolean is_active;
 } DesktopManagerInfo;
 
+/* Hidden-state record for an application (Classic-style Hide) */
+typedef struct
+{
+    FocusMenuSourceApp *app;
+    GList *hidden_windows;  /* FocusMenuSourceWindow* the plugin minimized itself; empty if hidden externally */
+} HiddenAppRecord;
+
+/* Menu row for a desktop manager that has no menu windows of its own */
+typedef struct
+{
+    DesktopManagerInfo *info;
+    FocusMenuAppRecord *app_record;  /* For the icon; NULL if it has no windows at all */
+} FocusMenuDesktopRow;
+
+/* Menu row for an application */
+typedef struct
+{
+    FocusMenuAppRecord *app_record;
+    gboolean is_active;
+    guint first_window;              /* Sorted submenu entries: a range of the layout's window_records */
+    guint n_windows;                 /* 0 for a flat row */
+} FocusMenuAppRow;
+
+/* Everything the menu shows, worked out before any widget is created */
+typedef struct
+{
+    FocusMenuAppRecord *current_record;  /* Application of the active window */
+    gboolean current_is_desktop_manager;
+    gboolean has_other_hideable;
+    gboolean has_minimized_windows;
+    GList *desktop_managers;             /* DesktopManagerInfo*, owned */
+    GArray *desktop_rows;                /* FocusMenuDesktopRow */
+    GArray *app_rows;                    /* FocusMenuAppRow, in display order */
+    GPtrArray *window_records;           /* The build arena's; emptied by focus_menu_layout_free() */
+    FocusMenuBuildArena *arena;
+} FocusMenuLayout;
+
 static void update_button_display(FocusMenuPlugin *plugin);
+static void queue_button_update(FocusMenuPlugin *plugin);
 static void create_menu(FocusMenuPlugin *plugin);
-static void on_active_window_changed(WnckScreen *screen, WnckWindow *previous, FocusMenuPlugin *plugin);
-static void on_window_opened(WnckScreen *screen, WnckWindow *window, FocusMenuPlugin *plugin);
-static void on_window_closed(WnckScreen *screen, WnckWindow *window, FocusMenuPlugin *plugin);
+static void focus_menu_on_model_changed(FocusMenuModel *model, FocusMenuModelChange change, gpointer object, gulong id, gpointer user_data);
 static void focus_menu_free(XfcePanelPlugin *plugin);
 static gboolean focus_menu_remote_event(XfcePanelPlugin *plugin, const gchar *name, const GValue *value);
 static DesktopManagerInfo *desktop_manager_info_copy(const DesktopManagerInfo *src);
 static void hide_current_application(GtkMenuItem *item, FocusMenuPlugin *plugin);
-static void show_all_app_windows(GtkMenuItem *item, WnckApplication *app);
-static void activate_single_window(GtkMenuItem *item, WnckWindow *window);
+static void hide_application(FocusMenuPlugin *plugin, FocusMenuAppRecord *record);
+static void show_application(FocusMenuPlugin *plugin, FocusMenuAppRecord *record, guint32 timestamp);
+static void activate_window(FocusMenuPlugin *plugin, FocusMenuSourceWindow *window, guint32 timestamp);
+static guint32 focus_menu_get_timestamp(FocusMenuPlugin *plugin);
+static void show_all_app_windows(GtkMenuItem *item, FocusMenuSourceApp *app);
+static void activate_single_window(GtkMenuItem *item, FocusMenuSourceWindow *window);
 static void on_submenus_toggled(GtkToggleButton *button, FocusMenuPlugin *plugin);
-static void create_flat_app_menu_item(WnckApplication *app, GList *app_window_list, gboolean is_active_app, FocusMenuPlugin *plugin);
-static void create_app_submenu_with_show_all(WnckApplication *app, GList *app_window_list, gboolean is_active_app, FocusMenuPlugin *plugin);
+static void create_flat_app_menu_item(FocusMenuAppRecord *app_record, gboolean is_active_app, FocusMenuPlugin *plugin);
+static void create_app_submenu_with_show_all(FocusMenuAppRecord *app_record, FocusMenuWindowRecord **window_records, guint n_windows, gboolean is_active_app, FocusMenuPlugin *plugin);
+
+/* Window/application model functions */
+static FocusMenuModel *focus_menu_model_new(FocusMenuWindowSource *source, ClassicSortStyle sort_style, ClassicLocaleType locale_type);
+static void focus_menu_model_free(FocusMenuModel *model);
+static void focus_menu_model_set_notify(FocusMenuModel *model, FocusMenuModelNotify notify, gpointer user_data);
+static FocusMenuAppRecord *focus_menu_model_get_app(FocusMenuModel *model, FocusMenuSourceApp *app);
+static FocusMenuAppRecord *focus_menu_model_find_app_by_pid(FocusMenuModel *model, pid_t pid);
+static FocusMenuAppRecord *focus_menu_model_find_app_by_id(FocusMenuModel *model, gulong id);
+static FocusMenuWindowRecord *focus_menu_model_find_window_by_id(FocusMenuModel *model, gulong id);
+static GList *focus_menu_model_list_apps_by_pid(FocusMenuModel *model, pid_t pid);
+static FocusMenuWindowRecord *focus_menu_model_find_desktop_window(FocusMenuModel *model, pid_t pid);
+static FocusMenuAppRecord *focus_menu_model_get_active_app(FocusMenuModel *model);
+static void focus_menu_model_set_sort_style(FocusMenuModel *model, ClassicSortStyle sort_style);
+static GList *focus_menu_model_get_sorted_apps(FocusMenuModel *model);
+static guint focus_menu_app_record_append_menu_windows(FocusMenuAppRecord *record, GPtrArray *window_records);
+static GdkPixbuf *focus_menu_app_record_get_menu_icon(FocusMenuModel *model, FocusMenuAppRecord *record);
+static guint focus_menu_model_trim_icons(FocusMenuModel *model, guint keep);
+
+/* Menu layout functions */
+static FocusMenuBuildArena *focus_menu_build_arena_get(FocusMenuPlugin *plugin);
+static void focus_menu_build_arena_free(FocusMenuBuildArena *arena);
+static FocusMenuLayout *focus_menu_layout_build(FocusMenuPlugin *plugin);
+static void focus_menu_layout_free(FocusMenuLayout *layout);
+
+/* Hidden-state registry functions */
+static void hidden_app_record_free(HiddenAppRecord *record);
+static gboolean app_is_hidden(FocusMenuPlugin *plugin, FocusMenuSourceApp *app);
+static void hidden_registry_record(FocusMenuPlugin *plugin, FocusMenuAppRecord *record, GList *hidden_windows);
+static void hidden_registry_seed(FocusMenuPlugin *plugin);
+
+/* Bulk operation journal functions */
+static void bulk_journal_begin(FocusMenuPlugin *plugin, BulkOperation op);
+static void bulk_journal_add(FocusMenuPlugin *plugin, FocusMenuSourceWindow *window, gint stack_position);
+static void undo_bulk_operation(GtkMenuItem *item, FocusMenuPlugin *plugin);
+
+/* Flight recorder functions */
+static void flight_record(FlightEventKind kind, const char *what, gint64 value);
+static gchar *flight_recorder_dump(void);
+
+/* wnck window source */
+static FocusMenuWindowSource *focus_menu_wnck_source_new(WnckScreen *screen);
+
+/* Event recorder functions */
+static EventRecorder *event_recorder_start(FocusMenuWindowSource *source, const gchar *path);
+static void event_recorder_note_menu(EventRecorder *recorder);
+static void event_recorder_stop(EventRecorder *recorder);
+
+/* Process worker functions */
+static ProcessWorker *process_worker_new(FocusMenuModel *model);
+static void process_worker_request_scan(ProcessWorker *worker);
+static void process_worker_request_classify(ProcessWorker *worker, pid_t pid);
+static GList *process_worker_get_desktop_processes(ProcessWorker *worker);
+static void process_worker_close(ProcessWorker *worker);
+
+/* Shared backend functions */
+static void focus_menu_backend_acquire(FocusMenuPlugin *plugin);
+static void focus_menu_backend_release(FocusMenuPlugin *plugin);
+
+/* Trace-event functions */
+static void trace_init(FocusMenuPlugin *plugin);
+static gint64 trace_begin(FocusMenuPlugin *plugin);
+static void trace_end(FocusMenuPlugin *plugin, const char *name, gint64 start_us);
+static void trace_flush(FocusMenuPlugin *plugin);
+static void trace_shutdown(FocusMenuPlugin *plugin);
+static void on_menu_deactivate(GtkMenuShell *menu, FocusMenuPlugin *plugin);
+
+/* Allocation phase functions */
+static const char *alloc_phase(const char *phase);
+
+#ifdef DEBUG
+/* X request accounting functions */
+static gulong x_requests_begin(void);
+static gulong x_action_cap(XAction action, guint n_windows);
+static void x_requests_end(FocusMenuPlugin *plugin, XAction action, gulong start, guint n_windows);
+#endif
+
+/* Popup latency functions */
+static gint64 latency_histogram_percentile(const LatencyHistogram *histogram, guint percentile);
+static void latency_cancel(FocusMenuPlugin *plugin);
+static void latency_watch_menu(FocusMenuPlugin *plugin);
+
+/* Idle memory release functions */
+static void memory_release(FocusMenuPlugin *plugin);
+static void memory_release_schedule(FocusMenuPlugin *plugin);
+static void memory_release_cancel(FocusMenuPlugin *plugin);
+
+/* D-Bus service functions */
+static void dbus_emit_model_change(FocusMenuBackend *backend, FocusMenuModelChange change, gulong id);
+static void dbus_service_start(FocusMenuBackend *backend);
+static void dbus_service_stop(FocusMenuBackend *backend);
 
 /* Configuration functions */
 static void focus_menu_configure_plugin(XfcePanelPlugin *panel, FocusMenuPlugin *plugin);
 static void focus_menu_about(XfcePanelPlugin *panel);
 static void on_icon_only_toggled(GtkToggleButton *button, FocusMenuPlugin *plugin);
 static void on_checkmarks_toggled(GtkToggleButton *button, FocusMenuPlugin *plugin);
+static void on_dump_flight_recorder_clicked(GtkButton *button, GtkLabel *label);
+static GtkWidget *diagnostics_page_new(FocusMenuPlugin *plugin);
 static void focus_menu_load_settings(FocusMenuPlugin *plugin);
 static void focus_menu_save_settings(FocusMenuPlugin *plugin);
 static gchar *focus_menu_get_property_name(FocusMenuPlugin *plugin, const gchar *property);
 static void focus_menu_apply_icon_only_mode(FocusMenuPlugin *plugin);
 
 /* Sorting functions */
-static ClassicSortStyle determine_sort_style(WnckScreen *screen);
-static gint compare_apps_by_display_name_with_data(gconstpointer a, gconstpointer b, gpointer user_data);
-static gint compare_windows_by_name_with_data(gconstpointer a, gconstpointer b, gpointer user_data);
-static gchar *extract_document_name_for_sorting(const gchar *window_title);
-
-/* OPEN CLASSIC LIBRARY*/
-/* Application display finder tools for PIDs */
-gchar *classlib_get_process_name_from_pid(pid_t pid) 
-{
-    gchar *cmdline_path = g_strdup_printf("/proc/%d/cmdline", pid);
-    gchar *cmdline = NULL;
-    gsize cmdline_length = 0;
-    gchar *result = NULL;
-
-    if (g_file_get_contents(cmdline_path, &cmdline, &cmdline_length, NULL)) 
-    {
-        if (cmdline_length > 0) 
-        {
-            /* Extract program name (first null-terminated string) */
-            gchar *program_name = g_strdup(cmdline);
-            result = g_path_get_basename(program_name);
-            g_free(program_name);
-        }
-        g_free(cmdline);
-    }
-
-    g_free(cmdline_path);
-    return result ? result : g_strdup("unknown");
-}
-
-gboolean classlib_looks_like_window_title(const gchar *name)
-{
-    return (strlen(name) > 20 ||           // Too long for app name
-    strstr(name, " — ") ||         // Contains document separator
-    strstr(name, " - ") ||         // Alternate separator
-    strchr(name, ':') ||           // Contains colons
-    strchr(name, '/'));            // Contains paths
-}
-
-/* =============================================================================
- * APPLICATION NAME RESOLUTION SYSTEM
- * 6-tier resolution system extracted from both working projects
- * ============================================================================= */
-
-/**
- * Validate that a string contains valid UTF-8 encoding.
- * Returns a safe fallback if the input is invalid.
- */
-const gchar *classlib_ensure_valid_utf8(const gchar *input) 
-{
-    if (!input) 
-    {
-        return "Invalid App Name";
-    }
+static ClassicSortStyle sort_style_for_desktop_processes(GList *processes);
+static ClassicSortStyle determine_sort_style(FocusMenuWindowSource *source);
 
-    if (g_utf8_validate(input, -1, NULL)) 
-    {
-        return input; /* Input is valid UTF-8 */
-    } 
-    else 
-    {
-        return "Invalid App Name"; /* Safe fallback for invalid UTF-8 */
-    }
-}
 
 /**
- * Get the proper display name for a WnckApplication using 6-tier resolution.
- *
- * This is the core function that both projects rely on for consistent
- * application naming. Extracted from macos9-menu.c get_app_display_name().
+ * Display name for a source application: its name through the classlib tiers,
+ * or the title of first_window (may be NULL) when it has no name at all.
  */
-const gchar *classlib_get_application_display_name(WnckApplication *app) 
+static const gchar *source_app_get_display_name(FocusMenuWindowSource *source, FocusMenuSourceApp *app, FocusMenuSourceWindow *first_window) 
 {
-    if (!app) 
-    {
-        return "Untitled Program";
-    }
-
-    const gchar *name = wnck_application_get_name(app);
+    const gchar *name = focus_menu_source_app_get_name(source, app);
 
     /* Handle applications with no name (like Python apps) */
     if (!name || strlen(name) == 0) 
     {
-        /* Try to get name from first window as fallback */
-        GList *windows = wnck_application_get_windows(app);
-        if (windows) 
+        if (first_window) 
         {
-            WnckWindow *first_window = WNCK_WINDOW(windows->data);
-            const gchar *window_name = wnck_window_get_name(first_window);
+            const gchar *window_name = focus_menu_source_window_get_name(source, first_window);
             if (window_name && strlen(window_name) > 0) 
             {
                 /* Validate UTF-8 before returning */
@@ -213,1342 +488,2465 @@ const gchar *classlib_get_application_display_name(WnckApplication *app)
         return "Untitled Program";
     }
 
-    /* Validate the application name before processing */
-    name = classlib_ensure_valid_utf8(name);
-    if (g_strcmp0(name, "Invalid App Name") == 0) 
-    {
-        return name; /* Return the safe fallback */
-    }
-    /* =========================================================================
-     * TIER 0: Check if the name resembles a window title
-     * ========================================================================= */
-    /* TIER 0: PROCESS NAME FALLBACK - Handle window titles masquerading as app names */
-    if (classlib_looks_like_window_title(name)) 
-    {
-        pid_t pid = wnck_application_get_pid(app);
-        if (pid > 0)
-        {
-            gchar *process_name = classlib_get_process_name_from_pid(pid);
-            if (process_name && strlen(process_name) > 0 && g_strcmp0(process_name, "unknown") != 0) 
-                {
-                /* Use process name instead and continue through existing tiers */
-                name = g_intern_string(process_name);
-            g_free(process_name);
-                } 
-                else 
-                {
-                    g_free(process_name);
-                }
-        }
-    }
+    return classlib_resolve_display_name(name, focus_menu_source_app_get_pid(source, app));
+}
 
-    /* =========================================================================
-     * TIER 1: MANUAL MAPPING (Highest Priority)
-     * Specific preferences and edge cases that need exact control
-     * ========================================================================= */
+/* Scan /proc for desktop managers on the calling thread, counting the entries read */
+static GList *scan_desktop_processes(void) 
+{
+    guint entries_scanned = 0;
+    GList *processes = classlib_scan_desktop_managers(&entries_scanned);
 
-    /* Using case-insensitive comparison for reliability */
-    if (g_ascii_strcasecmp(name, "Org.mozilla.firefox") == 0) 
-    {
-        return "Firefox";
-    } 
-    else if (g_ascii_strcasecmp(name, "google-chrome") == 0) 
-    {
-        return "Google Chrome";
-    }
-     else if (g_ascii_strcasecmp(name, "code") == 0) {
-        return "Visual Studio Code";
-    }
-    else if (g_ascii_strcasecmp(name, "gimp") == 0) {
-    return "GIMP";
-    }
-     else if (g_ascii_strcasecmp(name, "vlc") == 0 || g_ascii_strcasecmp(name, "VLC media player") == 0) 
-    {
-        return "VLC Media Player";
-    }
-    else if (g_ascii_strcasecmp(name, "xfce4-about") == 0) 
-    {
-        return "About Xfce";
-    } 
-    else if (g_ascii_strcasecmp(name, "xfce4-appfinder") == 0) 
-    {
-        return "App Finder";
-    } 
-    else if (g_str_has_prefix(name, "Soffice") || g_str_has_prefix(name, "soffice"))
-    {
-        return "LibreOffice";
-    } 
-    else if (g_str_has_suffix(name, "- Audacious")) 
-    {
-        return "Audacious";
-    }
-    else if (g_ascii_strcasecmp(name, "cherrytree") == 0) 
-    {
-        return "CherryTree";
-    }
-    /* =========================================================================
-        * TIER 2: XFCE SETTINGS PATTERN
-        * Handle Xfce4-*-settings applications with proper capitalization
-        * ========================================================================= */
+    flight_record(FLIGHT_PROC_SCAN, "desktop-managers", entries_scanned);
+    perf_counters.proc_entries_scanned += entries_scanned;
+    return processes;
+}
+
+/* Enhanced find_all_desktop_managers that includes proper display names and icons.
+ * processes is a list of ClassicDesktopProcess, from a scan; it is not modified.
+ * The model is kept current by the source's events, so nothing is resynced first */
+static GList *find_all_desktop_managers(FocusMenuModel *model, GList *processes) 
+{
+    GList *desktop_managers = NULL;
+    FocusMenuAppRecord *active_record = focus_menu_model_get_active_app(model);
 
-    if (g_str_has_prefix(name, "Xfce4-") && g_str_has_suffix(name, "-settings")) 
+    for (GList *l = processes; l; l = l->next) 
     {
-        /* Extract the middle part and capitalize it */
-        const gchar *start = name + 6; /* Skip "Xfce4-" */
-        const gchar *end = g_strrstr(name, "-settings");
-        if (end && end > start) 
-        {
-            gsize len = end - start;
-            gchar *middle = g_strndup(start, len);
-            if (middle) 
-            {
-                /* Capitalize first letter */
-                if (middle[0] >= 'a' && middle[0] <= 'z') 
-                {
-                    middle[0] = middle[0] - 'a' + 'A';
-                }
+        ClassicDesktopProcess *process = l->data;
 
-                /* Apply Tier 5 logic to handle dashes in the middle part */
-                if (strchr(middle, '-') != NULL) 
-                {
-                    /* Replace dashes with spaces and capitalize each word */
-                    for (int i = 0; middle[i]; i++) 
-                    {
-                        if (middle[i] == '-') 
-                        {
-                            middle[i] = ' ';
-                            /* Capitalize letter after space (if exists and is lowercase) */
-                            if (middle[i + 1] >= 'a' && middle[i + 1] <= 'z') 
-                            {
-                                middle[i + 1] = middle[i + 1] - 'a' + 'A';
-                            }
-                        }
-                    }
-                }
-                /* Use GLib intern string to avoid memory leaks */
-                const gchar *result = g_intern_string(middle);
-                g_free(middle);  /* Free our temporary string */
-                return result;   /* Return the interned version (managed by GLib) */
-            }
-        }
-    }
+        /* The application's display name reads better than the process name */
+        FocusMenuAppRecord *app_record = focus_menu_model_find_app_by_pid(model, process->pid);
+        gchar *display_name = g_strdup(app_record && app_record->display_name ? app_record->display_name : process->display_name);
 
-    /* =========================================================================
-        * TIER 3: REVERSE DOMAIN PATTERN
-        * Handle org.*.* and Org.*.* applications
-        * ========================================================================= */
+        /* No active window means desktop is focused; otherwise it has to be one of this process's */
+        gboolean is_active = model->active_window == NULL || (active_record && active_record->pid == process->pid);
 
-    if (g_str_has_prefix(name, "org.") || g_str_has_prefix(name, "Org.")) 
-    {
-        /* Find the last dot to get the app name */
-        const gchar *last_dot = g_strrstr(name, ".");
-        if (last_dot) 
-        {
-            const gchar *app_name = last_dot + 1; /* Skip the dot */
-            if (strlen(app_name) > 0) 
-            {
-                /* Capitalize first letter only */
-                gchar *capitalized = g_strdup(app_name);
-                if (capitalized[0] >= 'a' && capitalized[0] <= 'z') 
-                {
-                    capitalized[0] = capitalized[0] - 'a' + 'A';
-                }
+        DesktopManagerInfo *dm_info = g_new0(DesktopManagerInfo, 1);
+        dm_info->pid = process->pid;
+        dm_info->name = g_strdup(process->name);
+        dm_info->display_name = display_name;  /* Transfer ownership */
+        dm_info->is_active = is_active;
 
-                /* Apply Tier 5 logic if there are dashes */
-                if (strchr(capitalized, '-') != NULL) 
-                {
-                    for (int i = 0; capitalized[i]; i++) {
-                        if (capitalized[i] == '-') 
-                        {
-                            capitalized[i] = ' ';
-                            /* Capitalize letter after space */
-                            if (capitalized[i + 1] >= 'a' && capitalized[i + 1] <= 'z') 
-                            {
-                                capitalized[i + 1] = capitalized[i + 1] - 'a' + 'A';
-                            }
-                        }
-                    }
-                }
-                const gchar *result = g_intern_string(capitalized);
-                g_free(capitalized);
-                return result;
-            }
-        }
+        desktop_managers = g_list_append(desktop_managers, dm_info);
     }
 
-    /* =========================================================================
-        * TIER 4: SIMPLE CAPITALIZATION
-        * Single lowercase words only - capitalize first letter
-        * ========================================================================= */
+    return desktop_managers;
+}
 
-    /* Check if it's a simple single word (no spaces, dots, dashes) */
-    if (!strchr(name, ' ') && !strchr(name, '.') && !strchr(name, '-')) 
-    {
-        /* Check if it's all lowercase */
-        gboolean is_lowercase = TRUE;
-        for (const gchar *p = name; *p; p++) 
-        {
-            if (*p >= 'A' && *p <= 'Z') 
-            {
-                is_lowercase = FALSE;
-                break;
-            }
-        }
 
-        if (is_lowercase && strlen(name) > 0) 
-        {
-            gchar *capitalized = g_strdup(name);
-            capitalized[0] = g_ascii_toupper(capitalized[0]);
-            const gchar *result = g_intern_string(capitalized);
-            g_free(capitalized);
-            return result;
-        }
+/* Free desktop manager info */
+static void desktop_manager_info_free(DesktopManagerInfo *dm_info) 
+{
+    if (dm_info) 
+    {
+        g_free(dm_info->name);
+        g_free(dm_info->display_name);
+        g_free(dm_info);
     }
+}
 
-    /* =========================================================================
-        * TIER 5: DASH REPLACEMENT
-        * Any name with dashes - replace with spaces and capitalize each word
-        * ========================================================================= */
-
-    if (strchr(name, '-') != NULL) 
+/* Sorting style for the desktop managers in a scan: Thunar's under xfdesktop, otherwise Caja's */
+static ClassicSortStyle sort_style_for_desktop_processes(GList *processes) 
+{
+    for (GList *l = processes; l; l = l->next) 
     {
-        gchar *processed = g_strdup(name);
+        ClassicDesktopProcess *process = l->data;
 
-        /* Replace dashes with spaces and capitalize each word */
-        for (int i = 0; processed[i]; i++) 
+        if (process->sort_style != CLASSLIB_SORT_STYLE_UNKNOWN) 
         {
-            if (processed[i] == '-') 
-            {
-                processed[i] = ' ';
-                /* Capitalize letter after space (if exists and is lowercase) */
-                if (processed[i + 1] >= 'a' && processed[i + 1] <= 'z') 
-                {
-                    processed[i + 1] = processed[i + 1] - 'a' + 'A';
-                }
-            }
+            return process->sort_style;
         }
+    }
 
-        /* Also capitalize the first letter if it's lowercase */
-        if (processed[0] >= 'a' && processed[0] <= 'z') 
-        {
-            processed[0] = processed[0] - 'a' + 'A';
-        }
+    return CLASSLIB_SORT_STYLE_CAJA;  /* Default fallback */
+}
 
-        const gchar *result = g_intern_string(processed);
-        g_free(processed);
-        return result;
+/* Desktop manager detection for sorting style, scanning /proc on the calling thread */
+static ClassicSortStyle determine_sort_style(FocusMenuWindowSource *source) 
+{
+    if (!source) 
+    {
+        return CLASSLIB_SORT_STYLE_CAJA;
     }
 
-    /* =========================================================================
-        * TIER 6: FALLBACK
-        * Return original name unchanged
-        * ========================================================================= */
+    GList *processes = scan_desktop_processes();
+    ClassicSortStyle result = sort_style_for_desktop_processes(processes);
+    g_list_free_full(processes, (GDestroyNotify)classlib_desktop_process_free);
 
-    return name;
+    return result;
 }
 
 /* =============================================================================
- * FILE MANAGER DETECTION AND BLACKLISTING SYSTEM
- * Extracted from switcher menu's file manager detection and spatial menu's blacklisting
+ * FLIGHT RECORDER
+ * Always-on ring of the most recent plugin events - wnck signals, menu
+ * builds, /proc scans and window operations. Storage is static, so recording
+ * never allocates; the ring is written to a file only when asked for
  * ============================================================================= */
 
-/**
- * Check if a process name corresponds to a desktop manager.
- * Extracted from switcher menu's desktop manager detection logic.
- */
-gboolean classlib_is_desktop_manager(const gchar *process_name) 
-{
-    if (!process_name) 
-    {
-        return FALSE;
-    }
-
-    const gchar *desktop_managers[] = 
-    {
-        "xfdesktop",
-        "caja",         /* caja -n --force-desktop */
-        "nemo-desktop",
-        "nautilus-desktop",
-        "pcmanfm",      /* pcmanfm --desktop */
-        NULL
-    };
+static FlightEvent flight_events[FLIGHT_RECORDER_EVENTS];
+static guint flight_next;      /* Slot the next event goes into */
+static guint64 flight_total;   /* Events recorded since startup */
 
-    for (int i = 0; desktop_managers[i]; i++) 
-    {
-        if (g_ascii_strcasecmp(process_name, desktop_managers[i]) == 0) 
-        {
-            return TRUE;
-        }
-    }
-    return FALSE;
+/* Record one event, overwriting the oldest. what must be a string literal */
+static void flight_record(FlightEventKind kind, const char *what, gint64 value) 
+{
+    FlightEvent *event = &flight_events[flight_next];
+    event->time_us = g_get_monotonic_time();
+    event->kind = kind;
+    event->what = what;
+    event->value = value;
+
+    flight_next = (flight_next + 1) % FLIGHT_RECORDER_EVENTS;
+    flight_total++;
 }
 
-/**
- * Check if an application should be considered a file manager.
- * Combines desktop manager detection and traditional file manager detection.
- */
-gboolean classlib_is_file_manager(WnckApplication *app) 
+/* Write the ring, oldest first, to $XDG_RUNTIME_DIR; returns the path or NULL */
+static gchar *flight_recorder_dump(void) 
 {
-    if (!app) 
-    {
-        return FALSE;
-    }
+    gchar *file_name = g_strdup_printf("focus-menu-flight-%d.log", (int)getpid());
+    gchar *path = g_build_filename(g_get_user_runtime_dir(), file_name, NULL);
+    g_free(file_name);
 
-    const gchar *app_name = wnck_application_get_name(app);
-    if (!app_name) 
+    FILE *file = g_fopen(path, "w");
+    if (!file) 
     {
-        return FALSE;
+        g_warning("Failed to open flight recorder file %s", path);
+        g_free(path);
+        return NULL;
     }
 
-    /* Check for known file managers */
-    const gchar *file_managers[] = 
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");
+    guint count = (guint)MIN(flight_total, (guint64)FLIGHT_RECORDER_EVENTS);
+    fprintf(file, "Focus Menu %s flight recorder, dumped %s\n", PLUGIN_VERSION, stamp);
+    fprintf(file, "%u of %" G_GUINT64_FORMAT " events; times are seconds before the dump\n\n", count, flight_total);
+    g_free(stamp);
+    g_date_time_unref(now);
+
+    gint64 dump_time = g_get_monotonic_time();
+    guint first = (flight_next + FLIGHT_RECORDER_EVENTS - count) % FLIGHT_RECORDER_EVENTS;
+    for (guint i = 0; i < count; i++) 
     {
-        "caja",
-        "thunar",
-        "nemo",
-        "nautilus",
-        "pcmanfm",
-        "dolphin",
-        "konqueror",
-        NULL
-    };
+        const FlightEvent *event = &flight_events[(first + i) % FLIGHT_RECORDER_EVENTS];
+        gdouble age = (dump_time - event->time_us) / (gdouble)G_USEC_PER_SEC;
 
-    for (int i = 0; file_managers[i]; i++) 
-    {
-        if (g_ascii_strcasecmp(app_name, file_managers[i]) == 0) 
+        switch (event->kind) 
         {
-            return TRUE;
+            case FLIGHT_WNCK_WINDOW:
+                fprintf(file, "%12.6f  wnck       %-24s window 0x%" G_GINT64_MODIFIER "x\n", -age, event->what, event->value);
+                break;
+            case FLIGHT_WNCK_APP:
+                fprintf(file, "%12.6f  wnck       %-24s pid %" G_GINT64_FORMAT "\n", -age, event->what, event->value);
+                break;
+            case FLIGHT_WNCK_SCREEN:
+                fprintf(file, "%12.6f  wnck       %s\n", -age, event->what);
+                break;
+            case FLIGHT_MENU_BUILD:
+                fprintf(file, "%12.6f  menu       %-24s %" G_GINT64_FORMAT " us\n", -age, event->what, event->value);
+                break;
+            case FLIGHT_PROC_SCAN:
+                fprintf(file, "%12.6f  proc       %-24s %" G_GINT64_FORMAT " entries\n", -age, event->what, event->value);
+                break;
+            case FLIGHT_WINDOW_OP:
+                fprintf(file, "%12.6f  window-op  %-24s window 0x%" G_GINT64_MODIFIER "x\n", -age, event->what, event->value);
+                break;
+            case FLIGHT_MEMORY_RELEASE:
+                fprintf(file, "%12.6f  memory     %-24s %" G_GINT64_FORMAT " kB\n", -age, event->what, event->value);
+                break;
         }
     }
 
-    /* Check for desktop managers */
-    return classlib_is_desktop_manager(app_name);
+    fclose(file);
+    return path;
 }
 
-/**
- * Check if an application should be blacklisted from recent document tracking.
- * Extracted from spatial menu's is_blacklisted_application() function.
- */
-/* Check if application should be blacklisted from recent documents */
-gboolean classlib_should_blacklist_application(xmlNode *bookmark_node) 
-{
-    /* Applications that primarily download/fetch files rather than edit documents */
-    const gchar *blacklisted_apps[] = 
-    {
-        "Firefox",
-        "firefox",
-        "Mozilla Firefox",
-        "Chrome",
-        "Chromium",
-        "Google Chrome",
-        "chromium",
-        "wget",
-        "curl",
-        "Thunderbird",
-        "thunderbird",
-        "Transmission",
-        "qBittorrent",
-        "aria2c",
-        "yt-dlp",
-        "youtube-dl",
-        NULL
-    };
+/* =============================================================================
+ * WNCK WINDOW SOURCE
+ * The window source the plugin runs on. Its handles are the wnck objects
+ * themselves, so code that only ever runs against wnck can cast freely
+ * between the two; wnck signals are passed on to the source's listener
+ * ============================================================================= */
 
-    /* Look for application metadata in the bookmark */
-    for (xmlNode *child = bookmark_node->children; child; child = child->next) 
-    {
-        if (child->type != XML_ELEMENT_NODE) 
-        {
-            continue;
-        }
+#define SOURCE_WINDOW(window) ((FocusMenuSourceWindow *)(window))
+#define SOURCE_APP(app) ((FocusMenuSourceApp *)(app))
 
-        /* Check for info/metadata structure */
-        if (xmlStrcmp(child->name, (const xmlChar *)"info") == 0) 
-        {
-            for (xmlNode *info_child = child->children; info_child; info_child = info_child->next) 
-            {
-                if (info_child->type != XML_ELEMENT_NODE) 
-                {
-                    continue;
-                }
+typedef struct
+{
+    FocusMenuWindowSource parent;
+    WnckScreen *screen;
+    GHashTable *apps;            /* WnckApplication* whose signals are connected */
+} WnckWindowSource;
 
-                /* Look for metadata with applications */
-                if (xmlStrcmp(info_child->name, (const xmlChar *)"metadata") == 0) 
-                {
-                    for (xmlNode *meta_child = info_child->children; meta_child; meta_child = meta_child->next) 
-                    {
-                        if (meta_child->type != XML_ELEMENT_NODE) 
-                        {
-                            continue;
-                        }
-
-                        /* Look for bookmark:applications */
-                        if (xmlStrcmp(meta_child->name, (const xmlChar *)"applications") == 0) 
-                        {
-                            for (xmlNode *app_child = meta_child->children; app_child; app_child = app_child->next) 
-                            {
-                                if (app_child->type != XML_ELEMENT_NODE) 
-                                {
-                                    continue;
-                                }
-
-                                /* Check bookmark:application elements */
-                                if (xmlStrcmp(app_child->name, (const xmlChar *)"application") == 0) 
-                                {
-                                    xmlChar *app_name = xmlGetProp(app_child, (const xmlChar *)"name");
-                                    if (app_name) 
-                                    {
-                                        /* Check against blacklist */
-                                        for (int i = 0; blacklisted_apps[i]; i++) 
-                                        {
-                                            if (g_ascii_strcasecmp((const gchar *)app_name, blacklisted_apps[i]) == 0) 
-                                            {
-                                                xmlFree(app_name);
-                                                return TRUE; /* Blacklisted */
-                                            }
-                                        }
-                                        xmlFree(app_name);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return FALSE; /* Not blacklisted */
+#define WNCK_WINDOW_SOURCE(source) ((WnckWindowSource *)(source))
+
+static void on_wnck_source_window_name_changed(WnckWindow *window, FocusMenuWindowSource *source) 
+{
+    flight_record(FLIGHT_WNCK_WINDOW, "name-changed", (gint64)wnck_window_get_xid(window));
+    focus_menu_source_emit_window_changed(source, SOURCE_WINDOW(window), FOCUS_MENU_SOURCE_CHANGE_NAME);
 }
 
-/**
- * Get the default file manager for the system using xdg-mime.
- */
-gchar *classlib_get_default_file_manager(void) 
+static void on_wnck_source_window_state_changed(WnckWindow *window, WnckWindowState changed_mask G_GNUC_UNUSED, WnckWindowState new_state G_GNUC_UNUSED, FocusMenuWindowSource *source) 
 {
-    gchar *output = NULL;
-    gchar *error = NULL;
-    gint exit_status;
+    flight_record(FLIGHT_WNCK_WINDOW, "state-changed", (gint64)wnck_window_get_xid(window));
+    focus_menu_source_emit_window_changed(source, SOURCE_WINDOW(window), FOCUS_MENU_SOURCE_CHANGE_STATE);
+}
 
-    /* Query the default application for inode/directory */
-    if (g_spawn_command_line_sync("xdg-mime query default inode/directory",
-        &output, &error, &exit_status, NULL)) 
-        {
-            if (exit_status == 0 && output && *output) 
-            {
-                /* Strip newline and .desktop extension */
-                g_strstrip(output);
-                if (g_str_has_suffix(output, ".desktop")) 
-                {
-                    gchar *basename = g_path_get_basename(output);
-                    gchar *name = g_strndup(basename, strlen(basename) - 8); /* Remove .desktop */
-                    g_free(basename);
-                    g_free(output);
-                    return name;
-                }
-                return output;
-            }
-        }
-        g_free(output);
-        g_free(error);
+/* Also connected to "type-changed", which has the same signature */
+static void on_wnck_source_window_workspace_changed(WnckWindow *window, FocusMenuWindowSource *source) 
+{
+    flight_record(FLIGHT_WNCK_WINDOW, "workspace-changed", (gint64)wnck_window_get_xid(window));
+    focus_menu_source_emit_window_changed(source, SOURCE_WINDOW(window), FOCUS_MENU_SOURCE_CHANGE_WORKSPACE);
+}
 
-        /* Fallback detection */
-        const gchar *fallback_managers[] = {"caja", "thunar", "nemo", "nautilus", NULL};
-        for (int i = 0; fallback_managers[i]; i++) 
-        {
-            gchar *path = g_find_program_in_path(fallback_managers[i]);
-            if (path) 
-            {
-                g_free(path);
-                return g_strdup(fallback_managers[i]);
-            }
-        }
-        return NULL;
+static void on_wnck_source_window_icon_changed(WnckWindow *window, FocusMenuWindowSource *source) 
+{
+    flight_record(FLIGHT_WNCK_WINDOW, "icon-changed", (gint64)wnck_window_get_xid(window));
+    focus_menu_source_emit_window_changed(source, SOURCE_WINDOW(window), FOCUS_MENU_SOURCE_CHANGE_ICON);
 }
 
-/* =============================================================================
- * NATURAL SORTING SYSTEM
- * File manager aware string comparison extracted from switcher menu
- * ============================================================================= */
+static void on_wnck_source_app_name_changed(WnckApplication *app, FocusMenuWindowSource *source) 
+{
+    flight_record(FLIGHT_WNCK_APP, "name-changed", wnck_application_get_pid(app));
+    focus_menu_source_emit_app_changed(source, SOURCE_APP(app), FOCUS_MENU_SOURCE_CHANGE_NAME);
+}
 
-/**
- * Detect the current system locale type for sorting purposes.
- * Follows Linux locale hierarchy: LC_ALL -> LC_COLLATE -> LANG -> "C"
- */
-ClassicLocaleType classlib_detect_locale_type(void) 
+static void on_wnck_source_app_icon_changed(WnckApplication *app, FocusMenuWindowSource *source) 
 {
-    const gchar *locale = NULL;
+    flight_record(FLIGHT_WNCK_APP, "icon-changed", wnck_application_get_pid(app));
+    focus_menu_source_emit_app_changed(source, SOURCE_APP(app), FOCUS_MENU_SOURCE_CHANGE_ICON);
+}
 
-    /* Follow the canonical hierarchy */
-    locale = getenv("LC_ALL");
-    if (!locale || !*locale) 
-    {
-        locale = getenv("LC_COLLATE");
-        if (!locale || !*locale) 
-        {
-            locale = getenv("LANG");
-            if (!locale || !*locale) 
-            {
-                locale = "C";  /* Final fallback */
-            }
-        }
+static void wnck_source_watch_app(WnckWindowSource *wnck_source, WnckApplication *app) 
+{
+    if (!app || !g_hash_table_add(wnck_source->apps, app)) return;
+
+    g_signal_connect(app, "name-changed", G_CALLBACK(on_wnck_source_app_name_changed), wnck_source);
+    g_signal_connect(app, "icon-changed", G_CALLBACK(on_wnck_source_app_icon_changed), wnck_source);
+}
+
+static void wnck_source_watch_window(WnckWindowSource *wnck_source, WnckWindow *window) 
+{
+    g_signal_connect(window, "name-changed", G_CALLBACK(on_wnck_source_window_name_changed), wnck_source);
+    g_signal_connect(window, "state-changed", G_CALLBACK(on_wnck_source_window_state_changed), wnck_source);
+    g_signal_connect(window, "workspace-changed", G_CALLBACK(on_wnck_source_window_workspace_changed), wnck_source);
+    g_signal_connect(window, "type-changed", G_CALLBACK(on_wnck_source_window_workspace_changed), wnck_source);
+    g_signal_connect(window, "icon-changed", G_CALLBACK(on_wnck_source_window_icon_changed), wnck_source);
+
+    wnck_source_watch_app(wnck_source, wnck_window_get_application(window));
+}
+
+static void on_wnck_source_window_opened(WnckScreen *screen G_GNUC_UNUSED, WnckWindow *window, WnckWindowSource *wnck_source) 
+{
+    flight_record(FLIGHT_WNCK_WINDOW, "window-opened", (gint64)wnck_window_get_xid(window));
+    wnck_source_watch_window(wnck_source, window);
+    focus_menu_source_emit_window_opened(&wnck_source->parent, SOURCE_WINDOW(window));
+}
+
+static void on_wnck_source_window_closed(WnckScreen *screen G_GNUC_UNUSED, WnckWindow *window, WnckWindowSource *wnck_source) 
+{
+    flight_record(FLIGHT_WNCK_WINDOW, "window-closed", (gint64)wnck_window_get_xid(window));
+    g_signal_handlers_disconnect_by_data(window, wnck_source);
+    focus_menu_source_emit_window_closed(&wnck_source->parent, SOURCE_WINDOW(window));
+}
+
+static void on_wnck_source_application_opened(WnckScreen *screen G_GNUC_UNUSED, WnckApplication *app, WnckWindowSource *wnck_source) 
+{
+    flight_record(FLIGHT_WNCK_APP, "application-opened", wnck_application_get_pid(app));
+    wnck_source_watch_app(wnck_source, app);
+    focus_menu_source_emit_app_opened(&wnck_source->parent, SOURCE_APP(app));
+}
+
+static void on_wnck_source_application_closed(WnckScreen *screen G_GNUC_UNUSED, WnckApplication *app, WnckWindowSource *wnck_source) 
+{
+    flight_record(FLIGHT_WNCK_APP, "application-closed", wnck_application_get_pid(app));
+    focus_menu_source_emit_app_closed(&wnck_source->parent, SOURCE_APP(app));
+    g_signal_handlers_disconnect_by_data(app, wnck_source);
+    g_hash_table_remove(wnck_source->apps, app);
+}
+
+static void on_wnck_source_active_window_changed(WnckScreen *screen G_GNUC_UNUSED, WnckWindow *previous G_GNUC_UNUSED, FocusMenuWindowSource *source) 
+{
+    flight_record(FLIGHT_WNCK_SCREEN, "active-window-changed", 0);
+    focus_menu_source_emit_active_window_changed(source);
+}
+
+static void on_wnck_source_active_workspace_changed(WnckScreen *screen G_GNUC_UNUSED, WnckWorkspace *previous G_GNUC_UNUSED, FocusMenuWindowSource *source) 
+{
+    flight_record(FLIGHT_WNCK_SCREEN, "active-workspace-changed", 0);
+    focus_menu_source_emit_active_workspace_changed(source);
+}
+
+static void wnck_source_update(FocusMenuWindowSource *source) 
+{
+    wnck_screen_force_update(WNCK_WINDOW_SOURCE(source)->screen);
+}
+
+static GList *wnck_source_list_windows(FocusMenuWindowSource *source) 
+{
+    return wnck_screen_get_windows_stacked(WNCK_WINDOW_SOURCE(source)->screen);
+}
+
+static FocusMenuSourceWindow *wnck_source_get_active_window(FocusMenuWindowSource *source) 
+{
+    return SOURCE_WINDOW(wnck_screen_get_active_window(WNCK_WINDOW_SOURCE(source)->screen));
+}
+
+static FocusMenuSourceWorkspace *wnck_source_get_active_workspace(FocusMenuWindowSource *source) 
+{
+    return (FocusMenuSourceWorkspace *)wnck_screen_get_active_workspace(WNCK_WINDOW_SOURCE(source)->screen);
+}
+
+static gint wnck_source_workspace_get_number(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWorkspace *workspace) 
+{
+    return workspace ? wnck_workspace_get_number(WNCK_WORKSPACE(workspace)) : -1;
+}
+
+static gulong wnck_source_window_get_id(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    return wnck_window_get_xid(WNCK_WINDOW(window));
+}
+
+static FocusMenuSourceApp *wnck_source_window_get_app(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    return SOURCE_APP(wnck_window_get_application(WNCK_WINDOW(window)));
+}
+
+static const gchar *wnck_source_window_get_name(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    return wnck_window_get_name(WNCK_WINDOW(window));
+}
+
+static FocusMenuSourceWindowType wnck_source_window_get_type(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    switch (wnck_window_get_window_type(WNCK_WINDOW(window))) 
+    {
+        case WNCK_WINDOW_NORMAL:
+            return FOCUS_MENU_SOURCE_WINDOW_NORMAL;
+        case WNCK_WINDOW_DESKTOP:
+            return FOCUS_MENU_SOURCE_WINDOW_DESKTOP;
+        default:
+            return FOCUS_MENU_SOURCE_WINDOW_OTHER;
+    }
+}
+
+static FocusMenuSourceWindowState wnck_source_window_get_state(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    FocusMenuSourceWindowState state = 0;
+
+    if (wnck_window_is_minimized(WNCK_WINDOW(window))) state |= FOCUS_MENU_SOURCE_STATE_MINIMIZED;
+    if (wnck_window_is_pinned(WNCK_WINDOW(window))) state |= FOCUS_MENU_SOURCE_STATE_PINNED;
+    return state;
+}
+
+static FocusMenuSourceWorkspace *wnck_source_window_get_workspace(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    return (FocusMenuSourceWorkspace *)wnck_window_get_workspace(WNCK_WINDOW(window));
+}
+
+static gulong wnck_source_app_get_id(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceApp *app) 
+{
+    return wnck_application_get_xid(WNCK_APPLICATION(app));
+}
+
+static const gchar *wnck_source_app_get_name(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceApp *app) 
+{
+    return wnck_application_get_name(WNCK_APPLICATION(app));
+}
+
+static pid_t wnck_source_app_get_pid(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceApp *app) 
+{
+    return wnck_application_get_pid(WNCK_APPLICATION(app));
+}
+
+static GdkPixbuf *wnck_source_app_get_icon(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceApp *app) 
+{
+    return wnck_application_get_icon(WNCK_APPLICATION(app));
+}
+
+/* Window operations go through these so the recorder sees every one */
+static void wnck_source_window_minimize(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window) 
+{
+    flight_record(FLIGHT_WINDOW_OP, "minimize", (gint64)wnck_window_get_xid(WNCK_WINDOW(window)));
+    wnck_window_minimize(WNCK_WINDOW(window));
+}
+
+static void wnck_source_window_unminimize(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window, guint32 timestamp) 
+{
+    flight_record(FLIGHT_WINDOW_OP, "unminimize", (gint64)wnck_window_get_xid(WNCK_WINDOW(window)));
+    wnck_window_unminimize(WNCK_WINDOW(window), timestamp);
+    /* Small delay to ensure proper stacking - some window managers need this */
+    g_usleep(1000);
+}
+
+static void wnck_source_window_activate(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWindow *window, guint32 timestamp) 
+{
+    flight_record(FLIGHT_WINDOW_OP, "activate", (gint64)wnck_window_get_xid(WNCK_WINDOW(window)));
+    wnck_window_activate(WNCK_WINDOW(window), timestamp);
+}
+
+static void wnck_source_workspace_activate(FocusMenuWindowSource *source G_GNUC_UNUSED, FocusMenuSourceWorkspace *workspace, guint32 timestamp) 
+{
+    flight_record(FLIGHT_WINDOW_OP, "activate-workspace", wnck_workspace_get_number(WNCK_WORKSPACE(workspace)));
+    wnck_workspace_activate(WNCK_WORKSPACE(workspace), timestamp);
+}
+
+static void wnck_source_free(FocusMenuWindowSource *source) 
+{
+    WnckWindowSource *wnck_source = WNCK_WINDOW_SOURCE(source);
+
+    g_signal_handlers_disconnect_by_data(wnck_source->screen, wnck_source);
+    for (GList *l = wnck_screen_get_windows(wnck_source->screen); l; l = l->next) 
+    {
+        g_signal_handlers_disconnect_by_data(l->data, wnck_source);
+    }
+
+    GHashTableIter iter;
+    gpointer app;
+    g_hash_table_iter_init(&iter, wnck_source->apps);
+    while (g_hash_table_iter_next(&iter, &app, NULL)) 
+    {
+        g_signal_handlers_disconnect_by_data(app, wnck_source);
+    }
+
+    g_hash_table_destroy(wnck_source->apps);
+    g_free(wnck_source);
+}
+
+static const FocusMenuWindowSourceClass wnck_source_class = 
+{
+    .name = "wnck",
+    .update = wnck_source_update,
+    .list_windows = wnck_source_list_windows,
+    .get_active_window = wnck_source_get_active_window,
+    .get_active_workspace = wnck_source_get_active_workspace,
+    .workspace_get_number = wnck_source_workspace_get_number,
+    .window_get_id = wnck_source_window_get_id,
+    .window_get_app = wnck_source_window_get_app,
+    .window_get_name = wnck_source_window_get_name,
+    .window_get_type = wnck_source_window_get_type,
+    .window_get_state = wnck_source_window_get_state,
+    .window_get_workspace = wnck_source_window_get_workspace,
+    .app_get_id = wnck_source_app_get_id,
+    .app_get_name = wnck_source_app_get_name,
+    .app_get_pid = wnck_source_app_get_pid,
+    .app_get_icon = wnck_source_app_get_icon,
+    .window_minimize = wnck_source_window_minimize,
+    .window_unminimize = wnck_source_window_unminimize,
+    .window_activate = wnck_source_window_activate,
+    .workspace_activate = wnck_source_workspace_activate,
+    .free = wnck_source_free,
+};
+
+/* Window source backed by a wnck screen, watching the windows it already has */
+static FocusMenuWindowSource *focus_menu_wnck_source_new(WnckScreen *screen) 
+{
+    WnckWindowSource *wnck_source = g_new0(WnckWindowSource, 1);
+    wnck_source->parent.klass = &wnck_source_class;
+    wnck_source->screen = screen;
+    wnck_source->apps = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (GList *l = wnck_screen_get_windows(screen); l; l = l->next) 
+    {
+        wnck_source_watch_window(wnck_source, WNCK_WINDOW(l->data));
+    }
+
+    g_signal_connect(screen, "window-opened", G_CALLBACK(on_wnck_source_window_opened), wnck_source);
+    g_signal_connect(screen, "window-closed", G_CALLBACK(on_wnck_source_window_closed), wnck_source);
+    g_signal_connect(screen, "application-opened", G_CALLBACK(on_wnck_source_application_opened), wnck_source);
+    g_signal_connect(screen, "application-closed", G_CALLBACK(on_wnck_source_application_closed), wnck_source);
+    g_signal_connect(screen, "active-window-changed", G_CALLBACK(on_wnck_source_active_window_changed), wnck_source);
+    g_signal_connect(screen, "active-workspace-changed", G_CALLBACK(on_wnck_source_active_workspace_changed), wnck_source);
+
+    return &wnck_source->parent;
+}
+
+/* =============================================================================
+ * EVENT RECORDER
+ * Writes every window source event the model sees, with its time and the
+ * identities involved, as one line of JSON. bench/event-replay feeds such
+ * a file back through the model on the in-memory source, so handler and
+ * menu costs can be compared between versions on identical input.
+ * The recorder sits between the source and the model's listener
+ * ============================================================================= */
+
+#define EVENT_RECORDER_BUFFER (64 * 1024)  /* stdio buffer, so events rarely cause a write */
+
+/* Write text as a JSON string, escaping quotes, backslashes and control characters */
+static void event_recorder_put_string(FILE *file, const gchar *text) 
+{
+    gchar *valid = classlib_dup_valid_utf8(text);
+
+    fputc('"', file);
+    for (const guchar *p = (const guchar *)valid; *p; p++) 
+    {
+        if (*p == '"' || *p == '\\') 
+        {
+            fputc('\\', file);
+            fputc(*p, file);
+        } 
+        else if (*p < 0x20) 
+        {
+            fprintf(file, "\\u%04x", *p);
+        } 
+        else 
+        {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+    g_free(valid);
+}
+
+/* Start a line: {"t":<microseconds since the start>,"ev":"<event>" */
+static void event_recorder_begin(EventRecorder *recorder, const char *event) 
+{
+    fprintf(recorder->file, "{\"t\":%" G_GINT64_FORMAT ",\"ev\":\"%s\"", g_get_monotonic_time() - recorder->start_us, event);
+    recorder->events++;
+}
+
+static void event_recorder_put_app(EventRecorder *recorder, FocusMenuSourceApp *app) 
+{
+    FocusMenuWindowSource *source = recorder->source;
+
+    fprintf(recorder->file, ",\"app\":%lu,\"pid\":%d,\"app_name\":", app ? focus_menu_source_app_get_id(source, app) : 0UL,
+            app ? (int)focus_menu_source_app_get_pid(source, app) : 0);
+    event_recorder_put_string(recorder->file, app ? focus_menu_source_app_get_name(source, app) : NULL);
+}
+
+/* Everything the model reads from a window, so the replay can rebuild it */
+static void event_recorder_put_window(EventRecorder *recorder, FocusMenuSourceWindow *window) 
+{
+    FocusMenuWindowSource *source = recorder->source;
+
+    fprintf(recorder->file, ",\"win\":%lu", focus_menu_source_window_get_id(source, window));
+    event_recorder_put_app(recorder, focus_menu_source_window_get_app(source, window));
+    fputs(",\"name\":", recorder->file);
+    event_recorder_put_string(recorder->file, focus_menu_source_window_get_name(source, window));
+    fprintf(recorder->file, ",\"type\":%d,\"state\":%d,\"ws\":%d",
+            (int)focus_menu_source_window_get_type(source, window),
+            (int)focus_menu_source_window_get_state(source, window),
+            focus_menu_source_workspace_get_number(source, focus_menu_source_window_get_workspace(source, window)));
+}
+
+static void event_recorder_end(EventRecorder *recorder) 
+{
+    fputs("}\n", recorder->file);
+}
+
+static const char *event_recorder_change_name(FocusMenuSourceChange change) 
+{
+    switch (change) 
+    {
+        case FOCUS_MENU_SOURCE_CHANGE_NAME:
+            return "name";
+        case FOCUS_MENU_SOURCE_CHANGE_STATE:
+            return "state";
+        case FOCUS_MENU_SOURCE_CHANGE_WORKSPACE:
+            return "workspace";
+        case FOCUS_MENU_SOURCE_CHANGE_ICON:
+            return "icon";
     }
+    return "unknown";
+}
+
+static void event_recorder_write_active_window(EventRecorder *recorder) 
+{
+    FocusMenuSourceWindow *active = focus_menu_source_get_active_window(recorder->source);
+
+    event_recorder_begin(recorder, "active-window");
+    fprintf(recorder->file, ",\"win\":%lu", active ? focus_menu_source_window_get_id(recorder->source, active) : 0UL);
+    event_recorder_end(recorder);
+}
+
+static void event_recorder_write_active_workspace(EventRecorder *recorder) 
+{
+    FocusMenuWindowSource *source = recorder->source;
+
+    event_recorder_begin(recorder, "active-workspace");
+    fprintf(recorder->file, ",\"ws\":%d", focus_menu_source_workspace_get_number(source, focus_menu_source_get_active_workspace(source)));
+    event_recorder_end(recorder);
+}
+
+/* Listener callbacks: write the event, then pass it on unchanged */
+static void on_recorder_window_opened(FocusMenuSourceWindow *window, gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_begin(recorder, "window-opened");
+    event_recorder_put_window(recorder, window);
+    event_recorder_end(recorder);
+    if (recorder->listener && recorder->listener->window_opened) recorder->listener->window_opened(window, recorder->listener_data);
+}
+
+static void on_recorder_window_closed(FocusMenuSourceWindow *window, gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_begin(recorder, "window-closed");
+    fprintf(recorder->file, ",\"win\":%lu", focus_menu_source_window_get_id(recorder->source, window));
+    event_recorder_end(recorder);
+    if (recorder->listener && recorder->listener->window_closed) recorder->listener->window_closed(window, recorder->listener_data);
+}
+
+static void on_recorder_window_changed(FocusMenuSourceWindow *window, FocusMenuSourceChange change, gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
 
-    /* Check if it's C locale */
-    if (g_strcmp0(locale, "C") == 0 || g_strcmp0(locale, "POSIX") == 0) 
+    event_recorder_begin(recorder, "window-changed");
+    fprintf(recorder->file, ",\"what\":\"%s\"", event_recorder_change_name(change));
+    event_recorder_put_window(recorder, window);
+    event_recorder_end(recorder);
+    if (recorder->listener && recorder->listener->window_changed) recorder->listener->window_changed(window, change, recorder->listener_data);
+}
+
+static void on_recorder_app_opened(FocusMenuSourceApp *app, gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_begin(recorder, "app-opened");
+    event_recorder_put_app(recorder, app);
+    event_recorder_end(recorder);
+    if (recorder->listener && recorder->listener->app_opened) recorder->listener->app_opened(app, recorder->listener_data);
+}
+
+static void on_recorder_app_closed(FocusMenuSourceApp *app, gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_begin(recorder, "app-closed");
+    fprintf(recorder->file, ",\"app\":%lu", focus_menu_source_app_get_id(recorder->source, app));
+    event_recorder_end(recorder);
+    if (recorder->listener && recorder->listener->app_closed) recorder->listener->app_closed(app, recorder->listener_data);
+}
+
+static void on_recorder_app_changed(FocusMenuSourceApp *app, FocusMenuSourceChange change, gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_begin(recorder, "app-changed");
+    fprintf(recorder->file, ",\"what\":\"%s\"", event_recorder_change_name(change));
+    event_recorder_put_app(recorder, app);
+    event_recorder_end(recorder);
+    if (recorder->listener && recorder->listener->app_changed) recorder->listener->app_changed(app, change, recorder->listener_data);
+}
+
+static void on_recorder_active_window_changed(gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_write_active_window(recorder);
+    if (recorder->listener && recorder->listener->active_window_changed) recorder->listener->active_window_changed(recorder->listener_data);
+}
+
+static void on_recorder_active_workspace_changed(gpointer user_data) 
+{
+    EventRecorder *recorder = user_data;
+
+    event_recorder_write_active_workspace(recorder);
+    if (recorder->listener && recorder->listener->active_workspace_changed) recorder->listener->active_workspace_changed(recorder->listener_data);
+}
+
+static const FocusMenuSourceListener event_recorder_listener = 
+{
+    .window_opened = on_recorder_window_opened,
+    .window_closed = on_recorder_window_closed,
+    .window_changed = on_recorder_window_changed,
+    .app_opened = on_recorder_app_opened,
+    .app_closed = on_recorder_app_closed,
+    .app_changed = on_recorder_app_changed,
+    .active_window_changed = on_recorder_active_window_changed,
+    .active_workspace_changed = on_recorder_active_workspace_changed,
+};
+
+/* Start recording in front of the source's current listener. The file opens
+ * with a header and a snapshot of the session as it is now, written as the
+ * events that would have created it */
+static EventRecorder *event_recorder_start(FocusMenuWindowSource *source, const gchar *path) 
+{
+    FILE *file = g_fopen(path, "w");
+    if (!file) 
     {
-        return CLASSLIB_LOCALE_TYPE_C;
+        g_warning("Failed to open event recording %s", path);
+        return NULL;
     }
+    setvbuf(file, NULL, _IOFBF, EVENT_RECORDER_BUFFER);
+
+    EventRecorder *recorder = g_new0(EventRecorder, 1);
+    recorder->file = file;
+    recorder->start_us = g_get_monotonic_time();
+    recorder->source = source;
+    recorder->listener = source->listener;
+    recorder->listener_data = source->listener_data;
+
+    fprintf(file, "{\"focus_menu_recording\":1,\"plugin_version\":\"%s\",\"source\":\"%s\"}\n", PLUGIN_VERSION, source->klass->name);
+    event_recorder_write_active_workspace(recorder);
+    for (GList *l = focus_menu_source_list_windows(source); l; l = l->next) 
+    {
+        event_recorder_begin(recorder, "window-opened");
+        event_recorder_put_window(recorder, l->data);
+        event_recorder_end(recorder);
+    }
+    event_recorder_write_active_window(recorder);
+
+    focus_menu_source_set_listener(source, &event_recorder_listener, recorder);
+    return recorder;
+}
+
+/* The menu was opened; the replay rebuilds its layout at this point */
+static void event_recorder_note_menu(EventRecorder *recorder) 
+{
+    if (!recorder) return;
+
+    event_recorder_begin(recorder, "menu");
+    event_recorder_end(recorder);
+}
+
+/* Hand the source back to the listener recording started in front of */
+static void event_recorder_stop(EventRecorder *recorder) 
+{
+    if (!recorder) return;
+
+    focus_menu_source_set_listener(recorder->source, recorder->listener, recorder->listener_data);
+    fclose(recorder->file);
+    g_message("Focus Menu: recorded %" G_GUINT64_FORMAT " events", recorder->events);
+    g_free(recorder);
+}
+
+/* =============================================================================
+ * PROCESS WORKER
+ * Walking /proc and reading command lines can stall for a long time on a
+ * loaded machine, and the panel draws every plugin on this thread. A
+ * one-thread pool does those reads instead and hands each result back to
+ * the main context, so the menu only ever reads finished scans. Every menu
+ * build asks for a fresh scan, which the next build will see, and each new
+ * application's process is classified here as soon as the model has it
+ * ============================================================================= */
+
+struct _ProcessWorker
+{
+    GThreadPool *pool;           /* One thread, so scans run in order */
+    GMainContext *context;       /* Where results are delivered (referenced) */
+    FocusMenuModel *model;       /* Re-keyed when the sorting style changes; NULL once the owner has gone */
+    gint ref_count;              /* The owner's, plus one per scan in flight; main thread only */
+    gboolean busy;               /* A scan is queued or running */
+    gboolean rescan;             /* Another scan was asked for while busy */
+    gboolean have_scan;          /* desktop_processes holds a finished scan */
+    GList *desktop_processes;    /* ClassicDesktopProcess*, from the last finished scan */
+};
+
+/* One scan; its results are filled on the worker. Each scan also refreshes
+ * classlib's per-process verdicts, which the main thread reads directly */
+typedef struct
+{
+    ProcessWorker *worker;
+    pid_t pid;                   /* Classify just this process, or 0 for the whole table */
+    GList *desktop_processes;
+    guint entries_scanned;
+} ProcessScan;
+
+static void process_worker_unref(ProcessWorker *worker) 
+{
+    if (--worker->ref_count > 0) return;
+
+    g_list_free_full(worker->desktop_processes, (GDestroyNotify)classlib_desktop_process_free);
+    g_main_context_unref(worker->context);
+    g_free(worker);
+}
+
+static void process_scan_free(ProcessScan *scan) 
+{
+    g_list_free_full(scan->desktop_processes, (GDestroyNotify)classlib_desktop_process_free);
+    g_free(scan);
+}
+
+/* Main thread: take a finished scan's results, then start the next scan if one was asked for */
+static gboolean process_worker_deliver(gpointer data) 
+{
+    ProcessScan *scan = data;
+    ProcessWorker *worker = scan->worker;
+
+    if (scan->pid) 
+    {
+        /* A single process's verdict is already in classlib's cache */
+        process_scan_free(scan);
+        process_worker_unref(worker);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (worker->model) 
+    {
+        g_list_free_full(worker->desktop_processes, (GDestroyNotify)classlib_desktop_process_free);
+        worker->desktop_processes = scan->desktop_processes;
+        scan->desktop_processes = NULL;
+        worker->have_scan = TRUE;
+
+        flight_record(FLIGHT_PROC_SCAN, "desktop-managers", scan->entries_scanned);
+        perf_counters.proc_entries_scanned += scan->entries_scanned;
+
+        /* The first scan decides the sort style; a desktop manager change later re-sorts */
+        focus_menu_model_set_sort_style(worker->model, sort_style_for_desktop_processes(worker->desktop_processes));
+    }
+
+    worker->busy = FALSE;
+    if (worker->rescan) 
+    {
+        worker->rescan = FALSE;
+        process_worker_request_scan(worker);
+    }
+
+    process_scan_free(scan);
+    process_worker_unref(worker);
+    return G_SOURCE_REMOVE;
+}
+
+/* Worker thread: touches nothing but the scan it was given */
+static void process_worker_run(gpointer data, gpointer user_data G_GNUC_UNUSED) 
+{
+    ProcessScan *scan = data;
+
+    if (scan->pid) 
+    {
+        ClassicProcessClass process_class;
+        classlib_classify_process(scan->pid, &process_class);
+    }
+    else 
+    {
+        scan->desktop_processes = classlib_scan_desktop_managers(&scan->entries_scanned);
+    }
+
+    /* An idle source rather than g_main_context_invoke(), which would run the
+     * delivery right here if no main loop happened to own the context */
+    GSource *source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, process_worker_deliver, scan, NULL);
+    g_source_attach(source, scan->worker->context);
+    g_source_unref(source);
+}
+
+/* Start the worker and its first scan; NULL if no thread could be started */
+static ProcessWorker *process_worker_new(FocusMenuModel *model) 
+{
+    GError *error = NULL;
+    ProcessWorker *worker = g_new0(ProcessWorker, 1);
+
+    worker->pool = g_thread_pool_new(process_worker_run, worker, 1, FALSE, &error);
+    if (!worker->pool) 
+    {
+        g_warning("Focus Menu: no process worker thread, scanning on the main thread: %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        g_free(worker);
+        return NULL;
+    }
+
+    worker->context = g_main_context_ref_thread_default();
+    worker->model = model;
+    worker->ref_count = 1;
+
+    process_worker_request_scan(worker);
+    return worker;
+}
+
+/* Queue a scan of the process table, which also reclassifies every process; coalesces while one runs */
+static void process_worker_request_scan(ProcessWorker *worker) 
+{
+    if (!worker || !worker->model) return;
+
+    if (worker->busy) 
+    {
+        worker->rescan = TRUE;
+        return;
+    }
+
+    ProcessScan *scan = g_new0(ProcessScan, 1);
+    scan->worker = worker;
+
+    GError *error = NULL;
+    worker->ref_count++;
+    worker->busy = TRUE;
+    if (!g_thread_pool_push(worker->pool, scan, &error)) 
+    {
+        g_warning("Focus Menu: could not queue a process scan: %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        worker->busy = FALSE;
+        worker->ref_count--;
+        process_scan_free(scan);
+    }
+}
+
+/* Queue the classification of one new process, unless it already has a verdict.
+ * Runs alongside scans without touching their coalescing; the pool keeps order */
+static void process_worker_request_classify(ProcessWorker *worker, pid_t pid) 
+{
+    ClassicProcessClass process_class;
+    if (!worker || !worker->model || pid <= 0 || classlib_lookup_process_class(pid, &process_class)) return;
+
+    ProcessScan *scan = g_new0(ProcessScan, 1);
+    scan->worker = worker;
+    scan->pid = pid;
+
+    GError *error = NULL;
+    worker->ref_count++;
+    if (!g_thread_pool_push(worker->pool, scan, &error)) 
+    {
+        g_warning("Focus Menu: could not queue a process classification: %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        worker->ref_count--;
+        process_scan_free(scan);
+    }
+}
+
+/* Desktop managers from the last finished scan, owned by the worker; NULL before the first */
+static GList *process_worker_get_desktop_processes(ProcessWorker *worker) 
+{
+    return worker->desktop_processes;
+}
+
+/* Drop queued scans, wait for a running one, and let results still on their way be discarded */
+static void process_worker_close(ProcessWorker *worker) 
+{
+    if (!worker) return;
+
+    worker->model = NULL;
+    g_thread_pool_free(worker->pool, TRUE, TRUE);
+    worker->pool = NULL;
+    process_worker_unref(worker);
+}
+
+/* =============================================================================
+ * SHARED BACKEND
+ * A panel with the plugin on several panels or monitors runs every instance
+ * in one process. They all watch the same screen, so one reference-counted
+ * backend holds the wnck handle, the window source, the model with its name
+ * and icon caches, and the process worker; each instance keeps its widgets,
+ * settings and hidden-application registry, and borrows the rest
+ * ============================================================================= */
+
+struct _FocusMenuBackend
+{
+    gint ref_count;              /* One per instance */
+    WnckHandle *handle;          /* handle and screen are NULL when FOCUS_MENU_SOURCE=xcb picked the xcb source */
+    WnckScreen *screen;
+    FocusMenuWindowSource *source;
+    FocusMenuModel *model;
+    ProcessWorker *process_worker;   /* NULL if no thread could be started */
+    EventRecorder *recorder;         /* NULL unless FOCUS_MENU_RECORD is set */
+    GList *instances;                /* FocusMenuPlugin*, oldest first */
+
+    /* One D-Bus service per process, whichever instances come and go */
+    guint dbus_owner_id;
+    GDBusConnection *dbus_connection;
+    guint dbus_registration_id;
+};
+
+static FocusMenuBackend *shared_backend;
+
+/* The model has a single listener; every instance hears its changes, and they go out once on the bus */
+static void focus_menu_backend_on_model_changed(FocusMenuModel *model, FocusMenuModelChange change, gpointer object, gulong id, gpointer user_data) 
+{
+    FocusMenuBackend *backend = (FocusMenuBackend *)user_data;
+
+    if (change == MODEL_APPLICATION_ADDED) 
+    {
+        /* Classify the new process off this thread before any menu asks about it */
+        process_worker_request_classify(backend->process_worker, focus_menu_source_app_get_pid(model->source, object));
+    }
+
+    for (GList *l = backend->instances; l; l = l->next) 
+    {
+        focus_menu_on_model_changed(model, change, object, id, l->data);
+    }
+    dbus_emit_model_change(backend, change, id);
+}
+
+static FocusMenuBackend *focus_menu_backend_new(ClassicLocaleType locale_type) 
+{
+    FocusMenuBackend *backend = g_new0(FocusMenuBackend, 1);
+
+    #ifdef FOCUS_MENU_XCB
+    /* FOCUS_MENU_SOURCE=xcb follows windows over a direct X connection instead of libwnck */
+    if (g_strcmp0(g_getenv("FOCUS_MENU_SOURCE"), "xcb") == 0) 
+    {
+        backend->source = focus_menu_xcb_source_new(NULL);
+        if (!backend->source) 
+        {
+            g_warning("Focus Menu: could not start the xcb window source, using libwnck");
+        }
+    }
+    #endif
+
+    if (!backend->source) 
+    {
+        /* Initialize libwnck with the new handle-based API */
+        backend->handle = wnck_handle_new(WNCK_CLIENT_TYPE_PAGER);
+        backend->screen = wnck_handle_get_default_screen(backend->handle);
+
+        /* No forced update: wnck reads the screen on its first idle, and the
+         * window-opened and active-window-changed signals that follow fill the
+         * model and the button the same way later changes do */
+        backend->source = focus_menu_wnck_source_new(backend->screen);
+    }
+
+    /* Build the window/application model before any instance's screen handlers run.
+     * It starts with Caja's sorting style; the process worker's first scan finds
+     * the desktop manager, and without a worker the scan happens here */
+    backend->model = focus_menu_model_new(backend->source, CLASSLIB_SORT_STYLE_CAJA, locale_type);
+    focus_menu_model_set_notify(backend->model, focus_menu_backend_on_model_changed, backend);
+    backend->process_worker = process_worker_new(backend->model);
+    if (!backend->process_worker) 
+    {
+        focus_menu_model_set_sort_style(backend->model, determine_sort_style(backend->source));
+    }
+
+    /* FOCUS_MENU_RECORD writes every window event the model sees to a file */
+    const gchar *record_path = g_getenv("FOCUS_MENU_RECORD");
+    if (record_path && *record_path) 
+    {
+        backend->recorder = event_recorder_start(backend->source, record_path);
+        if (backend->recorder) 
+        {
+            g_message("Focus Menu: recording window events to %s", record_path);
+        }
+    }
+
+    /* Share the model with other programs on the session bus */
+    dbus_service_start(backend);
+    return backend;
+}
+
+static void focus_menu_backend_free(FocusMenuBackend *backend) 
+{
+    dbus_service_stop(backend);
+    process_worker_close(backend->process_worker);
+
+    /* The recorder steps aside, the model stops listening, and the source
+     * disconnects its handlers */
+    event_recorder_stop(backend->recorder);
+    focus_menu_model_free(backend->model);
+    focus_menu_source_free(backend->source);
+
+    /* Clean up the wnck handle, if the source was wnck's */
+    if (backend->handle) 
+    {
+        g_object_unref(backend->handle);
+    }
+    g_free(backend);
+}
+
+/* Attach an instance to the backend, creating it for the first one */
+static void focus_menu_backend_acquire(FocusMenuPlugin *plugin) 
+{
+    if (!shared_backend) 
+    {
+        shared_backend = focus_menu_backend_new(plugin->locale_type);
+    }
+
+    FocusMenuBackend *backend = shared_backend;
+    backend->ref_count++;
+    backend->instances = g_list_append(backend->instances, plugin);
+
+    plugin->backend = backend;
+    plugin->source = backend->source;
+    plugin->model = backend->model;
+    plugin->recorder = backend->recorder;
+    plugin->process_worker = backend->process_worker;
+}
+
+/* Detach an instance; the last one out frees the backend */
+static void focus_menu_backend_release(FocusMenuPlugin *plugin) 
+{
+    FocusMenuBackend *backend = plugin->backend;
+    if (!backend) return;
+
+    backend->instances = g_list_remove(backend->instances, plugin);
+    plugin->backend = NULL;
+    plugin->source = NULL;
+    plugin->model = NULL;
+    plugin->recorder = NULL;
+    plugin->process_worker = NULL;
+
+    if (--backend->ref_count > 0) return;
+
+    if (backend == shared_backend) shared_backend = NULL;
+    focus_menu_backend_free(backend);
+}
+
+/* =============================================================================
+ * WINDOW / APPLICATION MODEL
+ * Kept current from the window source's events, so building the menu and
+ * the bulk commands read prepared records instead of re-querying the source
+ * ============================================================================= */
+
+/* Build the label a window gets in an application's submenu */
+static gchar *build_window_menu_label(const gchar *window_name, const gchar *app_name) 
+{
+    if (!window_name) window_name = "Untitled";
+
+    /* Ensure window name is valid UTF-8 before any processing */
+    gchar *safe_window_name = classlib_dup_valid_utf8(window_name);
+
+    /* Remove redundant application name suffix */
+    gchar *clean_window_name = classlib_remove_app_name_suffix(safe_window_name, app_name);
+
+    /* Truncate very long window names for better usability */
+    gchar *display_name;
+    if (strlen(clean_window_name) > 50 && g_utf8_strlen(clean_window_name, -1) > 47) 
+    {
+        /* Use g_utf8_substring to safely truncate without breaking UTF-8 characters */
+        gchar *truncated = g_utf8_substring(clean_window_name, 0, 47);
+        display_name = g_strconcat(truncated, "...", NULL);
+        g_free(truncated);
+    } 
+    else 
+    {
+        display_name = g_strdup(clean_window_name);
+    }
+
+    /* Double-check that our final display name is valid UTF-8 */
+    if (!g_utf8_validate(display_name, -1, NULL)) 
+    {
+        gchar *temp = display_name;
+        display_name = classlib_dup_valid_utf8(temp);
+        g_free(temp);
+
+        /* If classlib_dup_valid_utf8 still couldn't fix it, use fallback */
+        if (!display_name || strlen(display_name) == 0) 
+        {
+            g_free(display_name);
+            display_name = g_strdup("Window");
+        }
+    }
+
+    g_free(clean_window_name);
+    g_free(safe_window_name);
+    return display_name;
+}
+
+static void focus_menu_window_record_free(FocusMenuWindowRecord *record) 
+{
+    if (record) 
+    {
+        g_free(record->menu_label);
+        g_free(record->sort_key);
+        g_free(record);
+    }
+}
+
+static void focus_menu_app_record_free(FocusMenuAppRecord *record) 
+{
+    if (record) 
+    {
+        g_free(record->display_name);
+        g_free(record->sort_key);
+        g_list_free(record->windows);
+        if (record->menu_icon) 
+        {
+            g_object_unref(record->menu_icon);
+        }
+        g_free(record);
+    }
+}
+
+/* Tell the listener, if any, about a change to object */
+static void focus_menu_model_notify(FocusMenuModel *model, FocusMenuModelChange change, gpointer object) 
+{
+    if (!model->notify) return;
+
+    gulong id = 0;
+    switch (change) 
+    {
+        case MODEL_APPLICATION_ADDED:
+        case MODEL_APPLICATION_REMOVED:
+        case MODEL_APPLICATION_CHANGED:
+            id = focus_menu_source_app_get_id(model->source, object);
+            break;
+        case MODEL_WINDOW_ADDED:
+        case MODEL_WINDOW_REMOVED:
+        case MODEL_WINDOW_CHANGED:
+        case MODEL_ACTIVE_WINDOW_CHANGED:
+            id = object ? focus_menu_source_window_get_id(model->source, object) : 0;
+            break;
+        case MODEL_ACTIVE_WORKSPACE_CHANGED:
+            break;
+    }
+    model->notify(model, change, object, id, model->notify_data);
+}
+
+/* Decide which menu counters a window belongs to, from its cached flags */
+static void window_record_classify(FocusMenuModel *model, FocusMenuWindowRecord *record) 
+{
+    FocusMenuSourceWorkspace *active_ws = model->active_workspace;
+    gboolean on_active_ws = active_ws && (record->is_pinned || record->workspace == active_ws);
+
+    /* Same rules the menu always used: normal windows on this workspace, or minimized anywhere */
+    record->in_menu = active_ws && record->is_normal && (record->is_minimized || on_active_ws);
+    record->hideable_visible = on_active_ws && record->is_normal && !record->is_minimized && !record->is_desktop_named;
+}
+
+/* Add (sign = 1) or remove (sign = -1) a window's share of the counters */
+static void window_record_account(FocusMenuModel *model, FocusMenuWindowRecord *record, gint sign) 
+{
+    FocusMenuAppRecord *app_record = record->app_record;
+
+    if (record->in_menu) 
+    {
+        app_record->n_menu_windows += sign;
+        if (record->is_minimized) 
+        {
+            model->n_minimized += sign;
+        }
+    }
+
+    if (record->hideable_visible) 
+    {
+        app_record->n_hideable_visible += sign;
+        model->n_hideable_visible += sign;
+    }
+}
+
+/* Add an application to the pid index; unknown pids (0) are not indexed */
+static void model_pid_index_add(FocusMenuModel *model, FocusMenuAppRecord *record) 
+{
+    if (record->pid <= 0) return;
+
+    /* Stolen and put back, so replacing the entry doesn't free the list */
+    gpointer key = GINT_TO_POINTER(record->pid);
+    GList *records = g_hash_table_lookup(model->apps_by_pid, key);
+    g_hash_table_steal(model->apps_by_pid, key);
+    g_hash_table_insert(model->apps_by_pid, key, g_list_append(records, record));
+}
+
+static void model_pid_index_remove(FocusMenuModel *model, FocusMenuAppRecord *record) 
+{
+    if (record->pid <= 0) return;
+
+    gpointer key = GINT_TO_POINTER(record->pid);
+    GList *records = g_hash_table_lookup(model->apps_by_pid, key);
+    g_hash_table_steal(model->apps_by_pid, key);
+    records = g_list_remove(records, record);
+    if (records) 
+    {
+        g_hash_table_insert(model->apps_by_pid, key, records);
+    }
+}
+
+/* A window that can stand for its process's desktop */
+static gboolean window_record_is_desktop(const FocusMenuWindowRecord *record) 
+{
+    return record->is_desktop_type || record->is_desktop_named;
+}
+
+/* Pick pid's desktop window again from its applications' windows, desktop-type ones first */
+static void model_desktop_index_rebuild(FocusMenuModel *model, pid_t pid) 
+{
+    FocusMenuWindowRecord *best = NULL;
+
+    for (GList *a = focus_menu_model_list_apps_by_pid(model, pid); a; a = a->next) 
+    {
+        for (GList *w = ((FocusMenuAppRecord *)a->data)->windows; w; w = w->next) 
+        {
+            FocusMenuWindowRecord *record = (FocusMenuWindowRecord *)w->data;
+            if (!window_record_is_desktop(record)) continue;
+            if (!best || (record->is_desktop_type && !best->is_desktop_type)) 
+            {
+                best = record;
+            }
+        }
+    }
+
+    if (best) 
+    {
+        g_hash_table_insert(model->desktop_windows, GINT_TO_POINTER(pid), best);
+    } 
+    else 
+    {
+        g_hash_table_remove(model->desktop_windows, GINT_TO_POINTER(pid));
+    }
+}
+
+/* After a window's flags or membership changed; only desktop windows cost a rebuild */
+static void model_desktop_index_update(FocusMenuModel *model, FocusMenuWindowRecord *record) 
+{
+    pid_t pid = record->app_record->pid;
+    if (pid <= 0) return;
+
+    if (window_record_is_desktop(record) || g_hash_table_lookup(model->desktop_windows, GINT_TO_POINTER(pid)) == record) 
+    {
+        model_desktop_index_rebuild(model, pid);
+    }
+}
+
+/* Re-read the cheap window flags from the source and update the counters */
+static void window_record_refresh_state(FocusMenuModel *model, FocusMenuWindowRecord *record) 
+{
+    FocusMenuSourceWindow *window = record->window;
+    const char *window_name = focus_menu_source_window_get_name(model->source, window);
+    FocusMenuSourceWindowState state = focus_menu_source_window_get_state(model->source, window);
+
+    FocusMenuSourceWindowType type = focus_menu_source_window_get_type(model->source, window);
+
+    window_record_account(model, record, -1);
+
+    record->is_normal = type == FOCUS_MENU_SOURCE_WINDOW_NORMAL;
+    record->is_desktop_type = type == FOCUS_MENU_SOURCE_WINDOW_DESKTOP;
+    record->is_desktop_named = window_name && (g_strcmp0(window_name, "Desktop") == 0 || g_str_has_suffix(window_name, "Desktop"));
+    record->was_minimized = record->is_minimized;
+    record->is_minimized = (state & FOCUS_MENU_SOURCE_STATE_MINIMIZED) != 0;
+    record->is_pinned = (state & FOCUS_MENU_SOURCE_STATE_PINNED) != 0;
+    record->workspace = focus_menu_source_window_get_workspace(model->source, window);
+
+    window_record_classify(model, record);
+    window_record_account(model, record, 1);
+    model_desktop_index_update(model, record);
+}
+
+/* Recompute the display strings for a window (title or app name changed) */
+static void window_record_refresh_strings(FocusMenuModel *model, FocusMenuWindowRecord *record) 
+{
+    const char *window_name = focus_menu_source_window_get_name(model->source, record->window);
+
+    g_free(record->menu_label);
+    record->menu_label = build_window_menu_label(window_name, record->app_record->display_name);
+
+    /* Sort on just the document part of the title */
+    gchar *document_name = classlib_extract_document_name_for_sorting(window_name ? window_name : "");
+    g_free(record->sort_key);
+    record->sort_key = classlib_file_manager_aware_sort_key(document_name, model->sort_style, model->locale_type);
+    g_free(document_name);
+}
+
+/* Recompute an application's display name and anything derived from it.
+ * Returns FALSE if the name was unchanged; nobody is notified */
+static gboolean app_record_update_name(FocusMenuModel *model, FocusMenuAppRecord *record) 
+{
+    FocusMenuWindowRecord *first_window = record->windows ? record->windows->data : NULL;
+    const char *display_name = source_app_get_display_name(model->source, record->app, first_window ? first_window->window : NULL);
+
+    if (record->display_name && g_strcmp0(display_name, record->display_name) == 0) 
+    {
+        perf_counters.display_name_hits++;
+        return FALSE;
+    }
+    perf_counters.display_name_misses++;
+
+    g_free(record->display_name);
+    record->display_name = g_strdup(display_name);
+    g_free(record->sort_key);
+    record->sort_key = classlib_file_manager_aware_sort_key(record->display_name, model->sort_style, model->locale_type);
+    model->sorted_apps_dirty = TRUE;
+
+    /* Submenu labels strip the application name, so they follow it */
+    for (GList *l = record->windows; l; l = l->next) 
+    {
+        window_record_refresh_strings(model, (FocusMenuWindowRecord *)l->data);
+    }
+    return TRUE;
+}
+
+/* As app_record_update_name(), telling the listener when the name changed */
+static void app_record_refresh_name(FocusMenuModel *model, FocusMenuAppRecord *record) 
+{
+    if (app_record_update_name(model, record)) 
+    {
+        focus_menu_model_notify(model, MODEL_APPLICATION_CHANGED, record->app);
+    }
+}
+
+static void app_record_invalidate_icon(FocusMenuAppRecord *record) 
+{
+    if (record->menu_icon) 
+    {
+        g_object_unref(record->menu_icon);
+        record->menu_icon = NULL;
+    }
+}
+
+static FocusMenuAppRecord *focus_menu_model_ensure_app(FocusMenuModel *model, FocusMenuSourceApp *app) 
+{
+    FocusMenuAppRecord *record = g_hash_table_lookup(model->apps, app);
+    if (record) 
+    {
+        return record;
+    }
+
+    record = g_new0(FocusMenuAppRecord, 1);
+    record->app = app;
+    record->pid = focus_menu_source_app_get_pid(model->source, app);
+    g_hash_table_insert(model->apps, app, record);
+    model_pid_index_add(model, record);
+
+    /* No ApplicationChanged for an application nobody has been told about yet */
+    app_record_update_name(model, record);
+    model->sorted_apps_dirty = TRUE;
+    focus_menu_model_notify(model, MODEL_APPLICATION_ADDED, app);
+    return record;
+}
+
+static void focus_menu_model_remove_app(FocusMenuModel *model, FocusMenuSourceApp *app) 
+{
+    FocusMenuAppRecord *record = g_hash_table_lookup(model->apps, app);
+    if (!record) 
+    {
+        return;
+    }
+
+    /* Another application of the same process may hold its desktop window now */
+    model_pid_index_remove(model, record);
+    if (record->pid > 0) 
+    {
+        model_desktop_index_rebuild(model, record->pid);
+    }
+
+    g_hash_table_remove(model->apps, app);
+    model->sorted_apps_dirty = TRUE;
+    focus_menu_model_notify(model, MODEL_APPLICATION_REMOVED, app);
+}
+
+static void focus_menu_model_add_window(FocusMenuModel *model, FocusMenuSourceWindow *window) 
+{
+    if (!window || g_hash_table_contains(model->windows, window)) 
+    {
+        return;
+    }
+
+    FocusMenuSourceApp *app = focus_menu_source_window_get_app(model->source, window);
+    if (!app) 
+    {
+        return;
+    }
+
+    FocusMenuAppRecord *app_record = focus_menu_model_ensure_app(model, app);
+
+    FocusMenuWindowRecord *record = g_new0(FocusMenuWindowRecord, 1);
+    record->window = window;
+    record->app_record = app_record;
+    g_hash_table_insert(model->windows, window, record);
+    g_hash_table_insert(model->windows_by_id, GSIZE_TO_POINTER(focus_menu_source_window_get_id(model->source, window)), record);
+    app_record->windows = g_list_append(app_record->windows, record);
+
+    window_record_refresh_state(model, record);
+
+    /* A first window may give a nameless application its name */
+    app_record_refresh_name(model, app_record);
+    if (!record->menu_label) 
+    {
+        window_record_refresh_strings(model, record);
+    }
+    focus_menu_model_notify(model, MODEL_WINDOW_ADDED, window);
+}
+
+static void focus_menu_model_remove_window(FocusMenuModel *model, FocusMenuSourceWindow *window) 
+{
+    FocusMenuWindowRecord *record = g_hash_table_lookup(model->windows, window);
+    if (!record) 
+    {
+        return;
+    }
+
+    window_record_account(model, record, -1);
+    record->app_record->windows = g_list_remove(record->app_record->windows, record);
+    model_desktop_index_update(model, record);
+
+    if (model->active_window == window) 
+    {
+        model->active_window = NULL;
+    }
+
+    g_hash_table_remove(model->windows_by_id, GSIZE_TO_POINTER(focus_menu_source_window_get_id(model->source, window)));
+    g_hash_table_remove(model->windows, window);
+    focus_menu_model_notify(model, MODEL_WINDOW_REMOVED, window);
+}
+
+static void on_model_window_opened(FocusMenuSourceWindow *window, gpointer user_data) 
+{
+    focus_menu_model_add_window((FocusMenuModel *)user_data, window);
+}
 
-    /* Everything else is treated as UTF-8 locale */
-    return CLASSLIB_LOCALE_TYPE_UTF8;
+static void on_model_window_closed(FocusMenuSourceWindow *window, gpointer user_data) 
+{
+    focus_menu_model_remove_window((FocusMenuModel *)user_data, window);
 }
 
-/**
- * Get special character priority for different file managers.
- * Extracted from switcher menu's get_special_char_priority().
- */
-gint classlib_get_special_char_priority(const gchar *str, ClassicSortStyle sort_style) 
+static void on_model_window_changed(FocusMenuSourceWindow *window, FocusMenuSourceChange change, gpointer user_data) 
 {
-    if (!str || !*str) return 1;  /* Default priority for empty strings */
+    FocusMenuModel *model = (FocusMenuModel *)user_data;
+    FocusMenuWindowRecord *record = g_hash_table_lookup(model->windows, window);
+    if (!record) return;
+
+    switch (change) 
     {
-        switch (sort_style) 
+        case FOCUS_MENU_SOURCE_CHANGE_NAME:
         {
-            case CLASSLIB_SORT_STYLE_CAJA:
-            /* Caja: Both . and # files go to end */
-            if (str[0] == '.' || str[0] == '#') 
-            {
-                return 1;   /* Special files last */
-            } 
-            else 
-            {
-                return 0;   /* Normal files first */
-            }
-
-            case CLASSLIB_SORT_STYLE_THUNAR:
-            /* Thunar: Only . files get special treatment (go to beginning) */
-            if (str[0] == '.') 
-            {
-                return 0;   /* Hidden files first */
-            } 
-            else 
-            {
-                return 1;   /* Everything else (including #) second */
-            }
+            /* Desktop-named windows are protected from hiding */
+            window_record_refresh_state(model, record);
+            window_record_refresh_strings(model, record);
 
-            case CLASSLIB_SORT_STYLE_UNKNOWN:
-            default:
-            /* Default to Caja behavior */
-            if (str[0] == '.' || str[0] == '#') 
-            {
-                return 1;
-            } 
-            else 
+            /* Nameless applications borrow their first window's title */
+            const char *app_name = focus_menu_source_app_get_name(model->source, record->app_record->app);
+            if (!app_name || !*app_name) 
             {
-                return 0;
+                app_record_refresh_name(model, record->app_record);
             }
+            break;
         }
+        case FOCUS_MENU_SOURCE_CHANGE_STATE:
+        case FOCUS_MENU_SOURCE_CHANGE_WORKSPACE:
+            window_record_refresh_state(model, record);
+            break;
+        case FOCUS_MENU_SOURCE_CHANGE_ICON:
+            /* Application icons come from their windows */
+            app_record_invalidate_icon(record->app_record);
+            return;
     }
+    focus_menu_model_notify(model, MODEL_WINDOW_CHANGED, window);
 }
 
-/**
- * File manager aware string comparison.
- * Extracted from switcher menu's file_manager_aware_compare().
- */
-gint classlib_file_manager_aware_compare(const gchar *a, const gchar *b, ClassicSortStyle sort_style, ClassicLocaleType locale_type) 
+static void on_model_app_opened(FocusMenuSourceApp *app, gpointer user_data) 
+{
+    focus_menu_model_ensure_app((FocusMenuModel *)user_data, app);
+}
+
+static void on_model_app_closed(FocusMenuSourceApp *app, gpointer user_data) 
 {
-    if (!a && !b) return 0;
-    if (!a) return -1;
-    if (!b) return 1;
+    focus_menu_model_remove_app((FocusMenuModel *)user_data, app);
+}
 
-    /* Phase 1: Special character priority (different for each file manager) */
-    gint priority_a = classlib_get_special_char_priority(a, sort_style);
-    gint priority_b = classlib_get_special_char_priority(b, sort_style);
+static void on_model_app_changed(FocusMenuSourceApp *app, FocusMenuSourceChange change, gpointer user_data) 
+{
+    FocusMenuModel *model = (FocusMenuModel *)user_data;
+    FocusMenuAppRecord *record = g_hash_table_lookup(model->apps, app);
+    if (!record) return;
 
-    if (priority_a != priority_b) 
+    if (change == FOCUS_MENU_SOURCE_CHANGE_ICON) 
     {
-        return priority_a - priority_b;
+        app_record_invalidate_icon(record);
     }
-
-    /* Phase 2: Locale-aware comparison */
-    if (sort_style == CLASSLIB_SORT_STYLE_CAJA && locale_type == CLASSLIB_LOCALE_TYPE_C) 
-    {
-        /* Only Caja falls back to C locale sorting */
-        return strcmp(a, b);
-    } 
     else 
     {
-        /* Thunar always uses UTF-8, Caja uses UTF-8 in UTF-8 locales */
-        gchar *key_a = g_utf8_collate_key_for_filename(a, -1);
-        gchar *key_b = g_utf8_collate_key_for_filename(b, -1);
-        gint result = strcmp(key_a, key_b);
-        g_free(key_a);
-        g_free(key_b);
-        return result;
+        app_record_refresh_name(model, record);
     }
 }
-/* =============================================================================
- * DESKTOP FILE SEARCH SYSTEM
- * Extracted from spatial menu's desktop file search logic
- * ============================================================================= */
 
-/**
- * Parse desktop file for display name and icon.
- * Helper function for desktop file searching.
- */
-static gboolean parse_desktop_file_for_search(const gchar *desktop_path, gchar **display_name, gchar **icon_name) 
+static void on_model_active_window_changed(gpointer user_data) 
 {
-    GKeyFile *key_file = g_key_file_new();
-    GError *error = NULL;
+    FocusMenuModel *model = (FocusMenuModel *)user_data;
+    model->active_window = focus_menu_source_get_active_window(model->source);
+    focus_menu_model_notify(model, MODEL_ACTIVE_WINDOW_CHANGED, model->active_window);
+}
 
-    if (!g_key_file_load_from_file(key_file, desktop_path, G_KEY_FILE_NONE, &error)) 
-    {
-        g_key_file_free(key_file);
-        if (error) g_error_free(error);
-        return FALSE;
-    }
+/* The only O(windows) event: every window's workspace membership changes meaning */
+static void on_model_active_workspace_changed(gpointer user_data) 
+{
+    FocusMenuModel *model = (FocusMenuModel *)user_data;
+    model->active_workspace = focus_menu_source_get_active_workspace(model->source);
 
-    /* Get application name */
-    gchar *name = g_key_file_get_string(key_file, "Desktop Entry", "Name", NULL);
-    if (display_name) 
-    {
-        *display_name = name;
-    } 
-    else 
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, model->windows);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) 
     {
-        g_free(name);
+        FocusMenuWindowRecord *record = (FocusMenuWindowRecord *)value;
+        window_record_account(model, record, -1);
+        window_record_classify(model, record);
+        window_record_account(model, record, 1);
     }
+    focus_menu_model_notify(model, MODEL_ACTIVE_WORKSPACE_CHANGED, NULL);
+}
 
-    /* Get icon name */
-    gchar *icon = g_key_file_get_string(key_file, "Desktop Entry", "Icon", NULL);
-    if (icon_name) 
-    {
-        *icon_name = icon;
-    } 
-    else 
+static const FocusMenuSourceListener model_source_listener = 
+{
+    .window_opened = on_model_window_opened,
+    .window_closed = on_model_window_closed,
+    .window_changed = on_model_window_changed,
+    .app_opened = on_model_app_opened,
+    .app_closed = on_model_app_closed,
+    .app_changed = on_model_app_changed,
+    .active_window_changed = on_model_active_window_changed,
+    .active_workspace_changed = on_model_active_workspace_changed,
+};
+
+/* Create the model and load the windows the source already knows about */
+static FocusMenuModel *focus_menu_model_new(FocusMenuWindowSource *source, ClassicSortStyle sort_style, ClassicLocaleType locale_type) 
+{
+    FocusMenuModel *model = g_new0(FocusMenuModel, 1);
+    model->source = source;
+    model->sort_style = sort_style;
+    model->locale_type = locale_type;
+    model->apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)focus_menu_app_record_free);
+    model->windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)focus_menu_window_record_free);
+    model->windows_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    model->apps_by_pid = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_list_free);
+    model->desktop_windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+    model->active_window = focus_menu_source_get_active_window(source);
+    model->active_workspace = focus_menu_source_get_active_workspace(source);
+
+    for (GList *l = focus_menu_source_list_windows(source); l; l = l->next) 
     {
-        g_free(icon);
+        focus_menu_model_add_window(model, l->data);
     }
 
-    g_key_file_free(key_file);
-    return TRUE;
+    focus_menu_source_set_listener(source, &model_source_listener, model);
+    return model;
 }
 
-/**
- * Search a specific directory for desktop files matching an application name.
- * Extracted from spatial menu's search_desktop_dir_for_app().
- */
-gchar *classlib_search_desktop_directory(const gchar *dir_path, const gchar *app_name) 
+/* Install the single change listener; NULL removes it */
+static void focus_menu_model_set_notify(FocusMenuModel *model, FocusMenuModelNotify notify, gpointer user_data) 
 {
-    if (!dir_path || !app_name) 
-    {
-        return NULL;
-    }
+    model->notify = notify;
+    model->notify_data = user_data;
+}
 
-    DIR *dir = opendir(dir_path);
-    if (!dir) 
-    {
-        return NULL;
-    }
+static void focus_menu_model_free(FocusMenuModel *model) 
+{
+    if (!model) return;
 
-    struct dirent *entry;
-    gchar *result = NULL;
+    focus_menu_source_set_listener(model->source, NULL, NULL);
 
-    while ((entry = readdir(dir)) != NULL) 
-    {
-        if (!g_str_has_suffix(entry->d_name, ".desktop")) 
-        {
-            continue;
-        }
+    g_list_free(model->sorted_apps);
+    g_hash_table_destroy(model->desktop_windows);
+    g_hash_table_destroy(model->apps_by_pid);
+    g_hash_table_destroy(model->windows_by_id);
+    g_hash_table_destroy(model->windows);
+    g_hash_table_destroy(model->apps);
+    g_free(model);
+}
+
+static FocusMenuWindowRecord *focus_menu_model_get_window(FocusMenuModel *model, FocusMenuSourceWindow *window) 
+{
+    return (model && window) ? g_hash_table_lookup(model->windows, window) : NULL;
+}
+
+static FocusMenuAppRecord *focus_menu_model_get_app(FocusMenuModel *model, FocusMenuSourceApp *app) 
+{
+    return (model && app) ? g_hash_table_lookup(model->apps, app) : NULL;
+}
+
+/* Re-key every application and window for another sorting style */
+static void focus_menu_model_set_sort_style(FocusMenuModel *model, ClassicSortStyle sort_style) 
+{
+    if (!model || model->sort_style == sort_style) return;
+
+    model->sort_style = sort_style;
 
-        gchar *desktop_path = g_build_filename(dir_path, entry->d_name, NULL);
-        gchar *display_name = NULL;
-        gchar *icon_name = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, model->apps);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) 
+    {
+        FocusMenuAppRecord *record = value;
+        g_free(record->sort_key);
+        record->sort_key = classlib_file_manager_aware_sort_key(record->display_name, model->sort_style, model->locale_type);
 
-        if (parse_desktop_file_for_search(desktop_path, &display_name, &icon_name)) 
+        for (GList *l = record->windows; l; l = l->next) 
         {
-            if (display_name && g_ascii_strcasecmp(display_name, app_name) == 0) 
-            {
-                result = g_strdup(desktop_path);
-                g_free(display_name);
-                g_free(icon_name);
-                g_free(desktop_path);
-                break;
-            }
-            g_free(display_name);
-            g_free(icon_name);
+            window_record_refresh_strings(model, (FocusMenuWindowRecord *)l->data);
         }
-        g_free(desktop_path);
     }
-
-    closedir(dir);
-    return result;
+    model->sorted_apps_dirty = TRUE;
 }
 
-/*
- * Helper function to assist classlib_find_desktop_file in retrieving executables' desktop files.
- */
-static gchar *search_desktop_by_executable(const gchar *dir_path, const gchar *exe_name) 
+/* Oldest application of a process, if any */
+static FocusMenuAppRecord *focus_menu_model_find_app_by_pid(FocusMenuModel *model, pid_t pid) 
 {
-    DIR *dir = opendir(dir_path);
-    if (!dir) return NULL;
+    GList *records = focus_menu_model_list_apps_by_pid(model, pid);
+    return records ? records->data : NULL;
+}
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) 
-    {
-        if (!g_str_has_suffix(entry->d_name, ".desktop")) continue;
+/* Every application of a process, oldest first; the list belongs to the model */
+static GList *focus_menu_model_list_apps_by_pid(FocusMenuModel *model, pid_t pid) 
+{
+    return pid > 0 ? g_hash_table_lookup(model->apps_by_pid, GINT_TO_POINTER(pid)) : NULL;
+}
 
-        gchar *desktop_path = g_build_filename(dir_path, entry->d_name, NULL);
-        GKeyFile *keyfile = g_key_file_new();
+/* The process's desktop-type window, or else one titled "Desktop" */
+static FocusMenuWindowRecord *focus_menu_model_find_desktop_window(FocusMenuModel *model, pid_t pid) 
+{
+    return pid > 0 ? g_hash_table_lookup(model->desktop_windows, GINT_TO_POINTER(pid)) : NULL;
+}
 
-        if (g_key_file_load_from_file(keyfile, desktop_path, G_KEY_FILE_NONE, NULL)) 
-        {
-            gchar *exec = g_key_file_get_string(keyfile, "Desktop Entry", "Exec", NULL);
-            if (exec && strstr(exec, exe_name)) 
-            {
-                g_free(exec);
-                g_key_file_free(keyfile);
-                closedir(dir);
-                return desktop_path;
-            }
-            g_free(exec);
-        }
-        g_key_file_free(keyfile);
-        g_free(desktop_path);
+/* Application record by source id (a group leader XID under wnck); a walk,
+ * as only the bus asks by id */
+static FocusMenuAppRecord *focus_menu_model_find_app_by_id(FocusMenuModel *model, gulong id) 
+{
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, model->apps);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) 
+    {
+        FocusMenuAppRecord *record = value;
+        if (focus_menu_source_app_get_id(model->source, record->app) == id) return record;
     }
-    closedir(dir);
     return NULL;
 }
 
+/* Window record by source id (the XID under wnck) */
+static FocusMenuWindowRecord *focus_menu_model_find_window_by_id(FocusMenuModel *model, gulong id) 
+{
+    return g_hash_table_lookup(model->windows_by_id, GSIZE_TO_POINTER(id));
+}
 
-/**
- * Find desktop file for an application by name.
- * Extracted from spatial menu's find_desktop_file_for_application().
- */
-gchar *classlib_find_desktop_file(const gchar *app_name, WnckApplication *app) 
+/* Application of the active window, if any */
+static FocusMenuAppRecord *focus_menu_model_get_active_app(FocusMenuModel *model) 
+{
+    FocusMenuWindowRecord *record = focus_menu_model_get_window(model, model->active_window);
+    return record ? record->app_record : NULL;
+}
+
+static gint compare_app_records_by_sort_key(gconstpointer a, gconstpointer b) 
+{
+    const FocusMenuAppRecord *record_a = a;
+    const FocusMenuAppRecord *record_b = b;
+
+    return strcmp(record_a->sort_key, record_b->sort_key);
+}
+
+/* For g_qsort_with_data() over an array of FocusMenuWindowRecord* */
+static gint compare_window_record_ptrs_by_sort_key(gconstpointer a, gconstpointer b, gpointer user_data G_GNUC_UNUSED) 
 {
-    if (!app_name) return NULL;
+    const FocusMenuWindowRecord *record_a = *(FocusMenuWindowRecord *const *)a;
+    const FocusMenuWindowRecord *record_b = *(FocusMenuWindowRecord *const *)b;
+
+    return strcmp(record_a->sort_key, record_b->sort_key);
+}
 
-    const gchar *desktop_dirs[] = 
+/* All application records in display order; owned by the model, re-sorted only after changes */
+static GList *focus_menu_model_get_sorted_apps(FocusMenuModel *model) 
+{
+    if (model->sorted_apps_dirty) 
     {
-        "/usr/share/applications",
-        "/usr/local/share/applications",
-        NULL
-    };
+        g_list_free(model->sorted_apps);
+        model->sorted_apps = g_list_sort(g_hash_table_get_values(model->apps), compare_app_records_by_sort_key);
+        model->sorted_apps_dirty = FALSE;
+    }
+    return model->sorted_apps;
+}
+
+/* Append an application's windows that belong in the menu, sorted (ties in
+ * opening order); returns how many were added */
+static guint focus_menu_app_record_append_menu_windows(FocusMenuAppRecord *record, GPtrArray *window_records) 
+{
+    guint first = window_records->len;
+    for (GList *l = record->windows; l; l = l->next) 
+    {
+        FocusMenuWindowRecord *window_record = (FocusMenuWindowRecord *)l->data;
+        if (window_record->in_menu) 
+        {
+            g_ptr_array_add(window_records, window_record);
+        }
+    }
 
-    /* Try search variations */
-    gchar *search_names[4];
-    search_names[0] = g_strdup(app_name);
-    search_names[1] = g_ascii_strdown(app_name, -1);
-    search_names[2] = g_strdelimit(g_ascii_strdown(app_name, -1), " ", '-');
-    search_names[3] = NULL;
+    guint n_windows = window_records->len - first;
+    g_qsort_with_data(window_records->pdata + first, (gint)n_windows, sizeof(gpointer), compare_window_record_ptrs_by_sort_key, NULL);
+    return n_windows;
+}
 
-    for (int i = 0; desktop_dirs[i]; i++) 
+/* The application icon at menu size, scaled once and kept until the icon changes */
+static GdkPixbuf *focus_menu_app_record_get_menu_icon(FocusMenuModel *model, FocusMenuAppRecord *record) 
+{
+    if (!record->menu_icon) 
     {
-        for (int j = 0; search_names[j]; j++) 
+        GdkPixbuf *icon = focus_menu_source_app_get_icon(model->source, record->app);
+        if (icon) 
         {
-            gchar *result = classlib_search_desktop_directory(desktop_dirs[i], search_names[j]);
-            if (result) 
-            {
-                for (int k = 0; k < 3; k++) g_free(search_names[k]);
-                return result;
-            }
+            record->menu_icon = gdk_pixbuf_scale_simple(icon, 16, 16, GDK_INTERP_BILINEAR);
+            perf_counters.icon_scales++;
         }
     }
+    return record->menu_icon;
+}
 
-    for (int i = 0; i < 3; i++) g_free(search_names[i]);
-    /* Fallback: search by executable name */
-    pid_t pid = wnck_application_get_pid(app);
-    if (pid > 0) 
+/* Drop scaled menu icons down to keep, holding on to those of applications
+ * the menu lists first; returns how many were dropped */
+static guint focus_menu_model_trim_icons(FocusMenuModel *model, guint keep) 
+{
+    guint kept = 0;
+    guint dropped = 0;
+
+    for (gint pass = 0; pass < 2; pass++) 
     {
-        gchar *exe_name = classlib_get_process_name_from_pid(pid);
-        if (exe_name && g_strcmp0(exe_name, "unknown") != 0) 
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, model->apps);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) 
         {
-            for (int i = 0; desktop_dirs[i]; i++) 
+            FocusMenuAppRecord *record = (FocusMenuAppRecord *)value;
+            if (!record->menu_icon || (pass == 0) != (record->n_menu_windows > 0)) continue;
+
+            if (kept < keep) 
             {
-                gchar *result = search_desktop_by_executable(desktop_dirs[i], exe_name);
-                if (result) 
-                {
-                    g_free(exe_name);
-                    return result;
-                }
+                kept++;
+                continue;
             }
+            g_object_unref(record->menu_icon);
+            record->menu_icon = NULL;
+            dropped++;
         }
-        g_free(exe_name);
     }
-    return NULL;
-}
-/**
-* Natural string comparison with smart number handling.
-* Simplified version focusing on natural numeric ordering.
-*/
-gint classlib_natural_compare_strings(const gchar *a, const gchar *b) 
-{
-    if (!a && !b) return 0;
-    if (!a) return -1;
-    if (!b) return 1;
-
-    /* Use GLib's filename-aware collation which handles natural sorting */
-    gchar *key_a = g_utf8_collate_key_for_filename(a, -1);
-    gchar *key_b = g_utf8_collate_key_for_filename(b, -1);
-    gint result = strcmp(key_a, key_b);
-    g_free(key_a);
-    g_free(key_b);
-    return result;
+    return dropped;
 }
 
-/* END CLASSIC LIBRARY */
-
-/* Find the WnckApplication for a given PID */
-static WnckApplication *find_application_by_pid(WnckScreen *screen, pid_t pid) 
+/* Helper function to apply underline styling to desktop managers */
+static void apply_desktop_manager_styling(GtkWidget *menu_item) 
 {
-    if (!screen) return NULL;
+    if (!menu_item) return;
 
-    GList *windows = wnck_screen_get_windows(screen);
-    for (GList *l = windows; l; l = l->next) 
-    {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
+    /* Find the label widget in the menu item's box */
+    GtkWidget *box = gtk_bin_get_child(GTK_BIN(menu_item));
+    if (!GTK_IS_BOX(box)) return;
 
-        WnckApplication *app = wnck_window_get_application(window);
-        if (app && wnck_application_get_pid(app) == pid) 
+    GList *children = gtk_container_get_children(GTK_CONTAINER(box));
+    for (GList *child = children; child; child = child->next) 
+    {
+        if (GTK_IS_LABEL(child->data)) 
         {
-            return app;
+            GtkWidget *label = GTK_WIDGET(child->data);
+
+            /* Apply underline styling to indicate special desktop manager status */
+            PangoAttrList *attrs = pango_attr_list_new();
+            PangoAttribute *attr = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
+            pango_attr_list_insert(attrs, attr);
+            gtk_label_set_attributes(GTK_LABEL(label), attrs);
+            pango_attr_list_unref(attrs);
+
+            break;
         }
     }
-    return NULL;
+    g_list_free(children);
 }
 
-/* Enhanced find_all_desktop_managers that includes proper display names and icons */
-static GList *find_all_desktop_managers(WnckScreen *screen) 
+/* Whether an application draws the desktop, by the process classifier's verdict */
+static gboolean is_desktop_manager(FocusMenuPlugin *plugin, FocusMenuSourceApp *app) 
 {
-    GList *desktop_managers = NULL;
-    GDir *proc_dir;
-    const gchar *proc_entry;
-    WnckWindow *active_window = NULL;
+    if (!app) 
+    {
+        return FALSE;
+    }
 
-    if (screen) 
+    FocusMenuWindowSource *source = plugin->source;
+    pid_t pid = focus_menu_source_app_get_pid(source, app);
+    ClassicProcessClass process_class;
+
+    if (classlib_lookup_process_class(pid, &process_class)) 
     {
-        active_window = wnck_screen_get_active_window(screen);
-        /* Force update to ensure we have current window information */
-        wnck_screen_force_update(screen);
+        return (process_class.role & CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER) != 0;
     }
 
-    proc_dir = g_dir_open("/proc", 0, NULL);
-    if (!proc_dir) 
+    /* Not classified yet. Names that are only ever desktop managers need no
+     * command line; for the rest (a caja window or the desktop) it decides */
+    ClassicProcessRole roles = classlib_get_name_roles(focus_menu_source_app_get_name(source, app));
+    if (!(roles & CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER)) 
     {
-        g_warning("Could not open /proc directory");
-        return NULL;
+        return FALSE;
+    }
+    if (roles == CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER) 
+    {
+        return TRUE;
     }
 
-    while ((proc_entry = g_dir_read_name(proc_dir)) != NULL) 
+    /* A new process whose verdict the worker has not delivered yet; it was
+     * queued when the application opened. Until it arrives, count it as the
+     * desktop so Hide Others cannot hide it, and leave /proc to the worker */
+    if (plugin->process_worker) 
     {
-        /* Skip non-numeric entries (not PIDs) */
-        if (!g_ascii_isdigit(proc_entry[0])) 
-        {
-            continue;
-        }
+        return TRUE;
+    }
 
-        pid_t pid = (pid_t)atoi(proc_entry);
-        gchar *cmdline_path = g_strdup_printf("/proc/%s/cmdline", proc_entry);
-        gchar *cmdline = NULL;
-        gsize cmdline_length = 0;
+    return classlib_classify_process(pid, &process_class) &&
+           (process_class.role & CLASSLIB_PROCESS_ROLE_DESKTOP_MANAGER) != 0;
+}
 
-        if (g_file_get_contents(cmdline_path, &cmdline, &cmdline_length, NULL)) 
-        {
-            if (cmdline_length > 0) 
-            {
-                /* Extract the program name (first argument) */
-                gchar *program_name = g_strdup(cmdline);  /* First null-terminated string */
-                gchar *basename = g_path_get_basename(program_name);
 
-                /* Check if this is a known desktop manager */
-                gboolean is_desktop_manager = FALSE;
-                gchar *display_name = NULL;
+/* =============================================================================
+ * TRACE EVENTS
+ * Optional spans around the menu's hot paths, written as Chrome trace-event
+ * JSON (viewable in Perfetto or chrome://tracing). Spans go into a buffer
+ * allocated once when tracing is enabled; the file is only written after the
+ * menu closes, so the timed work isn't disturbed by I/O
+ * ============================================================================= */
 
-                if (g_strcmp0(basename, "xfdesktop") == 0) 
-                {
-                    is_desktop_manager = TRUE;
-                    display_name = g_strdup("Xfdesktop");  /* Will be updated from libwnck if available */
-                } 
-                else if (g_strcmp0(basename, "nemo-desktop") == 0) 
-                {
-                    is_desktop_manager = TRUE;
-                    display_name = g_strdup("Nemo");  /* Will be updated from libwnck if available */
-                } 
-                else if (g_strcmp0(basename, "caja") == 0) 
-                {
-                    /* Check if it's the desktop version of Caja */
-                    gboolean has_force_desktop = FALSE;
+/* Turn tracing on if FOCUS_MENU_TRACE is set or the hidden "trace" property is true */
+static void trace_init(FocusMenuPlugin *plugin) 
+{
+    const gchar *env = g_getenv("FOCUS_MENU_TRACE");
+    gboolean enabled = env && *env && g_strcmp0(env, "0") != 0;
 
-                    if (cmdline_length > 15) 
-                    {
-                        for (gsize i = 0; i <= cmdline_length - 15; i++) 
-                        {
-                            if (memcmp(&cmdline[i], "--force-desktop", 15) == 0) 
-                            {
-                                has_force_desktop = TRUE;
-                                break;
-                            }
-                        }
-                    }
+    if (!enabled && plugin->channel) 
+    {
+        gchar *prop_name = focus_menu_get_property_name(plugin, "trace");
+        enabled = xfconf_channel_get_bool(plugin->channel, prop_name, FALSE);
+        g_free(prop_name);
+    }
 
-                    if (has_force_desktop) 
-                    {
-                        is_desktop_manager = TRUE;
-                        display_name = g_strdup("Caja");  /* Will be updated from libwnck if available */
-                    }
-                }
+    if (!enabled || plugin->trace_events) return;
 
-                if (is_desktop_manager) 
-                {
-                    /* Try to find the corresponding WnckApplication for better name/icon */
-                    WnckApplication *app = find_application_by_pid(screen, pid);
-                    if (app) 
-                    {
-                        /* Use the proper application display name */
-                        const char *app_display_name = classlib_get_application_display_name(app);
-                        if (app_display_name) 
-                        {
-                            g_free(display_name);
-                            display_name = g_strdup(app_display_name);
-                        }
-                    }
+    plugin->trace_events = g_new0(TraceEvent, TRACE_BUFFER_EVENTS);
+    plugin->trace_count = 0;
+    plugin->trace_file_started = FALSE;
 
-                    /* Check if this desktop manager is currently active */
-                    gboolean is_active = FALSE;
-                    if (active_window == NULL) 
-                    {
-                        /* No active window means desktop is focused */
-                        is_active = TRUE;
-                    } 
-                    else 
-                    {
-                        /* Check if the active window belongs to this desktop manager */
-                        WnckApplication *active_app = wnck_window_get_application(active_window);
-                        if (active_app && wnck_application_get_pid(active_app) == pid) 
-                        {
-                            is_active = TRUE;
-                        }
-                    }
+    gchar *file_name = g_strdup_printf("focus-menu-%d-%d.trace.json", xfce_panel_plugin_get_unique_id(plugin->plugin), (int)getpid());
+    plugin->trace_path = g_build_filename(g_get_user_runtime_dir(), file_name, NULL);
+    g_free(file_name);
 
-                    DesktopManagerInfo *dm_info = g_new0(DesktopManagerInfo, 1);
-                    dm_info->pid = pid;
-                    dm_info->name = g_strdup(basename);
-                    dm_info->display_name = display_name;  /* Transfer ownership */
-                    dm_info->is_active = is_active;
+    g_message("Focus Menu: tracing to %s", plugin->trace_path);
+}
 
-                    desktop_managers = g_list_append(desktop_managers, dm_info);
-                }
-                g_free(program_name);
-                g_free(basename);
-            }
-        }
-        g_free(cmdline);
-        g_free(cmdline_path);
-    }
-    g_dir_close(proc_dir);
-    return desktop_managers;
+/* Start a span; returns 0 when tracing is off so callers need no checks */
+static gint64 trace_begin(FocusMenuPlugin *plugin) 
+{
+    return plugin->trace_events ? g_get_monotonic_time() : 0;
 }
 
+/* Close a span opened with trace_begin(). name must be a string literal */
+static void trace_end(FocusMenuPlugin *plugin, const char *name, gint64 start_us) 
+{
+    if (!plugin->trace_events) return;
 
-/* Free desktop manager info */
-static void desktop_manager_info_free(DesktopManagerInfo *dm_info) 
+    gint64 end_us = g_get_monotonic_time();
+
+    /* A full buffer is written out rather than dropping spans */
+    if (plugin->trace_count == TRACE_BUFFER_EVENTS) 
+    {
+        trace_flush(plugin);
+    }
+
+    TraceEvent *event = &plugin->trace_events[plugin->trace_count++];
+    event->name = name;
+    event->start_us = start_us;
+    event->duration_us = end_us - start_us;
+}
+
+/* Append buffered spans to the trace file and empty the buffer */
+static void trace_flush(FocusMenuPlugin *plugin) 
 {
-    if (dm_info) 
+    if (!plugin->trace_events || plugin->trace_count == 0) return;
+
+    FILE *file = g_fopen(plugin->trace_path, plugin->trace_file_started ? "a" : "w");
+    if (!file) 
     {
-        g_free(dm_info->name);
-        g_free(dm_info->display_name);
-        g_free(dm_info);
+        g_warning("Failed to open trace file %s", plugin->trace_path);
+        plugin->trace_count = 0;
+        return;
+    }
+
+    /* JSON array format; the closing bracket is optional until the plugin exits */
+    if (!plugin->trace_file_started) 
+    {
+        fputs("[\n", file);
     }
+
+    int pid = (int)getpid();
+    for (guint i = 0; i < plugin->trace_count; i++) 
+    {
+        TraceEvent *event = &plugin->trace_events[i];
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"focus-menu\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d}\n",
+        (plugin->trace_file_started || i > 0) ? "," : "", event->name, event->start_us, event->duration_us, pid, pid);
+    }
+
+    fclose(file);
+    plugin->trace_file_started = TRUE;
+    plugin->trace_count = 0;
 }
 
-/* Desktop manager detection for sorting style */
-static ClassicSortStyle determine_sort_style(WnckScreen *screen) 
+static gboolean on_trace_flush_idle(gpointer user_data) 
 {
-    if (!screen) 
+    FocusMenuPlugin *plugin = (FocusMenuPlugin *)user_data;
+    plugin->trace_flush_idle_id = 0;
+    trace_flush(plugin);
+    return G_SOURCE_REMOVE;
+}
+
+/* Write the spans once the menu has gone away and the main loop is quiet */
+static void on_menu_deactivate(GtkMenuShell *menu G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+{
+    if (plugin->trace_events && !plugin->trace_flush_idle_id) 
     {
-        return CLASSLIB_SORT_STYLE_CAJA;
+        plugin->trace_flush_idle_id = g_idle_add_full(G_PRIORITY_LOW, on_trace_flush_idle, plugin, NULL);
     }
 
-    /* Use existing desktop manager detection */
-    GList *desktop_managers = find_all_desktop_managers(screen);
-    ClassicSortStyle result = CLASSLIB_SORT_STYLE_UNKNOWN;
+    memory_release_schedule(plugin);
+}
+
+/* Flush, close the JSON array and release the buffer */
+static void trace_shutdown(FocusMenuPlugin *plugin) 
+{
+    if (!plugin->trace_events) return;
 
-    for (GList *l = desktop_managers; l; l = l->next) 
+    if (plugin->trace_flush_idle_id) 
     {
-        DesktopManagerInfo *dm_info = (DesktopManagerInfo *)l->data;
+        g_source_remove(plugin->trace_flush_idle_id);
+        plugin->trace_flush_idle_id = 0;
+    }
 
-        if (g_strcmp0(dm_info->name, "caja") == 0) 
-        {
-            result = CLASSLIB_SORT_STYLE_CAJA;
-            break;
-        } 
-        else if (g_strcmp0(dm_info->name, "xfdesktop") == 0) 
+    trace_flush(plugin);
+    if (plugin->trace_file_started) 
+    {
+        FILE *file = g_fopen(plugin->trace_path, "a");
+        if (file) 
         {
-            result = CLASSLIB_SORT_STYLE_THUNAR;
-            break;
+            fputs("]\n", file);
+            fclose(file);
         }
     }
 
-    /* Clean up */
-    g_list_free_full(desktop_managers, (GDestroyNotify)desktop_manager_info_free);
+    g_free(plugin->trace_events);
+    plugin->trace_events = NULL;
+    g_free(plugin->trace_path);
+    plugin->trace_path = NULL;
+}
+
+/* =============================================================================
+ * ALLOCATION PHASES
+ * Names the part of menu construction that is running, for the allocation
+ * counter in bench/alloc-shim.c. The shim defines focus_menu_alloc_phase()
+ * when it is preloaded; otherwise the weak reference stays NULL and marking
+ * a phase costs one test
+ * ============================================================================= */
 
-    if (result == CLASSLIB_SORT_STYLE_UNKNOWN) 
-    {
-        result = CLASSLIB_SORT_STYLE_CAJA;  /* Default fallback */
-    }
+extern const char *focus_menu_alloc_phase(const char *phase) __attribute__((weak));
+
+/* Enter phase (NULL for none); returns the phase it replaces, for restoring */
+static const char *alloc_phase(const char *phase) 
+{
+    return focus_menu_alloc_phase ? focus_menu_alloc_phase(phase) : NULL;
+}
+
+#ifdef DEBUG
+/* =============================================================================
+ * X REQUEST ACCOUNTING
+ * Debug builds count the X requests each user action sends, from Xlib's
+ * sequence numbers. A request costs at most one round trip, so over a
+ * remote X or XRDP link the count bounds what an action waits for. The
+ * caps keep actions from drifting back to resyncing the whole screen
+ * ============================================================================= */
+
+/* Requests an action may send: a fixed part plus so many per window it changes */
+static const struct
+{
+    const char *name;
+    gulong base;             /* Timestamp query, activation and error-trap syncs */
+    gulong per_window;       /* One message and its error-trap sync per window */
+} x_action_caps[X_ACTION_COUNT] =
+{
+    [X_ACTION_MENU_OPEN] = { "menu_open", 8, 0 },
+    [X_ACTION_ACTIVATE_WINDOW] = { "activate_window", 12, 0 },
+    [X_ACTION_ACTIVATE_DESKTOP] = { "activate_desktop", 12, 0 },
+    [X_ACTION_HIDE_OTHERS] = { "hide_others", 8, 4 },
+    [X_ACTION_SHOW_ALL] = { "show_all", 12, 4 },
+};
+
+/* Sequence number the next X request will get; 0 without an X display */
+static gulong x_requests_begin(void) 
+{
+    GdkDisplay *display = gdk_display_get_default();
+    if (!display || !GDK_IS_X11_DISPLAY(display)) return 0;
+    return XNextRequest(GDK_DISPLAY_XDISPLAY(display));
+}
 
-    return result;
+static gulong x_action_cap(XAction action, guint n_windows) 
+{
+    return x_action_caps[action].base + x_action_caps[action].per_window * n_windows;
 }
 
-/* Helper function to remove application name suffixes from window titles */
-static gchar *remove_app_name_suffix(const gchar *window_title, const gchar *app_name) 
+/* Record what the action sent since start; n_windows is how many windows it changed */
+static void x_requests_end(FocusMenuPlugin *plugin, XAction action, gulong start, guint n_windows) 
 {
-    if (!window_title || !app_name) 
+    gulong end = x_requests_begin();
+    if (!start || !end) return;
+
+    gulong requests = end - start;
+    gulong cap = x_action_cap(action, n_windows);
+    plugin->x_requests[action] = requests;
+    g_debug("DEBUG: %s sent %lu X requests (cap %lu)", x_action_caps[action].name, requests, cap);
+    if (requests > cap) 
     {
-        return g_strdup(window_title ? window_title : "");
+        plugin->x_request_overruns++;
+        g_warning("Focus Menu: %s sent %lu X requests, more than the %lu allowed", x_action_caps[action].name, requests, cap);
     }
+}
+#endif
 
-    gchar *title_copy = g_strdup(window_title);
-    gsize app_len = strlen(app_name);
+/* =============================================================================
+ * POPUP LATENCY
+ * Time from the button press to the first frame the menu is painted in,
+ * taken from the menu window's frame clock and kept in a log-bucketed
+ * histogram (LATENCY_SUB_BUCKETS buckets per doubling of the latency)
+ * ============================================================================= */
 
-    /* Look for patterns like " — AppName" or " - AppName" at the end */
-    const gchar *patterns[] = 
-    {
-        " — ",  /* Em dash U+2014 (most common) */
-        " – ",  /* En dash U+2013 */
-        " - ",  /* Regular hyphen-minus U+002D */
-        " ― ",  /* Horizontal bar U+2015 */
-        " ‒ ",  /* Figure dash U+2012 */
-        " ⸺ ",  /* Two-em dash U+2E3A */
-        " ⸻ ",  /* Three-em dash U+2E3B */
-        "—",    /* Em dash without spaces */
-        "–",    /* En dash without spaces */
-        "-",    /* Hyphen without spaces */
-        NULL
-    };
+/* Histogram bucket for a latency; small values get a bucket each */
+static guint latency_bucket_index(gint64 latency_us) 
+{
+    if (latency_us < LATENCY_SUB_BUCKETS) return latency_us < 0 ? 0 : (guint)latency_us;
+    if (latency_us > G_MAXUINT32) latency_us = G_MAXUINT32;
 
-    for (int i = 0; patterns[i]; i++) 
-    {
-        gsize pattern_len = strlen(patterns[i]);
+    /* Octave from the highest set bit, sub-bucket from the two bits below it */
+    guint octave = (guint)g_bit_nth_msf((gulong)latency_us, -1);
+    guint sub = (guint)(latency_us >> (octave - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    guint index = (octave - 1) * LATENCY_SUB_BUCKETS + sub;
 
-        /* Find the pattern in the title */
-        gchar *pattern_pos = g_strrstr(title_copy, patterns[i]);
-        if (!pattern_pos) continue;
+    return MIN(index, LATENCY_BUCKETS - 1);
+}
 
-        /* Check if this pattern is followed by something that ends with our app name */
-        gchar *after_pattern = pattern_pos + pattern_len;
-        gsize remaining_len = strlen(after_pattern);
+/* Smallest latency that falls into a bucket */
+static gint64 latency_bucket_lower_bound(guint index) 
+{
+    if (index < LATENCY_SUB_BUCKETS) return index;
 
-        /* Check for exact match with app name */
-        if (remaining_len == app_len && g_ascii_strcasecmp(after_pattern, app_name) == 0) 
-        {
-            *pattern_pos = '\0';  /* Remove from pattern onwards */
-            break;
-        }
+    guint octave = index / LATENCY_SUB_BUCKETS + 1;
+    guint sub = index % LATENCY_SUB_BUCKETS;
+    return (gint64)(LATENCY_SUB_BUCKETS + sub) << (octave - 2);
+}
 
-        /* Check if it ends with the app name (for cases like "Mozilla Firefox" when app_name is "Firefox") */
-        if (remaining_len >= app_len) 
+/* Latency at a percentile, reported as the upper edge of its bucket */
+static gint64 latency_histogram_percentile(const LatencyHistogram *histogram, guint percentile) 
+{
+    if (histogram->total == 0) return 0;
+
+    guint64 rank = ((guint64)histogram->total * percentile + 99) / 100;
+    guint64 seen = 0;
+    for (guint i = 0; i < LATENCY_BUCKETS; i++) 
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank) 
         {
-            gchar *potential_app = after_pattern + remaining_len - app_len;
-            if (g_ascii_strcasecmp(potential_app, app_name) == 0) 
-            {
-                /* Make sure there's a word boundary before the app name */
-                if (potential_app == after_pattern || *(potential_app - 1) == ' ') 
-                {
-                    *pattern_pos = '\0';  /* Remove from pattern onwards */
-                    break;
-                }
-            }
+            return latency_bucket_lower_bound(i + 1);
         }
     }
+    return latency_bucket_lower_bound(LATENCY_BUCKETS);
+}
 
-    /* Trim any trailing whitespace */
-    g_strstrip(title_copy);
+/* Add one sample along with the session size it was taken at */
+static void latency_histogram_add(LatencyHistogram *histogram, gint64 latency_us, guint n_windows, guint n_apps) 
+{
+    guint index = latency_bucket_index(latency_us);
+    histogram->counts[index]++;
+    histogram->window_sums[index] += n_windows;
+    histogram->app_sums[index] += n_apps;
+    histogram->total++;
+}
 
-    /* If we ended up with an empty string, return a fallback */
-    if (strlen(title_copy) == 0) 
+/* Stop waiting for a paint, e.g. because the menu is being replaced */
+static void latency_cancel(FocusMenuPlugin *plugin) 
+{
+    if (plugin->latency_clock) 
     {
-        g_free(title_copy);
-        return g_strdup("Document");
+        g_signal_handler_disconnect(plugin->latency_clock, plugin->latency_handler_id);
+        g_object_unref(plugin->latency_clock);
+        plugin->latency_clock = NULL;
+        plugin->latency_handler_id = 0;
     }
-
-    return title_copy;
 }
-static gchar *ensure_valid_utf8(const gchar *input) 
+
+/* First paint of the menu after a click - that's one sample */
+static void on_menu_after_paint(GdkFrameClock *clock G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
 {
-    if (!input) 
-    {
-        return g_strdup("");
-    }
+    gint64 latency_us = g_get_monotonic_time() - plugin->press_time_us;
+    latency_cancel(plugin);
 
-    /* Check if string is already valid UTF-8 */
-    if (g_utf8_validate(input, -1, NULL)) 
-    {
-        return g_strdup(input);
-    }
+    guint n_windows = plugin->model ? g_hash_table_size(plugin->model->windows) : 0;
+    guint n_apps = plugin->model ? g_hash_table_size(plugin->model->apps) : 0;
+    latency_histogram_add(&plugin->latency, latency_us, n_windows, n_apps);
 
-    /* If not valid, try to make it valid by escaping invalid sequences */
-    gchar *escaped = g_uri_escape_string(input, G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, TRUE);
-    if (escaped && g_utf8_validate(escaped, -1, NULL)) 
+    /* What an idle memory release costs, kept apart for Diagnostics */
+    if (plugin->popup_after_release) 
     {
-        return escaped;
+        plugin->popup_after_release = FALSE;
+        plugin->released_popups++;
+        plugin->released_latency_total_us += latency_us;
     }
 
-    /* Last resort: return a safe fallback */
-    g_free(escaped);
-    return g_strdup("Invalid Window Name");
+    g_debug("Menu painted %" G_GINT64_FORMAT " us after click (%u windows, %u apps); "
+    "p50 %" G_GINT64_FORMAT " us, p95 %" G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT " us over %u popups",
+    latency_us, n_windows, n_apps,
+    latency_histogram_percentile(&plugin->latency, 50),
+    latency_histogram_percentile(&plugin->latency, 95),
+    latency_histogram_percentile(&plugin->latency, 99),
+    plugin->latency.total);
 }
-/* Extract document name for sorting from window titles */
-static gchar *extract_document_name_for_sorting(const gchar *window_title) 
+
+/* Watch the popped-up menu's frame clock for its first paint */
+static void latency_watch_menu(FocusMenuPlugin *plugin) 
 {
-    if (!window_title) return g_strdup("");
+    latency_cancel(plugin);
 
-    /* First ensure the input is valid UTF-8 */
-    gchar *safe_title = ensure_valid_utf8(window_title);
+    GtkWidget *toplevel = gtk_widget_get_toplevel(plugin->menu);
+    GdkFrameClock *clock = toplevel ? gtk_widget_get_frame_clock(toplevel) : NULL;
+    if (!clock) return;
 
-    /* For windows like "~/path/filename - Application", extract just "filename" */
-    const gchar *last_slash = g_strrstr(safe_title, "/");
-    const gchar *app_separator = g_strrstr(safe_title, " - ");
+    plugin->latency_clock = g_object_ref(clock);
+    plugin->latency_handler_id = g_signal_connect(clock, "after-paint", G_CALLBACK(on_menu_after_paint), plugin);
+}
 
-    gchar *filename_part;
-    if (last_slash) 
-    {
-        filename_part = g_strdup(last_slash + 1);  /* Skip the slash */
-    } 
-    else 
-    {
-        filename_part = g_strdup(safe_title);
-    }
+/* =============================================================================
+ * IDLE MEMORY RELEASE
+ * With the hidden "memory-idle-seconds" property set, the popped-down menu
+ * is destroyed that long after it closes, the scaled icons and build
+ * scratch are cut back, and freed heap is handed back to the system. Meant
+ * for hosts running dozens of panels; the price is a slower next click,
+ * which Diagnostics shows next to the usual click-to-menu times
+ * ============================================================================= */
+
+/* Resident set size in kB, or -1 */
+static gint64 memory_read_rss_kb(void) 
+{
+    gchar *contents = NULL;
+    gint64 rss_kb = -1;
 
-    /* Remove the application name suffix if present */
-    if (app_separator) 
+    if (g_file_get_contents("/proc/self/statm", &contents, NULL, NULL)) 
     {
-        gchar *separator_in_filename = g_strrstr(filename_part, " - ");
-        if (separator_in_filename) 
+        unsigned long size_pages, resident_pages;
+        if (sscanf(contents, "%lu %lu", &size_pages, &resident_pages) == 2) 
         {
-            *separator_in_filename = '\0';  /* Truncate at the separator */
+            rss_kb = (gint64)resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
         }
     }
-
-    g_free(safe_title);
-    return filename_part;
+    g_free(contents);
+    return rss_kb;
 }
-/* Application sorting with file manager awareness */
-static gint compare_apps_by_display_name_with_data(gconstpointer a, gconstpointer b, gpointer user_data) 
+
+/* Give back everything only the next popup would use */
+static void memory_release(FocusMenuPlugin *plugin) 
 {
-    WnckApplication *app_a = WNCK_APPLICATION(a);
-    WnckApplication *app_b = WNCK_APPLICATION(b);
-    FocusMenuPlugin *plugin = (FocusMenuPlugin *)user_data;
+    /* Never while the menu is up */
+    if (plugin->menu && gtk_widget_get_mapped(plugin->menu)) return;
+
+    gint64 rss_before = memory_read_rss_kb();
 
-    const char *name_a = classlib_get_application_display_name(app_a);
-    const char *name_b = classlib_get_application_display_name(app_b);
+    /* The menu holds every row widget, scaled icon reference and DesktopManagerInfo copy */
+    if (plugin->menu) 
+    {
+        latency_cancel(plugin);
+        gtk_widget_destroy(plugin->menu);
+        plugin->menu = NULL;
+    }
+
+    focus_menu_build_arena_free(plugin->build_arena);
+    plugin->build_arena = NULL;
+    guint icons = plugin->model ? focus_menu_model_trim_icons(plugin->model, MEMORY_RELEASE_ICON_CAP) : 0;
+
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
 
-    return classlib_file_manager_aware_compare(name_a, name_b, plugin->sort_style, plugin->locale_type);
+    gint64 rss_after = memory_read_rss_kb();
+    plugin->memory_releases++;
+    plugin->memory_rss_before_kb = rss_before;
+    plugin->memory_rss_after_kb = rss_after;
+    plugin->popup_after_release = TRUE;
+
+    gint64 released_kb = (rss_before >= 0 && rss_after >= 0) ? rss_before - rss_after : 0;
+    flight_record(FLIGHT_MEMORY_RELEASE, "idle-release", released_kb);
+    g_debug("Idle memory release: RSS %" G_GINT64_FORMAT " kB -> %" G_GINT64_FORMAT " kB, %u menu icons dropped",
+            rss_before, rss_after, icons);
 }
 
-/* Window sorting with file manager awareness */
-static gint compare_windows_by_name_with_data(gconstpointer a, gconstpointer b, gpointer user_data) 
+static gboolean on_memory_idle(gpointer user_data) 
 {
-    WnckWindow *win_a = WNCK_WINDOW(a);
-    WnckWindow *win_b = WNCK_WINDOW(b);
     FocusMenuPlugin *plugin = (FocusMenuPlugin *)user_data;
+    plugin->memory_idle_id = 0;
+    memory_release(plugin);
+    return G_SOURCE_REMOVE;
+}
 
-    const char *full_name_a = wnck_window_get_name(win_a);
-    const char *full_name_b = wnck_window_get_name(win_b);
-
-    /* Handle NULL names */
-    if (!full_name_a && !full_name_b) return 0;
-    if (!full_name_a) return -1;
-    if (!full_name_b) return 1;
+/* Start the idle countdown; called when the menu closes */
+static void memory_release_schedule(FocusMenuPlugin *plugin) 
+{
+    memory_release_cancel(plugin);
+    if (plugin->memory_idle_seconds == 0) return;
 
-    /* Extract just the filename part for sorting */
-    gchar *name_a = extract_document_name_for_sorting(full_name_a);
-    gchar *name_b = extract_document_name_for_sorting(full_name_b);
+    plugin->memory_idle_id = g_timeout_add_seconds(plugin->memory_idle_seconds, on_memory_idle, plugin);
+}
 
-    gint result = classlib_file_manager_aware_compare(name_a, name_b, plugin->sort_style, plugin->locale_type);
+static void memory_release_cancel(FocusMenuPlugin *plugin) 
+{
+    if (plugin->memory_idle_id) 
+    {
+        g_source_remove(plugin->memory_idle_id);
+        plugin->memory_idle_id = 0;
+    }
+}
 
-    g_free(name_a);
-    g_free(name_b);
+/* =============================================================================
+ * HIDDEN-STATE REGISTRY
+ * Tracks which applications are hidden and which windows the plugin hid,
+ * so styling and restoring don't need to rescan every window
+ * ============================================================================= */
 
-    return result;
+/* Free a hidden-state record */
+static void hidden_app_record_free(HiddenAppRecord *record)
+{
+    if (record)
+    {
+        g_list_free(record->hidden_windows);
+        g_free(record);
+    }
 }
 
-/* Helper function to apply underline styling to desktop managers */
-static void apply_desktop_manager_styling(GtkWidget *menu_item) 
+/* O(1) check used for menu row styling */
+static gboolean app_is_hidden(FocusMenuPlugin *plugin, FocusMenuSourceApp *app)
 {
-    if (!menu_item) return;
+    if (!plugin || !plugin->hidden_apps || !app) return FALSE;
 
-    /* Find the label widget in the menu item's box */
-    GtkWidget *box = gtk_bin_get_child(GTK_BIN(menu_item));
-    if (!GTK_IS_BOX(box)) return;
+    return g_hash_table_contains(plugin->hidden_apps, app);
+}
 
-    GList *children = gtk_container_get_children(GTK_CONTAINER(box));
-    for (GList *child = children; child; child = child->next) 
-    {
-        if (GTK_IS_LABEL(child->data)) 
-        {
-            GtkWidget *label = GTK_WIDGET(child->data);
+/* Mark an application hidden if none of its normal windows are left on screen.
+ * Window state is read from the source, which may be ahead of the model. */
+static void hidden_registry_update_app(FocusMenuPlugin *plugin, FocusMenuAppRecord *app_record)
+{
+    if (!app_record || g_hash_table_contains(plugin->hidden_apps, app_record->app)) return;
 
-            /* Apply underline styling to indicate special desktop manager status */
-            PangoAttrList *attrs = pango_attr_list_new();
-            PangoAttribute *attr = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
-            pango_attr_list_insert(attrs, attr);
-            gtk_label_set_attributes(GTK_LABEL(label), attrs);
-            pango_attr_list_unref(attrs);
+    gboolean has_normal_window = FALSE;
+    for (GList *l = app_record->windows; l; l = l->next)
+    {
+        FocusMenuSourceWindow *window = ((FocusMenuWindowRecord *)l->data)->window;
+        if (focus_menu_source_window_get_type(plugin->source, window) != FOCUS_MENU_SOURCE_WINDOW_NORMAL) continue;
 
-            break;
+        if (!(focus_menu_source_window_get_state(plugin->source, window) & FOCUS_MENU_SOURCE_STATE_MINIMIZED))
+        {
+            return;  /* Still visible */
         }
+        has_normal_window = TRUE;
+    }
+
+    if (has_normal_window)
+    {
+        /* Hidden by something other than us (e.g. minimized one by one) */
+        HiddenAppRecord *record = g_new0(HiddenAppRecord, 1);
+        record->app = app_record->app;
+        g_hash_table_insert(plugin->hidden_apps, app_record->app, record);
     }
-    g_list_free(children);
 }
 
-/* Enhanced debug that also checks if cmdline reading is working */
-static gboolean is_desktop_manager(WnckApplication *app) 
+/* Record windows the plugin just minimized; takes ownership of the list.
+ * The minimize requests are asynchronous, so windows in the list count as
+ * minimized even if the source hasn't caught up yet. */
+static void hidden_registry_record(FocusMenuPlugin *plugin, FocusMenuAppRecord *app_record, GList *hidden_windows)
 {
-    if (!app) 
+    if (!plugin || !app_record || !hidden_windows) 
     {
-        return FALSE;
+        g_list_free(hidden_windows);
+        return;
     }
 
-    const char *app_name = wnck_application_get_name(app);
-    if (!app_name) 
+    for (GList *l = app_record->windows; l; l = l->next)
     {
-        return FALSE;
-    }
+        FocusMenuSourceWindow *window = ((FocusMenuWindowRecord *)l->data)->window;
+        if (focus_menu_source_window_get_type(plugin->source, window) != FOCUS_MENU_SOURCE_WINDOW_NORMAL) continue;
 
-    pid_t pid = wnck_application_get_pid(app);
+        if (!(focus_menu_source_window_get_state(plugin->source, window) & FOCUS_MENU_SOURCE_STATE_MINIMIZED) && !g_list_find(hidden_windows, window))
+        {
+            /* Something stays on screen (e.g. a desktop window), so the app isn't hidden */
+            g_list_free(hidden_windows);
+            return;
+        }
+    }
 
-    /* Direct process name checks (no cmdline parsing needed) */
-    if (g_strcmp0(app_name, "nemo-desktop") == 0) 
+    HiddenAppRecord *record = g_hash_table_lookup(plugin->hidden_apps, app_record->app);
+    if (record)
     {
-        return TRUE;
+        record->hidden_windows = g_list_concat(record->hidden_windows, hidden_windows);
     }
-
-    if (g_strcmp0(app_name, "xfdesktop") == 0) 
+    else
     {
-        return TRUE;
+        record = g_new0(HiddenAppRecord, 1);
+        record->app = app_record->app;
+        record->hidden_windows = hidden_windows;
+        g_hash_table_insert(plugin->hidden_apps, app_record->app, record);
     }
+}
 
-    /* For Caja, we need to check command line arguments */
-    if (g_ascii_strcasecmp(app_name, "caja") == 0 || g_str_has_prefix(app_name, "Caja")) 
+/* Restore a hidden application by unminimizing only the windows the plugin hid.
+ * Returns FALSE if there is nothing recorded, so the caller can fall back to a full restore. */
+static gboolean hidden_registry_restore(FocusMenuPlugin *plugin, FocusMenuSourceApp *app, guint32 timestamp)
+{
+    HiddenAppRecord *record = g_hash_table_lookup(plugin->hidden_apps, app);
+    if (!record || !record->hidden_windows) return FALSE;
+
+    /* Take the list before dropping the record - the app is no longer hidden */
+    GList *windows = record->hidden_windows;
+    record->hidden_windows = NULL;
+    g_hash_table_remove(plugin->hidden_apps, app);
+
+    /* The record is in the application's window order, so walk the screen's
+     * stacking order (bottom first) to restore them as they were stacked */
+    GHashTable *hidden = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (GList *l = windows; l; l = l->next)
     {
-        gchar *cmdline_path = g_strdup_printf("/proc/%d/cmdline", pid);
-        gchar *cmdline = NULL;
-        gsize cmdline_length = 0;
-        gboolean is_desktop = FALSE;
-        GError *error = NULL;
-
-        if (g_file_get_contents(cmdline_path, &cmdline, &cmdline_length, &error)) 
-        {
-            /* Now let's manually check for the flags in the raw data */
-            gboolean has_force_desktop = FALSE;
-            gboolean has_n_flag = FALSE;
-            gboolean has_desktop_flag = FALSE;
+        g_hash_table_add(hidden, l->data);
+    }
 
-            /* Search for "--force-desktop" in the raw bytes */
-            if (cmdline_length > 15) 
-            {
-                for (gsize i = 0; i <= cmdline_length - 15; i++) 
-                {
-                    if (memcmp(&cmdline[i], "--force-desktop", 15) == 0) 
-                    {
-                        has_force_desktop = TRUE;
-                        break;
-                    }
-                }
-            }
+    FocusMenuSourceWindow *top_window = NULL;
+    for (GList *l = focus_menu_source_list_windows(plugin->source); l; l = l->next)
+    {
+        FocusMenuSourceWindow *window = l->data;
+        if (!g_hash_table_contains(hidden, window)) continue;
 
-            /* Search for "-n" */
-            if (cmdline_length > 2) 
-            {
-                for (gsize i = 0; i <= cmdline_length - 2; i++) 
-                {
-                    if (memcmp(&cmdline[i], "-n", 2) == 0 && (i == 0 || cmdline[i-1] == '\0') && (i + 2 >= cmdline_length || cmdline[i+2] == '\0' || cmdline[i+2] == ' ')) 
-                    {
-                        has_n_flag = TRUE;
-                        break;
-                    }
-                }
-            }
+        focus_menu_source_window_unminimize(plugin->source, window, timestamp);
+        top_window = window;
+    }
+    g_hash_table_destroy(hidden);
 
-            /* Search for "--desktop" */
-            if (cmdline_length > 9) 
-            {
-                for (gsize i = 0; i <= cmdline_length - 9; i++) 
-                {
-                    if (memcmp(&cmdline[i], "--desktop", 9) == 0) 
-                    {
-                        has_desktop_flag = TRUE;
-                        break;
-                    }
-                }
-            }
+    /* The topmost restored window gets focus */
+    if (top_window)
+    {
+        focus_menu_source_window_activate(plugin->source, top_window, timestamp);
+    }
 
-            if (has_force_desktop || (has_n_flag && has_force_desktop) || has_desktop_flag) 
-            {
-                is_desktop = TRUE;
-            }
-        }
-        else 
-        {
-            if (error) g_error_free(error);
-        }
+    g_list_free(windows);
+    return TRUE;
+}
 
-        g_free(cmdline);
-        g_free(cmdline_path);
+/* A window the model just added: a visible one shows its application, a minimized one may complete its hiding */
+static void hidden_registry_window_added(FocusMenuPlugin *plugin, FocusMenuWindowRecord *record)
+{
+    if (!record || !record->is_normal) return;
 
-        return is_desktop;
+    if (record->is_minimized)
+    {
+        hidden_registry_update_app(plugin, record->app_record);
+    }
+    else
+    {
+        g_hash_table_remove(plugin->hidden_apps, record->app_record->app);
     }
-    return FALSE;
 }
 
-/* Helper function to determine if a window is a desktop window (should be protected from hiding) */
-static gboolean is_desktop_window(WnckWindow *window) 
+/* Follow minimize and unminimize from anywhere, not just the plugin's own requests */
+static void hidden_registry_window_changed(FocusMenuPlugin *plugin, FocusMenuWindowRecord *record)
 {
-    if (!window) return FALSE;
+    if (!record || !record->is_normal || record->is_minimized == record->was_minimized) return;
 
-    /* First check: only consider NORMAL windows as potentially hideable */
-    if (wnck_window_get_window_type(window) != WNCK_WINDOW_NORMAL) 
+    if (record->is_minimized)
     {
-        return TRUE;  /* Non-normal windows are protected */
+        hidden_registry_update_app(plugin, record->app_record);
     }
-
-    /* Second check: skip windows that look like desktop windows by name */
-    const char *window_name = wnck_window_get_name(window);
-    if (window_name && (g_strcmp0(window_name, "Desktop") == 0 || g_str_has_suffix(window_name, "Desktop"))) 
+    else
     {
-        return TRUE;  /* Desktop-named windows are protected */
+        /* Any window coming back means the application is shown again */
+        g_hash_table_remove(plugin->hidden_apps, record->app_record->app);
     }
-        return FALSE;  /* This window can be hidden */
 }
 
-/* Check if an application has non-desktop windows that can be hidden */
-static gboolean app_has_hideable_windows(WnckApplication *app, WnckScreen *screen) 
+/* Forget a closed window if we hid it; its model record is already gone */
+static void hidden_registry_window_removed(FocusMenuPlugin *plugin, FocusMenuSourceWindow *window)
 {
-    if (!app || !screen) return FALSE;
-
-    GList *windows = wnck_application_get_windows(app);
-    WnckWorkspace *active_ws = wnck_screen_get_active_workspace(screen);
-
-    if (!active_ws) return FALSE;
-
-    for (GList *l = windows; l; l = l->next) 
+    FocusMenuSourceApp *app = focus_menu_source_window_get_app(plugin->source, window);
+    HiddenAppRecord *record = app ? g_hash_table_lookup(plugin->hidden_apps, app) : NULL;
+    if (record)
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
+        record->hidden_windows = g_list_remove(record->hidden_windows, window);
+    }
+}
 
-        /* Check if it's on current workspace and not minimized */
-        if ((wnck_window_is_visible_on_workspace(window, active_ws) || wnck_window_is_minimized(window)) && !wnck_window_is_minimized(window)) 
-        {
-            /* Use our helper function to check if this window can be hidden */
-            if (!is_desktop_window(window)) 
-            {
-                return TRUE;
-            }
-        }
+/* Start from the windows already open; later changes arrive through focus_menu_on_model_changed() */
+static void hidden_registry_seed(FocusMenuPlugin *plugin)
+{
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, plugin->model->windows);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        hidden_registry_window_added(plugin, (FocusMenuWindowRecord *)value);
     }
-    return FALSE;
 }
 
 /* Deep copy a DesktopManagerInfo structure */
@@ -1571,7 +2969,7 @@ static void activate_desktop_manager(GtkMenuItem *item, gpointer user_data G_GNU
     /* Check if we're in menu construction mode - if so, ignore this signal */
     GtkWidget *menu = gtk_widget_get_parent(GTK_WIDGET(item));
     FocusMenuPlugin *plugin = NULL;
-    WnckScreen *screen = NULL;
+    FocusMenuWindowSource *source = NULL;
 
     if (menu) 
     {
@@ -1582,7 +2980,7 @@ static void activate_desktop_manager(GtkMenuItem *item, gpointer user_data G_GNU
             {
                 return;
             }
-            screen = plugin->screen;
+            source = plugin->source;
         }
     }
 
@@ -1593,66 +2991,45 @@ static void activate_desktop_manager(GtkMenuItem *item, gpointer user_data G_GNU
         return;
     }
 
-    if (!screen) 
+    if (!source) 
     {
         return;
     }
 
-    /* Force libwnck to update its state before checking active window */
-    wnck_screen_force_update(screen);
+    #ifdef DEBUG
+    gulong x_start = x_requests_begin();
+    #endif
 
-    WnckWindow *active_window = wnck_screen_get_active_window(screen);
+    /* The active window comes from _NET_ACTIVE_WINDOW events, so it is already current */
+    FocusMenuSourceWindow *active_window = focus_menu_source_get_active_window(source);
 
     /* Only try to focus desktop if something else is currently focused */
     if (active_window) 
     {
-        WnckApplication *active_app = wnck_window_get_application(active_window);
+        FocusMenuSourceApp *active_app = focus_menu_source_window_get_app(source, active_window);
 
         /* Check if the current window belongs to the desktop manager */
-        if (active_app && wnck_application_get_pid(active_app) == dm_info->pid) 
+        if (active_app && focus_menu_source_app_get_pid(source, active_app) == dm_info->pid) 
         {
             return;
         }
 
-        /* Method 1: Try to find and activate a desktop window */
-        GList *windows = wnck_screen_get_windows(screen);
-        WnckWorkspace *active_ws = wnck_screen_get_active_workspace(screen);
+        /* Method 1: Try to find and activate a desktop window, kept per process by the model */
         gboolean desktop_window_found = FALSE;
 
-        if (active_ws) {
-            for (GList *l = windows; l; l = l->next) 
+        if (plugin->model && focus_menu_source_get_active_workspace(source)) 
+        {
+            FocusMenuWindowRecord *desktop_window = focus_menu_model_find_desktop_window(plugin->model, dm_info->pid);
+            if (desktop_window) 
             {
-                WnckWindow *window = WNCK_WINDOW(l->data);
-                if (!window) continue;
-
-                WnckApplication *window_app = wnck_window_get_application(window);
-                if (window_app && wnck_application_get_pid(window_app) == dm_info->pid) 
-                {
-                    WnckWindowType window_type = wnck_window_get_window_type(window);
-                    const char *window_name = wnck_window_get_name(window);
-
-                    /* Look for desktop-type windows first */
-                    if (window_type == WNCK_WINDOW_DESKTOP) 
-                    {
-                        wnck_window_activate(window, gtk_get_current_event_time());
-                        desktop_window_found = TRUE;
-                        break;
-                    }
-
-                    /* Also check for windows named "Desktop" */
-                    if (window_name && (g_strcmp0(window_name, "Desktop") == 0 || g_str_has_suffix(window_name, "Desktop"))) 
-                    {
-                        wnck_window_activate(window, gtk_get_current_event_time());
-                        desktop_window_found = TRUE;
-                        break;
-                    }
-                }
+                focus_menu_source_window_activate(source, desktop_window->window, gtk_get_current_event_time());
+                desktop_window_found = TRUE;
             }
         }
         /* Method 2: If no desktop window found, try to minimize current window */
         if (!desktop_window_found)
         {
-            wnck_window_minimize(active_window);
+            focus_menu_source_window_minimize(source, active_window);
         }
 
         /* Method 3: As a last resort, try to remove focus entirely */
@@ -1670,6 +3047,10 @@ static void activate_desktop_manager(GtkMenuItem *item, gpointer user_data G_GNU
             }
         }
     }
+
+    #ifdef DEBUG
+    x_requests_end(plugin, X_ACTION_ACTIVATE_DESKTOP, x_start, 0);
+    #endif
 }
 
 static void on_submenus_toggled(GtkToggleButton *button, FocusMenuPlugin *plugin) 
@@ -1678,169 +3059,275 @@ static void on_submenus_toggled(GtkToggleButton *button, FocusMenuPlugin *plugin
     focus_menu_save_settings(plugin);
 }
 
-static void hide_all_applications(GtkMenuItem *item G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+/* =============================================================================
+ * BULK OPERATION JOURNAL
+ * Remembers exactly what the last Hide Others / Show All changed, so it can
+ * be reversed without touching anything else on screen
+ * ============================================================================= */
+
+/* Start a new journal, replacing whatever the previous operation recorded */
+static void bulk_journal_begin(FocusMenuPlugin *plugin, BulkOperation op) 
+{
+    g_array_set_size(plugin->journal, 0);
+    plugin->journal_op = op;
+    FocusMenuSourceWindow *active_window = plugin->model ? plugin->model->active_window : NULL;
+    plugin->journal_active_xid = active_window ? focus_menu_source_window_get_id(plugin->source, active_window) : 0;
+}
+
+/* Record a window's state just before the bulk operation changes it */
+static void bulk_journal_add(FocusMenuPlugin *plugin, FocusMenuSourceWindow *window, gint stack_position) 
+{
+    BulkJournalEntry entry;
+    entry.xid = focus_menu_source_window_get_id(plugin->source, window);
+    entry.stack_position = stack_position;
+    entry.was_minimized = (focus_menu_source_window_get_state(plugin->source, window) & FOCUS_MENU_SOURCE_STATE_MINIMIZED) != 0;
+    g_array_append_val(plugin->journal, entry);
+}
+
+/* An operation that changed nothing leaves nothing to undo */
+static void bulk_journal_finish(FocusMenuPlugin *plugin) 
 {
-    if (!plugin || !plugin->screen) 
+    if (plugin->journal->len == 0) 
     {
-        return;
+        plugin->journal_op = BULK_OP_NONE;
     }
+}
+
+static gint compare_journal_entries_by_stacking(gconstpointer a, gconstpointer b) 
+{
+    const BulkJournalEntry *entry_a = a;
+    const BulkJournalEntry *entry_b = b;
 
-    GList *windows = wnck_screen_get_windows(plugin->screen);
-    GList *apps_to_hide = NULL;
-    WnckApplication *current_app = NULL;
+    return entry_a->stack_position - entry_b->stack_position;
+}
 
-    if (plugin->active_window) 
+/* Put every journaled window back the way it was, in one pass bottom to top */
+static void undo_bulk_operation(GtkMenuItem *item G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+{
+    if (!plugin || !plugin->model || plugin->journal_op == BULK_OP_NONE) 
     {
-        current_app = wnck_window_get_application(plugin->active_window);
+        return;
     }
 
-    /* Collect applications to hide, excluding current app */
-    for (GList *l = windows; l; l = l->next) 
+    guint32 timestamp = focus_menu_get_timestamp(plugin);
+
+    g_array_sort(plugin->journal, compare_journal_entries_by_stacking);
+
+    for (guint i = 0; i < plugin->journal->len; i++) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
+        BulkJournalEntry *entry = &g_array_index(plugin->journal, BulkJournalEntry, i);
 
-        WnckWorkspace *active_ws = wnck_screen_get_active_workspace(plugin->screen);
-        if (!active_ws) continue;
+        /* Windows closed since then are simply skipped */
+        FocusMenuWindowRecord *record = focus_menu_model_find_window_by_id(plugin->model, entry->xid);
+        if (!record) continue;
 
-        if (wnck_window_is_visible_on_workspace(window, active_ws) && !wnck_window_is_minimized(window)) 
+        gboolean is_minimized = (focus_menu_source_window_get_state(plugin->source, record->window) & FOCUS_MENU_SOURCE_STATE_MINIMIZED) != 0;
+        if (entry->was_minimized) 
         {
-            WnckApplication *app = wnck_window_get_application(window);
-            if (!app || app == current_app) continue;
-            /* Check if this specific window can be hidden (not the whole app) */
-            if (!is_desktop_window(window)) 
+            if (!is_minimized) 
             {
-                /* Add to hide list if not already present */
-                if (!g_list_find(apps_to_hide, app)) 
-                {
-                    apps_to_hide = g_list_append(apps_to_hide, app);
-                }
+                focus_menu_source_window_minimize(plugin->source, record->window);
             }
+        } 
+        else if (is_minimized) 
+        {
+            focus_menu_source_window_unminimize(plugin->source, record->window, timestamp);
+            g_hash_table_remove(plugin->hidden_apps, record->app_record->app);
         }
     }
 
-    /* Hide hideable windows from collected applications */
-    for (GList *l = apps_to_hide; l; l = l->next) 
+    /* Give focus back to the window that had it before */
+    FocusMenuWindowRecord *previous_active = plugin->journal_active_xid ? focus_menu_model_find_window_by_id(plugin->model, plugin->journal_active_xid) : NULL;
+    if (previous_active) 
+    {
+        focus_menu_source_window_activate(plugin->source, previous_active->window, timestamp);
+    }
+
+    /* The journal can only be replayed once */
+    g_array_set_size(plugin->journal, 0);
+    plugin->journal_op = BULK_OP_NONE;
+}
+
+/* Event time for window manager requests; D-Bus calls have no current event */
+static guint32 focus_menu_get_timestamp(FocusMenuPlugin *plugin) 
+{
+    guint32 timestamp = gtk_get_current_event_time();
+    if (timestamp == GDK_CURRENT_TIME && plugin && plugin->button && gtk_widget_get_realized(plugin->button)) 
+    {
+        timestamp = gdk_x11_get_server_time(gtk_widget_get_window(plugin->button));
+    }
+    return timestamp;
+}
+
+static void hide_all_applications(GtkMenuItem *item G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+{
+    if (!plugin || !plugin->source || !plugin->model) 
+    {
+        return;
+    }
+
+    #ifdef DEBUG
+    gulong x_start = x_requests_begin();
+    #endif
+
+    GHashTable *stack_positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+    FocusMenuAppRecord *current_record = focus_menu_model_get_active_app(plugin->model);
+    gint position = 0;
+
+    /* Remember stacking order for the undo journal */
+    for (GList *l = focus_menu_source_list_windows(plugin->source); l; l = l->next) 
+    {
+        g_hash_table_insert(stack_positions, l->data, GINT_TO_POINTER(position++));
+    }
+
+    bulk_journal_begin(plugin, BULK_OP_HIDE_OTHERS);
+
+    /* Only applications with a visible, hideable window are touched */
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, plugin->model->apps);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) 
     {
-        WnckApplication *app = WNCK_APPLICATION(l->data);
-        if (!app) continue;
+        FocusMenuAppRecord *app_record = (FocusMenuAppRecord *)value;
+        if (app_record == current_record || app_record->n_hideable_visible == 0) continue;
 
-        GList *app_windows = wnck_application_get_windows(app);
-        for (GList *w = app_windows; w; w = w->next) 
+        GList *hidden_windows = NULL;
+        for (GList *w = app_record->windows; w; w = w->next) 
         {
-            WnckWindow *window = WNCK_WINDOW(w->data);
-            if (window && !wnck_window_is_minimized(window)) 
-            {
-                /* Double-check: only hide non-desktop windows */
-                if (!is_desktop_window(window)) 
-                {
-                    wnck_window_minimize(window);
-                }
-            }
+            FocusMenuWindowRecord *window_record = (FocusMenuWindowRecord *)w->data;
+
+            /* Only hide non-desktop windows */
+            if (window_record->is_minimized || !window_record->is_normal || window_record->is_desktop_named) continue;
+
+            bulk_journal_add(plugin, window_record->window, GPOINTER_TO_INT(g_hash_table_lookup(stack_positions, window_record->window)));
+            focus_menu_source_window_minimize(plugin->source, window_record->window);
+            hidden_windows = g_list_append(hidden_windows, window_record->window);
         }
+        hidden_registry_record(plugin, app_record, hidden_windows);
     }
-    g_list_free(apps_to_hide);
+
+    #ifdef DEBUG
+    x_requests_end(plugin, X_ACTION_HIDE_OTHERS, x_start, plugin->journal->len);
+    #endif
+
+    bulk_journal_finish(plugin);
+    g_hash_table_destroy(stack_positions);
 }
 
 static void show_all_applications(GtkMenuItem *item G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
 {
-    if (!plugin || !plugin->screen) 
+    if (!plugin || !plugin->source || !plugin->model) 
     {
         return;
     }
 
-    GList *windows = wnck_screen_get_windows(plugin->screen);
-    guint32 timestamp = gtk_get_current_event_time();
-    WnckWindow *current_active = plugin->active_window;
+    /* Nothing to restore - skip the stacking walk */
+    if (plugin->model->n_minimized == 0) 
+    {
+        return;
+    }
+
+    #ifdef DEBUG
+    gulong x_start = x_requests_begin();
+    #endif
+
+    GList *windows = focus_menu_source_list_windows(plugin->source);
+    guint32 timestamp = focus_menu_get_timestamp(plugin);
+    FocusMenuSourceWindow *current_active = plugin->model->active_window;
+    gint position = 0;
+
+    bulk_journal_begin(plugin, BULK_OP_SHOW_ALL);
 
     /* First pass: collect minimized windows in stacking order (bottom to top) */
     GList *minimized_windows = NULL;
-    for (GList *l = windows; l; l = l->next) 
+    for (GList *l = windows; l; l = l->next, position++) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
+        FocusMenuSourceWindow *window = l->data;
 
-        WnckWorkspace *active_ws = wnck_screen_get_active_workspace(plugin->screen);
-        if (!active_ws) continue;
-
-        if ((wnck_window_is_visible_on_workspace(window, active_ws) || wnck_window_is_minimized(window)) && wnck_window_is_minimized(window) && wnck_window_get_window_type(window) == WNCK_WINDOW_NORMAL) 
+        FocusMenuWindowRecord *window_record = focus_menu_model_get_window(plugin->model, window);
+        if (window_record && window_record->in_menu && window_record->is_minimized) 
         {
-            /* Add to our list - this preserves the stacking order from wnck_screen_get_windows() */
-            minimized_windows = g_list_append(minimized_windows, window);
+            /* Prepending and reversing keeps the source's stacking order */
+            minimized_windows = g_list_prepend(minimized_windows, window);
+            bulk_journal_add(plugin, window, position);
         }
     }
+    minimized_windows = g_list_reverse(minimized_windows);
 
     /* Second pass: unminimize in stacking order (bottom to top) */
     /* This preserves the original relative positions */
     for (GList *l = minimized_windows; l; l = l->next) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (window) 
-        {
-            wnck_window_unminimize(window, timestamp);
-            /* Small delay to ensure proper stacking - some window managers need this */
-            g_usleep(1000); /* 1 millisecond delay */
-        }
+        focus_menu_source_window_unminimize(plugin->source, l->data, timestamp);
     }
 
     /* Third pass: restore focus to the originally active window */
-    if (current_active && !wnck_window_is_minimized(current_active)) 
+    if (current_active && !(focus_menu_source_window_get_state(plugin->source, current_active) & FOCUS_MENU_SOURCE_STATE_MINIMIZED)) 
     {
-        wnck_window_activate(current_active, timestamp);
+        focus_menu_source_window_activate(plugin->source, current_active, timestamp);
     }
 
+    #ifdef DEBUG
+    x_requests_end(plugin, X_ACTION_SHOW_ALL, x_start, plugin->journal->len);
+    #endif
+
+    /* Nothing is hidden any more */
+    g_hash_table_remove_all(plugin->hidden_apps);
+    bulk_journal_finish(plugin);
+
     g_list_free(minimized_windows);
 }
 
-static void hide_current_application(GtkMenuItem *item G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+/* Hide one application; desktop managers keep their desktop window */
+static void hide_application(FocusMenuPlugin *plugin, FocusMenuAppRecord *record) 
 {
-    if (!plugin || !plugin->active_window) 
+    if (!plugin || !record) 
     {
         return;
     }
 
-    WnckApplication *app = wnck_window_get_application(plugin->active_window);
-    if (!app) return;
-
     /* Check if this is a desktop manager */
-    if (is_desktop_manager(app)) 
+    if (is_desktop_manager(plugin, record->app)) 
     {
-        /* For desktop managers, only hide non-desktop windows */
-        GList *windows = wnck_application_get_windows(app);
-        WnckWorkspace *active_ws = wnck_screen_get_active_workspace(plugin->screen);
+        /* For desktop managers, only hide normal windows on this workspace that aren't desktop windows */
+        if (!plugin->model->active_workspace) return;
 
-        if (!active_ws) return;
-
-        for (GList *l = windows; l; l = l->next) 
+        GList *hidden_windows = NULL;
+        for (GList *l = record->windows; l; l = l->next) 
         {
-            WnckWindow *window = WNCK_WINDOW(l->data);
-            if (!window) continue;
-
-            /* Only hide normal file manager windows, not desktop windows */
-            if (wnck_window_is_visible_on_workspace(window, active_ws) && !wnck_window_is_minimized(window) && wnck_window_get_window_type(window) == WNCK_WINDOW_NORMAL) 
-                {
-                    /* Additional check: skip windows that look like desktop windows */
-                    const char *window_name = wnck_window_get_name(window);
-                    if (window_name && (g_strcmp0(window_name, "Desktop") == 0 || g_str_has_suffix(window_name, "Desktop"))) 
-                    {
-                        continue;
-                    }
-                    wnck_window_minimize(window);
-                }
+            FocusMenuWindowRecord *window_record = (FocusMenuWindowRecord *)l->data;
+            if (window_record->hideable_visible) 
+            {
+                focus_menu_source_window_minimize(plugin->source, window_record->window);
+                hidden_windows = g_list_append(hidden_windows, window_record->window);
+            }
         }
+        hidden_registry_record(plugin, record, hidden_windows);
         return;
     }
 
     /* Normal application - hide all windows as before */
-    GList *windows = wnck_application_get_windows(app);
-    for (GList *l = windows; l; l = l->next) 
+    GList *hidden_windows = NULL;
+    for (GList *l = record->windows; l; l = l->next) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (window && !wnck_window_is_minimized(window)) 
+        FocusMenuWindowRecord *window_record = (FocusMenuWindowRecord *)l->data;
+        if (!window_record->is_minimized) 
         {
-            wnck_window_minimize(window);
+            focus_menu_source_window_minimize(plugin->source, window_record->window);
+            hidden_windows = g_list_append(hidden_windows, window_record->window);
         }
     }
+    hidden_registry_record(plugin, record, hidden_windows);
+}
+
+static void hide_current_application(GtkMenuItem *item G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+{
+    if (!plugin || !plugin->model) 
+    {
+        return;
+    }
+
+    hide_application(plugin, focus_menu_model_get_active_app(plugin->model));
 }
 
 /* Enhanced helper function to apply both icon opacity and text italicization for hidden/minimized items */
@@ -1948,7 +3435,17 @@ static GtkWidget* create_selective_menu_item_with_icon(const char* label, GdkPix
     /* Add icon if provided */
     if (icon) 
     {
-        GdkPixbuf *scaled_icon = gdk_pixbuf_scale_simple(icon, 16, 16, GDK_INTERP_BILINEAR);
+        /* Model icons arrive pre-scaled; only rescale what doesn't fit */
+        GdkPixbuf *scaled_icon = NULL;
+        if (gdk_pixbuf_get_width(icon) == 16 && gdk_pixbuf_get_height(icon) == 16) 
+        {
+            scaled_icon = g_object_ref(icon);
+        } 
+        else 
+        {
+            scaled_icon = gdk_pixbuf_scale_simple(icon, 16, 16, GDK_INTERP_BILINEAR);
+            perf_counters.icon_scales++;
+        }
         if (scaled_icon) 
         {
             GtkWidget *image = gtk_image_new_from_pixbuf(scaled_icon);
@@ -1974,193 +3471,177 @@ static GtkWidget* create_selective_menu_item_with_icon(const char* label, GdkPix
     return item;
 }
 /* Show all windows of an application */
-static void show_all_app_windows(GtkMenuItem *item, WnckApplication *app) 
+static void show_all_app_windows(GtkMenuItem *item, FocusMenuSourceApp *app) 
 {
     if (!app) return;
 
     /* Check if we're in menu construction mode */
+    FocusMenuPlugin *plugin = NULL;
     GtkWidget *menu = gtk_widget_get_parent(GTK_WIDGET(item));
     if (menu) {
-        FocusMenuPlugin *plugin = g_object_get_data(G_OBJECT(menu), "plugin-data");
+        plugin = g_object_get_data(G_OBJECT(menu), "plugin-data");
         if (plugin && plugin->menu_construction_mode) 
         {
             return;
         }
     }
+    if (!plugin) return;
 
-    /* Get screen and windows */
-    GList *windows = wnck_application_get_windows(app);
-    if (!windows) return;
+    show_application(plugin, focus_menu_model_get_app(plugin->model, app), focus_menu_get_timestamp(plugin));
+}
 
-    WnckWindow *first_window = WNCK_WINDOW(windows->data);
-    WnckScreen *screen = wnck_window_get_screen(first_window);
-    if (!screen) return;
+/* Bring back every window of an application, raising its most recent one last */
+static void show_application(FocusMenuPlugin *plugin, FocusMenuAppRecord *record, guint32 timestamp) 
+{
+    if (!plugin || !record) return;
 
-    guint32 timestamp = gtk_get_current_event_time();
-    WnckWorkspace *active_ws = wnck_screen_get_active_workspace(screen);
-    if (!active_ws) return;
+    /* Hidden applications come back exactly as they were hidden */
+    if (hidden_registry_restore(plugin, record->app, timestamp)) 
+    {
+        return;
+    }
+
+    FocusMenuWindowSource *source = plugin->source;
+    if (!record->windows || !plugin->model->active_workspace) return;
 
     /* Collect windows and find most recent */
     GList *windows_to_show = NULL;
-    WnckWindow *most_recent_window = NULL;
+    FocusMenuSourceWindow *most_recent_window = NULL;
+    gboolean most_recent_minimized = FALSE;
 
-    for (GList *l = windows; l; l = l->next) 
+    for (GList *l = record->windows; l; l = l->next) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
+        FocusMenuWindowRecord *window_record = (FocusMenuWindowRecord *)l->data;
 
-        /* Only process normal windows on current workspace */
-        if ((wnck_window_is_visible_on_workspace(window, active_ws) || wnck_window_is_minimized(window)) && wnck_window_get_window_type(window) == WNCK_WINDOW_NORMAL) 
+        /* Only process normal windows on current workspace, or minimized anywhere */
+        if (!window_record->in_menu) continue;
+
+        FocusMenuSourceWindow *window = window_record->window;
+        if (window_record->is_minimized) 
         {
-            if (wnck_window_is_minimized(window)) 
-            {
-                windows_to_show = g_list_append(windows_to_show, window);
-            }
+            windows_to_show = g_list_append(windows_to_show, window);
 
-            /* Try to find the most recently active window */
-            if (!wnck_window_is_minimized(window)) 
-            {
-                /* For visible windows, prefer the currently active one */
-                WnckWindow *current_active = wnck_screen_get_active_window(screen);
-                if (current_active && current_active == window) 
-                {
-                    most_recent_window = window; /* This is currently focused */
-                } 
-                else if (!most_recent_window || wnck_window_is_minimized(most_recent_window)) 
-                {
-                    /* Use this visible window if we don't have a better candidate */
-                    most_recent_window = window;
-                }
-            } 
-            else if (!most_recent_window) 
+            /* If no visible window found yet, use this minimized one as fallback */
+            if (!most_recent_window) 
             {
-                /* If no visible window found yet, use this minimized one as fallback */
                 most_recent_window = window;
+                most_recent_minimized = TRUE;
             }
+        } 
+        else if (window == plugin->model->active_window) 
+        {
+            /* For visible windows, prefer the currently active one */
+            most_recent_window = window;
+            most_recent_minimized = FALSE;
+        } 
+        else if (!most_recent_window || most_recent_minimized) 
+        {
+            /* Use this visible window if we don't have a better candidate */
+            most_recent_window = window;
+            most_recent_minimized = FALSE;
         }
     }
 
     /* First, unminimize any minimized windows */
     for (GList *l = windows_to_show; l; l = l->next) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        wnck_window_unminimize(window, timestamp);
-        g_usleep(1000); /* Small delay for proper stacking */
+        focus_menu_source_window_unminimize(source, l->data, timestamp);
     }
 
     /* Then activate/raise ALL windows of this app (whether they were minimized or not) */
-    for (GList *l = windows; l; l = l->next) 
+    for (GList *l = record->windows; l; l = l->next) 
     {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
+        FocusMenuWindowRecord *window_record = (FocusMenuWindowRecord *)l->data;
 
-        /* Only process normal windows on current workspace */
-        if ((wnck_window_is_visible_on_workspace(window, active_ws) || wnck_window_is_minimized(window)) && wnck_window_get_window_type(window) == WNCK_WINDOW_NORMAL) 
+        /* Skip the most recent window - we'll activate it last */
+        if (window_record->in_menu && window_record->window != most_recent_window) 
         {
-            /* Skip the most recent window - we'll activate it last */
-            if (window != most_recent_window) 
-            {
-                wnck_window_activate(window, timestamp);
-                g_usleep(500); /* Small delay between activations */
-            }
+            focus_menu_source_window_activate(source, window_record->window, timestamp);
+            g_usleep(500); /* Small delay between activations */
         }
     }
 
     /* Finally, focus the most recent window (this brings it to the very top) */
     if (most_recent_window) 
     {
-        wnck_window_activate(most_recent_window, timestamp);
+        focus_menu_source_window_activate(source, most_recent_window, timestamp);
     }
 
     g_list_free(windows_to_show);
 }
 
 /* Activate individual window (submenu mode only) */
-static void activate_single_window(GtkMenuItem *item, WnckWindow *window) 
+static void activate_single_window(GtkMenuItem *item, FocusMenuSourceWindow *window) 
 {
     if (!window) return;
 
     /* Check if we're in menu construction mode */
     GtkWidget *menu = gtk_widget_get_parent(GTK_WIDGET(item));
-    if (menu) 
+    FocusMenuPlugin *plugin = menu ? g_object_get_data(G_OBJECT(menu), "plugin-data") : NULL;
+    if (!plugin || plugin->menu_construction_mode) 
     {
-        FocusMenuPlugin *plugin = g_object_get_data(G_OBJECT(menu), "plugin-data");
-        if (plugin && plugin->menu_construction_mode) 
-        {
-            return; /* Ignore activation during menu construction */
-        }
+        return; /* Ignore activation during menu construction */
     }
 
-    /* Standard window activation */
-    guint32 timestamp = gtk_get_current_event_time();
-    WnckWorkspace *workspace = wnck_window_get_workspace(window);
+    activate_window(plugin, window, gtk_get_current_event_time());
+}
+
+/* Switch to a window's workspace, restore it if minimized and focus it */
+static void activate_window(FocusMenuPlugin *plugin, FocusMenuSourceWindow *window, guint32 timestamp) 
+{
+    FocusMenuWindowSource *source = plugin->source;
+    FocusMenuSourceWorkspace *workspace = focus_menu_source_window_get_workspace(source, window);
+
+    #ifdef DEBUG
+    gulong x_start = x_requests_begin();
+    #endif
 
     if (workspace) 
     {
-        wnck_workspace_activate(workspace, timestamp);
+        focus_menu_source_workspace_activate(source, workspace, timestamp);
     }
 
-    if (wnck_window_is_minimized(window)) 
+    if (focus_menu_source_window_get_state(source, window) & FOCUS_MENU_SOURCE_STATE_MINIMIZED) 
     {
-        wnck_window_unminimize(window, timestamp);
+        focus_menu_source_window_unminimize(source, window, timestamp);
     }
 
-    wnck_window_activate(window, timestamp);
+    focus_menu_source_window_activate(source, window, timestamp);
+
+    #ifdef DEBUG
+    x_requests_end(plugin, X_ACTION_ACTIVATE_WINDOW, x_start, 0);
+    #endif
 }
 
 /* Create single menu item for application in flat mode */
-static void create_flat_app_menu_item(WnckApplication *app, GList *app_window_list, gboolean is_active_app, FocusMenuPlugin *plugin) 
+static void create_flat_app_menu_item(FocusMenuAppRecord *app_record, gboolean is_active_app, FocusMenuPlugin *plugin) 
 {
-    const char *app_name = classlib_get_application_display_name(app);
-    GdkPixbuf *icon = wnck_application_get_icon(app);
-
-    /* Check if all windows are minimized for styling */
-    gboolean all_minimized = TRUE;
-    for (GList *w = app_window_list; w; w = w->next) 
-    {
-        WnckWindow *window = WNCK_WINDOW(w->data);
-        if (window && !wnck_window_is_minimized(window)) 
-        {
-            all_minimized = FALSE;
-            break;
-        }
-    }
+    GdkPixbuf *icon = focus_menu_app_record_get_menu_icon(plugin->model, app_record);
 
     /* Create menu item */
-    GtkWidget *item = create_selective_menu_item_with_icon(app_name, icon, is_active_app, plugin->use_checkmarks);
+    GtkWidget *item = create_selective_menu_item_with_icon(app_record->display_name, icon, is_active_app, plugin->use_checkmarks);
 
-    /* Apply styling for minimized apps */
-    apply_hidden_styling(item, all_minimized);
+    /* Apply styling for hidden apps */
+    apply_hidden_styling(item, app_is_hidden(plugin, app_record->app));
 
     /* Connect to show_all_app_windows function */
-    g_signal_connect(item, "activate", G_CALLBACK(show_all_app_windows), app);
+    g_signal_connect(item, "activate", G_CALLBACK(show_all_app_windows), app_record->app);
 
     gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), item);
 }
 
 /* Create submenu with "Show All" first item (submenu mode) */
-static void create_app_submenu_with_show_all(WnckApplication *app, GList *app_window_list, gboolean is_active_app, FocusMenuPlugin *plugin) 
+static void create_app_submenu_with_show_all(FocusMenuAppRecord *app_record, FocusMenuWindowRecord **window_records, guint n_windows, gboolean is_active_app, FocusMenuPlugin *plugin) 
 {
-    const char *app_name = classlib_get_application_display_name(app);
-    GdkPixbuf *icon = wnck_application_get_icon(app);
-
-    /* Check if all windows are minimized for main item styling */
-    gboolean all_minimized = TRUE;
-    for (GList *w = app_window_list; w; w = w->next) 
-    {
-        WnckWindow *window = WNCK_WINDOW(w->data);
-        if (window && !wnck_window_is_minimized(window)) 
-        {
-            all_minimized = FALSE;
-            break;
-        }
-    }
+    FocusMenuBuildArena *arena = focus_menu_build_arena_get(plugin);
+    const char *app_name = app_record->display_name;
+    GdkPixbuf *icon = focus_menu_app_record_get_menu_icon(plugin->model, app_record);
 
     /* Create main menu item with submenu */
     GtkWidget *main_item = create_selective_menu_item_with_icon(app_name, icon, is_active_app, plugin->use_checkmarks);
 
-    /* Apply styling - hidden if all windows minimized, normal if any visible */
-    apply_hidden_styling(main_item, all_minimized);
+    /* Apply styling - hidden apps are dimmed and italicized */
+    apply_hidden_styling(main_item, app_is_hidden(plugin, app_record->app));
 
     GtkWidget *submenu = gtk_menu_new();
     if (!submenu) 
@@ -2169,103 +3650,232 @@ static void create_app_submenu_with_show_all(WnckApplication *app, GList *app_wi
         return;
     }
 
+    /* Submenu items need the plugin too (construction mode, hidden registry) */
+    g_object_set_data(G_OBJECT(submenu), "plugin-data", plugin);
+
     /* First item: "Show All [AppName] Windows" */
-    gchar *show_all_text = g_strdup_printf("Show All %s Windows", app_name);
-    GtkWidget *show_all_item = gtk_menu_item_new_with_label(show_all_text);
-    g_signal_connect(show_all_item, "activate", G_CALLBACK(show_all_app_windows), app);
+    g_string_printf(arena->scratch, "Show All %s Windows", app_name);
+    GtkWidget *show_all_item = gtk_menu_item_new_with_label(arena->scratch->str);
+    g_signal_connect(show_all_item, "activate", G_CALLBACK(show_all_app_windows), app_record->app);
     gtk_menu_shell_append(GTK_MENU_SHELL(submenu), show_all_item);
-    g_free(show_all_text);
 
     /* Separator */
     GtkWidget *separator = gtk_separator_menu_item_new();
     gtk_menu_shell_append(GTK_MENU_SHELL(submenu), separator);
 
-    /* Individual windows (using existing logic with modifications) */
-    app_window_list = g_list_sort_with_data(app_window_list, compare_windows_by_name_with_data, plugin);
+    /* Individual windows - labels were prepared by the model when the titles changed */
+    for (guint i = 0; i < n_windows; i++) 
+    {
+        FocusMenuWindowRecord *window_record = window_records[i];
+
+        /* Create individual window menu item */
+        GtkWidget *window_item = gtk_menu_item_new_with_label(window_record->menu_label);
+
+        /* Style minimized windows */
+        if (window_record->is_minimized) 
+        {
+            /* One attribute list serves every label; each label takes a reference */
+            if (!arena->italic) 
+            {
+                arena->italic = pango_attr_list_new();
+                pango_attr_list_insert(arena->italic, pango_attr_style_new(PANGO_STYLE_ITALIC));
+            }
+
+            GtkWidget *label = gtk_bin_get_child(GTK_BIN(window_item));
+            if (GTK_IS_LABEL(label)) 
+            {
+                gtk_label_set_attributes(GTK_LABEL(label), arena->italic);
+            }
+        }
+
+        /* Connect to individual window activation */
+        g_signal_connect(window_item, "activate", G_CALLBACK(activate_single_window), window_record->window);
+        gtk_menu_shell_append(GTK_MENU_SHELL(submenu), window_item);
+    }
+
+    gtk_menu_item_set_submenu(GTK_MENU_ITEM(main_item), submenu);
+    gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), main_item);
+}
+
+/* =============================================================================
+ * MENU BUILD ARENA
+ * Temporaries of a menu build - label text and the submenu entry lists -
+ * live in buffers the plugin keeps, which are emptied rather than freed
+ * when the build ends. After the first few builds they are big enough, and
+ * building a menu makes no allocations of its own for them
+ * ============================================================================= */
+
+static FocusMenuBuildArena *focus_menu_build_arena_get(FocusMenuPlugin *plugin) 
+{
+    if (!plugin->build_arena) 
+    {
+        plugin->build_arena = g_new0(FocusMenuBuildArena, 1);
+        plugin->build_arena->scratch = g_string_sized_new(128);
+        plugin->build_arena->window_records = g_ptr_array_new();
+    }
+    return plugin->build_arena;
+}
+
+/* End of a build: everything handed out is released at once */
+static void focus_menu_build_arena_reset(FocusMenuBuildArena *arena) 
+{
+    g_string_truncate(arena->scratch, 0);
+    g_ptr_array_set_size(arena->window_records, 0);
+}
+
+static void focus_menu_build_arena_free(FocusMenuBuildArena *arena) 
+{
+    if (!arena) return;
+
+    g_string_free(arena->scratch, TRUE);
+    g_ptr_array_free(arena->window_records, TRUE);
+    if (arena->italic) 
+    {
+        pango_attr_list_unref(arena->italic);
+    }
+    g_free(arena);
+}
+
+/* Work out the menu's rows and command states from the model; needs no display */
+static FocusMenuLayout *focus_menu_layout_build(FocusMenuPlugin *plugin) 
+{
+    FocusMenuLayout *layout = g_new0(FocusMenuLayout, 1);
+    layout->desktop_rows = g_array_new(FALSE, FALSE, sizeof(FocusMenuDesktopRow));
+    layout->app_rows = g_array_new(FALSE, FALSE, sizeof(FocusMenuAppRow));
+    layout->arena = focus_menu_build_arena_get(plugin);
+    layout->window_records = layout->arena->window_records;
+
+    if (!plugin->source || !plugin->model) 
+    {
+        return layout;
+    }
+
+    const char *outer_phase = alloc_phase("scan");
 
-    for (GList *w = app_window_list; w; w = w->next) 
+    /* Menu item states come straight from the model's counters */
+    layout->current_record = focus_menu_model_get_active_app(plugin->model);
+    if (layout->current_record) 
     {
-        WnckWindow *window = WNCK_WINDOW(w->data);
-        if (!window) continue;
+        layout->current_is_desktop_manager = is_desktop_manager(plugin, layout->current_record->app);
+    }
+
+    gint current_hideable = layout->current_record ? layout->current_record->n_hideable_visible : 0;
+    layout->has_other_hideable = plugin->model->n_hideable_visible - current_hideable > 0;
+    layout->has_minimized_windows = plugin->model->n_minimized > 0;
 
-        const char *window_name = wnck_window_get_name(window);
-        if (!window_name) window_name = "Untitled";
+    /* ENHANCED: Find all desktop managers (even those without visible windows).
+     * The worker's last scan is used as is, and a fresh one queued for next time */
+    gint64 span = trace_begin(plugin);
+    if (plugin->process_worker) 
+    {
+        layout->desktop_managers = find_all_desktop_managers(plugin->model, process_worker_get_desktop_processes(plugin->process_worker));
+        process_worker_request_scan(plugin->process_worker);
+    } 
+    else 
+    {
+        GList *processes = scan_desktop_processes();
+        layout->desktop_managers = find_all_desktop_managers(plugin->model, processes);
+        g_list_free_full(processes, (GDestroyNotify)classlib_desktop_process_free);
+    }
+    trace_end(plugin, "find_all_desktop_managers", span);
 
-        /* Ensure window name is valid UTF-8 before any processing */
-        gchar *safe_window_name = ensure_valid_utf8(window_name);
+    /* Applications in display order; each record knows its menu windows */
+    span = trace_begin(plugin);
+    alloc_phase("sort");
+    GList *apps = focus_menu_model_get_sorted_apps(plugin->model);
+    trace_end(plugin, "sort_apps", span);
+    alloc_phase("group");
 
-        /* Remove redundant application name suffix */
-        gchar *clean_window_name = remove_app_name_suffix(safe_window_name, app_name);
+    /* ENHANCED: Desktop managers come first */
+    for (GList *l = layout->desktop_managers; l; l = l->next) 
+    {
+        DesktopManagerInfo *dm_info = (DesktopManagerInfo *)l->data;
 
-        /* Truncate very long window names for better usability */
-        char *display_name;
-        if (strlen(clean_window_name) > 50) 
+        /* Check if this desktop manager already has windows in the normal app list */
+        gboolean already_in_apps = FALSE;
+        for (GList *a = focus_menu_model_list_apps_by_pid(plugin->model, dm_info->pid); a; a = a->next) 
         {
-            /* Use g_utf8_substring to safely truncate without breaking UTF-8 characters */
-            glong char_count = g_utf8_strlen(clean_window_name, -1);
-            if (char_count > 47) 
-            {
-                gchar *truncated = g_utf8_substring(clean_window_name, 0, 47);
-                display_name = g_strconcat(truncated, "...", NULL);
-                g_free(truncated);
-            } 
-            else 
+            FocusMenuAppRecord *app_record = (FocusMenuAppRecord *)a->data;
+            if (app_record->n_menu_windows > 0 && app_record->pid == dm_info->pid) 
             {
-                display_name = g_strdup(clean_window_name);
+                already_in_apps = TRUE;
+                break;
             }
-        } 
-        else 
-        {
-            display_name = g_strdup(clean_window_name);
         }
 
-        /* Double-check that our final display name is valid UTF-8 */
-        if (!g_utf8_validate(display_name, -1, NULL)) 
+        /* ENHANCED: For xfdesktop, also check if thunar is in the apps list */
+        if (!already_in_apps && g_strcmp0(dm_info->name, "xfdesktop") == 0) 
         {
-            gchar *temp = display_name;
-            display_name = ensure_valid_utf8(temp);
-            g_free(temp);
-
-            /* If ensure_valid_utf8 still couldn't fix it, use fallback */
-            if (!display_name || strlen(display_name) == 0) 
+            for (GList *a = apps; a; a = a->next) 
             {
-                g_free(display_name);
-                display_name = g_strdup("Window");
+                FocusMenuAppRecord *app_record = (FocusMenuAppRecord *)a->data;
+                if (app_record->n_menu_windows > 0) 
+                {
+                    const char *app_name = focus_menu_source_app_get_name(plugin->source, app_record->app);
+                    if (app_name && g_ascii_strcasecmp(app_name, "thunar") == 0) 
+                    {
+                        already_in_apps = TRUE;
+                        break;
+                    }
+                }
             }
         }
 
-        /* Create individual window menu item */
-        GtkWidget *window_item = gtk_menu_item_new_with_label(display_name);
-
-        /* Style minimized windows */
-        if (wnck_window_is_minimized(window)) 
+        if (!already_in_apps) 
         {
-            PangoAttrList *attrs = pango_attr_list_new();
-            PangoAttribute *attr = pango_attr_style_new(PANGO_STYLE_ITALIC);
-            pango_attr_list_insert(attrs, attr);
+            /* This desktop manager has no visible windows - list it on its own */
+            FocusMenuDesktopRow row;
+            row.info = dm_info;
+            row.app_record = focus_menu_model_find_app_by_pid(plugin->model, dm_info->pid);
+            g_array_append_val(layout->desktop_rows, row);
+        }
+    }
 
-            GtkWidget *label = gtk_bin_get_child(GTK_BIN(window_item));
-            if (GTK_IS_LABEL(label)) 
-            {
-                gtk_label_set_attributes(GTK_LABEL(label), attrs);
-            }
-            pango_attr_list_unref(attrs);
+    /* Continue with regular applications... */
+    FocusMenuAppRecord *active_record = focus_menu_model_get_active_app(plugin->model);
+    for (GList *l = apps; l; l = l->next) 
+    {
+        FocusMenuAppRecord *app_record = (FocusMenuAppRecord *)l->data;
+        if (app_record->n_menu_windows == 0) continue;
+
+        /* Always use the application name for consistency, not window names */
+        const char *app_name = app_record->display_name;
+        if (!app_name) continue;
+        if (g_ascii_strcasecmp(app_name, "Xfce4 Notifyd") == 0)
+        { // Not a real program
+            continue;
         }
 
-        /* Connect to individual window activation */
-        g_signal_connect(window_item, "activate", G_CALLBACK(activate_single_window), window);
-        gtk_menu_shell_append(GTK_MENU_SHELL(submenu), window_item);
+        FocusMenuAppRow row;
+        row.app_record = app_record;
+        row.is_active = (app_record == active_record);
+        row.first_window = layout->window_records->len;
+        row.n_windows = 0;
 
-        g_free(display_name);
-        g_free(clean_window_name);
-        g_free(safe_window_name);
+        /* Submenu mode: multi-window apps get submenus */
+        if (plugin->use_submenus && app_record->n_menu_windows > 1) 
+        {
+            row.n_windows = focus_menu_app_record_append_menu_windows(app_record, layout->window_records);
+        }
+        g_array_append_val(layout->app_rows, row);
     }
 
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(main_item), submenu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), main_item);
+    alloc_phase(outer_phase);
+    return layout;
+}
+
+static void focus_menu_layout_free(FocusMenuLayout *layout) 
+{
+    if (!layout) return;
+
+    focus_menu_build_arena_reset(layout->arena);
+    g_array_free(layout->app_rows, TRUE);
+    g_array_free(layout->desktop_rows, TRUE);
+    g_list_free_full(layout->desktop_managers, (GDestroyNotify)desktop_manager_info_free);
+    g_free(layout);
 }
 
-/* Create menu function - the main menu construction logic */
+/* Create menu function - builds the layout, then the widgets for it */
 static void create_menu(FocusMenuPlugin *plugin) 
 {
     if (!plugin) 
@@ -2276,6 +3886,7 @@ static void create_menu(FocusMenuPlugin *plugin)
     /* Destroy existing menu if it exists */
     if (plugin->menu) 
     {
+        latency_cancel(plugin);
         gtk_widget_destroy(plugin->menu);
         plugin->menu = NULL;
     }
@@ -2286,6 +3897,13 @@ static void create_menu(FocusMenuPlugin *plugin)
         plugin->radio_group = NULL;  /* Only manage radio group when using radio buttons */
     }
 
+    #ifdef DEBUG
+    gulong x_start = x_requests_begin();
+    #endif
+
+    FocusMenuLayout *layout = focus_menu_layout_build(plugin);
+    const char *outer_phase = alloc_phase("items");
+
     /* Enter menu construction mode to ignore activation signals */
     plugin->menu_construction_mode = TRUE;
 
@@ -2294,75 +3912,34 @@ static void create_menu(FocusMenuPlugin *plugin)
     {
         g_warning("Failed to create menu");
         plugin->menu_construction_mode = FALSE;
+        focus_menu_layout_free(layout);
+        alloc_phase(outer_phase);
         return;
     }
 
     /* Store plugin reference in menu for signal handlers to access */
     g_object_set_data(G_OBJECT(plugin->menu), "plugin-data", plugin);
+    g_signal_connect(plugin->menu, "deactivate", G_CALLBACK(on_menu_deactivate), plugin);
 
     /* Create dynamic "Hide [ApplicationName]" option */
-    if (plugin->active_window) 
+    if (layout->current_record) 
     {
-        WnckApplication *app = wnck_window_get_application(plugin->active_window);
-        if (app) 
+        const char *app_name = layout->current_record->display_name;
+        if (app_name) 
         {
-            const char *app_name = classlib_get_application_display_name(app);
-            if (app_name) 
+            g_string_printf(layout->arena->scratch, "Hide %s", app_name);
+            GtkWidget *hide_current = create_command_menu_item(layout->arena->scratch->str);
+            if (hide_current) 
             {
-                char *hide_text = g_strdup_printf("Hide %s", app_name);
-                GtkWidget *hide_current = create_command_menu_item(hide_text);
-                if (hide_current) 
+                if (layout->current_is_desktop_manager) 
                 {
-                    /* Check if this is a desktop manager */
-                    gboolean is_desktop = is_desktop_manager(app);
-
-                    if (is_desktop) 
-                    {
-                        /* Desktop manager - disable if no hideable windows */
-                        gboolean has_hideable = app_has_hideable_windows(app, plugin->screen);
-                        gtk_widget_set_sensitive(hide_current, has_hideable);
-                    }
-
-                    gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), hide_current);
-                    g_signal_connect(hide_current, "activate", G_CALLBACK(hide_current_application), plugin);
+                    /* Desktop manager - disable if no hideable windows */
+                    gboolean has_hideable = layout->current_record->n_hideable_visible > 0;
+                    gtk_widget_set_sensitive(hide_current, has_hideable);
                 }
-                g_free(hide_text);
-            }
-        }
-    }
-
-    /* Check for other windows and minimized windows to determine menu item states */
-    gboolean has_other_hideable = FALSE;
-    gboolean has_minimized_windows = FALSE;
-
-    GList *all_windows = wnck_screen_get_windows(plugin->screen);
-    for (GList *l = all_windows; l; l = l->next) 
-    {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
-
-        WnckWorkspace *active_ws = wnck_screen_get_active_workspace(plugin->screen);
-        if (!active_ws) continue;
-
-        if ((wnck_window_is_visible_on_workspace(window, active_ws) || wnck_window_is_minimized(window)) && wnck_window_get_window_type(window) == WNCK_WINDOW_NORMAL) 
-        {
 
-            if (wnck_window_is_minimized(window)) 
-            {
-                has_minimized_windows = TRUE;
-            }
-
-            if (window != plugin->active_window && !wnck_window_is_minimized(window)) 
-            {
-                WnckApplication *app = wnck_window_get_application(window);
-                // To properly disable 'hide others' if there's only one program focused
-                WnckApplication *current_app = wnck_window_get_application(plugin->active_window);
-                /* Only count as hideable if it's not a desktop manager and not already minimized */
-                if (app && !is_desktop_window(window)) 
-                {
-                    if(app == current_app){continue;}
-                    has_other_hideable = TRUE;
-                }
+                gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), hide_current);
+                g_signal_connect(hide_current, "activate", G_CALLBACK(hide_current_application), plugin);
             }
         }
     }
@@ -2371,7 +3948,7 @@ static void create_menu(FocusMenuPlugin *plugin)
     GtkWidget *hide_others = create_command_menu_item("Hide Others");
     if (hide_others) 
     {
-        gtk_widget_set_sensitive(hide_others, has_other_hideable);
+        gtk_widget_set_sensitive(hide_others, layout->has_other_hideable);
         gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), hide_others);
         g_signal_connect(hide_others, "activate", G_CALLBACK(hide_all_applications), plugin);
     }
@@ -2379,166 +3956,88 @@ static void create_menu(FocusMenuPlugin *plugin)
     GtkWidget *show_all = create_command_menu_item("Show All");
     if (show_all) 
     {
-        gtk_widget_set_sensitive(show_all, has_minimized_windows);
+        gtk_widget_set_sensitive(show_all, layout->has_minimized_windows);
         gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), show_all);
         g_signal_connect(show_all, "activate", G_CALLBACK(show_all_applications), plugin);
     }
 
+    /* Offer to reverse the last bulk operation */
+    if (plugin->journal_op != BULK_OP_NONE) 
+    {
+        GtkWidget *undo = create_command_menu_item(plugin->journal_op == BULK_OP_HIDE_OTHERS ? "Undo Hide Others" : "Undo Show All");
+        if (undo) 
+        {
+            gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), undo);
+            g_signal_connect(undo, "activate", G_CALLBACK(undo_bulk_operation), plugin);
+        }
+    }
+
     /* Add separator */
     GtkWidget *separator = gtk_separator_menu_item_new();
     gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), separator);
 
-    /* Safety check for screen */
-    if (!plugin->screen) 
+    /* Safety check for the window source */
+    if (!plugin->source || !plugin->model) 
     {
-        g_warning("No screen available");
+        g_warning("No window source available");
         plugin->menu_construction_mode = FALSE;
+        focus_menu_layout_free(layout);
         gtk_widget_show_all(plugin->menu);
+        alloc_phase(outer_phase);
         return;
     }
 
-    /* ENHANCED: Find all desktop managers (even those without visible windows) */
-    GList *forced_desktop_managers = find_all_desktop_managers(plugin->screen);
-
-    /* Get all windows and group by application (including minimized ones) */
-    GList *windows = wnck_screen_get_windows(plugin->screen);
-    GHashTable *app_windows = g_hash_table_new(g_direct_hash, g_direct_equal);
-
-    /* Group windows by application with safety checks (include minimized windows) */
-    for (GList *l = windows; l; l = l->next) 
-    {
-        WnckWindow *window = WNCK_WINDOW(l->data);
-        if (!window) continue;
-
-        WnckWorkspace *active_ws = wnck_screen_get_active_workspace(plugin->screen);
-        if (!active_ws) continue;
-
-        if ((wnck_window_is_visible_on_workspace(window, active_ws) || wnck_window_is_minimized(window)) && wnck_window_get_window_type(window) == WNCK_WINDOW_NORMAL) 
-        {
-            WnckApplication *app = wnck_window_get_application(window);
-            if (app) 
-            {
-                GList *app_window_list = g_hash_table_lookup(app_windows, app);
-                app_window_list = g_list_append(app_window_list, window);
-                g_hash_table_replace(app_windows, app, app_window_list);
-            }
-        }
-    }
-
-    /* Get sorted list of applications */
-    GList *apps = g_hash_table_get_keys(app_windows);
-    apps = g_list_sort_with_data(apps, compare_apps_by_display_name_with_data, plugin);
-
     #ifdef DEBUG
     g_debug("=== DEBUG: Menu creation started ===");
-    GList *debug_windows = wnck_screen_get_windows(plugin->screen);
-    g_debug("DEBUG: Total windows detected: %d", g_list_length(debug_windows));
-
-    /* Count unique applications */
-    g_debug("DEBUG: Unique applications detected: %d", g_hash_table_size(app_windows));
-    #endif
-
-    /* ENHANCED: Add desktop managers first */
-    for (GList *l = forced_desktop_managers; l; l = l->next) 
-    {
-        DesktopManagerInfo *dm_info = (DesktopManagerInfo *)l->data;
-
-        /* Check if this desktop manager already has windows in the normal app list */
-        gboolean already_in_apps = FALSE;
-        for (GList *a = apps; a; a = a->next) 
-        {
-            WnckApplication *app = WNCK_APPLICATION(a->data);
-            if (app && wnck_application_get_pid(app) == dm_info->pid) 
-            {
-                already_in_apps = TRUE;
-                break;
-            }
-        }
-
-        /* ENHANCED: For xfdesktop, also check if thunar is in the apps list */
-        if (!already_in_apps && g_strcmp0(dm_info->name, "xfdesktop") == 0) 
-        {
-            for (GList *a = apps; a; a = a->next) 
-            {
-                WnckApplication *app = WNCK_APPLICATION(a->data);
-                if (app) 
-                {
-                    const char *app_name = wnck_application_get_name(app);
-                    if (app_name && g_ascii_strcasecmp(app_name, "thunar") == 0) 
-                    {
-                        already_in_apps = TRUE;
-                        break;
-                    }
-                }
-            }
-        }
+    g_debug("DEBUG: Total windows detected: %u", g_hash_table_size(plugin->model->windows));
 
-        if (!already_in_apps) 
-        {
-            /* This desktop manager has no visible windows - add it manually */
+    /* Count unique applications */
+    g_debug("DEBUG: Unique applications detected: %u", g_hash_table_size(plugin->model->apps));
+    #endif
 
-            /* Try to find the application for the icon */
-            GdkPixbuf *desktop_icon = NULL;
-            WnckApplication *desktop_app = find_application_by_pid(plugin->screen, dm_info->pid);
-            if (desktop_app) 
-            {
-                desktop_icon = wnck_application_get_icon(desktop_app);
-            }
+    /* ENHANCED: Add desktop managers first */
+    for (guint i = 0; i < layout->desktop_rows->len; i++) 
+    {
+        FocusMenuDesktopRow *row = &g_array_index(layout->desktop_rows, FocusMenuDesktopRow, i);
+        DesktopManagerInfo *dm_info = row->info;
+        GdkPixbuf *desktop_icon = row->app_record ? focus_menu_app_record_get_menu_icon(plugin->model, row->app_record) : NULL;
 
-            GtkWidget *item = create_selective_menu_item_with_icon(dm_info->display_name, desktop_icon, dm_info->is_active, plugin->use_checkmarks);
-            if (item) 
-            {
-                /* Apply underline styling to indicate this is a special desktop manager */
-                apply_desktop_manager_styling(item);
-                gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), item);
-
-                /* Store a deep copy of dm_info in the menu item */
-                DesktopManagerInfo *dm_info_copy = desktop_manager_info_copy(dm_info);
-                g_object_set_data_full(G_OBJECT(item), "desktop-manager-info", dm_info_copy, (GDestroyNotify)desktop_manager_info_free);
-                g_signal_connect(item, "activate", G_CALLBACK(activate_desktop_manager), NULL);
-            }
+        GtkWidget *item = create_selective_menu_item_with_icon(dm_info->display_name, desktop_icon, dm_info->is_active, plugin->use_checkmarks);
+        if (item) 
+        {
+            /* Apply underline styling to indicate this is a special desktop manager */
+            apply_desktop_manager_styling(item);
+            gtk_menu_shell_append(GTK_MENU_SHELL(plugin->menu), item);
+
+            /* Store a deep copy of dm_info in the menu item */
+            DesktopManagerInfo *dm_info_copy = desktop_manager_info_copy(dm_info);
+            g_object_set_data_full(G_OBJECT(item), "desktop-manager-info", dm_info_copy, (GDestroyNotify)desktop_manager_info_free);
+            g_signal_connect(item, "activate", G_CALLBACK(activate_desktop_manager), NULL);
         }
     }
 
     /* Continue with regular applications... */
-    for (GList *l = apps; l; l = l->next) 
+    for (guint i = 0; i < layout->app_rows->len; i++) 
     {
-        WnckApplication *app = WNCK_APPLICATION(l->data);
-        if (!app) continue;
-
-        GList *app_window_list = g_hash_table_lookup(app_windows, app);
-        if (!app_window_list) continue;
-
-        /* Always use the application name for consistency, not window names */
-        const char *app_name = classlib_get_application_display_name(app);
-        if (!app_name) continue;
-        if (g_ascii_strcasecmp(app_name, "Xfce4 Notifyd") == 0)
-        { // Not a real program
-            continue;
-        }
-        /* Check if this is the currently active application */
-        WnckWindow *current_active = wnck_screen_get_active_window(plugin->screen);
-        gboolean is_active_app = FALSE;
-        if (current_active) 
-        {
-            WnckApplication *active_app = wnck_window_get_application(current_active);
-            if (active_app == app) 
-            {
-                is_active_app = TRUE;
-            }
-        }
+        FocusMenuAppRow *row = &g_array_index(layout->app_rows, FocusMenuAppRow, i);
+        gint64 span = trace_begin(plugin);
 
-        if (plugin->use_submenus && g_list_length(app_window_list) > 1) 
+        if (row->n_windows > 0) 
         {
             /* Submenu mode: multi-window apps get submenus */
-            create_app_submenu_with_show_all(app, app_window_list, is_active_app, plugin);
+            FocusMenuWindowRecord **window_records = (FocusMenuWindowRecord **)layout->window_records->pdata + row->first_window;
+            create_app_submenu_with_show_all(row->app_record, window_records, row->n_windows, row->is_active, plugin);
+            trace_end(plugin, "create_app_submenu_with_show_all", span);
         } 
         else 
         {
             /* Flat mode: all apps get single menu item (regardless of window count) */
-            create_flat_app_menu_item(app, app_window_list, is_active_app, plugin);
+            create_flat_app_menu_item(row->app_record, row->is_active, plugin);
+            trace_end(plugin, "create_flat_app_menu_item", span);
         }
     }
+    focus_menu_layout_free(layout);
+
     #ifdef DEBUG
     /* Add debug version separator and info */
     GtkWidget *debug_separator = gtk_separator_menu_item_new();
@@ -2554,47 +4053,118 @@ static void create_menu(FocusMenuPlugin *plugin)
 
     /* Exit menu construction mode - signals are now allowed */
     plugin->menu_construction_mode = FALSE;
+    gint64 span = trace_begin(plugin);
+    alloc_phase("show");
     gtk_widget_show_all(plugin->menu);
+    trace_end(plugin, "gtk_widget_show_all", span);
+    alloc_phase(outer_phase);
+
+    #ifdef DEBUG
+    x_requests_end(plugin, X_ACTION_MENU_OPEN, x_start, 0);
+    #endif
 }
 
+/* Show the active application's name and icon, both already kept by the model */
 static void update_button_display(FocusMenuPlugin *plugin) 
 {
-    if (!plugin || !plugin->screen) 
+    if (!plugin || !plugin->model) 
     {
         return;
     }
 
-    plugin->active_window = wnck_screen_get_active_window(plugin->screen);
+    FocusMenuSourceApp *app = NULL;
+    const char *app_name = "Desktop";
+    GdkPixbuf *icon = NULL;
 
-    if (plugin->active_window) 
+    if (plugin->model->active_window) 
     {
         /* Use application name for display (not window name) */
-        WnckApplication *app = wnck_window_get_application(plugin->active_window);
-        if (app) 
+        FocusMenuAppRecord *record = focus_menu_model_get_active_app(plugin->model);
+        if (!record) 
         {
-            const char *app_name = classlib_get_application_display_name(app);
-            GdkPixbuf *icon = wnck_application_get_icon(app);
+            return;
+        }
+        app = record->app;
+        app_name = record->display_name;
+        icon = focus_menu_app_record_get_menu_icon(plugin->model, record);
+    }
 
-            if (app_name) 
-            {
-                gtk_label_set_text(GTK_LABEL(plugin->label), app_name);
-            }
+    /* Nothing visible changed - skip the relabel and icon rescale */
+    if (app == plugin->displayed_app && icon == plugin->displayed_icon && g_strcmp0(app_name, plugin->displayed_label) == 0) 
+    {
+        return;
+    }
 
-            if (icon) 
-            {
-                GdkPixbuf *scaled_icon = gdk_pixbuf_scale_simple(icon, 16, 16, GDK_INTERP_BILINEAR);
-                if (scaled_icon) 
-                {
-                    gtk_image_set_from_pixbuf(GTK_IMAGE(plugin->icon), scaled_icon);
-                    g_object_unref(scaled_icon);
-                }
-            }
+    /* label and icon are NULL only when bench/event-replay runs without a display */
+    if (app_name && g_strcmp0(app_name, plugin->displayed_label) != 0) 
+    {
+        if (plugin->label) 
+        {
+            gtk_label_set_text(GTK_LABEL(plugin->label), app_name);
         }
-    } 
-    else 
+        g_free(plugin->displayed_label);
+        plugin->displayed_label = g_strdup(app_name);
+    }
+
+    if (icon != plugin->displayed_icon || app != plugin->displayed_app) 
+    {
+        /* The menu's icon is button-sized too; an application without one
+         * gets the desktop's rather than keeping the previous application's */
+        if (plugin->icon && icon) 
+        {
+            gtk_image_set_from_pixbuf(GTK_IMAGE(plugin->icon), icon);
+        } 
+        else if (plugin->icon) 
+        {
+            gtk_image_set_from_icon_name(GTK_IMAGE(plugin->icon), "desktop", GTK_ICON_SIZE_MENU);
+        }
+
+        /* Hold a reference so a recycled pixbuf address can't fool the comparison */
+        if (icon) 
+        {
+            g_object_ref(icon);
+        }
+        if (plugin->displayed_icon) 
+        {
+            g_object_unref(plugin->displayed_icon);
+        }
+        plugin->displayed_icon = icon;
+    }
+
+    plugin->displayed_app = app;
+}
+
+/* Idle callback that runs the single update for a burst of screen events */
+static gboolean on_button_update_idle(gpointer user_data) 
+{
+    FocusMenuPlugin *plugin = (FocusMenuPlugin *)user_data;
+    plugin->update_idle_id = 0;
+
+    #ifdef DEBUG
+    plugin->button_updates++;
+    g_debug("DEBUG: %u screen events coalesced into %u button updates (%.1f:1)", plugin->screen_events, plugin->button_updates, (gdouble)plugin->screen_events / plugin->button_updates);
+    #endif
+
+    update_button_display(plugin);
+    return G_SOURCE_REMOVE;
+}
+
+/* Schedule a button update; any number of events before the next frame share one update */
+static void queue_button_update(FocusMenuPlugin *plugin) 
+{
+    if (!plugin || !plugin->model) 
+    {
+        return;
+    }
+
+    #ifdef DEBUG
+    plugin->screen_events++;
+    #endif
+
+    if (plugin->update_idle_id == 0) 
     {
-        gtk_label_set_text(GTK_LABEL(plugin->label), "Desktop");
-        gtk_image_set_from_icon_name(GTK_IMAGE(plugin->icon), "desktop", GTK_ICON_SIZE_MENU);
+        /* After GTK's resize pass, before it redraws - lands in the next frame */
+        plugin->update_idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE + 15, on_button_update_idle, plugin, NULL);
     }
 }
 
@@ -2602,28 +4172,320 @@ static gboolean on_button_pressed(GtkWidget *widget, GdkEventButton *event, Focu
 {
     if (event->button == 1) 
     { /* Left mouse button */
+        plugin->press_time_us = g_get_monotonic_time();
+        memory_release_cancel(plugin);
+        event_recorder_note_menu(plugin->recorder);
+        gint64 click_span = trace_begin(plugin);
+        gint64 span = trace_begin(plugin);
+        gint64 build_start = g_get_monotonic_time();
         create_menu(plugin);
+        gint64 build_time = g_get_monotonic_time() - build_start;
+        flight_record(FLIGHT_MENU_BUILD, "create-menu", build_time);
+        plugin->menu_builds++;
+        plugin->build_time_total_us += build_time;
+        plugin->build_time_worst_us = MAX(plugin->build_time_worst_us, build_time);
+        trace_end(plugin, "create_menu", span);
 
         /* Position the menu to align right (Mac OS 9 style) */
+        span = trace_begin(plugin);
         gtk_menu_popup_at_widget(GTK_MENU(plugin->menu), widget, GDK_GRAVITY_SOUTH_EAST, GDK_GRAVITY_NORTH_EAST, (GdkEvent*)event);
+        trace_end(plugin, "menu_popup", span);
+        latency_watch_menu(plugin);
+        trace_end(plugin, "button_press", click_span);
         return TRUE; /* Event handled */
     }
     return FALSE;
 }
 
-static void on_active_window_changed(WnckScreen *screen G_GNUC_UNUSED, WnckWindow *previous G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+/* One instance's share of a model change: the button follows the active
+ * application, and the hidden-state registry follows windows and
+ * applications by their source objects */
+static void focus_menu_on_model_changed(FocusMenuModel *model, FocusMenuModelChange change, gpointer object, gulong id G_GNUC_UNUSED, gpointer user_data) 
 {
-    update_button_display(plugin);
+    FocusMenuPlugin *plugin = (FocusMenuPlugin *)user_data;
+
+    switch (change) 
+    {
+        case MODEL_WINDOW_ADDED:
+            hidden_registry_window_added(plugin, focus_menu_model_get_window(model, object));
+            queue_button_update(plugin);
+            break;
+        case MODEL_WINDOW_CHANGED:
+            hidden_registry_window_changed(plugin, focus_menu_model_get_window(model, object));
+            break;
+        case MODEL_WINDOW_REMOVED:
+            hidden_registry_window_removed(plugin, object);
+            queue_button_update(plugin);
+            break;
+        case MODEL_APPLICATION_REMOVED:
+            g_hash_table_remove(plugin->hidden_apps, object);
+            break;
+        case MODEL_APPLICATION_CHANGED:
+            /* A renamed application only matters while the button shows it */
+            if (object == plugin->displayed_app) queue_button_update(plugin);
+            break;
+        case MODEL_ACTIVE_WINDOW_CHANGED:
+            queue_button_update(plugin);
+            break;
+        default:
+            break;
+    }
 }
 
-static void on_window_opened(WnckScreen *screen G_GNUC_UNUSED, WnckWindow *window G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+/* =============================================================================
+ * D-BUS SERVICE
+ * Exports the model on the session bus as org.xfce.FocusMenu, so scripts can
+ * list applications and windows, follow changes and issue the menu's
+ * commands without scanning /proc and X themselves. The shared backend owns
+ * it, so a panel process has one service however many instances it runs;
+ * commands are carried out by the oldest live instance
+ * ============================================================================= */
+
+static const gchar dbus_introspection_xml[] =
+"<node>"
+"  <interface name='" FOCUS_MENU_DBUS_INTERFACE "'>"
+"    <method name='ListApplications'>"
+"      <!-- id (group leader XID), display name, pid, windows, menu windows, active, hidden, desktop manager -->"
+"      <arg type='a(tsiuubbb)' name='applications' direction='out'/>"
+"    </method>"
+"    <method name='ListWindows'>"
+"      <!-- XID, application id, title, minimized, listed in the menu, active -->"
+"      <arg type='a(ttsbbb)' name='windows' direction='out'/>"
+"    </method>"
+"    <method name='Hide'>"
+"      <arg type='t' name='application' direction='in'/>"
+"    </method>"
+"    <method name='HideOthers'/>"
+"    <method name='ShowAll'/>"
+"    <method name='Activate'>"
+"      <arg type='t' name='application' direction='in'/>"
+"    </method>"
+"    <method name='ActivateWindow'>"
+"      <arg type='t' name='window' direction='in'/>"
+"    </method>"
+"    <signal name='ApplicationAdded'><arg type='t' name='application'/></signal>"
+"    <signal name='ApplicationRemoved'><arg type='t' name='application'/></signal>"
+"    <signal name='ApplicationChanged'><arg type='t' name='application'/></signal>"
+"    <signal name='WindowAdded'><arg type='t' name='window'/></signal>"
+"    <signal name='WindowRemoved'><arg type='t' name='window'/></signal>"
+"    <signal name='WindowChanged'><arg type='t' name='window'/></signal>"
+"    <signal name='ActiveWindowChanged'><arg type='t' name='window'/></signal>"
+"    <signal name='ActiveWorkspaceChanged'/>"
+"  </interface>"
+"</node>";
+
+static GVariant *dbus_list_applications(FocusMenuPlugin *plugin) 
 {
-    update_button_display(plugin);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(tsiuubbb)"));
+
+    FocusMenuAppRecord *active_record = focus_menu_model_get_active_app(plugin->model);
+    for (GList *l = focus_menu_model_get_sorted_apps(plugin->model); l; l = l->next) 
+    {
+        FocusMenuAppRecord *record = (FocusMenuAppRecord *)l->data;
+        g_variant_builder_add(&builder, "(tsiuubbb)",
+        (guint64)focus_menu_source_app_get_id(plugin->source, record->app),
+        record->display_name ? record->display_name : "",
+        (gint32)record->pid,
+        g_list_length(record->windows),
+        (guint32)record->n_menu_windows,
+        record == active_record,
+        app_is_hidden(plugin, record->app),
+        is_desktop_manager(plugin, record->app));
+    }
+
+    return g_variant_new("(a(tsiuubbb))", &builder);
 }
 
-static void on_window_closed(WnckScreen *screen G_GNUC_UNUSED, WnckWindow *window G_GNUC_UNUSED, FocusMenuPlugin *plugin) 
+static GVariant *dbus_list_windows(FocusMenuPlugin *plugin) 
 {
-    update_button_display(plugin);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ttsbbb)"));
+
+    for (GList *l = focus_menu_source_list_windows(plugin->source); l; l = l->next) 
+    {
+        FocusMenuWindowRecord *record = focus_menu_model_get_window(plugin->model, l->data);
+        if (!record) continue;
+
+        gchar *title = classlib_dup_valid_utf8(focus_menu_source_window_get_name(plugin->source, record->window));
+        g_variant_builder_add(&builder, "(ttsbbb)",
+        (guint64)focus_menu_source_window_get_id(plugin->source, record->window),
+        (guint64)focus_menu_source_app_get_id(plugin->source, record->app_record->app),
+        title,
+        record->is_minimized,
+        record->in_menu,
+        record->window == plugin->model->active_window);
+        g_free(title);
+    }
+
+    return g_variant_new("(a(ttsbbb))", &builder);
+}
+
+/* The application a method's (t) argument names; returns an error to the caller and NULL if there is none */
+static FocusMenuAppRecord *dbus_lookup_application(FocusMenuPlugin *plugin, GVariant *parameters, GDBusMethodInvocation *invocation) 
+{
+    guint64 id = 0;
+    g_variant_get(parameters, "(t)", &id);
+
+    FocusMenuAppRecord *record = focus_menu_model_find_app_by_id(plugin->model, (gulong)id);
+    if (!record) 
+    {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "No application with id 0x%" G_GINT64_MODIFIER "x", id);
+    }
+    return record;
+}
+
+static void dbus_handle_method_call(GDBusConnection *connection G_GNUC_UNUSED, const gchar *sender G_GNUC_UNUSED, const gchar *object_path G_GNUC_UNUSED, const gchar *interface_name G_GNUC_UNUSED, const gchar *method_name, GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data) 
+{
+    FocusMenuBackend *backend = (FocusMenuBackend *)user_data;
+
+    /* Hidden state is kept per instance; the oldest one speaks for the panel */
+    FocusMenuPlugin *plugin = backend->instances ? backend->instances->data : NULL;
+    if (!plugin) 
+    {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED, "No Focus Menu instance is running");
+        return;
+    }
+
+    if (g_strcmp0(method_name, "ListApplications") == 0) 
+    {
+        g_dbus_method_invocation_return_value(invocation, dbus_list_applications(plugin));
+    } 
+    else if (g_strcmp0(method_name, "ListWindows") == 0) 
+    {
+        g_dbus_method_invocation_return_value(invocation, dbus_list_windows(plugin));
+    } 
+    else if (g_strcmp0(method_name, "HideOthers") == 0) 
+    {
+        hide_all_applications(NULL, plugin);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } 
+    else if (g_strcmp0(method_name, "ShowAll") == 0) 
+    {
+        show_all_applications(NULL, plugin);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } 
+    else if (g_strcmp0(method_name, "Hide") == 0) 
+    {
+        FocusMenuAppRecord *record = dbus_lookup_application(plugin, parameters, invocation);
+        if (!record) return;
+
+        hide_application(plugin, record);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } 
+    else if (g_strcmp0(method_name, "Activate") == 0) 
+    {
+        FocusMenuAppRecord *record = dbus_lookup_application(plugin, parameters, invocation);
+        if (!record) return;
+
+        show_application(plugin, record, focus_menu_get_timestamp(plugin));
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } 
+    else if (g_strcmp0(method_name, "ActivateWindow") == 0) 
+    {
+        guint64 xid = 0;
+        g_variant_get(parameters, "(t)", &xid);
+
+        FocusMenuWindowRecord *record = focus_menu_model_find_window_by_id(plugin->model, (gulong)xid);
+        if (!record) 
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "No window with XID 0x%" G_GINT64_MODIFIER "x", xid);
+            return;
+        }
+
+        activate_window(plugin, record->window, focus_menu_get_timestamp(plugin));
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    } 
+    else 
+    {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD, "Unknown method %s", method_name);
+    }
+}
+
+static const GDBusInterfaceVTable dbus_interface_vtable = 
+{
+    dbus_handle_method_call,
+    NULL,
+    NULL,
+    { 0 }
+};
+
+/* Forward model changes to the bus */
+static void dbus_emit_model_change(FocusMenuBackend *backend, FocusMenuModelChange change, gulong id) 
+{
+    if (!backend->dbus_connection || !backend->dbus_registration_id) return;
+
+    static const char *signal_names[] = 
+    {
+        [MODEL_APPLICATION_ADDED] = "ApplicationAdded",
+        [MODEL_APPLICATION_REMOVED] = "ApplicationRemoved",
+        [MODEL_APPLICATION_CHANGED] = "ApplicationChanged",
+        [MODEL_WINDOW_ADDED] = "WindowAdded",
+        [MODEL_WINDOW_REMOVED] = "WindowRemoved",
+        [MODEL_WINDOW_CHANGED] = "WindowChanged",
+        [MODEL_ACTIVE_WINDOW_CHANGED] = "ActiveWindowChanged",
+        [MODEL_ACTIVE_WORKSPACE_CHANGED] = "ActiveWorkspaceChanged"
+    };
+
+    GVariant *parameters = change == MODEL_ACTIVE_WORKSPACE_CHANGED ? NULL : g_variant_new("(t)", (guint64)id);
+    g_dbus_connection_emit_signal(backend->dbus_connection, NULL, FOCUS_MENU_DBUS_PATH, FOCUS_MENU_DBUS_INTERFACE, signal_names[change], parameters, NULL);
+}
+
+static void on_dbus_bus_acquired(GDBusConnection *connection, const gchar *name G_GNUC_UNUSED, gpointer user_data) 
+{
+    FocusMenuBackend *backend = (FocusMenuBackend *)user_data;
+    GError *error = NULL;
+
+    GDBusNodeInfo *node_info = g_dbus_node_info_new_for_xml(dbus_introspection_xml, &error);
+    if (!node_info) 
+    {
+        g_warning("Invalid D-Bus interface description: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    backend->dbus_registration_id = g_dbus_connection_register_object(connection, FOCUS_MENU_DBUS_PATH, node_info->interfaces[0], &dbus_interface_vtable, backend, NULL, &error);
+    g_dbus_node_info_unref(node_info);
+
+    if (!backend->dbus_registration_id) 
+    {
+        g_warning("Failed to export %s on D-Bus: %s", FOCUS_MENU_DBUS_PATH, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    backend->dbus_connection = g_object_ref(connection);
+}
+
+static void on_dbus_name_lost(GDBusConnection *connection G_GNUC_UNUSED, const gchar *name, gpointer user_data G_GNUC_UNUSED) 
+{
+    /* Another panel process already serves the desktop */
+    g_debug("D-Bus name %s not available", name);
+}
+
+static void dbus_service_start(FocusMenuBackend *backend) 
+{
+    backend->dbus_owner_id = g_bus_own_name(G_BUS_TYPE_SESSION, FOCUS_MENU_DBUS_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, on_dbus_bus_acquired, NULL, on_dbus_name_lost, backend, NULL);
+}
+
+static void dbus_service_stop(FocusMenuBackend *backend) 
+{
+    if (backend->dbus_connection) 
+    {
+        if (backend->dbus_registration_id) 
+        {
+            g_dbus_connection_unregister_object(backend->dbus_connection, backend->dbus_registration_id);
+            backend->dbus_registration_id = 0;
+        }
+        g_object_unref(backend->dbus_connection);
+        backend->dbus_connection = NULL;
+    }
+
+    if (backend->dbus_owner_id) 
+    {
+        g_bus_unown_name(backend->dbus_owner_id);
+        backend->dbus_owner_id = 0;
+    }
 }
 
 /* PROPERTIES DIALOG AND CONFIG FUNCTIONS */
@@ -2649,6 +4511,11 @@ static void focus_menu_load_settings(FocusMenuPlugin *plugin)
     prop_name = focus_menu_get_property_name(plugin, "use-submenus");
     plugin->use_submenus = xfconf_channel_get_bool(plugin->channel, prop_name, FALSE); /* Default: FALSE */
     g_free(prop_name);
+
+    /* Hidden setting: seconds after the menu closes to release its memory, 0 for never */
+    prop_name = focus_menu_get_property_name(plugin, "memory-idle-seconds");
+    plugin->memory_idle_seconds = xfconf_channel_get_uint(plugin->channel, prop_name, 0);
+    g_free(prop_name);
 }
 
 static void focus_menu_save_settings(FocusMenuPlugin *plugin) 
@@ -2697,6 +4564,188 @@ static void on_checkmarks_toggled(GtkToggleButton *button, FocusMenuPlugin *plug
     focus_menu_save_settings(plugin);
 }
 
+/* =============================================================================
+ * DIAGNOSTICS
+ * Live counters for the properties dialog, so a slow panel can be looked
+ * at on the spot without a debug build
+ * ============================================================================= */
+
+typedef enum
+{
+    DIAG_MENU_BUILDS,
+    DIAG_AVERAGE_BUILD,
+    DIAG_WORST_BUILD,
+    DIAG_POPUP_LATENCY,
+    DIAG_PROC_ENTRIES,
+    DIAG_NAME_CACHE,
+    DIAG_ICON_SCALES,
+    DIAG_WINDOWS,
+    DIAG_APPS,
+    DIAG_MEMORY_RELEASE,
+    DIAG_RELEASED_LATENCY,
+    DIAG_N_ROWS
+} DiagnosticsRow;
+
+static const char *diagnostics_row_titles[DIAG_N_ROWS] = 
+{
+    "Menu builds:",
+    "Average build time:",
+    "Worst build time:",
+    "Click to menu (p50 / p95 / p99):",
+    "/proc entries scanned:",
+    "Display-name cache hits:",
+    "Icon scaling operations:",
+    "Tracked windows:",
+    "Tracked applications:",
+    "Idle memory release:",
+    "Click to menu after a release:"
+};
+
+/* Widgets of an open Diagnostics section */
+typedef struct
+{
+    FocusMenuPlugin *plugin;
+    GtkWidget *values[DIAG_N_ROWS];
+    guint refresh_id;
+} DiagnosticsPage;
+
+/* Time in microseconds, in whichever unit reads best */
+static gchar *diagnostics_format_time(gint64 us) 
+{
+    if (us >= 10000) return g_strdup_printf("%.1f ms", us / 1000.0);
+    return g_strdup_printf("%" G_GINT64_FORMAT " µs", us);
+}
+
+static void diagnostics_set_row(DiagnosticsPage *page, DiagnosticsRow row, gchar *text) 
+{
+    gtk_label_set_text(GTK_LABEL(page->values[row]), text);
+    g_free(text);
+}
+
+static gboolean diagnostics_refresh(gpointer user_data) 
+{
+    DiagnosticsPage *page = (DiagnosticsPage *)user_data;
+    FocusMenuPlugin *plugin = page->plugin;
+
+    diagnostics_set_row(page, DIAG_MENU_BUILDS, g_strdup_printf("%u", plugin->menu_builds));
+    diagnostics_set_row(page, DIAG_AVERAGE_BUILD, diagnostics_format_time(plugin->menu_builds ? plugin->build_time_total_us / plugin->menu_builds : 0));
+    diagnostics_set_row(page, DIAG_WORST_BUILD, diagnostics_format_time(plugin->build_time_worst_us));
+
+    if (plugin->latency.total > 0) 
+    {
+        gchar *p50 = diagnostics_format_time(latency_histogram_percentile(&plugin->latency, 50));
+        gchar *p95 = diagnostics_format_time(latency_histogram_percentile(&plugin->latency, 95));
+        gchar *p99 = diagnostics_format_time(latency_histogram_percentile(&plugin->latency, 99));
+        diagnostics_set_row(page, DIAG_POPUP_LATENCY, g_strdup_printf("%s / %s / %s", p50, p95, p99));
+        g_free(p50);
+        g_free(p95);
+        g_free(p99);
+    } 
+    else 
+    {
+        diagnostics_set_row(page, DIAG_POPUP_LATENCY, g_strdup("-"));
+    }
+
+    diagnostics_set_row(page, DIAG_PROC_ENTRIES, g_strdup_printf("%" G_GUINT64_FORMAT, perf_counters.proc_entries_scanned));
+    diagnostics_set_row(page, DIAG_NAME_CACHE, g_strdup_printf("%" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT " misses)", perf_counters.display_name_hits, perf_counters.display_name_misses));
+    diagnostics_set_row(page, DIAG_ICON_SCALES, g_strdup_printf("%" G_GUINT64_FORMAT, perf_counters.icon_scales));
+    diagnostics_set_row(page, DIAG_WINDOWS, g_strdup_printf("%u", plugin->model ? g_hash_table_size(plugin->model->windows) : 0));
+    diagnostics_set_row(page, DIAG_APPS, g_strdup_printf("%u", plugin->model ? g_hash_table_size(plugin->model->apps) : 0));
+
+    if (plugin->memory_idle_seconds == 0) 
+    {
+        diagnostics_set_row(page, DIAG_MEMORY_RELEASE, g_strdup(_("Off")));
+    } 
+    else if (plugin->memory_releases == 0) 
+    {
+        diagnostics_set_row(page, DIAG_MEMORY_RELEASE, g_strdup_printf(_("After %u s idle; not yet"), plugin->memory_idle_seconds));
+    } 
+    else 
+    {
+        diagnostics_set_row(page, DIAG_MEMORY_RELEASE, g_strdup_printf(_("%u times; last %" G_GINT64_FORMAT " kB → %" G_GINT64_FORMAT " kB resident"),
+                                                                       plugin->memory_releases, plugin->memory_rss_before_kb, plugin->memory_rss_after_kb));
+    }
+    diagnostics_set_row(page, DIAG_RELEASED_LATENCY, plugin->released_popups ?
+                        diagnostics_format_time(plugin->released_latency_total_us / plugin->released_popups) : g_strdup("-"));
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_diagnostics_reset_clicked(GtkButton *button G_GNUC_UNUSED, DiagnosticsPage *page) 
+{
+    FocusMenuPlugin *plugin = page->plugin;
+
+    plugin->menu_builds = 0;
+    plugin->build_time_total_us = 0;
+    plugin->build_time_worst_us = 0;
+    memset(&plugin->latency, 0, sizeof(plugin->latency));
+    memset(&perf_counters, 0, sizeof(perf_counters));
+    plugin->memory_releases = 0;
+    plugin->released_popups = 0;
+    plugin->released_latency_total_us = 0;
+
+    diagnostics_refresh(page);
+}
+
+static void on_diagnostics_destroy(GtkWidget *widget G_GNUC_UNUSED, DiagnosticsPage *page) 
+{
+    if (page->refresh_id) 
+    {
+        g_source_remove(page->refresh_id);
+    }
+    g_free(page);
+}
+
+/* Build the Diagnostics section; it refreshes itself until destroyed */
+static GtkWidget *diagnostics_page_new(FocusMenuPlugin *plugin) 
+{
+    DiagnosticsPage *page = g_new0(DiagnosticsPage, 1);
+    page->plugin = plugin;
+
+    GtkWidget *frame = gtk_frame_new(_("Diagnostics"));
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 6);
+    gtk_container_add(GTK_CONTAINER(frame), box);
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 12);
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 2);
+    gtk_box_pack_start(GTK_BOX(box), grid, FALSE, FALSE, 0);
+
+    for (gint row = 0; row < DIAG_N_ROWS; row++) 
+    {
+        GtkWidget *title = gtk_label_new(_(diagnostics_row_titles[row]));
+        gtk_label_set_xalign(GTK_LABEL(title), 0.0);
+        gtk_grid_attach(GTK_GRID(grid), title, 0, row, 1, 1);
+
+        page->values[row] = gtk_label_new(NULL);
+        gtk_label_set_xalign(GTK_LABEL(page->values[row]), 0.0);
+        gtk_label_set_selectable(GTK_LABEL(page->values[row]), TRUE);
+        gtk_grid_attach(GTK_GRID(grid), page->values[row], 1, row, 1, 1);
+    }
+
+    /* Buttons: reset the counters, save the flight recorder */
+    GtkWidget *button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    GtkWidget *reset_button = gtk_button_new_with_label(_("Reset Counters"));
+    GtkWidget *dump_button = gtk_button_new_with_label(_("Save Recent Events"));
+    GtkWidget *dump_label = gtk_label_new(NULL);
+    gtk_label_set_ellipsize(GTK_LABEL(dump_label), PANGO_ELLIPSIZE_START);
+    gtk_label_set_selectable(GTK_LABEL(dump_label), TRUE);
+    gtk_box_pack_start(GTK_BOX(button_box), reset_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), dump_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), dump_label, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(box), button_box, FALSE, FALSE, 0);
+
+    g_signal_connect(reset_button, "clicked", G_CALLBACK(on_diagnostics_reset_clicked), page);
+    g_signal_connect(dump_button, "clicked", G_CALLBACK(on_dump_flight_recorder_clicked), dump_label);
+    g_signal_connect(frame, "destroy", G_CALLBACK(on_diagnostics_destroy), page);
+
+    diagnostics_refresh(page);
+    page->refresh_id = g_timeout_add_seconds(1, diagnostics_refresh, page);
+
+    return frame;
+}
+
 static void focus_menu_configure_plugin(XfcePanelPlugin *panel, FocusMenuPlugin *plugin) 
 {
     GtkWidget *dialog;
@@ -2733,6 +4782,9 @@ static void focus_menu_configure_plugin(XfcePanelPlugin *panel, FocusMenuPlugin
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(checkmarks_check), plugin->use_checkmarks);
     gtk_box_pack_start(GTK_BOX(vbox), checkmarks_check, FALSE, FALSE, 0);
 
+    /* Live counters, reset button and flight recorder dump */
+    gtk_box_pack_start(GTK_BOX(vbox), diagnostics_page_new(plugin), FALSE, FALSE, 0);
+
     /* Connect signals */
     g_signal_connect(submenus_check, "toggled", G_CALLBACK(on_submenus_toggled), plugin);
     g_signal_connect(checkmarks_check, "toggled", G_CALLBACK(on_checkmarks_toggled), plugin);
@@ -2746,6 +4798,22 @@ static void focus_menu_configure_plugin(XfcePanelPlugin *panel, FocusMenuPlugin
     gtk_widget_destroy(dialog);
 }
 
+static void on_dump_flight_recorder_clicked(GtkButton *button G_GNUC_UNUSED, GtkLabel *label) 
+{
+    gchar *path = flight_recorder_dump();
+    if (path) 
+    {
+        gchar *text = g_strdup_printf(_("Saved to %s"), path);
+        gtk_label_set_text(label, text);
+        g_free(text);
+        g_free(path);
+    } 
+    else 
+    {
+        gtk_label_set_text(label, _("Could not save recent events"));
+    }
+}
+
 static void focus_menu_about(XfcePanelPlugin *panel) 
 {
     const gchar *authors[] = { PLUGIN_AUTHORS, NULL };
@@ -2768,6 +4836,9 @@ static void focus_menu_construct(XfcePanelPlugin *plugin)
     focus_plugin->plugin = plugin;
     focus_plugin->radio_group = NULL;  /* Initialize radio group */
     focus_plugin->menu_construction_mode = FALSE;
+    focus_plugin->hidden_apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)hidden_app_record_free);
+    focus_plugin->journal_op = BULK_OP_NONE;
+    focus_plugin->journal = g_array_new(FALSE, FALSE, sizeof(BulkJournalEntry));
 
     /* Initialize configuration properties */
     focus_plugin->channel = NULL;
@@ -2779,6 +4850,14 @@ static void focus_menu_construct(XfcePanelPlugin *plugin)
     /* Initialize locale detection */
     focus_plugin->locale_type = classlib_detect_locale_type();
 
+    /* FOCUS_MENU_PROC_ROOT swaps /proc for a synthetic process table */
+    const gchar *proc_root = g_getenv("FOCUS_MENU_PROC_ROOT");
+    if (proc_root && *proc_root) 
+    {
+        classlib_set_proc_root(proc_root);
+        g_message("Focus Menu: reading processes from %s", proc_root);
+    }
+
     /* Create the button container */
     focus_plugin->button = gtk_button_new();
     gtk_button_set_relief(GTK_BUTTON(focus_plugin->button), GTK_RELIEF_NONE);
@@ -2792,17 +4871,16 @@ static void focus_menu_construct(XfcePanelPlugin *plugin)
 
     /* Create label */
     focus_plugin->label = gtk_label_new("Desktop");
+    focus_plugin->displayed_label = g_strdup("Desktop");
     gtk_box_pack_start(GTK_BOX(hbox), focus_plugin->label, TRUE, TRUE, 0);
 
     gtk_container_add(GTK_CONTAINER(focus_plugin->button), hbox);
 
-    /* Initialize libwnck with the new handle-based API */
-    focus_plugin->handle = wnck_handle_new(WNCK_CLIENT_TYPE_PAGER);
-    focus_plugin->screen = wnck_handle_get_default_screen(focus_plugin->handle);
-    wnck_screen_force_update(focus_plugin->screen);
+    /* The wnck handle, window source and model are shared with any other instance */
+    focus_menu_backend_acquire(focus_plugin);
 
-    /* Determine sorting style based on detected desktop manager */
-    focus_plugin->sort_style = determine_sort_style(focus_plugin->screen);
+    /* Seed the hidden-state registry from the windows already open */
+    hidden_registry_seed(focus_plugin);
 
     /* Initialize xfconf and load settings */
     GError *error = NULL;
@@ -2823,12 +4901,10 @@ static void focus_menu_construct(XfcePanelPlugin *plugin)
 
     /* Load settings */
     focus_menu_load_settings(focus_plugin);
+    trace_init(focus_plugin);
 
     /* Connect signals */
     g_signal_connect(focus_plugin->button, "button-press-event", G_CALLBACK(on_button_pressed), focus_plugin);
-    g_signal_connect(focus_plugin->screen, "active-window-changed", G_CALLBACK(on_active_window_changed), focus_plugin);
-    g_signal_connect(focus_plugin->screen, "window-opened", G_CALLBACK(on_window_opened), focus_plugin);
-    g_signal_connect(focus_plugin->screen, "window-closed", G_CALLBACK(on_window_closed), focus_plugin);
 
     /* Connect plugin lifecycle signals */
     g_signal_connect(plugin, "free-data", G_CALLBACK(focus_menu_free), NULL);
@@ -2863,22 +4939,42 @@ static void focus_menu_free(XfcePanelPlugin *plugin)
 
     if (focus_plugin) 
     {
+        latency_cancel(focus_plugin);
+        memory_release_cancel(focus_plugin);
         if (focus_plugin->menu) 
         {
             gtk_widget_destroy(focus_plugin->menu);
         }
 
-        /* Disconnect signals to avoid callbacks after cleanup */
-        if (focus_plugin->screen) 
+        /* Stop hearing model changes before tearing down what they touch; the last instance frees the shared model and source */
+        focus_menu_backend_release(focus_plugin);
+
+        if (focus_plugin->hidden_apps) 
+        {
+            g_hash_table_destroy(focus_plugin->hidden_apps);
+        }
+
+        if (focus_plugin->journal) 
+        {
+            g_array_free(focus_plugin->journal, TRUE);
+        }
+
+        focus_menu_build_arena_free(focus_plugin->build_arena);
+
+        /* Write out any remaining trace spans */
+        trace_shutdown(focus_plugin);
+
+        /* Drop any pending button update */
+        if (focus_plugin->update_idle_id) 
         {
-            g_signal_handlers_disconnect_by_data(focus_plugin->screen, focus_plugin);
+            g_source_remove(focus_plugin->update_idle_id);
         }
 
-        /* Clean up the wnck handle */
-        if (focus_plugin->handle) 
+        if (focus_plugin->displayed_icon) 
         {
-            g_object_unref(focus_plugin->handle);
+            g_object_unref(focus_plugin->displayed_icon);
         }
+        g_free(focus_plugin->displayed_label);
 
         /* Clean up configuration */
         if (focus_plugin->property_base) 
@@ -2895,9 +4991,19 @@ static void focus_menu_free(XfcePanelPlugin *plugin)
     }
 }
 
-static gboolean focus_menu_remote_event(XfcePanelPlugin *plugin G_GNUC_UNUSED, const gchar *name G_GNUC_UNUSED, const GValue *value G_GNUC_UNUSED) 
+/* xfce4-panel --plugin-event=focus-menu:dump-flight-recorder:bool:true */
+static gboolean focus_menu_remote_event(XfcePanelPlugin *plugin G_GNUC_UNUSED, const gchar *name, const GValue *value G_GNUC_UNUSED) 
 {
-    /* Handle remote events if needed */
+    if (g_strcmp0(name, "dump-flight-recorder") == 0) 
+    {
+        gchar *path = flight_recorder_dump();
+        if (path) 
+        {
+            g_message("Focus Menu: flight recorder written to %s", path);
+            g_free(path);
+        }
+        return TRUE;
+    }
     return FALSE;
 }
 
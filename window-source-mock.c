@@ -0,0 +1,380 @@
+/* window-source-mock - in-memory window source for benchmarks
+ *
+ * Holds a synthetic session: applications, windows in stacking order and
+ * a handful of workspaces. Requests are carried out immediately and the
+ * listener hears about them before the call returns.
+ */
+#include "window-source.h"
+
+struct _FocusMenuSourceWorkspace
+{
+    guint number;
+};
+
+struct _FocusMenuSourceApp
+{
+    gulong id;
+    gchar *name;
+    pid_t pid;
+    guint n_windows;
+};
+
+struct _FocusMenuSourceWindow
+{
+    gulong id;
+    FocusMenuSourceApp *app;
+    gchar *name;
+    FocusMenuSourceWindowType type;
+    FocusMenuSourceWindowState state;
+    FocusMenuSourceWorkspace *workspace;
+};
+
+typedef struct
+{
+    FocusMenuWindowSource parent;
+    GList *stack;                              /* Bottom to top */
+    GList *apps;
+    FocusMenuSourceWorkspace *workspaces;
+    guint n_workspaces;
+    FocusMenuSourceWorkspace *active_workspace;
+    FocusMenuSourceWindow *active_window;
+    GdkPixbuf *icon;                           /* Shared by every application */
+    gulong next_id;
+    guint requests;
+} MockSource;
+
+#define MOCK_SOURCE(source) ((MockSource *)(source))
+
+/* ===== SOURCE OPERATIONS ===== */
+
+static GList *mock_list_windows(FocusMenuWindowSource *source)
+{
+    return MOCK_SOURCE(source)->stack;
+}
+
+static FocusMenuSourceWindow *mock_get_active_window(FocusMenuWindowSource *source)
+{
+    return MOCK_SOURCE(source)->active_window;
+}
+
+static FocusMenuSourceWorkspace *mock_get_active_workspace(FocusMenuWindowSource *source)
+{
+    return MOCK_SOURCE(source)->active_workspace;
+}
+
+static gint mock_workspace_get_number(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace)
+{
+    (void)source;
+    return workspace ? (gint)workspace->number : -1;
+}
+
+static gulong mock_window_get_id(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    (void)source;
+    return window->id;
+}
+
+static FocusMenuSourceApp *mock_window_get_app(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    (void)source;
+    return window->app;
+}
+
+static const gchar *mock_window_get_name(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    (void)source;
+    return window->name;
+}
+
+static FocusMenuSourceWindowType mock_window_get_type(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    (void)source;
+    return window->type;
+}
+
+static FocusMenuSourceWindowState mock_window_get_state(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    (void)source;
+    return window->state;
+}
+
+static FocusMenuSourceWorkspace *mock_window_get_workspace(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    (void)source;
+    return (window->state & FOCUS_MENU_SOURCE_STATE_PINNED) ? NULL : window->workspace;
+}
+
+static gulong mock_app_get_id(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    (void)source;
+    return app->id;
+}
+
+static const gchar *mock_app_get_name(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    (void)source;
+    return app->name;
+}
+
+static pid_t mock_app_get_pid(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    (void)source;
+    return app->pid;
+}
+
+static GdkPixbuf *mock_app_get_icon(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    (void)app;
+    return MOCK_SOURCE(source)->icon;
+}
+
+static void mock_window_minimize(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    MOCK_SOURCE(source)->requests++;
+    focus_menu_mock_source_set_window_state(source, window, window->state | FOCUS_MENU_SOURCE_STATE_MINIMIZED);
+}
+
+static void mock_window_unminimize(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp)
+{
+    (void)timestamp;
+    MOCK_SOURCE(source)->requests++;
+    focus_menu_mock_source_set_window_state(source, window, window->state & ~FOCUS_MENU_SOURCE_STATE_MINIMIZED);
+}
+
+static void mock_window_activate(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+
+    (void)timestamp;
+    mock->requests++;
+
+    /* Activation raises, so the window moves to the top of the stack */
+    mock->stack = g_list_remove(mock->stack, window);
+    mock->stack = g_list_append(mock->stack, window);
+
+    if (window->state & FOCUS_MENU_SOURCE_STATE_MINIMIZED)
+    {
+        focus_menu_mock_source_set_window_state(source, window, window->state & ~FOCUS_MENU_SOURCE_STATE_MINIMIZED);
+    }
+    focus_menu_mock_source_set_active_window(source, window);
+}
+
+static void mock_workspace_activate(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace, guint32 timestamp)
+{
+    (void)timestamp;
+    MOCK_SOURCE(source)->requests++;
+    focus_menu_mock_source_set_active_workspace(source, workspace->number);
+}
+
+static void mock_app_free(FocusMenuSourceApp *app)
+{
+    g_free(app->name);
+    g_free(app);
+}
+
+static void mock_window_free(FocusMenuSourceWindow *window)
+{
+    g_free(window->name);
+    g_free(window);
+}
+
+static void mock_free(FocusMenuWindowSource *source)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+
+    g_list_free_full(mock->stack, (GDestroyNotify)mock_window_free);
+    g_list_free_full(mock->apps, (GDestroyNotify)mock_app_free);
+    g_free(mock->workspaces);
+    g_object_unref(mock->icon);
+    g_free(mock);
+}
+
+static const FocusMenuWindowSourceClass mock_source_class =
+{
+    .name = "mock",
+    .update = NULL,
+    .list_windows = mock_list_windows,
+    .get_active_window = mock_get_active_window,
+    .get_active_workspace = mock_get_active_workspace,
+    .workspace_get_number = mock_workspace_get_number,
+    .window_get_id = mock_window_get_id,
+    .window_get_app = mock_window_get_app,
+    .window_get_name = mock_window_get_name,
+    .window_get_type = mock_window_get_type,
+    .window_get_state = mock_window_get_state,
+    .window_get_workspace = mock_window_get_workspace,
+    .app_get_id = mock_app_get_id,
+    .app_get_name = mock_app_get_name,
+    .app_get_pid = mock_app_get_pid,
+    .app_get_icon = mock_app_get_icon,
+    .window_minimize = mock_window_minimize,
+    .window_unminimize = mock_window_unminimize,
+    .window_activate = mock_window_activate,
+    .workspace_activate = mock_workspace_activate,
+    .free = mock_free,
+};
+
+/* ===== SESSION SCRIPTING ===== */
+
+FocusMenuWindowSource *focus_menu_mock_source_new(guint n_workspaces)
+{
+    MockSource *mock = g_new0(MockSource, 1);
+    guint i;
+
+    mock->parent.klass = &mock_source_class;
+    mock->n_workspaces = MAX(n_workspaces, 1);
+    mock->workspaces = g_new0(FocusMenuSourceWorkspace, mock->n_workspaces);
+    for (i = 0; i < mock->n_workspaces; i++)
+    {
+        mock->workspaces[i].number = i;
+    }
+    mock->active_workspace = &mock->workspaces[0];
+    mock->icon = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, 16, 16);
+    gdk_pixbuf_fill(mock->icon, 0x808080ff);
+    mock->next_id = 0x1000;
+
+    return &mock->parent;
+}
+
+FocusMenuSourceApp *focus_menu_mock_source_add_app(FocusMenuWindowSource *source, const gchar *name, pid_t pid)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+    FocusMenuSourceApp *app = g_new0(FocusMenuSourceApp, 1);
+
+    app->id = mock->next_id++;
+    app->name = g_strdup(name);
+    app->pid = pid;
+    mock->apps = g_list_prepend(mock->apps, app);
+
+    return app;
+}
+
+/* The application is announced along with its first window, as wnck does */
+FocusMenuSourceWindow *focus_menu_mock_source_add_window(FocusMenuWindowSource *source, FocusMenuSourceApp *app, const gchar *title,
+                                                         FocusMenuSourceWindowType type, FocusMenuSourceWindowState state, guint workspace)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+    FocusMenuSourceWindow *window = g_new0(FocusMenuSourceWindow, 1);
+
+    window->id = mock->next_id++;
+    window->app = app;
+    window->name = g_strdup(title);
+    window->type = type;
+    window->state = state;
+    window->workspace = &mock->workspaces[MIN(workspace, mock->n_workspaces - 1)];
+    mock->stack = g_list_append(mock->stack, window);
+
+    if (app->n_windows++ == 0)
+    {
+        focus_menu_source_emit_app_opened(source, app);
+    }
+    focus_menu_source_emit_window_opened(source, window);
+
+    return window;
+}
+
+/* Closing the last window of an application closes the application too.
+ * The handle stays allocated until the source is freed, so a script can
+ * open windows for it again later */
+void focus_menu_mock_source_remove_window(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+    FocusMenuSourceApp *app = window->app;
+
+    mock->stack = g_list_remove(mock->stack, window);
+    if (mock->active_window == window)
+    {
+        mock->active_window = NULL;
+        focus_menu_source_emit_active_window_changed(source);
+    }
+    focus_menu_source_emit_window_closed(source, window);
+    mock_window_free(window);
+
+    if (--app->n_windows == 0)
+    {
+        focus_menu_source_emit_app_closed(source, app);
+    }
+}
+
+void focus_menu_mock_source_set_window_name(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, const gchar *title)
+{
+    g_free(window->name);
+    window->name = g_strdup(title);
+    focus_menu_source_emit_window_changed(source, window, FOCUS_MENU_SOURCE_CHANGE_NAME);
+}
+
+void focus_menu_mock_source_set_window_state(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, FocusMenuSourceWindowState state)
+{
+    if (window->state == state)
+    {
+        return;
+    }
+
+    window->state = state;
+    focus_menu_source_emit_window_changed(source, window, FOCUS_MENU_SOURCE_CHANGE_STATE);
+}
+
+void focus_menu_mock_source_set_window_type(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, FocusMenuSourceWindowType type)
+{
+    if (window->type == type)
+    {
+        return;
+    }
+
+    window->type = type;
+    focus_menu_source_emit_window_changed(source, window, FOCUS_MENU_SOURCE_CHANGE_WORKSPACE);
+}
+
+void focus_menu_mock_source_set_window_workspace(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint workspace)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+    FocusMenuSourceWorkspace *target = &mock->workspaces[MIN(workspace, mock->n_workspaces - 1)];
+
+    if (window->workspace == target)
+    {
+        return;
+    }
+
+    window->workspace = target;
+    focus_menu_source_emit_window_changed(source, window, FOCUS_MENU_SOURCE_CHANGE_WORKSPACE);
+}
+
+void focus_menu_mock_source_set_app_name(FocusMenuWindowSource *source, FocusMenuSourceApp *app, const gchar *name)
+{
+    g_free(app->name);
+    app->name = g_strdup(name);
+    focus_menu_source_emit_app_changed(source, app, FOCUS_MENU_SOURCE_CHANGE_NAME);
+}
+
+void focus_menu_mock_source_set_active_window(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+
+    if (mock->active_window == window)
+    {
+        return;
+    }
+
+    mock->active_window = window;
+    focus_menu_source_emit_active_window_changed(source);
+}
+
+void focus_menu_mock_source_set_active_workspace(FocusMenuWindowSource *source, guint workspace)
+{
+    MockSource *mock = MOCK_SOURCE(source);
+    FocusMenuSourceWorkspace *target = &mock->workspaces[MIN(workspace, mock->n_workspaces - 1)];
+
+    if (mock->active_workspace == target)
+    {
+        return;
+    }
+
+    mock->active_workspace = target;
+    focus_menu_source_emit_active_workspace_changed(source);
+}
+
+/* Minimize, unminimize and activate requests received so far */
+guint focus_menu_mock_source_get_request_count(FocusMenuWindowSource *source)
+{
+    return MOCK_SOURCE(source)->requests;
+}
@@ -0,0 +1,1033 @@
+/* window-source-xcb - window source that reads EWMH properties over XCB
+ *
+ * An alternative to the libwnck source for hosts that only need what the
+ * model and the menu use: the stacking order, the active window and
+ * workspace, and each window's name, class, pid, type, state and desktop.
+ * Nothing else is tracked. Property requests are sent in batches and their
+ * replies collected afterwards, so opening a session of N windows costs a
+ * handful of round trips rather than several per window.
+ *
+ * Windows are grouped into applications by their WM_HINTS window group,
+ * then WM_CLIENT_LEADER, as libwnck does; an application is named after
+ * its group leader, or failing that its first window's WM_CLASS.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <glib-unix.h>
+#include <xcb/xcb.h>
+
+#include "window-source.h"
+
+#define XCB_SOURCE_NAME_LONGS 1024          /* Titles longer than 4 KiB are cut short */
+#define XCB_SOURCE_LIST_LONGS 65536         /* Windows in _NET_CLIENT_LIST_STACKING */
+#define XCB_SOURCE_ICON_LONGS (1024 * 1024)
+#define XCB_SOURCE_ICON_SIZE 32             /* Preferred _NET_WM_ICON width */
+#define XCB_SOURCE_ALL_DESKTOPS 0xFFFFFFFFu
+#define XCB_SOURCE_WINDOW_GROUP_HINT (1 << 6)
+#define XCB_SOURCE_ICONIC_STATE 3           /* ICCCM WM_STATE value */
+
+typedef enum
+{
+    ATOM_NET_CLIENT_LIST_STACKING,
+    ATOM_NET_ACTIVE_WINDOW,
+    ATOM_NET_CURRENT_DESKTOP,
+    ATOM_NET_NUMBER_OF_DESKTOPS,
+    ATOM_NET_WM_NAME,
+    ATOM_UTF8_STRING,
+    ATOM_NET_WM_PID,
+    ATOM_NET_WM_STATE,
+    ATOM_NET_WM_STATE_HIDDEN,
+    ATOM_NET_WM_STATE_STICKY,
+    ATOM_NET_WM_DESKTOP,
+    ATOM_NET_WM_WINDOW_TYPE,
+    ATOM_NET_WM_WINDOW_TYPE_NORMAL,
+    ATOM_NET_WM_WINDOW_TYPE_DESKTOP,
+    ATOM_NET_WM_ICON,
+    ATOM_WM_CLIENT_LEADER,
+    ATOM_WM_CHANGE_STATE,
+    N_ATOMS
+} XcbSourceAtom;
+
+static const char *atom_names[N_ATOMS] =
+{
+    [ATOM_NET_CLIENT_LIST_STACKING] = "_NET_CLIENT_LIST_STACKING",
+    [ATOM_NET_ACTIVE_WINDOW] = "_NET_ACTIVE_WINDOW",
+    [ATOM_NET_CURRENT_DESKTOP] = "_NET_CURRENT_DESKTOP",
+    [ATOM_NET_NUMBER_OF_DESKTOPS] = "_NET_NUMBER_OF_DESKTOPS",
+    [ATOM_NET_WM_NAME] = "_NET_WM_NAME",
+    [ATOM_UTF8_STRING] = "UTF8_STRING",
+    [ATOM_NET_WM_PID] = "_NET_WM_PID",
+    [ATOM_NET_WM_STATE] = "_NET_WM_STATE",
+    [ATOM_NET_WM_STATE_HIDDEN] = "_NET_WM_STATE_HIDDEN",
+    [ATOM_NET_WM_STATE_STICKY] = "_NET_WM_STATE_STICKY",
+    [ATOM_NET_WM_DESKTOP] = "_NET_WM_DESKTOP",
+    [ATOM_NET_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+    [ATOM_NET_WM_WINDOW_TYPE_NORMAL] = "_NET_WM_WINDOW_TYPE_NORMAL",
+    [ATOM_NET_WM_WINDOW_TYPE_DESKTOP] = "_NET_WM_WINDOW_TYPE_DESKTOP",
+    [ATOM_NET_WM_ICON] = "_NET_WM_ICON",
+    [ATOM_WM_CLIENT_LEADER] = "WM_CLIENT_LEADER",
+    [ATOM_WM_CHANGE_STATE] = "WM_CHANGE_STATE",
+};
+
+/* Per-window properties, as a mask of what to (re)read */
+typedef enum
+{
+    PROP_NET_NAME = 1 << 0,
+    PROP_WM_NAME = 1 << 1,
+    PROP_CLASS = 1 << 2,
+    PROP_PID = 1 << 3,
+    PROP_STATE = 1 << 4,
+    PROP_DESKTOP = 1 << 5,
+    PROP_TYPE = 1 << 6,
+    PROP_HINTS = 1 << 7,
+    PROP_CLIENT_LEADER = 1 << 8
+} XcbSourceProperty;
+
+#define PROP_ALL ((1 << 9) - 1)
+
+/* Root window properties */
+typedef enum
+{
+    ROOT_STACKING = 1 << 0,
+    ROOT_ACTIVE = 1 << 1,
+    ROOT_CURRENT_DESKTOP = 1 << 2,
+    ROOT_N_DESKTOPS = 1 << 3
+} XcbSourceRootProperty;
+
+#define ROOT_ALL ((1 << 4) - 1)
+
+struct _FocusMenuSourceWorkspace
+{
+    guint number;
+};
+
+struct _FocusMenuSourceApp
+{
+    xcb_window_t leader;         /* Group leader, or the window itself if it has none */
+    gchar *name;
+    pid_t pid;
+    guint n_windows;
+    GdkPixbuf *icon;             /* Read on first use */
+    gboolean icon_read;
+};
+
+struct _FocusMenuSourceWindow
+{
+    xcb_window_t xid;
+    FocusMenuSourceApp *app;     /* NULL until the window is announced */
+    gchar *net_name;             /* _NET_WM_NAME */
+    gchar *wm_name;              /* WM_NAME, used if there is no _NET_WM_NAME */
+    gchar *class_name;           /* Second string of WM_CLASS */
+    pid_t pid;
+    xcb_window_t group;          /* WM_HINTS window group */
+    xcb_window_t client_leader;
+    FocusMenuSourceWindowType type;
+    gboolean hidden;             /* _NET_WM_STATE_HIDDEN */
+    gboolean sticky;             /* _NET_WM_STATE_STICKY */
+    guint32 desktop;
+};
+
+typedef struct
+{
+    FocusMenuWindowSource parent;
+    xcb_connection_t *connection;
+    xcb_window_t root;
+    xcb_atom_t atoms[N_ATOMS];
+    guint watch_id;                  /* Main context watch on the connection */
+    GList *stack;                    /* Bottom to top */
+    GHashTable *windows;             /* xid -> FocusMenuSourceWindow* */
+    GHashTable *apps;                /* leader xid -> FocusMenuSourceApp*, owned */
+    GPtrArray *workspaces;           /* FocusMenuSourceWorkspace*, by number */
+    guint active_workspace;
+    FocusMenuSourceWindow *active_window;
+} XcbSource;
+
+/* One outstanding property request */
+typedef struct
+{
+    FocusMenuSourceWindow *window;
+    XcbSourceProperty property;
+    xcb_get_property_cookie_t cookie;
+} XcbSourceRequest;
+
+#define XCB_SOURCE(source) ((XcbSource *)(source))
+
+static void xcb_source_dispatch(XcbSource *xcb);
+
+/* ===== PROPERTY READING ===== */
+
+static xcb_get_property_cookie_t xcb_source_request(XcbSource *xcb, xcb_window_t window, xcb_atom_t property, xcb_atom_t type, guint32 longs) 
+{
+    return xcb_get_property(xcb->connection, 0, window, property, type, 0, longs);
+}
+
+/* Send the request for one window property */
+static xcb_get_property_cookie_t xcb_source_request_property(XcbSource *xcb, xcb_window_t xid, XcbSourceProperty property) 
+{
+    switch (property)
+    {
+        case PROP_NET_NAME:
+            return xcb_source_request(xcb, xid, xcb->atoms[ATOM_NET_WM_NAME], xcb->atoms[ATOM_UTF8_STRING], XCB_SOURCE_NAME_LONGS);
+        case PROP_WM_NAME:
+            return xcb_source_request(xcb, xid, XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, XCB_SOURCE_NAME_LONGS);
+        case PROP_CLASS:
+            return xcb_source_request(xcb, xid, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 256);
+        case PROP_PID:
+            return xcb_source_request(xcb, xid, xcb->atoms[ATOM_NET_WM_PID], XCB_ATOM_CARDINAL, 1);
+        case PROP_STATE:
+            return xcb_source_request(xcb, xid, xcb->atoms[ATOM_NET_WM_STATE], XCB_ATOM_ATOM, 64);
+        case PROP_DESKTOP:
+            return xcb_source_request(xcb, xid, xcb->atoms[ATOM_NET_WM_DESKTOP], XCB_ATOM_CARDINAL, 1);
+        case PROP_TYPE:
+            return xcb_source_request(xcb, xid, xcb->atoms[ATOM_NET_WM_WINDOW_TYPE], XCB_ATOM_ATOM, 16);
+        case PROP_HINTS:
+            return xcb_source_request(xcb, xid, XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 9);
+        case PROP_CLIENT_LEADER:
+        default:
+            return xcb_source_request(xcb, xid, xcb->atoms[ATOM_WM_CLIENT_LEADER], XCB_ATOM_WINDOW, 1);
+    }
+}
+
+/* The property a PropertyNotify atom stands for, or 0 if it is not one we read */
+static XcbSourceProperty xcb_source_property_for_atom(XcbSource *xcb, xcb_atom_t atom) 
+{
+    if (atom == xcb->atoms[ATOM_NET_WM_NAME]) return PROP_NET_NAME;
+    if (atom == XCB_ATOM_WM_NAME) return PROP_WM_NAME;
+    if (atom == XCB_ATOM_WM_CLASS) return PROP_CLASS;
+    if (atom == xcb->atoms[ATOM_NET_WM_PID]) return PROP_PID;
+    if (atom == xcb->atoms[ATOM_NET_WM_STATE]) return PROP_STATE;
+    if (atom == xcb->atoms[ATOM_NET_WM_DESKTOP]) return PROP_DESKTOP;
+    if (atom == xcb->atoms[ATOM_NET_WM_WINDOW_TYPE]) return PROP_TYPE;
+    if (atom == XCB_ATOM_WM_HINTS) return PROP_HINTS;
+    if (atom == xcb->atoms[ATOM_WM_CLIENT_LEADER]) return PROP_CLIENT_LEADER;
+    return 0;
+}
+
+static XcbSourceRootProperty xcb_source_root_property_for_atom(XcbSource *xcb, xcb_atom_t atom) 
+{
+    if (atom == xcb->atoms[ATOM_NET_CLIENT_LIST_STACKING]) return ROOT_STACKING;
+    if (atom == xcb->atoms[ATOM_NET_ACTIVE_WINDOW]) return ROOT_ACTIVE;
+    if (atom == xcb->atoms[ATOM_NET_CURRENT_DESKTOP]) return ROOT_CURRENT_DESKTOP;
+    if (atom == xcb->atoms[ATOM_NET_NUMBER_OF_DESKTOPS]) return ROOT_N_DESKTOPS;
+    return 0;
+}
+
+/* Text property as valid UTF-8; WM_NAME may be Latin-1 */
+static gchar *xcb_source_reply_string(xcb_get_property_reply_t *reply) 
+{
+    if (!reply || reply->format != 8 || xcb_get_property_value_length(reply) <= 0) return NULL;
+
+    const gchar *value = xcb_get_property_value(reply);
+    gint length = xcb_get_property_value_length(reply);
+
+    if (g_utf8_validate(value, length, NULL)) return g_strndup(value, length);
+
+    gchar *converted = g_convert(value, length, "UTF-8", "ISO-8859-1", NULL, NULL, NULL);
+    return converted ? converted : g_utf8_make_valid(value, length);
+}
+
+static gboolean xcb_source_reply_cardinal(xcb_get_property_reply_t *reply, guint32 *value) 
+{
+    if (!reply || reply->format != 32 || xcb_get_property_value_length(reply) < 4) return FALSE;
+
+    *value = *(const guint32 *)xcb_get_property_value(reply);
+    return TRUE;
+}
+
+static gboolean xcb_source_reply_has_atom(xcb_get_property_reply_t *reply, xcb_atom_t atom) 
+{
+    if (!reply || reply->format != 32) return FALSE;
+
+    const xcb_atom_t *atoms = xcb_get_property_value(reply);
+    gint n = xcb_get_property_value_length(reply) / 4;
+    for (gint i = 0; i < n; i++)
+    {
+        if (atoms[i] == atom) return TRUE;
+    }
+    return FALSE;
+}
+
+static FocusMenuSourceWindowType xcb_source_reply_window_type(XcbSource *xcb, xcb_get_property_reply_t *reply) 
+{
+    if (!reply || reply->format != 32 || xcb_get_property_value_length(reply) < 4)
+    {
+        return FOCUS_MENU_SOURCE_WINDOW_NORMAL;   /* EWMH: managed windows without a type are normal */
+    }
+
+    /* The first type the source knows wins, as in libwnck */
+    const xcb_atom_t *atoms = xcb_get_property_value(reply);
+    gint n = xcb_get_property_value_length(reply) / 4;
+    for (gint i = 0; i < n; i++)
+    {
+        if (atoms[i] == xcb->atoms[ATOM_NET_WM_WINDOW_TYPE_NORMAL]) return FOCUS_MENU_SOURCE_WINDOW_NORMAL;
+        if (atoms[i] == xcb->atoms[ATOM_NET_WM_WINDOW_TYPE_DESKTOP]) return FOCUS_MENU_SOURCE_WINDOW_DESKTOP;
+    }
+    return FOCUS_MENU_SOURCE_WINDOW_OTHER;
+}
+
+/* Store one reply on its window; returns the listener change it amounts to, or -1 for none */
+static gint xcb_source_apply_property(XcbSource *xcb, FocusMenuSourceWindow *window, XcbSourceProperty property, xcb_get_property_reply_t *reply) 
+{
+    guint32 value = 0;
+
+    switch (property)
+    {
+        case PROP_NET_NAME:
+        {
+            gchar *name = xcb_source_reply_string(reply);
+            gboolean changed = g_strcmp0(name, window->net_name) != 0;
+            g_free(window->net_name);
+            window->net_name = name;
+            return changed ? FOCUS_MENU_SOURCE_CHANGE_NAME : -1;
+        }
+        case PROP_WM_NAME:
+        {
+            gchar *name = xcb_source_reply_string(reply);
+            gboolean changed = g_strcmp0(name, window->wm_name) != 0 && !window->net_name;
+            g_free(window->wm_name);
+            window->wm_name = name;
+            return changed ? FOCUS_MENU_SOURCE_CHANGE_NAME : -1;
+        }
+        case PROP_CLASS:
+        {
+            /* WM_CLASS is "instance\0Class\0" */
+            g_free(window->class_name);
+            window->class_name = NULL;
+            if (reply && reply->format == 8 && xcb_get_property_value_length(reply) > 0)
+            {
+                const gchar *value_start = xcb_get_property_value(reply);
+                gint length = xcb_get_property_value_length(reply);
+                const gchar *split = memchr(value_start, '\0', length);
+                if (split && split + 1 < value_start + length)
+                {
+                    window->class_name = g_strndup(split + 1, value_start + length - split - 1);
+                }
+                else
+                {
+                    window->class_name = g_strndup(value_start, length);
+                }
+            }
+            return -1;
+        }
+        case PROP_PID:
+            window->pid = xcb_source_reply_cardinal(reply, &value) ? (pid_t)value : 0;
+            return -1;
+        case PROP_STATE:
+        {
+            gboolean hidden = xcb_source_reply_has_atom(reply, xcb->atoms[ATOM_NET_WM_STATE_HIDDEN]);
+            gboolean sticky = xcb_source_reply_has_atom(reply, xcb->atoms[ATOM_NET_WM_STATE_STICKY]);
+            gboolean changed = hidden != window->hidden || sticky != window->sticky;
+            window->hidden = hidden;
+            window->sticky = sticky;
+            return changed ? FOCUS_MENU_SOURCE_CHANGE_STATE : -1;
+        }
+        case PROP_DESKTOP:
+        {
+            guint32 desktop = xcb_source_reply_cardinal(reply, &value) ? value : 0;
+            gboolean changed = desktop != window->desktop;
+            gboolean was_pinned = window->desktop == XCB_SOURCE_ALL_DESKTOPS;
+            window->desktop = desktop;
+            if (!changed) return -1;
+            return was_pinned != (desktop == XCB_SOURCE_ALL_DESKTOPS) ? FOCUS_MENU_SOURCE_CHANGE_STATE : FOCUS_MENU_SOURCE_CHANGE_WORKSPACE;
+        }
+        case PROP_TYPE:
+        {
+            FocusMenuSourceWindowType type = xcb_source_reply_window_type(xcb, reply);
+            gboolean changed = type != window->type;
+            window->type = type;
+            return changed ? FOCUS_MENU_SOURCE_CHANGE_WORKSPACE : -1;
+        }
+        case PROP_HINTS:
+            /* WM_HINTS: flags, input, initial_state, icon_pixmap, icon_window, x, y, icon_mask, window_group */
+            window->group = XCB_WINDOW_NONE;
+            if (reply && reply->format == 32 && xcb_get_property_value_length(reply) >= 9 * 4)
+            {
+                const guint32 *hints = xcb_get_property_value(reply);
+                if (hints[0] & XCB_SOURCE_WINDOW_GROUP_HINT) window->group = hints[8];
+            }
+            return -1;
+        case PROP_CLIENT_LEADER:
+            window->client_leader = xcb_source_reply_cardinal(reply, &value) ? value : XCB_WINDOW_NONE;
+            return -1;
+    }
+    return -1;
+}
+
+/* Read the given properties of several windows: every request goes out before
+ * the first reply is awaited. Changes to windows already announced are passed on */
+static void xcb_source_read_windows(XcbSource *xcb, GPtrArray *windows, const guint *masks, gboolean announce) 
+{
+    GArray *requests = g_array_new(FALSE, FALSE, sizeof(XcbSourceRequest));
+
+    for (guint i = 0; i < windows->len; i++)
+    {
+        FocusMenuSourceWindow *window = g_ptr_array_index(windows, i);
+        for (guint bit = 1; bit & PROP_ALL; bit <<= 1)
+        {
+            if (!(masks[i] & bit)) continue;
+
+            XcbSourceRequest request = { window, bit, xcb_source_request_property(xcb, window->xid, bit) };
+            g_array_append_val(requests, request);
+        }
+    }
+
+    guint *changes = g_new0(guint, windows->len);
+    guint window_index = 0;
+    for (guint i = 0; i < requests->len; i++)
+    {
+        XcbSourceRequest *request = &g_array_index(requests, XcbSourceRequest, i);
+        xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb->connection, request->cookie, NULL);
+
+        while (g_ptr_array_index(windows, window_index) != request->window) window_index++;
+        gint change = xcb_source_apply_property(xcb, request->window, request->property, reply);
+        if (change >= 0) changes[window_index] |= 1u << change;
+        free(reply);
+    }
+
+    for (guint i = 0; announce && i < windows->len; i++)
+    {
+        FocusMenuSourceWindow *window = g_ptr_array_index(windows, i);
+        for (guint change = 0; change <= FOCUS_MENU_SOURCE_CHANGE_ICON; change++)
+        {
+            if (changes[i] & (1u << change))
+            {
+                focus_menu_source_emit_window_changed(&xcb->parent, window, (FocusMenuSourceChange)change);
+            }
+        }
+    }
+
+    g_free(changes);
+    g_array_free(requests, TRUE);
+}
+
+/* ===== APPLICATIONS ===== */
+
+static void xcb_source_app_free(FocusMenuSourceApp *app) 
+{
+    if (app->icon) g_object_unref(app->icon);
+    g_free(app->name);
+    g_free(app);
+}
+
+/* Put new windows into applications, naming new applications after their
+ * group leaders (one batch of requests for all of them) */
+static void xcb_source_assign_apps(XcbSource *xcb, GPtrArray *windows) 
+{
+    GPtrArray *new_apps = g_ptr_array_new();
+
+    for (guint i = 0; i < windows->len; i++)
+    {
+        FocusMenuSourceWindow *window = g_ptr_array_index(windows, i);
+        xcb_window_t leader = window->group ? window->group : window->client_leader ? window->client_leader : window->xid;
+        FocusMenuSourceApp *app = g_hash_table_lookup(xcb->apps, GUINT_TO_POINTER(leader));
+
+        if (!app)
+        {
+            app = g_new0(FocusMenuSourceApp, 1);
+            app->leader = leader;
+            app->pid = window->pid;
+            g_hash_table_insert(xcb->apps, GUINT_TO_POINTER(leader), app);
+            g_ptr_array_add(new_apps, app);
+        }
+        window->app = app;
+    }
+
+    GArray *cookies = g_array_sized_new(FALSE, FALSE, sizeof(xcb_get_property_cookie_t), new_apps->len * 2);
+    for (guint i = 0; i < new_apps->len; i++)
+    {
+        FocusMenuSourceApp *app = g_ptr_array_index(new_apps, i);
+        xcb_get_property_cookie_t cookie = xcb_source_request_property(xcb, app->leader, PROP_NET_NAME);
+        g_array_append_val(cookies, cookie);
+        cookie = xcb_source_request_property(xcb, app->leader, PROP_WM_NAME);
+        g_array_append_val(cookies, cookie);
+    }
+
+    for (guint i = 0; i < new_apps->len; i++)
+    {
+        FocusMenuSourceApp *app = g_ptr_array_index(new_apps, i);
+        xcb_get_property_reply_t *net_name = xcb_get_property_reply(xcb->connection, g_array_index(cookies, xcb_get_property_cookie_t, i * 2), NULL);
+        xcb_get_property_reply_t *wm_name = xcb_get_property_reply(xcb->connection, g_array_index(cookies, xcb_get_property_cookie_t, i * 2 + 1), NULL);
+
+        app->name = xcb_source_reply_string(net_name);
+        if (!app->name) app->name = xcb_source_reply_string(wm_name);
+        free(net_name);
+        free(wm_name);
+    }
+
+    /* Leaders without a name borrow the class of their first window */
+    for (guint i = 0; i < windows->len; i++)
+    {
+        FocusMenuSourceWindow *window = g_ptr_array_index(windows, i);
+        if (!window->app->name && window->class_name) window->app->name = g_strdup(window->class_name);
+    }
+
+    g_array_free(cookies, TRUE);
+    g_ptr_array_free(new_apps, TRUE);
+}
+
+static void xcb_source_free_pixels(guchar *pixels, gpointer data) 
+{
+    (void)data;
+    g_free(pixels);
+}
+
+/* Decode the _NET_WM_ICON entry closest to the preferred size */
+static GdkPixbuf *xcb_source_icon_from_reply(xcb_get_property_reply_t *reply) 
+{
+    if (!reply || reply->format != 32) return NULL;
+
+    const guint32 *data = xcb_get_property_value(reply);
+    gsize n = (gsize)xcb_get_property_value_length(reply) / 4;
+    const guint32 *best = NULL;
+    guint32 best_width = 0;
+
+    for (gsize i = 0; i + 2 <= n; )
+    {
+        guint32 width = data[i];
+        guint32 height = data[i + 1];
+        if (width == 0 || height == 0 || width > 1024 || height > 1024 || (gsize)width * height > n - i - 2) break;
+
+        /* The smallest icon at least the preferred size, else the largest */
+        gboolean better = !best
+            || (best_width < XCB_SOURCE_ICON_SIZE && width > best_width)
+            || (width >= XCB_SOURCE_ICON_SIZE && width < best_width);
+        if (better)
+        {
+            best = &data[i];
+            best_width = width;
+        }
+        i += 2 + (gsize)width * height;
+    }
+    if (!best) return NULL;
+
+    guint32 width = best[0];
+    guint32 height = best[1];
+    guchar *pixels = g_malloc((gsize)width * height * 4);
+    for (gsize p = 0; p < (gsize)width * height; p++)
+    {
+        guint32 argb = best[2 + p];
+        pixels[p * 4] = (argb >> 16) & 0xff;
+        pixels[p * 4 + 1] = (argb >> 8) & 0xff;
+        pixels[p * 4 + 2] = argb & 0xff;
+        pixels[p * 4 + 3] = argb >> 24;
+    }
+
+    return gdk_pixbuf_new_from_data(pixels, GDK_COLORSPACE_RGB, TRUE, 8, (int)width, (int)height, (int)width * 4,
+                                    xcb_source_free_pixels, NULL);
+}
+
+/* ===== SESSION TRACKING ===== */
+
+static void xcb_source_window_free(FocusMenuSourceWindow *window) 
+{
+    g_free(window->net_name);
+    g_free(window->wm_name);
+    g_free(window->class_name);
+    g_free(window);
+}
+
+static void xcb_source_ensure_workspaces(XcbSource *xcb, guint n_workspaces) 
+{
+    while (xcb->workspaces->len < MAX(n_workspaces, 1))
+    {
+        FocusMenuSourceWorkspace *workspace = g_new0(FocusMenuSourceWorkspace, 1);
+        workspace->number = xcb->workspaces->len;
+        g_ptr_array_add(xcb->workspaces, workspace);
+    }
+}
+
+/* Announce a closed window, and its application if it was the last window */
+static void xcb_source_close_window(XcbSource *xcb, FocusMenuSourceWindow *window) 
+{
+    FocusMenuSourceApp *app = window->app;
+
+    g_hash_table_remove(xcb->windows, GUINT_TO_POINTER(window->xid));
+    if (xcb->active_window == window)
+    {
+        xcb->active_window = NULL;
+        focus_menu_source_emit_active_window_changed(&xcb->parent);
+    }
+    focus_menu_source_emit_window_closed(&xcb->parent, window);
+    xcb_source_window_free(window);
+
+    if (--app->n_windows == 0)
+    {
+        focus_menu_source_emit_app_closed(&xcb->parent, app);
+        g_hash_table_remove(xcb->apps, GUINT_TO_POINTER(app->leader));
+    }
+}
+
+/* Bring the window list in line with _NET_CLIENT_LIST_STACKING */
+static void xcb_source_apply_stacking(XcbSource *xcb, xcb_get_property_reply_t *reply, gboolean announce) 
+{
+    const xcb_window_t *xids = (reply && reply->format == 32) ? xcb_get_property_value(reply) : NULL;
+    gint n = xids ? xcb_get_property_value_length(reply) / 4 : 0;
+    GHashTable *listed = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GPtrArray *opened = g_ptr_array_new();
+    GList *stack = NULL;
+
+    for (gint i = 0; i < n; i++)
+    {
+        if (g_hash_table_contains(listed, GUINT_TO_POINTER(xids[i]))) continue;
+
+        FocusMenuSourceWindow *window = g_hash_table_lookup(xcb->windows, GUINT_TO_POINTER(xids[i]));
+        if (!window)
+        {
+            window = g_new0(FocusMenuSourceWindow, 1);
+            window->xid = xids[i];
+            g_hash_table_insert(xcb->windows, GUINT_TO_POINTER(window->xid), window);
+            g_ptr_array_add(opened, window);
+
+            guint32 event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+            xcb_change_window_attributes(xcb->connection, window->xid, XCB_CW_EVENT_MASK, &event_mask);
+        }
+        g_hash_table_add(listed, GUINT_TO_POINTER(xids[i]));
+        stack = g_list_prepend(stack, window);
+    }
+
+    /* Windows gone from the list close, in the old stacking order */
+    GList *old_stack = xcb->stack;
+    xcb->stack = g_list_reverse(stack);
+    for (GList *l = old_stack; l; l = l->next)
+    {
+        FocusMenuSourceWindow *window = l->data;
+        if (!g_hash_table_contains(listed, GUINT_TO_POINTER(window->xid))) xcb_source_close_window(xcb, window);
+    }
+    g_list_free(old_stack);
+
+    /* New windows: every property of every one of them in a single batch */
+    if (opened->len > 0)
+    {
+        guint *masks = g_new(guint, opened->len);
+        for (guint i = 0; i < opened->len; i++) masks[i] = PROP_ALL;
+        xcb_source_read_windows(xcb, opened, masks, FALSE);
+        xcb_source_assign_apps(xcb, opened);
+        g_free(masks);
+
+        for (guint i = 0; i < opened->len; i++)
+        {
+            FocusMenuSourceWindow *window = g_ptr_array_index(opened, i);
+            if (window->app->n_windows++ == 0 && announce)
+            {
+                focus_menu_source_emit_app_opened(&xcb->parent, window->app);
+            }
+            if (announce)
+            {
+                focus_menu_source_emit_window_opened(&xcb->parent, window);
+            }
+        }
+    }
+
+    g_ptr_array_free(opened, TRUE);
+    g_hash_table_destroy(listed);
+}
+
+/* Read root window properties in one batch and pass on what changed */
+static void xcb_source_read_root(XcbSource *xcb, guint mask, gboolean announce) 
+{
+    xcb_get_property_cookie_t stacking = { 0 }, active = { 0 }, current = { 0 }, n_desktops = { 0 };
+
+    if (mask & ROOT_N_DESKTOPS)
+    {
+        n_desktops = xcb_source_request(xcb, xcb->root, xcb->atoms[ATOM_NET_NUMBER_OF_DESKTOPS], XCB_ATOM_CARDINAL, 1);
+    }
+    if (mask & ROOT_CURRENT_DESKTOP)
+    {
+        current = xcb_source_request(xcb, xcb->root, xcb->atoms[ATOM_NET_CURRENT_DESKTOP], XCB_ATOM_CARDINAL, 1);
+    }
+    if (mask & ROOT_STACKING)
+    {
+        stacking = xcb_source_request(xcb, xcb->root, xcb->atoms[ATOM_NET_CLIENT_LIST_STACKING], XCB_ATOM_WINDOW, XCB_SOURCE_LIST_LONGS);
+    }
+    if (mask & ROOT_ACTIVE)
+    {
+        active = xcb_source_request(xcb, xcb->root, xcb->atoms[ATOM_NET_ACTIVE_WINDOW], XCB_ATOM_WINDOW, 1);
+    }
+
+    guint32 value = 0;
+    if (mask & ROOT_N_DESKTOPS)
+    {
+        xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb->connection, n_desktops, NULL);
+        xcb_source_ensure_workspaces(xcb, xcb_source_reply_cardinal(reply, &value) ? value : 1);
+        free(reply);
+    }
+    if (mask & ROOT_CURRENT_DESKTOP)
+    {
+        xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb->connection, current, NULL);
+        guint number = xcb_source_reply_cardinal(reply, &value) ? value : 0;
+        free(reply);
+
+        xcb_source_ensure_workspaces(xcb, number + 1);
+        if (number != xcb->active_workspace)
+        {
+            xcb->active_workspace = number;
+            if (announce) focus_menu_source_emit_active_workspace_changed(&xcb->parent);
+        }
+    }
+    if (mask & ROOT_STACKING)
+    {
+        xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb->connection, stacking, NULL);
+        xcb_source_apply_stacking(xcb, reply, announce);
+        free(reply);
+    }
+    if (mask & ROOT_ACTIVE)
+    {
+        xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb->connection, active, NULL);
+        xcb_window_t xid = xcb_source_reply_cardinal(reply, &value) ? value : XCB_WINDOW_NONE;
+        free(reply);
+
+        FocusMenuSourceWindow *window = xid ? g_hash_table_lookup(xcb->windows, GUINT_TO_POINTER(xid)) : NULL;
+        if (window != xcb->active_window)
+        {
+            xcb->active_window = window;
+            if (announce) focus_menu_source_emit_active_window_changed(&xcb->parent);
+        }
+    }
+}
+
+/* Handle every event already received, re-reading the properties they name.
+ * Reading replies can queue more events, so this repeats until none are left */
+static void xcb_source_dispatch(XcbSource *xcb) 
+{
+    GHashTable *dirty = g_hash_table_new(g_direct_hash, g_direct_equal);  /* xid -> property mask */
+
+    for (;;)
+    {
+        guint root_mask = 0;
+        xcb_generic_event_t *event;
+
+        while ((event = xcb_poll_for_event(xcb->connection)) != NULL)
+        {
+            if ((event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY)
+            {
+                xcb_property_notify_event_t *notify = (xcb_property_notify_event_t *)event;
+                if (notify->window == xcb->root)
+                {
+                    root_mask |= xcb_source_root_property_for_atom(xcb, notify->atom);
+                }
+                else
+                {
+                    guint property = xcb_source_property_for_atom(xcb, notify->atom);
+                    if (property)
+                    {
+                        guint previous = GPOINTER_TO_UINT(g_hash_table_lookup(dirty, GUINT_TO_POINTER(notify->window)));
+                        g_hash_table_insert(dirty, GUINT_TO_POINTER(notify->window), GUINT_TO_POINTER(previous | property));
+                    }
+                }
+            }
+            /* Errors, mostly from windows destroyed before we asked about them, are ignored */
+            free(event);
+        }
+
+        if (!root_mask && g_hash_table_size(dirty) == 0) break;
+
+        if (root_mask) xcb_source_read_root(xcb, root_mask, TRUE);
+
+        GPtrArray *windows = g_ptr_array_new();
+        GArray *masks = g_array_new(FALSE, FALSE, sizeof(guint));
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, dirty);
+        while (g_hash_table_iter_next(&iter, &key, &value))
+        {
+            FocusMenuSourceWindow *window = g_hash_table_lookup(xcb->windows, key);
+            if (!window) continue;
+
+            guint mask = GPOINTER_TO_UINT(value);
+            g_ptr_array_add(windows, window);
+            g_array_append_val(masks, mask);
+        }
+        g_hash_table_remove_all(dirty);
+
+        if (windows->len > 0) xcb_source_read_windows(xcb, windows, (const guint *)masks->data, TRUE);
+        g_array_free(masks, TRUE);
+        g_ptr_array_free(windows, TRUE);
+    }
+
+    g_hash_table_destroy(dirty);
+    xcb_flush(xcb->connection);
+}
+
+static gboolean xcb_source_on_readable(gint fd G_GNUC_UNUSED, GIOCondition condition, gpointer user_data) 
+{
+    XcbSource *xcb = user_data;
+
+    if ((condition & (G_IO_HUP | G_IO_ERR)) || xcb_connection_has_error(xcb->connection))
+    {
+        g_warning("Focus Menu: lost the X connection");
+        xcb->watch_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    xcb_source_dispatch(xcb);
+    return G_SOURCE_CONTINUE;
+}
+
+/* ===== SOURCE OPERATIONS ===== */
+
+/* One round trip makes the server's queue ours, then everything in it is handled */
+static void xcb_update(FocusMenuWindowSource *source) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+
+    free(xcb_get_input_focus_reply(xcb->connection, xcb_get_input_focus(xcb->connection), NULL));
+    xcb_source_dispatch(xcb);
+}
+
+static GList *xcb_list_windows(FocusMenuWindowSource *source) 
+{
+    return XCB_SOURCE(source)->stack;
+}
+
+static FocusMenuSourceWindow *xcb_get_active_window(FocusMenuWindowSource *source) 
+{
+    return XCB_SOURCE(source)->active_window;
+}
+
+static FocusMenuSourceWorkspace *xcb_get_active_workspace(FocusMenuWindowSource *source) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+    return g_ptr_array_index(xcb->workspaces, MIN(xcb->active_workspace, xcb->workspaces->len - 1));
+}
+
+static gint xcb_workspace_get_number(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace) 
+{
+    (void)source;
+    return workspace ? (gint)workspace->number : -1;
+}
+
+static gulong xcb_window_get_id(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    (void)source;
+    return window->xid;
+}
+
+static FocusMenuSourceApp *xcb_window_get_app(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    (void)source;
+    return window->app;
+}
+
+static const gchar *xcb_window_get_name(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    (void)source;
+    return window->net_name ? window->net_name : window->wm_name;
+}
+
+static FocusMenuSourceWindowType xcb_window_get_type(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    (void)source;
+    return window->type;
+}
+
+static FocusMenuSourceWindowState xcb_window_get_state(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    FocusMenuSourceWindowState state = 0;
+
+    (void)source;
+    if (window->hidden)
+    {
+        state |= FOCUS_MENU_SOURCE_STATE_MINIMIZED;
+    }
+    if (window->sticky || window->desktop == XCB_SOURCE_ALL_DESKTOPS)
+    {
+        state |= FOCUS_MENU_SOURCE_STATE_PINNED;
+    }
+    return state;
+}
+
+static FocusMenuSourceWorkspace *xcb_window_get_workspace(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+
+    if (window->sticky || window->desktop >= xcb->workspaces->len)
+    {
+        return NULL;
+    }
+    return g_ptr_array_index(xcb->workspaces, window->desktop);
+}
+
+static gulong xcb_app_get_id(FocusMenuWindowSource *source, FocusMenuSourceApp *app) 
+{
+    (void)source;
+    return app->leader;
+}
+
+static const gchar *xcb_app_get_name(FocusMenuWindowSource *source, FocusMenuSourceApp *app) 
+{
+    (void)source;
+    return app->name;
+}
+
+static pid_t xcb_app_get_pid(FocusMenuWindowSource *source, FocusMenuSourceApp *app) 
+{
+    (void)source;
+    return app->pid;
+}
+
+/* Icons are read from the application's first window when first asked for */
+static GdkPixbuf *xcb_app_get_icon(FocusMenuWindowSource *source, FocusMenuSourceApp *app) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+
+    if (app->icon_read)
+    {
+        return app->icon;
+    }
+    app->icon_read = TRUE;
+
+    for (GList *l = xcb->stack; l; l = l->next)
+    {
+        FocusMenuSourceWindow *window = l->data;
+        if (window->app != app) continue;
+
+        xcb_get_property_cookie_t cookie = xcb_source_request(xcb, window->xid, xcb->atoms[ATOM_NET_WM_ICON], XCB_ATOM_CARDINAL, XCB_SOURCE_ICON_LONGS);
+        xcb_get_property_reply_t *reply = xcb_get_property_reply(xcb->connection, cookie, NULL);
+        app->icon = xcb_source_icon_from_reply(reply);
+        free(reply);
+        break;
+    }
+    return app->icon;
+}
+
+/* Ask the window manager for something on the root window, as EWMH pagers do */
+static void xcb_source_send_root_message(XcbSource *xcb, xcb_window_t window, xcb_atom_t type, guint32 data0, guint32 data1, guint32 data2) 
+{
+    xcb_client_message_event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.response_type = XCB_CLIENT_MESSAGE;
+    event.format = 32;
+    event.window = window;
+    event.type = type;
+    event.data.data32[0] = data0;
+    event.data.data32[1] = data1;
+    event.data.data32[2] = data2;
+
+    xcb_send_event(xcb->connection, 0, xcb->root, XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY | XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, (const char *)&event);
+    xcb_flush(xcb->connection);
+}
+
+static void xcb_window_minimize(FocusMenuWindowSource *source, FocusMenuSourceWindow *window) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+    xcb_source_send_root_message(xcb, window->xid, xcb->atoms[ATOM_WM_CHANGE_STATE], XCB_SOURCE_ICONIC_STATE, 0, 0);
+}
+
+/* Source indication 2: a pager acting for the user */
+static void xcb_window_activate(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+    xcb_source_send_root_message(xcb, window->xid, xcb->atoms[ATOM_NET_ACTIVE_WINDOW], 2, timestamp, 0);
+}
+
+/* Activation unminimizes, as libwnck's unminimize does for windows on this workspace */
+static void xcb_window_unminimize(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp) 
+{
+    xcb_window_activate(source, window, timestamp);
+}
+
+static void xcb_workspace_activate(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace, guint32 timestamp) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+    xcb_source_send_root_message(xcb, XCB_WINDOW_NONE, xcb->atoms[ATOM_NET_CURRENT_DESKTOP], workspace->number, timestamp, 0);
+}
+
+static void xcb_free(FocusMenuWindowSource *source) 
+{
+    XcbSource *xcb = XCB_SOURCE(source);
+
+    if (xcb->watch_id)
+    {
+        g_source_remove(xcb->watch_id);
+    }
+
+    g_list_free_full(xcb->stack, (GDestroyNotify)xcb_source_window_free);
+    g_hash_table_destroy(xcb->windows);
+    g_hash_table_destroy(xcb->apps);
+    g_ptr_array_free(xcb->workspaces, TRUE);
+    xcb_disconnect(xcb->connection);
+    g_free(xcb);
+}
+
+static const FocusMenuWindowSourceClass xcb_source_class = 
+{
+    .name = "xcb",
+    .update = xcb_update,
+    .list_windows = xcb_list_windows,
+    .get_active_window = xcb_get_active_window,
+    .get_active_workspace = xcb_get_active_workspace,
+    .workspace_get_number = xcb_workspace_get_number,
+    .window_get_id = xcb_window_get_id,
+    .window_get_app = xcb_window_get_app,
+    .window_get_name = xcb_window_get_name,
+    .window_get_type = xcb_window_get_type,
+    .window_get_state = xcb_window_get_state,
+    .window_get_workspace = xcb_window_get_workspace,
+    .app_get_id = xcb_app_get_id,
+    .app_get_name = xcb_app_get_name,
+    .app_get_pid = xcb_app_get_pid,
+    .app_get_icon = xcb_app_get_icon,
+    .window_minimize = xcb_window_minimize,
+    .window_unminimize = xcb_window_unminimize,
+    .window_activate = xcb_window_activate,
+    .workspace_activate = xcb_workspace_activate,
+    .free = xcb_free,
+};
+
+/* ===== CONSTRUCTION ===== */
+
+FocusMenuWindowSource *focus_menu_xcb_source_new(const gchar *display_name) 
+{
+    int screen_number = 0;
+    xcb_connection_t *connection = xcb_connect(display_name, &screen_number);
+
+    if (xcb_connection_has_error(connection))
+    {
+        xcb_disconnect(connection);
+        return NULL;
+    }
+
+    xcb_screen_iterator_t screens = xcb_setup_roots_iterator(xcb_get_setup(connection));
+    for (int i = 0; i < screen_number && screens.rem; i++)
+    {
+        xcb_screen_next(&screens);
+    }
+    if (!screens.rem)
+    {
+        xcb_disconnect(connection);
+        return NULL;
+    }
+
+    XcbSource *xcb = g_new0(XcbSource, 1);
+    xcb->parent.klass = &xcb_source_class;
+    xcb->connection = connection;
+    xcb->root = screens.data->root;
+    xcb->windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+    xcb->apps = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)xcb_source_app_free);
+    xcb->workspaces = g_ptr_array_new_with_free_func(g_free);
+
+    /* Every atom in one round trip */
+    xcb_intern_atom_cookie_t cookies[N_ATOMS];
+    for (guint i = 0; i < N_ATOMS; i++)
+    {
+        cookies[i] = xcb_intern_atom(connection, 0, strlen(atom_names[i]), atom_names[i]);
+    }
+    for (guint i = 0; i < N_ATOMS; i++)
+    {
+        xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(connection, cookies[i], NULL);
+        xcb->atoms[i] = reply ? reply->atom : XCB_ATOM_NONE;
+        free(reply);
+    }
+
+    /* Listen before reading, so no change falls between the two */
+    guint32 event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(connection, xcb->root, XCB_CW_EVENT_MASK, &event_mask);
+    xcb_source_read_root(xcb, ROOT_ALL, FALSE);
+    xcb_source_ensure_workspaces(xcb, 1);
+
+    xcb->watch_id = g_unix_fd_add(xcb_get_file_descriptor(connection), G_IO_IN | G_IO_HUP | G_IO_ERR, xcb_source_on_readable, xcb);
+    xcb_source_dispatch(xcb);
+
+    return &xcb->parent;
+}
@@ -0,0 +1,276 @@
+/* window-source - where the Focus Menu model gets its windows from
+ *
+ * The model, the menu layout and the bulk commands see the session only
+ * through this interface. The plugin uses a libwnck source (focus-menu.c);
+ * the in-memory source in window-source-mock.c holds synthetic sessions so
+ * the same code can be benchmarked and profiled without a display, and
+ * window-source-xcb.c reads the X server directly.
+ *
+ * Windows, applications and workspaces are opaque handles owned by the
+ * source. They stay valid until the listener hears they are closed.
+ */
+#ifndef WINDOW_SOURCE_H
+#define WINDOW_SOURCE_H
+
+#include <glib.h>
+#include <sys/types.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+typedef struct _FocusMenuSourceWindow FocusMenuSourceWindow;
+typedef struct _FocusMenuSourceApp FocusMenuSourceApp;
+typedef struct _FocusMenuSourceWorkspace FocusMenuSourceWorkspace;
+typedef struct _FocusMenuWindowSource FocusMenuWindowSource;
+
+typedef enum
+{
+    FOCUS_MENU_SOURCE_WINDOW_NORMAL,
+    FOCUS_MENU_SOURCE_WINDOW_DESKTOP,
+    FOCUS_MENU_SOURCE_WINDOW_OTHER       /* Docks, dialogs, menus and the rest */
+} FocusMenuSourceWindowType;
+
+typedef enum
+{
+    FOCUS_MENU_SOURCE_STATE_MINIMIZED = 1 << 0,
+    FOCUS_MENU_SOURCE_STATE_PINNED = 1 << 1       /* On every workspace */
+} FocusMenuSourceWindowState;
+
+typedef enum
+{
+    FOCUS_MENU_SOURCE_CHANGE_NAME,
+    FOCUS_MENU_SOURCE_CHANGE_STATE,
+    FOCUS_MENU_SOURCE_CHANGE_WORKSPACE,  /* Also sent when the window type changes */
+    FOCUS_MENU_SOURCE_CHANGE_ICON
+} FocusMenuSourceChange;
+
+/* Session changes, delivered synchronously; any member may be NULL */
+typedef struct
+{
+    void (*window_opened)(FocusMenuSourceWindow *window, gpointer user_data);
+    void (*window_closed)(FocusMenuSourceWindow *window, gpointer user_data);
+    void (*window_changed)(FocusMenuSourceWindow *window, FocusMenuSourceChange change, gpointer user_data);
+    void (*app_opened)(FocusMenuSourceApp *app, gpointer user_data);
+    void (*app_closed)(FocusMenuSourceApp *app, gpointer user_data);
+    void (*app_changed)(FocusMenuSourceApp *app, FocusMenuSourceChange change, gpointer user_data);
+    void (*active_window_changed)(gpointer user_data);
+    void (*active_workspace_changed)(gpointer user_data);
+} FocusMenuSourceListener;
+
+typedef struct
+{
+    const gchar *name;
+
+    /* Session */
+    void (*update)(FocusMenuWindowSource *source);  /* Catch up with the display server; may block */
+    GList *(*list_windows)(FocusMenuWindowSource *source);  /* Bottom to top; owned by the source */
+    FocusMenuSourceWindow *(*get_active_window)(FocusMenuWindowSource *source);
+    FocusMenuSourceWorkspace *(*get_active_workspace)(FocusMenuWindowSource *source);
+    gint (*workspace_get_number)(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace);
+
+    /* Windows */
+    gulong (*window_get_id)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+    FocusMenuSourceApp *(*window_get_app)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+    const gchar *(*window_get_name)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+    FocusMenuSourceWindowType (*window_get_type)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+    FocusMenuSourceWindowState (*window_get_state)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+    FocusMenuSourceWorkspace *(*window_get_workspace)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+
+    /* Applications */
+    gulong (*app_get_id)(FocusMenuWindowSource *source, FocusMenuSourceApp *app);
+    const gchar *(*app_get_name)(FocusMenuWindowSource *source, FocusMenuSourceApp *app);
+    pid_t (*app_get_pid)(FocusMenuWindowSource *source, FocusMenuSourceApp *app);
+    GdkPixbuf *(*app_get_icon)(FocusMenuWindowSource *source, FocusMenuSourceApp *app);  /* Owned by the source */
+
+    /* Requests; results arrive through the listener, possibly later */
+    void (*window_minimize)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+    void (*window_unminimize)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp);
+    void (*window_activate)(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp);
+    void (*workspace_activate)(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace, guint32 timestamp);
+
+    void (*free)(FocusMenuWindowSource *source);
+} FocusMenuWindowSourceClass;
+
+/* Base of every source; implementations embed it as their first member */
+struct _FocusMenuWindowSource
+{
+    const FocusMenuWindowSourceClass *klass;
+    const FocusMenuSourceListener *listener;
+    gpointer listener_data;
+};
+
+/* The single listener; NULL removes it */
+static inline void focus_menu_source_set_listener(FocusMenuWindowSource *source, const FocusMenuSourceListener *listener, gpointer user_data)
+{
+    source->listener = listener;
+    source->listener_data = user_data;
+}
+
+static inline void focus_menu_source_free(FocusMenuWindowSource *source)
+{
+    if (source) source->klass->free(source);
+}
+
+/* Accessors, so callers read like the rest of the plugin */
+static inline void focus_menu_source_update(FocusMenuWindowSource *source)
+{
+    if (source->klass->update) source->klass->update(source);
+}
+
+static inline GList *focus_menu_source_list_windows(FocusMenuWindowSource *source)
+{
+    return source->klass->list_windows(source);
+}
+
+static inline FocusMenuSourceWindow *focus_menu_source_get_active_window(FocusMenuWindowSource *source)
+{
+    return source->klass->get_active_window(source);
+}
+
+static inline FocusMenuSourceWorkspace *focus_menu_source_get_active_workspace(FocusMenuWindowSource *source)
+{
+    return source->klass->get_active_workspace(source);
+}
+
+static inline gint focus_menu_source_workspace_get_number(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace)
+{
+    return source->klass->workspace_get_number(source, workspace);
+}
+
+static inline gulong focus_menu_source_window_get_id(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    return source->klass->window_get_id(source, window);
+}
+
+static inline FocusMenuSourceApp *focus_menu_source_window_get_app(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    return source->klass->window_get_app(source, window);
+}
+
+static inline const gchar *focus_menu_source_window_get_name(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    return source->klass->window_get_name(source, window);
+}
+
+static inline FocusMenuSourceWindowType focus_menu_source_window_get_type(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    return source->klass->window_get_type(source, window);
+}
+
+static inline FocusMenuSourceWindowState focus_menu_source_window_get_state(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    return source->klass->window_get_state(source, window);
+}
+
+static inline FocusMenuSourceWorkspace *focus_menu_source_window_get_workspace(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    return source->klass->window_get_workspace(source, window);
+}
+
+static inline gulong focus_menu_source_app_get_id(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    return source->klass->app_get_id(source, app);
+}
+
+static inline const gchar *focus_menu_source_app_get_name(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    return source->klass->app_get_name(source, app);
+}
+
+static inline pid_t focus_menu_source_app_get_pid(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    return source->klass->app_get_pid(source, app);
+}
+
+static inline GdkPixbuf *focus_menu_source_app_get_icon(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    return source->klass->app_get_icon(source, app);
+}
+
+static inline void focus_menu_source_window_minimize(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    source->klass->window_minimize(source, window);
+}
+
+static inline void focus_menu_source_window_unminimize(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp)
+{
+    source->klass->window_unminimize(source, window, timestamp);
+}
+
+static inline void focus_menu_source_window_activate(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint32 timestamp)
+{
+    source->klass->window_activate(source, window, timestamp);
+}
+
+static inline void focus_menu_source_workspace_activate(FocusMenuWindowSource *source, FocusMenuSourceWorkspace *workspace, guint32 timestamp)
+{
+    source->klass->workspace_activate(source, workspace, timestamp);
+}
+
+/* For implementations: pass a change on to the listener */
+static inline void focus_menu_source_emit_window_opened(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    if (source->listener && source->listener->window_opened) source->listener->window_opened(window, source->listener_data);
+}
+
+static inline void focus_menu_source_emit_window_closed(FocusMenuWindowSource *source, FocusMenuSourceWindow *window)
+{
+    if (source->listener && source->listener->window_closed) source->listener->window_closed(window, source->listener_data);
+}
+
+static inline void focus_menu_source_emit_window_changed(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, FocusMenuSourceChange change)
+{
+    if (source->listener && source->listener->window_changed) source->listener->window_changed(window, change, source->listener_data);
+}
+
+static inline void focus_menu_source_emit_app_opened(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    if (source->listener && source->listener->app_opened) source->listener->app_opened(app, source->listener_data);
+}
+
+static inline void focus_menu_source_emit_app_closed(FocusMenuWindowSource *source, FocusMenuSourceApp *app)
+{
+    if (source->listener && source->listener->app_closed) source->listener->app_closed(app, source->listener_data);
+}
+
+static inline void focus_menu_source_emit_app_changed(FocusMenuWindowSource *source, FocusMenuSourceApp *app, FocusMenuSourceChange change)
+{
+    if (source->listener && source->listener->app_changed) source->listener->app_changed(app, change, source->listener_data);
+}
+
+static inline void focus_menu_source_emit_active_window_changed(FocusMenuWindowSource *source)
+{
+    if (source->listener && source->listener->active_window_changed) source->listener->active_window_changed(source->listener_data);
+}
+
+static inline void focus_menu_source_emit_active_workspace_changed(FocusMenuWindowSource *source)
+{
+    if (source->listener && source->listener->active_workspace_changed) source->listener->active_workspace_changed(source->listener_data);
+}
+
+/* In-memory source (window-source-mock.c). Every request takes effect at
+ * once and is reported before the call returns, like an instant window
+ * manager. Workspaces are numbered from 0. Applications stay allocated
+ * until the source is freed, even after their last window closes. */
+FocusMenuWindowSource *focus_menu_mock_source_new(guint n_workspaces);
+FocusMenuSourceApp *focus_menu_mock_source_add_app(FocusMenuWindowSource *source, const gchar *name, pid_t pid);
+FocusMenuSourceWindow *focus_menu_mock_source_add_window(FocusMenuWindowSource *source, FocusMenuSourceApp *app, const gchar *title,
+                                                         FocusMenuSourceWindowType type, FocusMenuSourceWindowState state, guint workspace);
+void focus_menu_mock_source_remove_window(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+void focus_menu_mock_source_set_window_name(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, const gchar *title);
+void focus_menu_mock_source_set_window_state(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, FocusMenuSourceWindowState state);
+void focus_menu_mock_source_set_window_type(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, FocusMenuSourceWindowType type);
+void focus_menu_mock_source_set_window_workspace(FocusMenuWindowSource *source, FocusMenuSourceWindow *window, guint workspace);
+void focus_menu_mock_source_set_app_name(FocusMenuWindowSource *source, FocusMenuSourceApp *app, const gchar *name);
+void focus_menu_mock_source_set_active_window(FocusMenuWindowSource *source, FocusMenuSourceWindow *window);
+void focus_menu_mock_source_set_active_workspace(FocusMenuWindowSource *source, guint workspace);
+guint focus_menu_mock_source_get_request_count(FocusMenuWindowSource *source);
+
+#ifdef FOCUS_MENU_XCB
+/* X server source (window-source-xcb.c, needs libxcb). Reads the EWMH
+ * properties the model uses straight from the server instead of through
+ * libwnck. Changes are picked up from the thread-default main context, or
+ * by focus_menu_source_update(). NULL opens $DISPLAY; returns NULL if the
+ * display cannot be opened. */
+FocusMenuWindowSource *focus_menu_xcb_source_new(const gchar *display_name);
+#endif
+
+#endif /* WINDOW_SOURCE_H */